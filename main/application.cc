@@ -9,12 +9,15 @@
 #include "mcp_server.h"
 #include "assets.h"
 #include "settings.h"
+#include "boot_timeline.h"
+#include "live_event_parser.h"
 
 #include "ble/ble_manager.h"
 #include "ble/application_ble_callbacks.h"
 
 #include <cstring>
 #include <esp_log.h>
+#include <esp_app_desc.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
 #include <arpa/inet.h>
@@ -22,13 +25,8 @@
 #include <errno.h>
 
 #if CONFIG_HTTPD_WS_SUPPORT
-#include <esp_http_server.h>
+#include "ws_ingest_server.h"
 #endif
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <unistd.h>
-#include <mbedtls/sha1.h>
-#include <mbedtls/base64.h>
 
 #define TAG "Application"
 
@@ -48,8 +46,17 @@ static const char* const STATE_STRINGS[] = {
     "invalid_state"
 };
 
+const char* Application::GetStateName(DeviceState state) {
+    if (state > kDeviceStateFatalError) {
+        return STATE_STRINGS[kDeviceStateFatalError + 1];
+    }
+    return STATE_STRINGS[state];
+}
+
 Application::Application() {
     event_group_ = xEventGroupCreate();
+    // Created before any ISR or task can publish
+    EventBus::GetInstance();
 
 #if CONFIG_USE_DEVICE_AEC && CONFIG_USE_SERVER_AEC
 #error "CONFIG_USE_DEVICE_AEC and CONFIG_USE_SERVER_AEC cannot be enabled at the same time"
@@ -61,23 +68,25 @@ Application::Application() {
     aec_mode_ = kAecOff;
 #endif
 
-    esp_timer_create_args_t clock_timer_args = {
+    esp_timer_create_args_t live_event_timer_args = {
         .callback = [](void* arg) {
             Application* app = (Application*)arg;
-            xEventGroupSetBits(app->event_group_, MAIN_EVENT_CLOCK_TICK);
+            app->Schedule([app]() {
+                app->HandleLiveEvents();
+            }, kTaskLaneTelemetry, "HandleLiveEvents");
         },
         .arg = this,
         .dispatch_method = ESP_TIMER_TASK,
-        .name = "clock_timer",
+        .name = "live_event_timer",
         .skip_unhandled_events = true
     };
-    esp_timer_create(&clock_timer_args, &clock_timer_handle_);
+    esp_timer_create(&live_event_timer_args, &live_event_timer_handle_);
 }
 
 Application::~Application() {
-    if (clock_timer_handle_ != nullptr) {
-        esp_timer_stop(clock_timer_handle_);
-        esp_timer_delete(clock_timer_handle_);
+    if (live_event_timer_handle_ != nullptr) {
+        esp_timer_stop(live_event_timer_handle_);
+        esp_timer_delete(live_event_timer_handle_);
     }
     vEventGroupDelete(event_group_);
 }
@@ -133,16 +142,18 @@ void Application::CheckAssetsVersion() {
     display->SetEmotion("microchip_ai");
 }
 
-void Application::CheckNewVersion(Ota& ota) {
+void Application::CheckNewVersion(Ota& ota, bool background) {
     const int MAX_RETRY = 10;
     int retry_count = 0;
     int retry_delay = 10; // 初始重试延迟为10秒
 
     auto& board = Board::GetInstance();
     while (true) {
-        SetDeviceState(kDeviceStateActivating);
         auto display = board.GetDisplay();
-        display->SetStatus(Lang::Strings::CHECKING_NEW_VERSION);
+        if (!background) {
+            SetDeviceState(kDeviceStateActivating);
+            display->SetStatus(Lang::Strings::CHECKING_NEW_VERSION);
+        }
 
         if (!ota.CheckVersion()) {
             retry_count++;
@@ -151,11 +162,18 @@ void Application::CheckNewVersion(Ota& ota) {
                 return;
             }
 
+            ESP_LOGW(TAG, "Check new version failed, retry in %d seconds (%d/%d)", retry_delay, retry_count, MAX_RETRY);
+            if (background) {
+                // The device is already usable, retry quietly
+                vTaskDelay(pdMS_TO_TICKS(retry_delay * 1000));
+                retry_delay *= 2;
+                continue;
+            }
+
             char buffer[256];
             snprintf(buffer, sizeof(buffer), Lang::Strings::CHECK_NEW_VERSION_FAILED, retry_delay, ota.GetCheckVersionUrl().c_str());
             Alert(Lang::Strings::ERROR, buffer, "cloud_slash", Lang::Sounds::OGG_EXCLAMATION);
 
-            ESP_LOGW(TAG, "Check new version failed, retry in %d seconds (%d/%d)", retry_delay, retry_count, MAX_RETRY);
             for (int i = 0; i < retry_delay; i++) {
                 vTaskDelay(pdMS_TO_TICKS(1000));
                 if (device_state_ == kDeviceStateIdle) {
@@ -168,7 +186,27 @@ void Application::CheckNewVersion(Ota& ota) {
         retry_count = 0;
         retry_delay = 10; // 重置重试延迟时间
 
+        if (background && ota.HasProtocolConfigChanged()) {
+            // The protocol was started from the stored config, rotated credentials would fail until the next boot
+            std::string protocol_type = ota.HasMqttConfig() ? "mqtt" : (ota.HasWebsocketConfig() ? "websocket" : "");
+            RunWhenIdle([this, protocol_type]() {
+                RestartProtocol(protocol_type);
+            }, "RestartProtocol");
+        }
+
         if (ota.HasNewVersion()) {
+            if (background) {
+                // Do not cut into the boot or a conversation, upgrade from the main loop once idle
+                while (device_state_ != kDeviceStateIdle) {
+                    vTaskDelay(pdMS_TO_TICKS(1000));
+                }
+                ota.MarkCurrentVersionValid();
+                xEventGroupSetBits(event_group_, MAIN_EVENT_CHECK_NEW_VERSION_DONE);
+                Schedule([this, &ota]() {
+                    UpgradeFirmware(ota);
+                });
+                return;
+            }
             if (UpgradeFirmware(ota)) {
                 return; // This line will never be reached after reboot
             }
@@ -179,10 +217,22 @@ void Application::CheckNewVersion(Ota& ota) {
         ota.MarkCurrentVersionValid();
         if (!ota.HasActivationCode() && !ota.HasActivationChallenge()) {
             xEventGroupSetBits(event_group_, MAIN_EVENT_CHECK_NEW_VERSION_DONE);
+            if (background && device_state_ == kDeviceStateActivating) {
+                // Activated after the boot finished, back to standby
+                Schedule([this]() {
+                    SetDeviceState(kDeviceStateIdle);
+                });
+            }
             // Exit the loop if done checking new version
             break;
         }
 
+        if (background) {
+            // Activation takes over the screen, wait for the boot and any conversation to finish
+            RunWhenIdle([this]() {
+                SetDeviceState(kDeviceStateActivating);
+            }, "ota.activating");
+        }
         display->SetStatus(Lang::Strings::ACTIVATION);
         // Activation code is shown to the user and waiting for the user to input
         if (ota.HasActivationCode()) {
@@ -279,23 +329,24 @@ void Application::ToggleChatState() {
 
     if (device_state_ == kDeviceStateIdle) {
         Schedule([this]() {
-            if (!protocol_->IsAudioChannelOpened()) {
-                SetDeviceState(kDeviceStateConnecting);
-                if (!protocol_->OpenAudioChannel()) {
-                    return;
-                }
-            }
-
-            SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
-        });
+            OpenAudioChannel([this]() {
+                SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+            });
+        }, kTaskLaneAudioControl);
+    } else if (device_state_ == kDeviceStateConnecting) {
+        // Pressed again while the server is slow to answer, give up waiting
+        Schedule([this]() {
+            protocol_->CancelOpenAudioChannel();
+            SetDeviceState(kDeviceStateIdle);
+        }, kTaskLaneAudioControl);
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
-        });
+        }, kTaskLaneAudioControl);
     } else if (device_state_ == kDeviceStateListening) {
         Schedule([this]() {
             protocol_->CloseAudioChannel();
-        });
+        }, kTaskLaneAudioControl);
     }
 }
 
@@ -316,20 +367,15 @@ void Application::StartListening() {
     
     if (device_state_ == kDeviceStateIdle) {
         Schedule([this]() {
-            if (!protocol_->IsAudioChannelOpened()) {
-                SetDeviceState(kDeviceStateConnecting);
-                if (!protocol_->OpenAudioChannel()) {
-                    return;
-                }
-            }
-
-            SetListeningMode(kListeningModeManualStop);
-        });
+            OpenAudioChannel([this]() {
+                SetListeningMode(kListeningModeManualStop);
+            });
+        }, kTaskLaneAudioControl);
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
             SetListeningMode(kListeningModeManualStop);
-        });
+        }, kTaskLaneAudioControl);
     }
 }
 
@@ -355,11 +401,24 @@ void Application::StopListening() {
             protocol_->SendStopListening();
             SetDeviceState(kDeviceStateIdle);
         }
-    });
+    }, kTaskLaneAudioControl);
 }
 
 void Application::Start() {
     auto& board = Board::GetInstance();
+
+    // The LED follows the device state and, while listening, the voice activity
+    auto led = board.GetLed();
+    auto& event_bus = EventBus::GetInstance();
+    event_bus.Subscribe<DeviceStateChangedEvent>([led](const DeviceStateChangedEvent& event) {
+        led->OnStateChanged();
+    });
+    event_bus.Subscribe<VadChangedEvent>([led](const VadChangedEvent& event) {
+        if (Application::GetInstance().GetDeviceState() == kDeviceStateListening) {
+            led->OnStateChanged();
+        }
+    });
+
     SetDeviceState(kDeviceStateStarting);
 
     /* Setup the display */
@@ -414,7 +473,25 @@ void Application::Start() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_WAKE_WORD_DETECTED);
     };
     callbacks.on_vad_change = [this](bool speaking) {
+#if CONFIG_BARGE_IN_DUCK || CONFIG_BARGE_IN_STOP
+        // Runs on the audio input task, so the playback reacts within a frame even if the main loop is busy
+        if (IsBargeInAllowed()) {
+#if CONFIG_BARGE_IN_DUCK
+            audio_service_.DuckPlayback(speaking);
+#else
+            if (speaking) {
+                aborted_ = true;
+                audio_service_.StopPlayback();
+                // The main loop settles it even if the voice is gone by the time it runs
+                barge_in_pending_ = true;
+            }
+#endif
+        }
+#endif
+        EventBus::GetInstance().Publish(VadChangedEvent{speaking});
+#if CONFIG_BARGE_IN_STOP
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
+#endif
     };
     audio_service_.SetCallbacks(callbacks);
 
@@ -424,33 +501,134 @@ void Application::Start() {
         vTaskDelete(NULL);
     }, "main_event_loop", 2048 * 4, this, 3, &main_event_loop_task_handle_);
 
-    /* Start the clock timer to update the status bar */
-    esp_timer_start_periodic(clock_timer_handle_, 1000000);
+    /* Refresh the status bar when its sources change, instead of every second */
+    StatusBarMonitor::GetInstance().Start([this]() {
+        PrintDebugStats();
+    });
+
+    /*
+     * Boot stages and what they wait for:
+     *   assets   - nothing, unless a new version has to be downloaded, then the network
+     *   version  - the network
+     *   protocol - the network, and the version check on the first boot to learn which protocol to use
+     *   ready    - the protocol and the assets
+     */
+    bool assets_download_pending;
+    {
+        Settings settings("assets", false);
+        assets_download_pending = !settings.GetString("download_url").empty();
+    }
+    if (!assets_download_pending) {
+        // Applying the local assets partition does not need the network
+        BootTimeline::Begin("assets");
+        xTaskCreate([](void* arg) {
+            Application* app = (Application*)arg;
+            app->CheckAssetsVersion();
+            BootTimeline::End("assets");
+            xEventGroupSetBits(app->event_group_, MAIN_EVENT_BOOT_ASSETS_DONE);
+            vTaskDelete(NULL);
+        }, "boot_assets", 4096 * 2, this, 2, NULL);
+    }
 
     /* Wait for the network to be ready */
+    BootTimeline::Begin("network");
     board.StartNetwork();
+    BootTimeline::End("network");
 
     // Update the status bar immediately to show the network state
-    display->UpdateStatusBar(true);
+    StatusBarMonitor::GetInstance().Notify(kStatusBarNetwork | kStatusBarBattery);
 
-    // Check for new assets version
-    CheckAssetsVersion();
+    if (assets_download_pending) {
+        BootTimeline::Begin("assets");
+        CheckAssetsVersion();
+        BootTimeline::End("assets");
+        xEventGroupSetBits(event_group_, MAIN_EVENT_BOOT_ASSETS_DONE);
+    }
 
-    // Check for new firmware version or get the MQTT broker address
-    Ota ota;
-    CheckNewVersion(ota);
+    // Check for new firmware version or get the MQTT broker address.
+    // Once a previous check has assigned a protocol, it starts right away and the check runs in the background.
+    auto protocol_type = Ota::GetLastProtocol();
+    background_version_check_ = !protocol_type.empty();
+    ota_ = std::make_unique<Ota>();
+    BootTimeline::Begin("version");
+    xTaskCreate([](void* arg) {
+        Application* app = (Application*)arg;
+        app->CheckNewVersion(*app->ota_, app->background_version_check_);
+        app->has_server_time_ = app->ota_->HasServerTime();
+        BootTimeline::End("version");
+        xEventGroupSetBits(app->event_group_, MAIN_EVENT_BOOT_VERSION_CHECKED);
+        app->check_new_version_task_handle_ = nullptr;
+        vTaskDelete(NULL);
+    }, "check_new_version", 4096 * 2, this, 1, &check_new_version_task_handle_);
+
+    if (!background_version_check_) {
+        xEventGroupWaitBits(event_group_, MAIN_EVENT_BOOT_VERSION_CHECKED, pdFALSE, pdFALSE, portMAX_DELAY);
+        if (ota_->HasMqttConfig()) {
+            protocol_type = "mqtt";
+        } else if (ota_->HasWebsocketConfig()) {
+            protocol_type = "websocket";
+        }
+    }
 
     // Initialize the protocol
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
+    BootTimeline::Begin("protocol");
 
     // Add MCP common tools before initializing the protocol
     auto& mcp_server = McpServer::GetInstance();
     mcp_server.AddCommonTools();
     mcp_server.AddUserOnlyTools();
 
-    if (ota.HasMqttConfig()) {
+    InitializeProtocol(protocol_type);
+    bool protocol_started = protocol_->Start();
+    BootTimeline::End("protocol");
+
+// Start the built-in WebSocket listener for live-stream events on port 8080 if requested.
+#if CONFIG_HTTPD_WS_SUPPORT
+    // Start the WS server task at low priority
+    xTaskCreate([](void* arg) {
+        Application* app = (Application*)arg;
+        WsIngestServer server(8080);
+        server.OnTextMessage([app](const char* data, size_t length) {
+            app->ProcessIncomingJson(data, length);
+        });
+        if (server.Start()) {
+            server.Run();
+        }
+        vTaskDelete(NULL);
+    }, "ws_server", 4096, (void*)this, 1, NULL);
+#endif
+
+    // The screen and sounds come from the assets, do not show ready before they are applied
+    xEventGroupWaitBits(event_group_, MAIN_EVENT_BOOT_ASSETS_DONE, pdFALSE, pdFALSE, portMAX_DELAY);
+
+    SystemInfo::PrintHeapStats();
+    SetDeviceState(kDeviceStateIdle);
+    BootTimeline::MarkReady();
+
+    if (protocol_started) {
+        std::string message = std::string(Lang::Strings::VERSION) + esp_app_get_description()->version;
+        display->ShowNotification(message.c_str());
+        display->SetChatMessage("system", "");
+        // Play the success sound to indicate the device is ready
+        audio_service_.PlaySound(Lang::Sounds::OGG_SUCCESS);
+
+        // Open the connection in advance so the first wake word does not wait for the handshake
+        Schedule([this]() {
+            protocol_->PreconnectAsync();
+        });
+    }
+}
+
+// Creates protocol_ and connects its callbacks, it is not started yet
+void Application::InitializeProtocol(const std::string& protocol_type) {
+    auto& board = Board::GetInstance();
+    auto display = board.GetDisplay();
+    auto codec = board.GetAudioCodec();
+
+    if (protocol_type == "mqtt") {
         protocol_ = std::make_unique<MqttProtocol>();
-    } else if (ota.HasWebsocketConfig()) {
+    } else if (protocol_type == "websocket") {
         protocol_ = std::make_unique<WebsocketProtocol>();
     } else {
         ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
@@ -466,7 +644,8 @@ void Application::Start() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
-        if (device_state_ == kDeviceStateSpeaking) {
+        // After an abort the server may keep streaming until it gets the message
+        if (device_state_ == kDeviceStateSpeaking && !aborted_) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
     });
@@ -483,21 +662,20 @@ void Application::Start() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
-        });
+        }, kTaskLaneUi, "OnAudioChannelClosed");
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
+    protocol_->OnIncomingMessage([this, display](const IncomingMessage& message) {
+        // Fields point into the received frame, copy them before scheduling
+        auto& type = message.type;
+        if (type.Equals("tts")) {
+            if (message.state.Equals("start")) {
                 Schedule([this]() {
                     aborted_ = false;
                     if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
                         SetDeviceState(kDeviceStateSpeaking);
                     }
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
+                }, kTaskLaneAudioControl, "tts.start");
+            } else if (message.state.Equals("stop")) {
                 Schedule([this]() {
                     if (device_state_ == kDeviceStateSpeaking) {
                         if (listening_mode_ == kListeningModeManualStop) {
@@ -506,251 +684,109 @@ void Application::Start() {
                             SetDeviceState(kDeviceStateListening);
                         }
                     }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
+                }, kTaskLaneAudioControl, "tts.stop");
+            } else if (message.state.Equals("sentence_start")) {
+                if (message.text.is_string()) {
+                    auto text = message.text.str();
+                    ESP_LOGI(TAG, "<< %s", text.c_str());
+                    Schedule([this, display, text = std::move(text)]() {
+                        display->SetChatMessage("assistant", text.c_str());
+                    }, kTaskLaneUi, "tts.sentence_start");
                 }
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
+        } else if (type.Equals("stt")) {
+            if (message.text.is_string()) {
+                auto text = message.text.str();
+                ESP_LOGI(TAG, ">> %s", text.c_str());
+                Schedule([this, display, text = std::move(text)]() {
+                    display->SetChatMessage("user", text.c_str());
+                }, kTaskLaneUi, "stt");
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
+        } else if (type.Equals("llm")) {
+            if (message.emotion.is_string()) {
+                Schedule([this, display, emotion_str = message.emotion.str()]() {
                     display->SetEmotion(emotion_str.c_str());
-                });
+                }, kTaskLaneUi, "llm.emotion");
             }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
-                McpServer::GetInstance().ParseMessage(payload);
+        } else if (type.Equals("mcp")) {
+            if (message.payload.is_object()) {
+                // Only the MCP request itself is parsed, the envelope never becomes a cJSON tree
+                McpServer::GetInstance().ParseMessage(std::string(message.payload.raw));
             }
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
+        } else if (type.Equals("system")) {
+            if (message.command.is_string()) {
+                auto command = message.command.str();
+                ESP_LOGI(TAG, "System command: %s", command.c_str());
+                if (command == "reboot") {
                     // Do a reboot if user requests a OTA update
                     Schedule([this]() {
                         Reboot();
-                    });
+                    }, kTaskLaneUi, "system.reboot");
                 } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
+                    ESP_LOGW(TAG, "Unknown system command: %s", command.c_str());
                 }
             }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::OGG_VIBRATION);
+        } else if (type.Equals("alert")) {
+            if (message.status.is_string() && message.message.is_string() && message.emotion.is_string()) {
+                Alert(message.status.str().c_str(), message.message.str().c_str(), message.emotion.str().c_str(), Lang::Sounds::OGG_VIBRATION);
             } else {
                 ESP_LOGW(TAG, "Alert command requires status, message and emotion");
             }
 #if CONFIG_RECEIVE_CUSTOM_MESSAGE
-        } else if (strcmp(type->valuestring, "custom") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
-            if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
+        } else if (type.Equals("custom")) {
+            ESP_LOGI(TAG, "Received custom message: %.*s", (int)message.raw.size(), message.raw.data());
+            if (message.payload.is_object()) {
+                Schedule([this, display, payload_str = std::string(message.payload.raw)]() {
                     display->SetChatMessage("system", payload_str.c_str());
-                });
+                }, kTaskLaneUi, "custom");
             } else {
                 ESP_LOGW(TAG, "Invalid custom message format: missing payload");
             }
 #endif
         } else {
-            ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+            ESP_LOGW(TAG, "Unknown message type: %s", type.str().c_str());
         }
     });
-    bool protocol_started = protocol_->Start();
-
-// Start a minimal built-in WebSocket TCP listener on port 8080 if requested.
-#if CONFIG_HTTPD_WS_SUPPORT
-    // Start the WS server task at low priority
-    xTaskCreate([](void* arg) {
-        Application* app = (Application*)arg;
-        // copy ws task body here to avoid std::function capture issues
-        const int port = 8080;
-        int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
-        if (listen_sock < 0) {
-            ESP_LOGW(TAG, "ws: failed to create socket: %d", listen_sock);
-            vTaskDelete(NULL);
-            return;
-        }
-
-        struct sockaddr_in addr;
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        addr.sin_port = htons(port);
-
-        int opt = 1;
-        setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+}
 
-        if (bind(listen_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-            ESP_LOGW(TAG, "ws: bind failed");
-            close(listen_sock);
-            vTaskDelete(NULL);
-            return;
-        }
+// Main loop only, while idle. Picks up endpoints and credentials rewritten by a background version check
+void Application::RestartProtocol(const std::string& protocol_type) {
+    ESP_LOGI(TAG, "Protocol config changed, restarting the protocol (%s)", protocol_type.c_str());
+    if (protocol_->IsAudioChannelOpened()) {
+        protocol_->CloseAudioChannel();
+    }
+    protocol_.reset();
+    InitializeProtocol(protocol_type);
+    if (protocol_->Start()) {
+        protocol_->PreconnectAsync();
+    }
+}
 
-        if (listen(listen_sock, 1) < 0) {
-            ESP_LOGW(TAG, "ws: listen failed");
-            close(listen_sock);
-            vTaskDelete(NULL);
-            return;
+// Blocks the calling task until `callback` ran in the main loop while the device was idle and no
+// channel job was running. Background tasks use it to change what a conversation depends on.
+void Application::RunWhenIdle(std::function<void()> callback, const char* name) {
+    auto state = std::make_shared<std::atomic<int>>(0);
+    while (true) {
+        while (device_state_ != kDeviceStateIdle || (protocol_ && protocol_->IsChannelBusy())) {
+            vTaskDelay(pdMS_TO_TICKS(100));
         }
-
-        ESP_LOGI(TAG, "WebSocket TCP listener started on port %d", port);
-
-        while (true) {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-            int client_sock = accept(listen_sock, (struct sockaddr*)&client_addr, &client_len);
-            if (client_sock < 0) {
-                ESP_LOGW(TAG, "ws: accept failed");
-                break;
-            }
-
-            // Read HTTP request headers (handshake)
-            std::string req;
-            char buf[512];
-            int r;
-            while ((r = recv(client_sock, buf, sizeof(buf), 0)) > 0) {
-                req.append(buf, buf + r);
-                if (req.find("\r\n\r\n") != std::string::npos) break;
-                if (req.size() > 8192) break;
-            }
-
-            // Find Sec-WebSocket-Key
-            std::string key_tag = "Sec-WebSocket-Key: ";
-            auto p = req.find(key_tag);
-            if (p == std::string::npos) {
-                ESP_LOGW(TAG, "ws: no Sec-WebSocket-Key, closing");
-                close(client_sock);
-                continue;
-            }
-            p += key_tag.size();
-            auto e = req.find("\r\n", p);
-            if (e == std::string::npos) {
-                close(client_sock);
-                continue;
-            }
-            std::string client_key = req.substr(p, e - p);
-
-            // Compute accept key: base64(sha1(client_key + GUID))
-            const char* GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-            std::string to_hash = client_key + std::string(GUID);
-            unsigned char sha1_result[20];
-            mbedtls_sha1((const unsigned char*)to_hash.data(), to_hash.size(), sha1_result);
-
-            size_t olen = 0;
-            unsigned char b64[64];
-            mbedtls_base64_encode(b64, sizeof(b64), &olen, sha1_result, sizeof(sha1_result));
-            std::string accept_key((char*)b64, olen);
-
-            // Send handshake response
-            std::string resp = "HTTP/1.1 101 Switching Protocols\r\n"
-                "Upgrade: websocket\r\n"
-                "Connection: Upgrade\r\n"
-                "Sec-WebSocket-Accept: " + accept_key + "\r\n\r\n";
-            send(client_sock, resp.data(), resp.size(), 0);
-
-            // Now read frames (very small/simple implementation: handle masked text frames)
-            while (true) {
-                uint8_t hdr[2];
-                int nr = recv(client_sock, hdr, 2, 0);
-                if (nr <= 0) break;
-                uint8_t opcode = hdr[0] & 0x0f;
-                bool masked = hdr[1] & 0x80;
-                uint64_t payload_len = hdr[1] & 0x7f;
-                if (payload_len == 126) {
-                    uint8_t ext[2];
-                    if (recv(client_sock, ext, 2, 0) != 2) break;
-                    payload_len = (ext[0] << 8) | ext[1];
-                } else if (payload_len == 127) {
-                    uint8_t ext[8];
-                    if (recv(client_sock, ext, 8, 0) != 8) break;
-                    payload_len = 0;
-                    for (int i = 0; i < 8; ++i) payload_len = (payload_len << 8) | ext[i];
-                }
-
-                uint8_t mask_key[4];
-                if (masked) {
-                    if (recv(client_sock, mask_key, 4, 0) != 4) break;
-                }
-
-                std::vector<char> payload(payload_len + 1);
-                size_t got = 0;
-                while (got < payload_len) {
-                    int m = recv(client_sock, payload.data() + got, payload_len - got, 0);
-                    if (m <= 0) break;
-                    got += m;
-                }
-                if (got != payload_len) break;
-
-                if (masked) {
-                    for (size_t i = 0; i < payload_len; ++i) {
-                        payload[i] ^= mask_key[i % 4];
-                    }
-                }
-                payload[payload_len] = '\0';
-
-                if (opcode == 0x1) { // text frame
-                    cJSON* root = cJSON_ParseWithLength(payload.data(), payload_len);
-                    if (root) {
-                        app->Schedule([root]() {
-                            Application::GetInstance().ProcessIncomingJson(root);
-                        });
-                    } else {
-                        ESP_LOGI(TAG, "ws: received non-JSON text frame len=%u", (unsigned)payload_len);
-                    }
-                } else if (opcode == 0x8) { // close
-                    break;
-                } else {
-                    // ignore other opcodes for now
-                }
+        state->store(0);
+        // Only one attempt is queued at a time, so `callback` outlives it
+        Schedule([this, state, &callback]() {
+            if (device_state_ != kDeviceStateIdle || (protocol_ && protocol_->IsChannelBusy())) {
+                state->store(1);
+                return;
             }
-
-            close(client_sock);
+            callback();
+            state->store(2);
+        }, kTaskLaneAudioControl, name);
+        while (state->load() == 0) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        if (state->load() == 2) {
+            return;
         }
-
-        close(listen_sock);
-        vTaskDelete(NULL);
-    }, "ws_server", 4096, (void*)this, 1, NULL);
-#endif
-
-    SystemInfo::PrintHeapStats();
-    SetDeviceState(kDeviceStateIdle);
-
-    has_server_time_ = ota.HasServerTime();
-    if (protocol_started) {
-        std::string message = std::string(Lang::Strings::VERSION) + ota.GetCurrentVersion();
-        display->ShowNotification(message.c_str());
-        display->SetChatMessage("system", "");
-        // Play the success sound to indicate the device is ready
-        audio_service_.PlaySound(Lang::Sounds::OGG_SUCCESS);
-    }
-}
-
-// Add a async task to MainLoop
-void Application::Schedule(std::function<void()> callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
     }
-    xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
 }
 
 // The Main Event Loop controls the chat state and websocket connection
@@ -762,57 +798,85 @@ void Application::MainEventLoop() {
             MAIN_EVENT_SEND_AUDIO |
             MAIN_EVENT_WAKE_WORD_DETECTED |
             MAIN_EVENT_VAD_CHANGE |
-            MAIN_EVENT_CLOCK_TICK |
             MAIN_EVENT_ERROR, pdTRUE, pdFALSE, portMAX_DELAY);
 
+        // The loop's own work is timed like tasks, a blocking handler delays everything queued behind it
         if (bits & MAIN_EVENT_ERROR) {
-            SetDeviceState(kDeviceStateIdle);
-            Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
+            main_tasks_.Measure("MAIN_EVENT_ERROR", [this]() {
+                SetDeviceState(kDeviceStateIdle);
+                Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
+            });
         }
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
-                    break;
+            main_tasks_.Measure("MAIN_EVENT_SEND_AUDIO", [this]() {
+                // The channel task is connecting, the packets wait for it
+                if (protocol_ && protocol_->IsChannelBusy()) {
+                    return;
                 }
-            }
+                while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+                    if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
+                        break;
+                    }
+                }
+            });
         }
 
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
-            OnWakeWordDetected();
+            main_tasks_.Measure("OnWakeWordDetected", [this]() {
+                OnWakeWordDetected();
+            });
         }
 
         if (bits & MAIN_EVENT_VAD_CHANGE) {
-            if (device_state_ == kDeviceStateListening) {
-                auto led = Board::GetInstance().GetLed();
-                led->OnStateChanged();
-            }
+            main_tasks_.Measure("MAIN_EVENT_VAD_CHANGE", [this]() {
+#if CONFIG_BARGE_IN_STOP
+                if (!barge_in_pending_.exchange(false) || device_state_ != kDeviceStateSpeaking) {
+                    // Nothing stopped, or the turn ended meanwhile and tts.start clears aborted_
+                    return;
+                }
+                if (audio_service_.IsVoiceDetected()) {
+                    // The playback is already silent, tell the server and keep listening
+                    AbortSpeaking(kAbortReasonNone);
+                    SetListeningMode(kListeningModeRealtime);
+                } else {
+                    // Only a blip, the frames already dropped are lost but the rest of the answer plays
+                    ESP_LOGI(TAG, "Voice gone before the barge-in was handled, resuming playback");
+                    aborted_ = false;
+                }
+#endif
+            });
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
-            }
+            main_tasks_.RunPending();
         }
 
-        if (bits & MAIN_EVENT_CLOCK_TICK) {
-            clock_ticks_++;
-            auto display = Board::GetInstance().GetDisplay();
-            display->UpdateStatusBar();
-        
-            // Print the debug info every 10 seconds
-            if (clock_ticks_ % 10 == 0) {
-                // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
-                // SystemInfo::PrintTaskList();
-                SystemInfo::PrintHeapStats();
-            }
-        }
     }
 }
 
+// Runs after status bar refreshes, which keep happening while idle, so it needs no wake-ups of its own
+void Application::PrintDebugStats() {
+    int64_t now = esp_timer_get_time();
+    if (now - last_debug_stats_time_ < DEBUG_STATS_INTERVAL_MS * 1000LL) {
+        return;
+    }
+    last_debug_stats_time_ = now;
+
+    // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
+    // SystemInfo::PrintTaskList();
+    SystemInfo::PrintHeapStats();
+    for (int lane = 0; lane < kTaskLaneCount; lane++) {
+        auto stats = main_tasks_.GetStats((MainTaskLane)lane);
+        ESP_LOGI(TAG, "Main tasks lane %d: %lu run, max depth %lu, latency avg %llu max %lu us, run max %lu us, long %lu, overflowed %lu, dropped %lu, on heap %lu",
+            lane, stats.executed, stats.max_depth, stats.executed > 0 ? stats.total_latency_us / stats.executed : 0,
+            stats.max_latency_us, stats.max_run_us, stats.long_tasks, stats.overflowed, stats.dropped, stats.heap_tasks);
+    }
+    auto status_bar = StatusBarMonitor::GetInstance().GetStats();
+    ESP_LOGI(TAG, "Status bar: %lu wake-ups, %lu in the last minute, %lu refreshes",
+        status_bar.wakeups, status_bar.wakeups_last_minute, status_bar.refreshes);
+}
+
 void Application::OnWakeWordDetected() {
     if (!protocol_) {
         return;
@@ -821,31 +885,28 @@ void Application::OnWakeWordDetected() {
     if (device_state_ == kDeviceStateIdle) {
         audio_service_.EncodeWakeWord();
 
-        if (!protocol_->IsAudioChannelOpened()) {
-            SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
-                audio_service_.EnableWakeWordDetection(true);
-                return;
-            }
-        }
-
-        auto wake_word = audio_service_.GetLastWakeWord();
-        ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
+        // Failing to open goes back to idle, which turns wake word detection on again
+        OpenAudioChannel([this]() {
+            auto wake_word = audio_service_.GetLastWakeWord();
+            ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_SEND_WAKE_WORD_DATA
-        // Encode and send the wake word data to the server
-        while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
-        }
-        // Set the chat state to wake word detected
-        protocol_->SendWakeWordDetected(wake_word);
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+            // Encode and send the wake word data to the server
+            while (auto packet = audio_service_.PopWakeWordPacket()) {
+                protocol_->SendAudio(std::move(packet));
+            }
+            // Set the chat state to wake word detected
+            protocol_->SendWakeWordDetected(wake_word);
+            SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
 #else
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
-        // Play the pop up sound to indicate the wake word is detected
-        audio_service_.PlaySound(Lang::Sounds::OGG_POPUP);
+            SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+            // Play the pop up sound to indicate the wake word is detected
+            audio_service_.PlaySound(Lang::Sounds::OGG_POPUP);
 #endif
+        });
     } else if (device_state_ == kDeviceStateSpeaking) {
         AbortSpeaking(kAbortReasonWakeWordDetected);
+        // Start listening right away instead of waiting for the server to end the speech
+        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
     } else if (device_state_ == kDeviceStateActivating) {
         SetDeviceState(kDeviceStateIdle);
     }
@@ -854,13 +915,46 @@ void Application::OnWakeWordDetected() {
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
+    audio_service_.StopPlayback();
     if (protocol_) {
         protocol_->SendAbortSpeaking(reason);
     }
 }
 
+// Main loop only. Opening can take seconds, it runs on the protocol's worker task while the device shows
+// connecting. `on_opened` runs in the main loop once the channel is open, unless the device left the
+// connecting state meanwhile, e.g. by an error or the user cancelling.
+void Application::OpenAudioChannel(std::function<void()> on_opened) {
+    if (!protocol_->IsChannelBusy() && protocol_->IsAudioChannelOpened()) {
+        on_opened();
+        return;
+    }
+
+    SetDeviceState(kDeviceStateConnecting);
+    protocol_->OpenAudioChannelAsync([this, on_opened = std::move(on_opened)](bool opened) {
+        if (device_state_ != kDeviceStateConnecting) {
+            if (opened) {
+                protocol_->CloseAudioChannel();
+            }
+            return;
+        }
+        if (!opened) {
+            SetDeviceState(kDeviceStateIdle);
+            return;
+        }
+        on_opened();
+    });
+}
+
+// Only with device AEC the VAD hears the user and not the assistant's own voice
+bool Application::IsBargeInAllowed() const {
+    return device_state_ == kDeviceStateSpeaking && listening_mode_ == kListeningModeRealtime &&
+        aec_mode_ == kAecOnDeviceSide;
+}
+
 void Application::SetListeningMode(ListeningMode mode) {
     listening_mode_ = mode;
+    audio_service_.SetUplinkDropPolicy(mode == kListeningModeRealtime ? kUplinkDropOldest : kUplinkDropNewest);
     SetDeviceState(kDeviceStateListening);
 }
 
@@ -869,18 +963,15 @@ void Application::SetDeviceState(DeviceState state) {
         return;
     }
     
-    clock_ticks_ = 0;
     auto previous_state = device_state_;
     device_state_ = state;
     ESP_LOGI(TAG, "STATE: %s", STATE_STRINGS[device_state_]);
 
-    // Send the state change event
+    // The LED, status bar, power save timers and MCP notifications follow through the event bus
     DeviceStateEventManager::GetInstance().PostStateChangeEvent(previous_state, state);
 
     auto& board = Board::GetInstance();
     auto display = board.GetDisplay();
-    auto led = board.GetLed();
-    led->OnStateChanged();
     switch (state) {
         case kDeviceStateUnknown:
         case kDeviceStateIdle:
@@ -920,10 +1011,21 @@ void Application::SetDeviceState(DeviceState state) {
             // Do nothing
             break;
     }
+
+    // Live-stream events held back while the device was busy
+    if (state == kDeviceStateIdle && live_events_.HasLlmEvents()) {
+        Schedule([this]() {
+            HandleLiveEvents();
+        }, kTaskLaneTelemetry);
+    }
 }
 
 void Application::Reboot() {
     ESP_LOGI(TAG, "Rebooting...");
+    // An open in flight still uses the protocol
+    while (protocol_ && protocol_->IsChannelBusy()) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
     // Disconnect the audio channel
     if (protocol_ && protocol_->IsAudioChannelOpened()) {
         protocol_->CloseAudioChannel();
@@ -944,7 +1046,7 @@ bool Application::UpgradeFirmware(Ota& ota, const std::string& url) {
     std::string version_info = url.empty() ? ota.GetFirmwareVersion() : "(Manual upgrade)";
     
     // Close audio channel if it's open
-    if (protocol_ && protocol_->IsAudioChannelOpened()) {
+    if (protocol_ && !protocol_->IsChannelBusy() && protocol_->IsAudioChannelOpened()) {
         ESP_LOGI(TAG, "Closing audio channel before firmware upgrade");
         protocol_->CloseAudioChannel();
     }
@@ -994,40 +1096,40 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     }
 
     if (device_state_ == kDeviceStateIdle) {
-        audio_service_.EncodeWakeWord();
-
-        if (!protocol_->IsAudioChannelOpened()) {
-            SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
-                audio_service_.EnableWakeWordDetection(true);
+        // Called from button and camera tasks, the audio channel is only opened from the main loop
+        Schedule([this, wake_word]() {
+            if (device_state_ != kDeviceStateIdle) {
                 return;
             }
-        }
+            audio_service_.EncodeWakeWord();
 
-        ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
+            OpenAudioChannel([this, wake_word]() {
+                ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
-        // Encode and send the wake word data to the server
-        while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
-        }
-        // Set the chat state to wake word detected
-        protocol_->SendWakeWordDetected(wake_word);
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+                // Encode and send the wake word data to the server
+                while (auto packet = audio_service_.PopWakeWordPacket()) {
+                    protocol_->SendAudio(std::move(packet));
+                }
+                // Set the chat state to wake word detected
+                protocol_->SendWakeWordDetected(wake_word);
+                SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
 #else
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
-        // Play the pop up sound to indicate the wake word is detected
-        audio_service_.PlaySound(Lang::Sounds::OGG_POPUP);
+                SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+                // Play the pop up sound to indicate the wake word is detected
+                audio_service_.PlaySound(Lang::Sounds::OGG_POPUP);
 #endif
+            });
+        }, kTaskLaneAudioControl);
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
-        });
+        }, kTaskLaneAudioControl);
     } else if (device_state_ == kDeviceStateListening) {   
         Schedule([this]() {
             if (protocol_) {
                 protocol_->CloseAudioChannel();
             }
-        });
+        }, kTaskLaneAudioControl);
     }
 }
 
@@ -1036,7 +1138,7 @@ bool Application::CanEnterSleepMode() {
         return false;
     }
 
-    if (protocol_ && protocol_->IsAudioChannelOpened()) {
+    if (protocol_ && (protocol_->IsChannelBusy() || protocol_->IsAudioChannelOpened())) {
         return false;
     }
 
@@ -1083,8 +1185,10 @@ void Application::SetAecMode(AecMode mode) {
             break;
         }
 
-        // If the AEC mode is changed, close the audio channel
-        if (protocol_ && protocol_->IsAudioChannelOpened()) {
+        // If the AEC mode is changed, close the audio channel, the hello of one being opened is outdated too
+        if (protocol_ && protocol_->IsOpeningAudioChannel()) {
+            protocol_->CancelOpenAudioChannel();
+        } else if (protocol_ && !protocol_->IsChannelBusy() && protocol_->IsAudioChannelOpened()) {
             protocol_->CloseAudioChannel();
         }
     });
@@ -1094,131 +1198,55 @@ void Application::PlaySound(const std::string_view& sound) {
     audio_service_.PlaySound(sound);
 }
 
-// Helper: detect and display Douyin/webcast-style messages.
-// Returns true if the object was recognized and handled (displayed), false otherwise.
-static bool HandleDouyinLikeMessage(cJSON* obj, Application* app) {
-    if (!obj || !app) return false;
+// Runs in the main loop. Display-only events are shown right away, the rest wait until the device
+// is idle and the LLM interval has passed, then the most important one starts a conversation.
+void Application::HandleLiveEvents() {
+    live_events_.BeginDrain();
     auto display = Board::GetInstance().GetDisplay();
 
-    // roomId + nickname/title style (simple chat entry)
-    auto roomId_item = cJSON_GetObjectItem(obj, "roomId");
-    auto nickname_item = cJSON_GetObjectItem(obj, "nickname");
-    auto title_item = cJSON_GetObjectItem(obj, "title");
-    if ((roomId_item && cJSON_IsString(roomId_item)) && (nickname_item && cJSON_IsString(nickname_item))) {
-        std::string nickname = nickname_item->valuestring;
-        std::string title = title_item && cJSON_IsString(title_item) ? title_item->valuestring : std::string();
-        ESP_LOGI(TAG, "WS Douyin message from %s room=%s", nickname.c_str(), roomId_item->valuestring);
-        if (!title.empty()) {
-            std::string msg = "进入" + nickname + "的直播间，带货兔，跟直播间朋友欢快地打个招呼吧，不要调用任何工具。";
-            app->Schedule([display, message = std::move(msg), app]() {
-                app->WakeWordInvoke(message);
-                display->SetChatMessage("system", message.c_str());
-            });
-        } else {
-            app->Schedule([display, nickname = std::move(nickname), app]() {
-                app->WakeWordInvoke(nickname);
-                display->SetChatMessage("system", nickname.c_str());
-            });
-        }
-
-        return true;
+    // Coalesced already, but a burst can still hold a few, only the latest is visible anyway
+    LiveEvent event;
+    std::string display_text;
+    while (live_events_.PopDisplayOnly(event)) {
+        display_text = std::move(event.text);
     }
 
-    // method-based webcast events
-    auto method = cJSON_GetObjectItem(obj, "method");
-    auto jsonrpc = cJSON_GetObjectItem(obj, "jsonrpc");
-    if (method && cJSON_IsString(method) && !(jsonrpc && cJSON_IsString(jsonrpc) && strcmp(jsonrpc->valuestring, "2.0") == 0)) {
-        const char* m = method->valuestring;
-
-        if (strcmp(m, "WebcastMemberMessage") == 0 || strcmp(m, "WebcastChatMessage") == 0) {
-            auto user = cJSON_GetObjectItem(obj, "user");
-            auto content = cJSON_GetObjectItem(obj, "content");
-            std::string name = "unknown";
-            if (cJSON_IsObject(user)) {
-                auto uname = cJSON_GetObjectItem(user, "name");
-                if (uname && cJSON_IsString(uname)) name = uname->valuestring;
-            }
-            std::string text = cJSON_IsString(content) ? content->valuestring : std::string();
-            ESP_LOGI(TAG, "WS %s from %s: %s", m, name.c_str(), text.c_str());
-            app->Schedule([display, name = std::move(name), text = std::move(text), app]() {
-                std::string msg = name + ": " + text;
-                app->WakeWordInvoke(msg);
-                display->SetChatMessage("system", msg.c_str());
-            });
+    int64_t now = esp_timer_get_time();
+    int64_t wait_us = last_live_forward_time_ + LIVE_EVENT_LLM_INTERVAL_MS * 1000LL - now;
+    if (device_state_ == kDeviceStateIdle && live_events_.HasLlmEvents()) {
+        if (last_live_forward_time_ != 0 && wait_us > 0) {
+            esp_timer_stop(live_event_timer_handle_);
+            esp_timer_start_once(live_event_timer_handle_, wait_us);
+        } else if (live_events_.PopForLlm(event, now)) {
+            last_live_forward_time_ = now;
+            display_text = event.text;
+            WakeWordInvoke(event.prompt);
         }
-        
-        else if (strcmp(m, "WebcastRoomStatsMessage") == 0) {
-            auto room = cJSON_GetObjectItem(obj, "room");
-            if (room && cJSON_IsObject(room)) {
-                auto ac = cJSON_GetObjectItem(room, "audienceCount");
-                if (ac && cJSON_IsString(ac)) {
-                    ESP_LOGI(TAG, "WS RoomStats audience=%s", ac->valuestring);
-                    app->Schedule([display, acs = std::string(ac->valuestring)]() {
-                        std::string msg = "直播间观众人数: " + acs;
-                        // app->WakeWordInvoke(msg);
-                        display->SetChatMessage("system", msg.c_str());
-                    });
-                    return true;
-                }
-            }
-        } else if (strcmp(m, "WebcastRoomUserSeqMessage") == 0) {
-            auto rank = cJSON_GetObjectItem(obj, "rank");
-            if (rank && cJSON_IsArray(rank)) {
-                std::string preview;
-                cJSON* r = nullptr;
-                int i = 0;
-                cJSON_ArrayForEach(r, rank) {
-                    if (i >= 3) break;
-                    auto nick = cJSON_GetObjectItem(r, "nickname");
-                    if (nick && cJSON_IsString(nick)) {
-                        if (!preview.empty()) preview += ", ";
-                        preview += nick->valuestring;
-                    }
-                    ++i;
-                }
-                if (!preview.empty()) {
-                    ESP_LOGI(TAG, "WS Room top: %s", preview.c_str());
-                    app->Schedule([display, preview]() {
-                        display->SetChatMessage("system", ("直播间前三位观众: " + preview).c_str());
-                    });
-                    return true;
-                }
-            }
-        }        
     }
 
-    return true;
+    if (!display_text.empty()) {
+        display->SetChatMessage("system", display_text.c_str());
+    }
 }
 
-void Application::ProcessIncomingJson(cJSON* root) {
-    if (!root) return;
-
-    // If it's an array, process each element and only handle Douyin-like items.
-    if (cJSON_IsArray(root)) {
-        cJSON* item = nullptr;
-        cJSON_ArrayForEach(item, root) {
-            if (item == nullptr) continue;
-
-            bool handled = HandleDouyinLikeMessage(item, this);
-            if (handled) continue;
-    
-            char* s = cJSON_PrintUnformatted(item);
-            ESP_LOGW(TAG, "WS unknown payload (ignored): %s", s ? s : "<nil>");
-            if (s) cJSON_free(s);
-        }
-        cJSON_Delete(root);
+void Application::ProcessIncomingJson(const char* data, size_t length) {
+    std::vector<LiveEvent> events;
+    auto result = LiveEventParser::Parse(data, length, esp_timer_get_time(), events, &live_filter_);
+    if (!result.valid) {
+        ESP_LOGI(TAG, "ws: received non-JSON text frame len=%u", (unsigned)length);
         return;
     }
-
-    // Single object: handle if Douyin-like, otherwise log as unknown
-    bool handled = HandleDouyinLikeMessage(root, this);
-    if (handled) {
-        cJSON_Delete(root);
-        return;
+    if (result.unknown > 0) {
+        ESP_LOGW(TAG, "WS unknown payload (ignored): %u of %u items", (unsigned)result.unknown, (unsigned)result.items);
     }
-
-    char* s = cJSON_PrintUnformatted(root);
-    ESP_LOGW(TAG, "WS unknown payload (ignored): %s", s ? s : "<nil>");
-    if (s) cJSON_free(s);
-    cJSON_Delete(root);
-}
\ No newline at end of file
+    ESP_LOGI(TAG, "WS batch: %u items, %u events", (unsigned)result.items, (unsigned)events.size());
+    // At most one drain task waits in the main loop, however many events arrive
+    if (!events.empty() && live_events_.Push(std::move(events))) {
+        if (!Schedule([this]() {
+            HandleLiveEvents();
+        }, kTaskLaneTelemetry)) {
+            // The lane is full, clear the pending drain so the next batch schedules one again
+            live_events_.BeginDrain();
+        }
+    }
+}
@@ -7,14 +7,19 @@
 #include <esp_timer.h>
 
 #include <string>
-#include <mutex>
-#include <deque>
 #include <memory>
+#include <functional>
+#include <atomic>
 
 #include "protocol.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state_event.h"
+#include "live_event_queue.h"
+#include "live_event_filter.h"
+#include "main_task_queue.h"
+#include "status_bar_monitor.h"
+#include "event_bus.h"
 
 // forward-declare cJSON to avoid including cJSON in the header
 struct cJSON;
@@ -26,7 +31,12 @@ struct cJSON;
 #define MAIN_EVENT_VAD_CHANGE (1 << 3)
 #define MAIN_EVENT_ERROR (1 << 4)
 #define MAIN_EVENT_CHECK_NEW_VERSION_DONE (1 << 5)
-#define MAIN_EVENT_CLOCK_TICK (1 << 6)
+#define MAIN_EVENT_BOOT_ASSETS_DONE (1 << 7)
+#define MAIN_EVENT_BOOT_VERSION_CHECKED (1 << 8)
+
+// Heap and main task stats are logged at most this often. They ride on status bar refreshes, which
+// while idle come every STATUS_BAR_BATTERY_INTERVAL_MS (30 s), so the log is sparser then
+#define DEBUG_STATS_INTERVAL_MS 10000
 
 
 enum AecMode {
@@ -48,8 +58,21 @@ public:
     void Start();
     void MainEventLoop();
     DeviceState GetDeviceState() const { return device_state_; }
+    static const char* GetStateName(DeviceState state);
     bool IsVoiceDetected() const { return audio_service_.IsVoiceDetected(); }
-    void Schedule(std::function<void()> callback);
+    // Runs the callback in the main loop, small captures are stored without allocating.
+    // The task is timed under `name`, the calling function by default; pass one when calling from a lambda.
+    // Returns false when the lane was full and the task dropped, which never happens to audio control tasks.
+    template <typename F>
+    bool Schedule(F&& callback, MainTaskLane lane = kTaskLaneUi, const char* name = __builtin_FUNCTION()) {
+        bool queued = main_tasks_.Push(MainTask(std::forward<F>(callback)), lane, name);
+        xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
+        return queued;
+    }
+    MainTaskLaneStats GetMainTaskStats(MainTaskLane lane) { return main_tasks_.GetStats(lane); }
+    std::vector<MainTaskTiming> GetMainTaskTimings() { return main_tasks_.GetRecentTimings(); }
+    uint32_t GetMainLoopLongWork() { return main_tasks_.long_work_count(); }
+    uint32_t GetMainLoopWatchdogCount() { return main_tasks_.watchdog_count(); }
     void SetDeviceState(DeviceState state);
     void Alert(const char* status, const char* message, const char* emotion = "", const std::string_view& sound = "");
     void DismissAlert();
@@ -65,37 +88,55 @@ public:
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
     void PlaySound(const std::string_view& sound);
-    // Process a parsed JSON object received from external sources (e.g. WebSocket)
-    // Ownership: caller transfers ownership of `root` to this function (it will be freed).
-    void ProcessIncomingJson(cJSON* root);
+    // Process a JSON object or array of objects received from external sources (e.g. WebSocket)
+    // Thread safe, the whole message is classified in one pass and its events queued for the main loop.
+    void ProcessIncomingJson(const char* data, size_t length);
+    LiveEventStats GetLiveEventStats() { return live_events_.GetStats(); }
+    LiveFilterStats GetLiveFilterStats() { return live_filter_.GetStats(); }
     AudioService& GetAudioService() { return audio_service_; }
+    // nullptr until Start() has created the protocol
+    Protocol* GetProtocol() { return protocol_.get(); }
         
 private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    MainTaskQueue main_tasks_;
     std::unique_ptr<Protocol> protocol_;
+    std::unique_ptr<Ota> ota_;
     EventGroupHandle_t event_group_ = nullptr;
-    esp_timer_handle_t clock_timer_handle_ = nullptr;
+    esp_timer_handle_t live_event_timer_handle_ = nullptr;
     volatile DeviceState device_state_ = kDeviceStateUnknown;
     ListeningMode listening_mode_ = kListeningModeAutoStop;
     AecMode aec_mode_ = kAecOff;
     std::string last_error_message_;
     AudioService audio_service_;
+    LiveEventQueue live_events_;
+    LiveEventFilter live_filter_;
+    int64_t last_live_forward_time_ = 0;
 
     bool has_server_time_ = false;
-    bool aborted_ = false;
-    int clock_ticks_ = 0;
+    bool background_version_check_ = false;
+    // Written by the audio input task on barge-in, read by the network task
+    std::atomic<bool> aborted_ = false;
+    // Set by the audio input task when it stopped the playback, cleared by the main loop
+    std::atomic<bool> barge_in_pending_ = false;
+    int64_t last_debug_stats_time_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
     TaskHandle_t main_event_loop_task_handle_ = nullptr;
 
     void OnWakeWordDetected();
-    void CheckNewVersion(Ota& ota);
+    void OpenAudioChannel(std::function<void()> on_opened);
+    void CheckNewVersion(Ota& ota, bool background = false);
+    void InitializeProtocol(const std::string& protocol_type);
+    void RestartProtocol(const std::string& protocol_type);
+    void RunWhenIdle(std::function<void()> callback, const char* name);
     void CheckAssetsVersion();
     void ShowActivationCode(const std::string& code, const std::string& message);
     void SetListeningMode(ListeningMode mode);
+    bool IsBargeInAllowed() const;
+    void HandleLiveEvents();
+    void PrintDebugStats();
     // Internal handler for parsed JSON objects. Caller must not free `root`.
     void HandleIncomingJson(const cJSON* root);
 };
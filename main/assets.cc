@@ -4,6 +4,7 @@
 #include "application.h"
 #include "lvgl_theme.h"
 #include "emote_display.h"
+#include "connection_timing.h"
 
 #include <esp_log.h>
 #include <spi_flash_mmap.h>
@@ -383,15 +384,20 @@ bool Assets::Download(std::string url, std::function<void(int progress, size_t s
     auto network = Board::GetInstance().GetNetwork();
     auto http = network->CreateHttp(0);
     
+    ConnectionTiming timing("assets", url);
+    timing.ResolveHost();
     if (!http->Open("GET", url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
     }
+    timing.MarkConnected();
 
     if (http->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "Failed to get assets, status code: %d", http->GetStatusCode());
         return false;
     }
+    timing.MarkFirstByte();
+    timing.Finish(true);
 
     size_t content_length = http->GetBodyLength();
     if (content_length == 0) {
@@ -1,6 +1,7 @@
 #include "audio_codec.h"
 #include "board.h"
 #include "settings.h"
+#include "status_bar_monitor.h"
 
 #include <esp_log.h>
 #include <cstring>
@@ -53,6 +54,8 @@ void AudioCodec::SetOutputVolume(int volume) {
     
     Settings settings("audio", true);
     settings.SetInt("output_volume", output_volume_);
+    // The mute icon follows the volume
+    StatusBarMonitor::GetInstance().Notify(kStatusBarMute);
 }
 
 void AudioCodec::SetInputGain(float gain) {
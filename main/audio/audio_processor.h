@@ -8,6 +8,18 @@
 #include <model_path.h>
 #include "audio_codec.h"
 
+struct AudioProcessorStats {
+    uint32_t chunks = 0;            // Chunks processed
+    uint32_t overruns = 0;          // Chunks that took longer than their real-time duration
+    uint32_t budget_us = 0;         // Real-time duration of one chunk
+    uint32_t process_us = 0;        // Averaged processing time per chunk (AEC / NS / VAD)
+    uint32_t output_us = 0;         // Averaged output handling time per chunk
+    uint32_t max_total_us = 0;      // Worst processing + output time per chunk
+    int headroom_percent = 100;     // Averaged share of the budget left unused, -1 when unavailable
+    int degrade_level = 0;          // Number of features disabled to save CPU
+    uint32_t dropped_feeds = 0;     // Fed chunks that did not match the current feed size
+};
+
 class AudioProcessor {
 public:
     virtual ~AudioProcessor() = default;
@@ -21,6 +33,9 @@ public:
     virtual void OnVadStateChange(std::function<void(bool speaking)> callback) = 0;
     virtual size_t GetFeedSize() = 0;
     virtual void EnableDeviceAec(bool enable) = 0;
+    virtual AudioProcessorStats GetStats() = 0;
+    virtual bool SetProfile(const std::string& profile) = 0;
+    virtual std::string GetProfile() = 0;
 };
 
 #endif
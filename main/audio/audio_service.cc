@@ -1,6 +1,7 @@
 #include "audio_service.h"
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -35,7 +36,7 @@ void AudioService::Initialize(AudioCodec* codec) {
 
     /* Setup the audio codec */
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    opus_encoder_ = std::make_unique<UplinkEncoder>(16000, 1, OPUS_FRAME_DURATION_MS);
     opus_encoder_->SetComplexity(0);
 
     if (codec->input_sample_rate() != 16000) {
@@ -49,7 +50,14 @@ void AudioService::Initialize(AudioCodec* codec) {
     audio_processor_ = std::make_unique<NoAudioProcessor>();
 #endif
 
+#if CONFIG_USE_AUDIO_DEBUGGER
+    audio_debugger_ = std::make_unique<AudioDebugger>();
+#endif
+
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
+#if CONFIG_USE_AUDIO_DEBUGGER
+        audio_debugger_->Feed(kAudioDebugStreamProcessed, data.data(), data.size(), 1, 16000);
+#endif
         PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
     });
 
@@ -178,10 +186,7 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 
 #if CONFIG_USE_AUDIO_DEBUGGER
     // 音频调试：发送原始音频数据
-    if (audio_debugger_ == nullptr) {
-        audio_debugger_ = std::make_unique<AudioDebugger>();
-    }
-    audio_debugger_->Feed(data);
+    audio_debugger_->Feed(kAudioDebugStreamInput, data.data(), data.size(), codec_->input_channels(), sample_rate);
 #endif
 
     return true;
@@ -269,12 +274,31 @@ void AudioService::AudioOutputTask() {
         audio_queue_cv_.notify_all();
         lock.unlock();
 
+        // Marked busy before the epoch check, so StopPlayback() either sees this frame in flight or this sees the new epoch
+        output_busy_ = true;
+        if (task->epoch != playback_epoch_) {
+            output_busy_ = false;
+            OnPlaybackSilenced();
+            continue;
+        }
+        int gain = playback_gain_;
+        if (gain != PLAYBACK_GAIN_UNITY) {
+            for (auto& sample : task->pcm) {
+                sample = (sample * gain) >> 8;
+            }
+        }
+
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
+#if CONFIG_USE_AUDIO_DEBUGGER
+        audio_debugger_->Feed(kAudioDebugStreamPlayback, task->pcm.data(), task->pcm.size(), 1, codec_->output_sample_rate());
+#endif
         codec_->OutputData(task->pcm);
+        output_busy_ = false;
+        OnPlaybackSilenced();
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
@@ -297,7 +321,7 @@ void AudioService::OpusCodecTask() {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
         audio_queue_cv_.wait(lock, [this]() {
             return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
+                !audio_encode_queue_.empty() ||
                 (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
         });
         if (service_stopped_) {
@@ -309,11 +333,13 @@ void AudioService::OpusCodecTask() {
             auto packet = std::move(audio_decode_queue_.front());
             audio_decode_queue_.pop_front();
             audio_queue_cv_.notify_all();
+            uint32_t epoch = playback_epoch_;
             lock.unlock();
 
             auto task = std::make_unique<AudioTask>();
             task->type = kAudioTaskTypeDecodeToPlaybackQueue;
             task->timestamp = packet->timestamp;
+            task->epoch = epoch;
 
             SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
             if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
@@ -336,10 +362,13 @@ void AudioService::OpusCodecTask() {
         }
         
         /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
+        if (!audio_encode_queue_.empty()) {
             auto task = std::move(audio_encode_queue_.front());
             audio_encode_queue_.pop_front();
             audio_queue_cv_.notify_all();
+            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+                opus_encoder_->SetBitrate(uplink_rate_.Update(audio_send_queue_.size(), esp_timer_get_time()));
+            }
             lock.unlock();
 
             auto packet = std::make_unique<AudioStreamPacket>();
@@ -354,7 +383,7 @@ void AudioService::OpusCodecTask() {
             if (task->type == kAudioTaskTypeEncodeToSendQueue) {
                 {
                     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
+                    PushPacketToSendQueue(std::move(packet));
                 }
                 if (callbacks_.on_send_queue_available) {
                     callbacks_.on_send_queue_available();
@@ -423,6 +452,25 @@ bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> pa
     return true;
 }
 
+// Called with audio_queue_mutex_ held
+void AudioService::PushPacketToSendQueue(std::unique_ptr<AudioStreamPacket> packet) {
+    auto& stats = uplink_rate_.stats();
+    if (uplink_drop_policy_ == kUplinkDropOldest) {
+        while (audio_send_queue_.size() >= MAX_REALTIME_SEND_PACKETS_IN_QUEUE) {
+            audio_send_queue_.pop_front();
+            if (stats.dropped_oldest++ == 0) {
+                ESP_LOGW(TAG, "Send queue is full, dropping the oldest audio");
+            }
+        }
+    } else if (audio_send_queue_.size() >= MAX_SEND_PACKETS_IN_QUEUE) {
+        if (stats.dropped_newest++ == 0) {
+            ESP_LOGW(TAG, "Send queue is full, dropping new audio");
+        }
+        return;
+    }
+    audio_send_queue_.push_back(std::move(packet));
+}
+
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     if (audio_send_queue_.empty()) {
@@ -430,10 +478,21 @@ std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
     }
     auto packet = std::move(audio_send_queue_.front());
     audio_send_queue_.pop_front();
+    uplink_rate_.OnPacketSent(packet->payload.size(), audio_send_queue_.size(), esp_timer_get_time());
     audio_queue_cv_.notify_all();
     return packet;
 }
 
+void AudioService::SetUplinkDropPolicy(UplinkDropPolicy policy) {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    uplink_drop_policy_ = policy;
+}
+
+UplinkStats AudioService::GetUplinkStats() {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    return uplink_rate_.stats();
+}
+
 void AudioService::EncodeWakeWord() {
     if (wake_word_) {
         wake_word_->EncodeWakeWordData();
@@ -490,6 +549,12 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     } else {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+
+        auto stats = GetUplinkStats();
+        if (stats.dropped_oldest > 0 || stats.dropped_newest > 0) {
+            ESP_LOGW(TAG, "Uplink dropped %lu oldest / %lu newest packets so far, bitrate %d bps",
+                stats.dropped_oldest, stats.dropped_newest, stats.bitrate);
+        }
     }
 }
 
@@ -626,6 +691,7 @@ bool AudioService::IsIdle() {
 
 void AudioService::ResetDecoder() {
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    playback_gain_ = PLAYBACK_GAIN_UNITY;
     opus_decoder_->ResetState();
     timestamp_queue_.clear();
     audio_decode_queue_.clear();
@@ -634,6 +700,54 @@ void AudioService::ResetDecoder() {
     audio_queue_cv_.notify_all();
 }
 
+void AudioService::StopPlayback() {
+    auto now = esp_timer_get_time();
+    bool playing;
+    {
+        // Bumped under the lock so the codec task cannot stamp a stale packet with the new epoch
+        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+        // Only count stops that had something to silence, a repeated abort is not a barge-in
+        playing = output_busy_ || !audio_playback_queue_.empty() || !audio_decode_queue_.empty();
+        if (playing) {
+            stop_playback_time_ = now;
+            silence_pending_ = true;
+        }
+        playback_epoch_++;
+        audio_decode_queue_.clear();
+        audio_playback_queue_.clear();
+        audio_queue_cv_.notify_all();
+    }
+    if (playing && !output_busy_) {
+        OnPlaybackSilenced();
+    }
+}
+
+void AudioService::DuckPlayback(bool duck) {
+    int gain = duck ? PLAYBACK_DUCK_GAIN : PLAYBACK_GAIN_UNITY;
+    if (playback_gain_.exchange(gain) != gain) {
+        ESP_LOGI(TAG, "%s playback", duck ? "Ducking" : "Restoring");
+    }
+}
+
+// Called by the output task after every frame, and by StopPlayback() when nothing was playing
+void AudioService::OnPlaybackSilenced() {
+    if (!silence_pending_.exchange(false)) {
+        return;
+    }
+    int latency = (esp_timer_get_time() - stop_playback_time_) / 1000;
+    std::lock_guard<std::mutex> lock(barge_in_mutex_);
+    barge_in_stats_.count++;
+    barge_in_stats_.last_latency_ms = latency;
+    barge_in_stats_.max_latency_ms = std::max(barge_in_stats_.max_latency_ms, latency);
+    barge_in_stats_.total_latency_ms += latency;
+    ESP_LOGI(TAG, "Playback stopped, silent after %d ms", latency);
+}
+
+BargeInStats AudioService::GetBargeInStats() {
+    std::lock_guard<std::mutex> lock(barge_in_mutex_);
+    return barge_in_stats_;
+}
+
 void AudioService::CheckAndUpdateAudioPowerState() {
     auto now = std::chrono::steady_clock::now();
     auto input_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_input_time_).count();
@@ -6,6 +6,7 @@
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -22,6 +23,8 @@
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
+#include "uplink_encoder.h"
+#include "uplink_rate_controller.h"
 
 
 /*
@@ -40,9 +43,15 @@
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
 #define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
 #define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+// In realtime mode older speech is worthless, keep at most this much queued
+#define MAX_REALTIME_SEND_PACKETS_IN_QUEUE (600 / OPUS_FRAME_DURATION_MS)
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
 
+// Playback gain in 1/256 steps, ducking lowers the assistant by 12 dB while the user talks over it
+#define PLAYBACK_GAIN_UNITY 256
+#define PLAYBACK_DUCK_GAIN 64
+
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
 
@@ -52,6 +61,16 @@
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
 
+/*
+ * What to throw away when the send queue is full, the microphone never waits for the network.
+ * DropNewest keeps the start of an utterance intact for turn based listening,
+ * DropOldest keeps the latency bounded for realtime conversation.
+ */
+enum UplinkDropPolicy {
+    kUplinkDropNewest,
+    kUplinkDropOldest,
+};
+
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
@@ -70,6 +89,14 @@ struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    uint32_t epoch = 0;     // Playback epoch the frame was decoded in, see StopPlayback()
+};
+
+struct BargeInStats {
+    uint32_t count = 0;
+    int last_latency_ms = 0;    // From StopPlayback() until no more assistant audio is written
+    int max_latency_ms = 0;
+    int64_t total_latency_ms = 0;
 };
 
 struct DebugStatistics {
@@ -95,6 +122,9 @@ public:
     bool IsWakeWordRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_WAKE_WORD_RUNNING; }
     bool IsAudioProcessorRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_PROCESSOR_RUNNING; }
     bool IsAfeWakeWord();
+    AudioProcessorStats GetAudioProcessorStats() { return audio_processor_->GetStats(); }
+    bool SetAudioProcessorProfile(const std::string& profile) { return audio_processor_->SetProfile(profile); }
+    std::string GetAudioProcessorProfile() { return audio_processor_->GetProfile(); }
 
     void EnableWakeWordDetection(bool enable);
     void EnableVoiceProcessing(bool enable);
@@ -102,6 +132,12 @@ public:
     void EnableDeviceAec(bool enable);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
+    void SetUplinkDropPolicy(UplinkDropPolicy policy);
+    UplinkStats GetUplinkStats();
+    // Local barge-in: silence the assistant within one frame, without waiting for the server
+    void StopPlayback();
+    void DuckPlayback(bool duck);
+    BargeInStats GetBargeInStats();
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
@@ -116,7 +152,9 @@ private:
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
-    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
+    std::unique_ptr<UplinkEncoder> opus_encoder_;
+    UplinkRateController uplink_rate_;
+    UplinkDropPolicy uplink_drop_policy_ = kUplinkDropNewest;
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
     OpusResampler input_resampler_;
     OpusResampler reference_resampler_;
@@ -140,6 +178,15 @@ private:
     // For server AEC
     std::deque<uint32_t> timestamp_queue_;
 
+    // Barge-in, the output task checks these without taking audio_queue_mutex_
+    std::atomic<uint32_t> playback_epoch_ = 0;
+    std::atomic<int> playback_gain_ = PLAYBACK_GAIN_UNITY;
+    std::atomic<bool> output_busy_ = false;
+    std::atomic<bool> silence_pending_ = false;
+    std::atomic<int64_t> stop_playback_time_ = 0;
+    std::mutex barge_in_mutex_;
+    BargeInStats barge_in_stats_;
+
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
     bool voice_detected_ = false;
@@ -154,8 +201,10 @@ private:
     void AudioOutputTask();
     void OpusCodecTask();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void PushPacketToSendQueue(std::unique_ptr<AudioStreamPacket> packet);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
+    void OnPlaybackSilenced();
 };
 
 #endif
\ No newline at end of file
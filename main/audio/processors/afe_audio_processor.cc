@@ -1,10 +1,70 @@
 #include "afe_audio_processor.h"
 #include <esp_log.h>
+#include <esp_timer.h>
+
+#include "settings.h"
 
 #define PROCESSOR_RUNNING 0x01
+#define PROFILE_CHANGED 0x02
+#define STATS_REPORT_INTERVAL_US (10 * 1000 * 1000)
 
 #define TAG "AfeAudioProcessor"
 
+#if CONFIG_AFE_PROFILE_LOW_POWER
+#define DEFAULT_AFE_PROFILE "low_power"
+#elif CONFIG_AFE_PROFILE_BALANCED
+#define DEFAULT_AFE_PROFILE "balanced"
+#else
+#define DEFAULT_AFE_PROFILE "high_quality"
+#endif
+
+struct AfeProfile {
+    const char* name;
+    afe_mode_t afe_mode;
+    aec_mode_t aec_mode;
+    bool ns_enabled;
+    vad_mode_t vad_mode;
+    int vad_min_speech_ms;
+    int vad_min_noise_ms;
+    afe_memory_alloc_mode_t memory_alloc_mode;
+};
+
+// ESP-SR VAD modes trigger on speech more readily as the number grows, VAD_MODE_0 is the hardest to trigger.
+// low_power: no NS, the least eager VAD mode, needs longer speech before triggering so short noises do not
+//            open the uplink, and waits longer before ending speech.
+// balanced:  NS on, a slightly more eager VAD with moderate speech and silence durations.
+// high_quality: the previous fixed settings, the ESP-SR default speech duration and the lowest end-of-speech delay.
+// low_power and high_quality keep the larger buffers in PSRAM, balanced splits them with internal RAM.
+static const AfeProfile kAfeProfiles[] = {
+    {"low_power", AFE_MODE_LOW_COST, AEC_MODE_VOIP_LOW_COST, false, VAD_MODE_0, 256, 300, AFE_MEMORY_ALLOC_MORE_PSRAM},
+    {"balanced", AFE_MODE_LOW_COST, AEC_MODE_VOIP_LOW_COST, true, VAD_MODE_1, 192, 200, AFE_MEMORY_ALLOC_INTERNAL_PSRAM_BALANCE},
+    {"high_quality", AFE_MODE_HIGH_PERF, AEC_MODE_VOIP_HIGH_PERF, true, VAD_MODE_0, 128, 100, AFE_MEMORY_ALLOC_MORE_PSRAM},
+};
+
+static const AfeProfile* FindAfeProfile(const std::string& name) {
+    for (const auto& profile : kAfeProfiles) {
+        if (name == profile.name) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER
+#define TASK_TIME_IS_CPU_TIME 1
+#else
+#define TASK_TIME_IS_CPU_TIME 0
+#endif
+
+#if TASK_TIME_IS_CPU_TIME
+// CPU time of the calling task. The counter only advances when the task is switched out, which happens
+// at the wait for fed data inside each fetch while processing keeps up, so the delta between samples
+// taken once per chunk covers a whole chunk. Nothing yields to close the current slice.
+static uint32_t GetTaskCpuTimeUs() {
+    return ulTaskGetRunTimeCounter(xTaskGetCurrentTaskHandle());
+}
+#endif
+
 AfeAudioProcessor::AfeAudioProcessor()
     : afe_data_(nullptr) {
     event_group_ = xEventGroupCreate();
@@ -19,33 +79,59 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
-    std::string input_format;
     for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
-        input_format.push_back('M');
+        input_format_.push_back('M');
     }
     for (int i = 0; i < ref_num; i++) {
-        input_format.push_back('R');
+        input_format_.push_back('R');
     }
 
-    srmodel_list_t *models;
     if (models_list == nullptr) {
-        models = esp_srmodel_init("model");
+        models_ = esp_srmodel_init("model");
     } else {
-        models = models_list;
+        models_ = models_list;
     }
 
-    char* ns_model_name = esp_srmodel_filter(models, ESP_NSNET_PREFIX, NULL);
-    char* vad_model_name = esp_srmodel_filter(models, ESP_VADN_PREFIX, NULL);
+#ifdef CONFIG_USE_DEVICE_AEC
+    device_aec_enabled_ = true;
+#endif
+
+    Settings settings("audio", false);
+    {
+        std::lock_guard<std::mutex> lock(afe_mutex_);
+        CreateAfe(settings.GetString("afe_profile", DEFAULT_AFE_PROFILE));
+    }
     
-    afe_config_t* afe_config = afe_config_init(input_format.c_str(), NULL, AFE_TYPE_VC, AFE_MODE_HIGH_PERF);
-    afe_config->aec_mode = AEC_MODE_VOIP_HIGH_PERF;
-    afe_config->vad_mode = VAD_MODE_0;
-    afe_config->vad_min_noise_ms = 100;
+    xTaskCreate([](void* arg) {
+        auto this_ = (AfeAudioProcessor*)arg;
+        this_->AudioProcessorTask();
+        vTaskDelete(NULL);
+    }, "audio_communication", 4096, this, 3, NULL);
+}
+
+// Must be called with afe_mutex_ held
+void AfeAudioProcessor::CreateAfe(const std::string& profile) {
+    const AfeProfile* selected = FindAfeProfile(profile);
+    if (selected == nullptr) {
+        ESP_LOGW(TAG, "Unknown audio processing profile: %s", profile.c_str());
+        selected = FindAfeProfile(DEFAULT_AFE_PROFILE);
+    }
+    profile_ = selected->name;
+
+    char* ns_model_name = esp_srmodel_filter(models_, ESP_NSNET_PREFIX, NULL);
+    char* vad_model_name = esp_srmodel_filter(models_, ESP_VADN_PREFIX, NULL);
+    
+    afe_config_t* afe_config = afe_config_init(input_format_.c_str(), NULL, AFE_TYPE_VC, selected->afe_mode);
+    afe_config->aec_mode = selected->aec_mode;
+    afe_config->vad_mode = selected->vad_mode;
+    afe_config->vad_min_speech_ms = selected->vad_min_speech_ms;
+    afe_config->vad_min_noise_ms = selected->vad_min_noise_ms;
     if (vad_model_name != nullptr) {
         afe_config->vad_model_name = vad_model_name;
     }
 
-    if (ns_model_name != nullptr) {
+    ns_enabled_ = selected->ns_enabled && ns_model_name != nullptr;
+    if (ns_enabled_) {
         afe_config->ns_init = true;
         afe_config->ns_model_name = ns_model_name;
         afe_config->afe_ns_mode = AFE_NS_MODE_NET;
@@ -54,7 +140,7 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
     }
 
     afe_config->agc_init = false;
-    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+    afe_config->memory_alloc_mode = selected->memory_alloc_mode;
 
 #ifdef CONFIG_USE_DEVICE_AEC
     afe_config->aec_init = true;
@@ -66,12 +152,16 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
 
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
-    
-    xTaskCreate([](void* arg) {
-        auto this_ = (AfeAudioProcessor*)arg;
-        this_->AudioProcessorTask();
-        vTaskDelete(NULL);
-    }, "audio_communication", 4096, this, 3, NULL);
+    afe_config_free(afe_config);
+
+#ifdef CONFIG_USE_DEVICE_AEC
+    // Keep the AEC state selected before the profile change
+    if (!device_aec_enabled_) {
+        afe_iface_->disable_aec(afe_data_);
+        afe_iface_->enable_vad(afe_data_);
+    }
+#endif
+    ESP_LOGI(TAG, "Audio processing profile: %s", profile_.c_str());
 }
 
 AfeAudioProcessor::~AfeAudioProcessor() {
@@ -82,6 +172,7 @@ AfeAudioProcessor::~AfeAudioProcessor() {
 }
 
 size_t AfeAudioProcessor::GetFeedSize() {
+    std::lock_guard<std::mutex> lock(afe_mutex_);
     if (afe_data_ == nullptr) {
         return 0;
     }
@@ -89,9 +180,18 @@ size_t AfeAudioProcessor::GetFeedSize() {
 }
 
 void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
+    std::lock_guard<std::mutex> lock(afe_mutex_);
     if (afe_data_ == nullptr) {
         return;
     }
+    // The chunk may have been sized by GetFeedSize() before a profile switch rebuilt the AFE,
+    // feed() reads exactly one chunk of the current size from the pointer
+    size_t expected = afe_iface_->get_feed_chunksize(afe_data_) * input_format_.size();
+    if (data.size() != expected) {
+        dropped_feeds_++;
+        ESP_LOGW(TAG, "Dropped a %u sample chunk, the AFE expects %u", (unsigned)data.size(), (unsigned)expected);
+        return;
+    }
     afe_iface_->feed(afe_data_, data.data());
 }
 
@@ -101,6 +201,7 @@ void AfeAudioProcessor::Start() {
 
 void AfeAudioProcessor::Stop() {
     xEventGroupClearBits(event_group_, PROCESSOR_RUNNING);
+    std::lock_guard<std::mutex> lock(afe_mutex_);
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
     }
@@ -124,19 +225,46 @@ void AfeAudioProcessor::AudioProcessorTask() {
     ESP_LOGI(TAG, "Audio communication task started, feed size: %d fetch size: %d",
         feed_size, fetch_size);
 
+    // Each fetched chunk carries fetch_size samples at 16kHz, processing must keep up with that
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.budget_us = fetch_size * 1000 / 16;
+    }
+    [[maybe_unused]] bool cpu_sampled = false;
+#if TASK_TIME_IS_CPU_TIME
+    uint32_t cpu_last = 0;
+    uint32_t cpu_chunks = 0;
+#endif
+
     while (true) {
-        xEventGroupWaitBits(event_group_, PROCESSOR_RUNNING, pdFALSE, pdTRUE, portMAX_DELAY);
+        auto bits = xEventGroupWaitBits(event_group_, PROCESSOR_RUNNING | PROFILE_CHANGED, pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & PROFILE_CHANGED) {
+            // The AFE is rebuilt here, the only place that fetches from it
+            xEventGroupClearBits(event_group_, PROFILE_CHANGED);
+            ApplyPendingProfile();
+            cpu_sampled = false;
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_.budget_us = afe_iface_->get_fetch_chunksize(afe_data_) * 1000 / 16;
+            continue;
+        }
+        if ((bits & PROCESSOR_RUNNING) == 0) {
+            continue;
+        }
 
         auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
         if ((xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING) == 0) {
+            // The next chunk after a restart would carry the time spent stopped
+            cpu_sampled = false;
             continue;
         }
         if (res == nullptr || res->ret_value == ESP_FAIL) {
             if (res != nullptr) {
                 ESP_LOGI(TAG, "Error code: %d", res->ret_value);
             }
+            cpu_sampled = false;
             continue;
         }
+        int64_t output_start = esp_timer_get_time();
 
         // VAD state change
         if (vad_state_change_callback_) {
@@ -169,18 +297,162 @@ void AfeAudioProcessor::AudioProcessorTask() {
                 }
             }
         }
+
+        uint32_t output_us = (uint32_t)(esp_timer_get_time() - output_start);
+#if TASK_TIME_IS_CPU_TIME
+        uint32_t cpu_now = GetTaskCpuTimeUs();
+        if (!cpu_sampled) {
+            cpu_sampled = true;
+            cpu_last = cpu_now;
+            cpu_chunks = 0;
+            continue;
+        }
+        // Behind schedule the task may not be switched out for several chunks, spread the time over them
+        cpu_chunks++;
+        if (cpu_now != cpu_last) {
+            uint32_t chunk_us = (cpu_now - cpu_last) / cpu_chunks;
+            UpdateStats(chunk_us > output_us ? chunk_us - output_us : 0, output_us);
+            cpu_last = cpu_now;
+            cpu_chunks = 0;
+        }
+#else
+        UpdateStats(0, output_us);
+#endif
+    }
+}
+
+// Without run time stats only the output handling can be timed, processing happens inside the blocking
+// fetch and cannot be told apart from the wait, so process_us is passed as 0 and no headroom is derived.
+void AfeAudioProcessor::UpdateStats(uint32_t process_us, uint32_t output_us) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.chunks++;
+#if TASK_TIME_IS_CPU_TIME
+    uint32_t total_us = process_us + output_us;
+    if (total_us > stats_.budget_us) {
+        stats_.overruns++;
+    }
+    if (total_us > stats_.max_total_us) {
+        stats_.max_total_us = total_us;
+    }
+#endif
+
+    // Exponential moving average over roughly the last 16 chunks
+    if (stats_.chunks == 1) {
+        stats_.process_us = process_us;
+        stats_.output_us = output_us;
+    } else {
+        stats_.process_us = (stats_.process_us * 15 + process_us) / 16;
+        stats_.output_us = (stats_.output_us * 15 + output_us) / 16;
+    }
+#if TASK_TIME_IS_CPU_TIME
+    int used_percent = (int)((uint64_t)(stats_.process_us + stats_.output_us) * 100 / stats_.budget_us);
+    stats_.headroom_percent = 100 - used_percent;
+#endif
+
+    CheckHeadroom();
+}
+
+// Called with stats_mutex_ held
+void AfeAudioProcessor::CheckHeadroom() {
+    int64_t now = esp_timer_get_time();
+    if (now - last_report_time_ >= STATS_REPORT_INTERVAL_US) {
+        if (stats_.overruns != last_report_overruns_) {
+            ESP_LOGW(TAG, "Overruns: %lu/%lu, headroom: %d%%, process: %luus, output: %luus, max: %luus, budget: %luus",
+                stats_.overruns, stats_.chunks, stats_.headroom_percent, stats_.process_us, stats_.output_us,
+                stats_.max_total_us, stats_.budget_us);
+            last_report_overruns_ = stats_.overruns;
+        }
+        last_report_time_ = now;
+    }
+
+#if CONFIG_AFE_AUTO_DEGRADE && TASK_TIME_IS_CPU_TIME
+    // Wait for the average to settle before acting on it
+    if (stats_.chunks - last_degrade_chunk_ < 16 || stats_.headroom_percent >= CONFIG_AFE_DEGRADE_HEADROOM_PERCENT) {
+        return;
+    }
+    if (ns_enabled_) {
+        ESP_LOGW(TAG, "Headroom %d%% below %d%%, disabling noise suppression", stats_.headroom_percent,
+            CONFIG_AFE_DEGRADE_HEADROOM_PERCENT);
+        afe_iface_->disable_ns(afe_data_);
+        ns_enabled_ = false;
+        stats_.degrade_level++;
+        last_degrade_chunk_ = stats_.chunks;
+    }
+#endif
+}
+
+AudioProcessorStats AfeAudioProcessor::GetStats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    AudioProcessorStats stats = stats_;
+#if !TASK_TIME_IS_CPU_TIME
+    // Processing time is not measurable, a headroom would be meaningless
+    stats.headroom_percent = -1;
+#endif
+    stats.dropped_feeds = dropped_feeds_;
+    return stats;
+}
+
+bool AfeAudioProcessor::SetProfile(const std::string& profile) {
+    if (FindAfeProfile(profile) == nullptr) {
+        ESP_LOGE(TAG, "Unknown audio processing profile: %s", profile.c_str());
+        return false;
+    }
+
+    Settings settings("audio", true);
+    settings.SetString("afe_profile", profile);
+
+    std::lock_guard<std::mutex> lock(afe_mutex_);
+    if (afe_data_ != nullptr && profile != profile_) {
+        pending_profile_ = profile;
+        xEventGroupSetBits(event_group_, PROFILE_CHANGED);
+    }
+    return true;
+}
+
+std::string AfeAudioProcessor::GetProfile() {
+    std::lock_guard<std::mutex> lock(afe_mutex_);
+    if (afe_data_ == nullptr) {
+        Settings settings("audio", false);
+        return settings.GetString("afe_profile", DEFAULT_AFE_PROFILE);
+    }
+    return profile_;
+}
+
+void AfeAudioProcessor::ApplyPendingProfile() {
+    {
+        std::lock_guard<std::mutex> lock(afe_mutex_);
+        if (pending_profile_.empty() || pending_profile_ == profile_) {
+            return;
+        }
+        afe_iface_->destroy(afe_data_);
+        CreateAfe(pending_profile_);
+        pending_profile_.clear();
+    }
+
+    output_buffer_.clear();
+    if (is_speaking_) {
+        is_speaking_ = false;
+        if (vad_state_change_callback_) {
+            vad_state_change_callback_(false);
+        }
     }
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.degrade_level = 0;
+    last_degrade_chunk_ = stats_.chunks;
 }
 
 void AfeAudioProcessor::EnableDeviceAec(bool enable) {
+    std::lock_guard<std::mutex> lock(afe_mutex_);
     if (enable) {
 #if CONFIG_USE_DEVICE_AEC
+        device_aec_enabled_ = true;
         afe_iface_->disable_vad(afe_data_);
         afe_iface_->enable_aec(afe_data_);
 #else
         ESP_LOGE(TAG, "Device AEC is not supported");
 #endif
     } else {
+        device_aec_enabled_ = false;
         afe_iface_->disable_aec(afe_data_);
         afe_iface_->enable_vad(afe_data_);
     }
@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <mutex>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
@@ -27,6 +29,9 @@ public:
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
+    AudioProcessorStats GetStats() override;
+    bool SetProfile(const std::string& profile) override;
+    std::string GetProfile() override;
 
 private:
     EventGroupHandle_t event_group_ = nullptr;
@@ -35,11 +40,29 @@ private:
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
+    srmodel_list_t* models_ = nullptr;
+    std::string input_format_;
+    std::mutex afe_mutex_;
+    std::string profile_;
+    std::string pending_profile_;
+    bool device_aec_enabled_ = false;
     int frame_samples_ = 0;
     bool is_speaking_ = false;
     std::vector<int16_t> output_buffer_;
+    bool ns_enabled_ = false;
+    // Written by the processing task, read by GetStats() from any task
+    std::mutex stats_mutex_;
+    AudioProcessorStats stats_;
+    std::atomic<uint32_t> dropped_feeds_ = 0;
+    uint32_t last_degrade_chunk_ = 0;
+    uint32_t last_report_overruns_ = 0;
+    int64_t last_report_time_ = 0;
 
     void AudioProcessorTask();
+    void CreateAfe(const std::string& profile);
+    void ApplyPendingProfile();
+    void UpdateStats(uint32_t process_us, uint32_t output_us);
+    void CheckHeadroom();
 };
 
 #endif 
\ No newline at end of file
@@ -3,15 +3,40 @@
 
 #if CONFIG_USE_AUDIO_DEBUGGER
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <errno.h>
 #include <cstring>
 #include <string>
+#include <algorithm>
 #endif
 
 #define TAG "AudioDebugger"
 
+#ifndef CONFIG_AUDIO_DEBUG_RING_SIZE_KB
+#define CONFIG_AUDIO_DEBUG_RING_SIZE_KB 32
+#endif
+
+// Keep packets below the typical MTU
+#define MAX_PACKET_PAYLOAD 1024
+
+#if CONFIG_USE_AUDIO_DEBUGGER
+static const int kAdpcmIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static const int kAdpcmStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+#endif
+
 
 AudioDebugger::AudioDebugger() {
 #if CONFIG_USE_AUDIO_DEBUGGER
@@ -20,16 +45,16 @@ AudioDebugger::AudioDebugger() {
         // 解析配置的服务器地址 "IP:PORT"
         std::string server_addr = CONFIG_AUDIO_DEBUG_UDP_SERVER;
         size_t colon_pos = server_addr.find(':');
-        
+
         if (colon_pos != std::string::npos) {
             std::string ip = server_addr.substr(0, colon_pos);
             int port = std::stoi(server_addr.substr(colon_pos + 1));
-            
+
             memset(&udp_server_addr_, 0, sizeof(udp_server_addr_));
             udp_server_addr_.sin_family = AF_INET;
             udp_server_addr_.sin_port = htons(port);
             inet_pton(AF_INET, ip.c_str(), &udp_server_addr_.sin_addr);
-            
+
             ESP_LOGI(TAG, "Initialized server address: %s", CONFIG_AUDIO_DEBUG_UDP_SERVER);
         } else {
             ESP_LOGW(TAG, "Invalid server address: %s, should be IP:PORT", CONFIG_AUDIO_DEBUG_UDP_SERVER);
@@ -39,11 +64,68 @@ AudioDebugger::AudioDebugger() {
     } else {
         ESP_LOGW(TAG, "Failed to create UDP socket: %d", errno);
     }
+    if (udp_sockfd_ < 0) {
+        return;
+    }
+
+    bool enabled_streams[kAudioDebugStreamCount] = {
+        true,
+#if CONFIG_AUDIO_DEBUG_STREAM_PROCESSED
+        true,
+#else
+        false,
+#endif
+#if CONFIG_AUDIO_DEBUG_STREAM_PLAYBACK
+        true,
+#else
+        false,
+#endif
+    };
+
+    // The ring size must be a power of two so positions can be masked
+    size_t ring_size = 1;
+    while (ring_size < CONFIG_AUDIO_DEBUG_RING_SIZE_KB * 1024) {
+        ring_size <<= 1;
+    }
+    for (int i = 0; i < kAudioDebugStreamCount; i++) {
+        if (!enabled_streams[i]) {
+            continue;
+        }
+        auto buffer = (uint8_t*)heap_caps_malloc(ring_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buffer == nullptr) {
+            buffer = (uint8_t*)heap_caps_malloc(ring_size, MALLOC_CAP_8BIT);
+        }
+        if (buffer == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate ring buffer for stream %d", i);
+            continue;
+        }
+        rings_[i].buffer = buffer;
+        rings_[i].size = ring_size;
+    }
+
+    running_ = true;
+    TaskHandle_t task = nullptr;
+    xTaskCreate([](void* arg) {
+        auto this_ = (AudioDebugger*)arg;
+        this_->SenderTask();
+        this_->sender_task_ = nullptr;
+        vTaskDelete(NULL);
+    }, "audio_debugger", 4096, this, 1, &task);
+    sender_task_ = task;
 #endif
 }
 
 AudioDebugger::~AudioDebugger() {
 #if CONFIG_USE_AUDIO_DEBUGGER
+    running_ = false;
+    while (sender_task_ != nullptr) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    for (auto& ring : rings_) {
+        if (ring.buffer != nullptr) {
+            heap_caps_free(ring.buffer);
+        }
+    }
     if (udp_sockfd_ >= 0) {
         close(udp_sockfd_);
         ESP_LOGI(TAG, "Closed UDP socket");
@@ -51,18 +133,204 @@ AudioDebugger::~AudioDebugger() {
 #endif
 }
 
-void AudioDebugger::Feed(const std::vector<int16_t>& data) {
+void AudioDebugger::Feed(AudioDebugStream stream, const int16_t* data, size_t samples, int channels, int sample_rate) {
 #if CONFIG_USE_AUDIO_DEBUGGER
-    if (udp_sockfd_ >= 0) {
-        ssize_t sent = sendto(udp_sockfd_, data.data(), data.size() * sizeof(int16_t), 0,
+    auto& ring = rings_[stream];
+    if (ring.buffer == nullptr || channels <= 0 || samples == 0) {
+        return;
+    }
+
+    uint32_t frames = samples / channels;
+    if (ring.writing.exchange(true, std::memory_order_acquire)) {
+        // Another task is copying into this stream, never wait for it either
+        ring.frame_offset.fetch_add(frames, std::memory_order_relaxed);
+        ring.dropped_frames.fetch_add(frames, std::memory_order_relaxed);
+        return;
+    }
+    size_t total = sizeof(Record) + samples * sizeof(int16_t);
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    size_t tail = ring.tail.load(std::memory_order_acquire);
+    if (samples > UINT16_MAX || total > ring.size - (head - tail)) {
+        // Never wait for the sender, the gap shows up in frame_offset on the host
+        ring.frame_offset.fetch_add(frames, std::memory_order_relaxed);
+        ring.dropped_frames.fetch_add(frames, std::memory_order_relaxed);
+        ring.writing.store(false, std::memory_order_release);
+        return;
+    }
+
+    Record record = {
+        .frame_offset = ring.frame_offset.fetch_add(frames, std::memory_order_relaxed),
+        .sample_rate = (uint32_t)sample_rate,
+        .samples = (uint16_t)samples,
+        .channels = (uint8_t)channels,
+        .reserved = 0,
+    };
+    auto write = [&ring](size_t position, const void* source, size_t length) {
+        size_t offset = position & (ring.size - 1);
+        size_t first = std::min(length, ring.size - offset);
+        memcpy(ring.buffer + offset, source, first);
+        memcpy(ring.buffer, (const uint8_t*)source + first, length - first);
+    };
+    write(head, &record, sizeof(record));
+    write(head + sizeof(record), data, samples * sizeof(int16_t));
+    ring.head.store(head + total, std::memory_order_release);
+    ring.writing.store(false, std::memory_order_release);
+#endif
+}
+
+void AudioDebugger::SenderTask() {
+#if CONFIG_USE_AUDIO_DEBUGGER
+    ESP_LOGI(TAG, "Audio debugger sender started");
+    while (running_) {
+        bool drained = false;
+        for (int i = 0; i < kAudioDebugStreamCount; i++) {
+            drained |= DrainRing((AudioDebugStream)i);
+        }
+        if (!drained) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+#endif
+}
+
+bool AudioDebugger::DrainRing(AudioDebugStream stream) {
+#if CONFIG_USE_AUDIO_DEBUGGER
+    auto& ring = rings_[stream];
+    if (ring.buffer == nullptr) {
+        return false;
+    }
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+    size_t head = ring.head.load(std::memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+
+    auto read = [&ring](size_t position, void* destination, size_t length) {
+        size_t offset = position & (ring.size - 1);
+        size_t first = std::min(length, ring.size - offset);
+        memcpy(destination, ring.buffer + offset, first);
+        memcpy((uint8_t*)destination + first, ring.buffer, length - first);
+    };
+    Record record;
+    read(tail, &record, sizeof(record));
+    size_t length = record.samples * sizeof(int16_t);
+    record_buffer_.resize(length);
+    read(tail + sizeof(record), record_buffer_.data(), length);
+    ring.tail.store(tail + sizeof(record) + length, std::memory_order_release);
+
+    uint32_t dropped = ring.dropped_frames.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        ESP_LOGW(TAG, "Stream %d dropped %lu frames, sender is too slow", stream, dropped);
+    }
+
+    SendFrames(stream, record, (const int16_t*)record_buffer_.data());
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AudioDebugger::SendFrames(AudioDebugStream stream, const Record& record, const int16_t* samples) {
+#if CONFIG_USE_AUDIO_DEBUGGER
+    const int channels = record.channels;
+    const size_t total_frames = record.samples / channels;
+    const size_t frames_per_packet = MAX_PACKET_PAYLOAD / (channels * sizeof(int16_t));
+#if CONFIG_AUDIO_DEBUG_ADPCM
+    const uint8_t codec = channels <= AUDIO_DEBUG_MAX_ADPCM_CHANNELS ? AUDIO_DEBUG_CODEC_IMA_ADPCM : AUDIO_DEBUG_CODEC_PCM16;
+#else
+    const uint8_t codec = AUDIO_DEBUG_CODEC_PCM16;
+#endif
+    packet_buffer_.resize(sizeof(AudioDebugHeader) + MAX_PACKET_PAYLOAD);
+
+    for (size_t frame = 0; frame < total_frames; frame += frames_per_packet) {
+        size_t frames = std::min(frames_per_packet, total_frames - frame);
+        auto header = (AudioDebugHeader*)packet_buffer_.data();
+        header->magic = AUDIO_DEBUG_MAGIC;
+        header->stream = stream;
+        header->codec = codec;
+        header->channels = channels;
+        header->sequence = sequences_[stream]++;
+        header->frame_offset = record.frame_offset + frame;
+        header->sample_rate = record.sample_rate;
+
+        uint8_t* payload = packet_buffer_.data() + sizeof(AudioDebugHeader);
+        size_t payload_size;
+        if (codec == AUDIO_DEBUG_CODEC_IMA_ADPCM) {
+            payload_size = EncodeAdpcm(stream, samples + frame * channels, frames, channels, payload);
+        } else {
+            payload_size = frames * channels * sizeof(int16_t);
+            memcpy(payload, samples + frame * channels, payload_size);
+        }
+
+        ssize_t sent = sendto(udp_sockfd_, packet_buffer_.data(), sizeof(AudioDebugHeader) + payload_size, 0,
                              (struct sockaddr*)&udp_server_addr_, sizeof(udp_server_addr_));
         if (sent < 0) {
             ESP_LOGW(TAG, "Failed to send audio data to %s: %d", CONFIG_AUDIO_DEBUG_UDP_SERVER, errno);
-        } else {
-            ESP_LOGD(TAG, "Sent %d bytes audio data to %s", sent, CONFIG_AUDIO_DEBUG_UDP_SERVER);
         }
     }
 #endif
 }
 
- 
\ No newline at end of file
+/*
+ * IMA ADPCM, 4 bits per sample. The payload starts with the encoder state of every channel
+ * (int16 predictor, uint8 index, uint8 reserved) so that a lost packet does not desync the host,
+ * followed by the interleaved samples, two per byte, low nibble first.
+ */
+size_t AudioDebugger::EncodeAdpcm(AudioDebugStream stream, const int16_t* samples, size_t frames, int channels, uint8_t* output) {
+#if CONFIG_USE_AUDIO_DEBUGGER
+    uint8_t* out = output;
+    for (int ch = 0; ch < channels; ch++) {
+        auto& state = adpcm_states_[stream][ch];
+        int16_t predictor = (int16_t)state.predictor;
+        memcpy(out, &predictor, sizeof(predictor));
+        out[2] = (uint8_t)state.index;
+        out[3] = 0;
+        out += 4;
+    }
+
+    size_t nibble_count = 0;
+    for (size_t i = 0; i < frames * channels; i++) {
+        auto& state = adpcm_states_[stream][i % channels];
+        int step = kAdpcmStepTable[state.index];
+        int diff = samples[i] - state.predictor;
+        int nibble = 0;
+        if (diff < 0) {
+            nibble = 8;
+            diff = -diff;
+        }
+        int delta = step >> 3;
+        if (diff >= step) {
+            nibble |= 4;
+            diff -= step;
+            delta += step;
+        }
+        step >>= 1;
+        if (diff >= step) {
+            nibble |= 2;
+            diff -= step;
+            delta += step;
+        }
+        step >>= 1;
+        if (diff >= step) {
+            nibble |= 1;
+            delta += step;
+        }
+        state.predictor += (nibble & 8) ? -delta : delta;
+        state.predictor = std::clamp(state.predictor, -32768, 32767);
+        state.index = std::clamp(state.index + kAdpcmIndexTable[nibble], 0, 88);
+
+        if (nibble_count % 2 == 0) {
+            *out = nibble;
+        } else {
+            *out++ |= nibble << 4;
+        }
+        nibble_count++;
+    }
+    if (nibble_count % 2 != 0) {
+        out++;
+    }
+    return out - output;
+#else
+    return 0;
+#endif
+}
@@ -2,21 +2,93 @@
 #define AUDIO_DEBUGGER_H
 
 #include <vector>
+#include <atomic>
 #include <cstdint>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+#define AUDIO_DEBUG_MAGIC 0xAD
+
+#define AUDIO_DEBUG_CODEC_PCM16 0
+#define AUDIO_DEBUG_CODEC_IMA_ADPCM 1
+#define AUDIO_DEBUG_MAX_ADPCM_CHANNELS 4
+
+enum AudioDebugStream : uint8_t {
+    kAudioDebugStreamInput = 0,         // Raw input, reference channel interleaved if present
+    kAudioDebugStreamProcessed = 1,     // Audio processor output
+    kAudioDebugStreamPlayback = 2,      // Decoded downlink audio
+    kAudioDebugStreamCount
+};
+
+/*
+ * Every UDP packet starts with this header (little endian), followed by the samples.
+ * A gap in sequence means the packet was lost on the network,
+ * a gap in frame_offset without one in sequence means the device ring buffer overflowed.
+ */
+struct __attribute__((packed)) AudioDebugHeader {
+    uint8_t magic;
+    uint8_t stream;
+    uint8_t codec;
+    uint8_t channels;
+    uint32_t sequence;
+    uint32_t frame_offset;
+    uint32_t sample_rate;
+};
+
+/*
+ * The audio tasks copy samples into one ring per stream without blocking,
+ * a low priority task compresses and sends them, so the tap does not disturb the timing it observes.
+ * A stream may have more than one producer task (ReadAudioData is also called by the acoustic Wi-Fi
+ * config), one copies in at a time and a producer that finds the ring busy drops its chunk.
+ */
 class AudioDebugger {
 public:
     AudioDebugger();
     ~AudioDebugger();
 
-    void Feed(const std::vector<int16_t>& data);
+    void Feed(AudioDebugStream stream, const int16_t* data, size_t samples, int channels, int sample_rate);
 
 private:
+    struct Record {
+        uint32_t frame_offset;
+        uint32_t sample_rate;
+        uint16_t samples;
+        uint8_t channels;
+        uint8_t reserved;
+    };
+
+    struct Ring {
+        uint8_t* buffer = nullptr;
+        size_t size = 0;
+        std::atomic<bool> writing{false};   // Held by the producer copying in
+        std::atomic<size_t> head{0};        // Advanced by the producer holding writing only
+        std::atomic<size_t> tail{0};        // Advanced by the sender task only
+        std::atomic<uint32_t> frame_offset{0};  // Dropped chunks advance it too, leaving a gap
+        std::atomic<uint32_t> dropped_frames{0};
+    };
+
+    struct AdpcmState {
+        int predictor = 0;
+        int index = 0;
+    };
+
     int udp_sockfd_ = -1;
     struct sockaddr_in udp_server_addr_;
+    Ring rings_[kAudioDebugStreamCount];
+    uint32_t sequences_[kAudioDebugStreamCount] = {};
+    AdpcmState adpcm_states_[kAudioDebugStreamCount][AUDIO_DEBUG_MAX_ADPCM_CHANNELS];
+    std::vector<uint8_t> record_buffer_;
+    std::vector<uint8_t> packet_buffer_;
+    std::atomic<bool> running_{false};
+    std::atomic<TaskHandle_t> sender_task_{nullptr};
+
+    void SenderTask();
+    bool DrainRing(AudioDebugStream stream);
+    void SendFrames(AudioDebugStream stream, const Record& record, const int16_t* samples);
+    size_t EncodeAdpcm(AudioDebugStream stream, const int16_t* samples, size_t frames, int channels, uint8_t* output);
 };
 
-#endif 
\ No newline at end of file
+#endif
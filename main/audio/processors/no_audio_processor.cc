@@ -57,3 +57,16 @@ void NoAudioProcessor::EnableDeviceAec(bool enable) {
         ESP_LOGE(TAG, "Device AEC is not supported");
     }
 }
+
+AudioProcessorStats NoAudioProcessor::GetStats() {
+    return AudioProcessorStats();
+}
+
+bool NoAudioProcessor::SetProfile(const std::string& profile) {
+    ESP_LOGW(TAG, "Audio processing profiles are not supported");
+    return false;
+}
+
+std::string NoAudioProcessor::GetProfile() {
+    return "";
+}
@@ -1,6 +1,7 @@
 #ifndef DUMMY_AUDIO_PROCESSOR_H
 #define DUMMY_AUDIO_PROCESSOR_H
 
+#include <string>
 #include <vector>
 #include <functional>
 
@@ -21,6 +22,9 @@ public:
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
+    AudioProcessorStats GetStats() override;
+    bool SetProfile(const std::string& profile) override;
+    std::string GetProfile() override;
 
 private:
     AudioCodec* codec_ = nullptr;
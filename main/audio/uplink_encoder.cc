@@ -0,0 +1,66 @@
+#include "uplink_encoder.h"
+
+#include <esp_log.h>
+
+#define TAG "UplinkEncoder"
+
+// Enough for any frame at the bitrates the uplink uses
+#define MAX_OPUS_PACKET_SIZE 1500
+
+UplinkEncoder::UplinkEncoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), channels_(channels), duration_ms_(duration_ms) {
+    frame_size_ = sample_rate / 1000 * channels * duration_ms;
+
+    int error;
+    encoder_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &error);
+    if (encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", error);
+        return;
+    }
+    opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(bitrate_));
+}
+
+UplinkEncoder::~UplinkEncoder() {
+    if (encoder_ != nullptr) {
+        opus_encoder_destroy(encoder_);
+    }
+}
+
+void UplinkEncoder::SetComplexity(int complexity) {
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_COMPLEXITY(complexity));
+    }
+}
+
+void UplinkEncoder::SetBitrate(int bitrate) {
+    if (encoder_ == nullptr || bitrate == bitrate_) {
+        return;
+    }
+    bitrate_ = bitrate;
+    opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(bitrate));
+}
+
+bool UplinkEncoder::Encode(std::vector<int16_t>&& pcm, std::vector<uint8_t>& opus) {
+    if (encoder_ == nullptr) {
+        return false;
+    }
+    if ((int)pcm.size() != frame_size_) {
+        ESP_LOGE(TAG, "Audio data size %u does not match frame size %d", pcm.size(), frame_size_);
+        return false;
+    }
+
+    opus.resize(MAX_OPUS_PACKET_SIZE);
+    auto ret = opus_encode(encoder_, pcm.data(), frame_size_ / channels_, opus.data(), opus.size());
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to encode audio, error code: %ld", (long)ret);
+        return false;
+    }
+    opus.resize(ret);
+    return true;
+}
+
+void UplinkEncoder::ResetState() {
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_RESET_STATE);
+    }
+}
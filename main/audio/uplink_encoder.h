@@ -0,0 +1,36 @@
+#ifndef UPLINK_ENCODER_H
+#define UPLINK_ENCODER_H
+
+#include <vector>
+#include <cstdint>
+
+#include <opus.h>
+
+/*
+ * Opus encoder of the send path. OpusEncoderWrapper does not expose the bitrate, which the
+ * uplink rate control needs to change between frames, so this one talks to libopus directly.
+ * Takes exactly one frame of PCM per call, the audio processor already delivers whole frames.
+ */
+class UplinkEncoder {
+public:
+    UplinkEncoder(int sample_rate, int channels, int duration_ms);
+    ~UplinkEncoder();
+
+    void SetComplexity(int complexity);
+    void SetBitrate(int bitrate);
+    bool Encode(std::vector<int16_t>&& pcm, std::vector<uint8_t>& opus);
+    void ResetState();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+private:
+    OpusEncoder* encoder_ = nullptr;
+    int sample_rate_;
+    int channels_;
+    int duration_ms_;
+    int frame_size_;
+    int bitrate_ = OPUS_AUTO;
+};
+
+#endif // UPLINK_ENCODER_H
@@ -0,0 +1,72 @@
+#include "uplink_rate_controller.h"
+
+#include <esp_log.h>
+
+#define TAG "UplinkRate"
+
+static const int kBitrates[] = UPLINK_BITRATES;
+static const int kLevels = sizeof(kBitrates) / sizeof(kBitrates[0]);
+
+UplinkRateController::UplinkRateController() {
+    stats_.bitrate = kBitrates[0];
+}
+
+int UplinkRateController::bitrate() const {
+    return kBitrates[level_];
+}
+
+void UplinkRateController::SetLevel(int level, int64_t now_us) {
+    ESP_LOGI(TAG, "Uplink bitrate %d -> %d bps (throughput %lu bps)", kBitrates[level_], kBitrates[level],
+        stats_.throughput_bps);
+    level_ = level;
+    last_change_time_ = now_us;
+    stats_.bitrate = kBitrates[level];
+    stats_.bitrate_changes++;
+}
+
+int UplinkRateController::Update(size_t queue_depth, int64_t now_us) {
+    if (queue_depth >= UPLINK_QUEUE_HIGH_WATERMARK) {
+        low_since_ = 0;
+        if (level_ < kLevels - 1 && now_us - last_change_time_ >= UPLINK_STEP_DOWN_INTERVAL_MS * 1000LL) {
+            // Skip the levels the measured throughput cannot carry with some headroom
+            int level = level_ + 1;
+            if (stats_.throughput_bps > 0) {
+                while (level < kLevels - 1 && kBitrates[level] > (int)(stats_.throughput_bps * 8 / 10)) {
+                    level++;
+                }
+            }
+            SetLevel(level, now_us);
+        }
+    } else if (queue_depth <= 1) {
+        if (low_since_ == 0) {
+            low_since_ = now_us;
+        } else if (level_ > 0 && now_us - low_since_ >= UPLINK_STEP_UP_INTERVAL_MS * 1000LL) {
+            SetLevel(level_ - 1, now_us);
+            low_since_ = now_us;
+        }
+    } else {
+        low_since_ = 0;
+    }
+    return kBitrates[level_];
+}
+
+void UplinkRateController::OnPacketSent(size_t bytes, size_t queue_depth, int64_t now_us) {
+    // With an empty queue the drain rate is just the encoder's rate, only a backlog shows the link's
+    if (queue_depth == 0) {
+        window_start_ = 0;
+        window_bytes_ = 0;
+        return;
+    }
+    if (window_start_ == 0) {
+        window_start_ = now_us;
+        window_bytes_ = 0;
+        return;
+    }
+    window_bytes_ += bytes;
+    auto elapsed = now_us - window_start_;
+    if (elapsed >= UPLINK_THROUGHPUT_WINDOW_MS * 1000LL) {
+        stats_.throughput_bps = window_bytes_ * 8 * 1000000LL / elapsed;
+        window_start_ = now_us;
+        window_bytes_ = 0;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef UPLINK_RATE_CONTROLLER_H
+#define UPLINK_RATE_CONTROLLER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Encoder bitrates from best to worst, the first one is about what OPUS_AUTO picks for 16 kHz mono
+#define UPLINK_BITRATES { 16000, 12000, 10000, 8000, 6000 }
+// Queued packets that mean the network is falling behind (300 ms at 60 ms frames)
+#define UPLINK_QUEUE_HIGH_WATERMARK 5
+#define UPLINK_STEP_DOWN_INTERVAL_MS 500
+// The queue must stay (almost) empty this long before trying a better bitrate
+#define UPLINK_STEP_UP_INTERVAL_MS 5000
+#define UPLINK_THROUGHPUT_WINDOW_MS 1000
+
+struct UplinkStats {
+    int bitrate = 0;
+    uint32_t throughput_bps = 0;    // Measured while packets were queued, 0 if never measured
+    uint32_t bitrate_changes = 0;
+    uint32_t dropped_oldest = 0;
+    uint32_t dropped_newest = 0;
+};
+
+/*
+ * Picks the uplink Opus bitrate from the send queue depth and the rate the network drains it.
+ *
+ * A queue above UPLINK_QUEUE_HIGH_WATERMARK steps the bitrate down, straight to one the measured
+ * throughput can carry. A queue that stays empty for UPLINK_STEP_UP_INTERVAL_MS steps it back up
+ * one level at a time. Not thread safe, the audio service calls it under its queue lock.
+ */
+class UplinkRateController {
+public:
+    UplinkRateController();
+
+    // Before encoding a frame, returns the bitrate to encode it with
+    int Update(size_t queue_depth, int64_t now_us);
+    // A packet left the send queue for the network
+    void OnPacketSent(size_t bytes, size_t queue_depth, int64_t now_us);
+
+    int bitrate() const;
+    UplinkStats& stats() { return stats_; }
+
+private:
+    int level_ = 0;
+    int64_t last_change_time_ = 0;
+    int64_t low_since_ = 0;
+    int64_t window_start_ = 0;
+    size_t window_bytes_ = 0;
+    UplinkStats stats_;
+
+    void SetLevel(int level, int64_t now_us);
+};
+
+#endif // UPLINK_RATE_CONTROLLER_H
@@ -1,6 +1,8 @@
 #include "afsk_demod.h"
+#include "mfsk_demod.h"
 #include <cstring>
 #include <algorithm>
+#include <limits>
 #include "esp_log.h"
 #include "display.h"
 
@@ -12,6 +14,29 @@ namespace audio_wifi_config
 {
     static const char *kLogTag = "AUDIO_WIFI_CONFIG";
 
+    // Connect with the decoded "SSID\nPassword" text and restart on success
+    static void ApplyWifiCredentials(const std::string &text, WifiConfigurationAp *wifi_ap, Display *display) {
+        ESP_LOGI(kLogTag, "Received text data: %s", text.c_str());
+        display->SetChatMessage("system", text.c_str());
+
+        // Split SSID and password by newline character
+        size_t newline_position = text.find('\n');
+        if (newline_position == std::string::npos) {
+            ESP_LOGE(kLogTag, "Invalid data format, no newline character found");
+            return;
+        }
+        std::string wifi_ssid = text.substr(0, newline_position);
+        std::string wifi_password = text.substr(newline_position + 1);
+        ESP_LOGI(kLogTag, "WiFi SSID: %s, Password: %s", wifi_ssid.c_str(), wifi_password.c_str());
+
+        if (wifi_ap->ConnectToWifi(wifi_ssid, wifi_password)) {
+            wifi_ap->Save(wifi_ssid, wifi_password);  // Save WiFi credentials
+            esp_restart();                            // Restart device to apply new WiFi configuration
+        } else {
+            ESP_LOGE(kLogTag, "Failed to connect to WiFi with received credentials");
+        }
+    }
+
     void ReceiveWifiCredentialsFromAudio(Application *app,
                                         WifiConfigurationAp *wifi_ap,
                                         Display *display,
@@ -21,18 +46,29 @@ namespace audio_wifi_config
         const int kInputSampleRate = 16000;                                    // Input sampling rate
         const float kDownsampleStep = static_cast<float>(kInputSampleRate) / static_cast<float>(kAudioSampleRate); // Downsampling step
         std::vector<int16_t> audio_data;
+        std::vector<AfskSample> downsampled_data;
+        std::vector<float> probabilities;
         AudioSignalProcessor signal_processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate, kWindowSize);
         AudioDataBuffer data_buffer;
+#if CONFIG_ACOUSTIC_WIFI_MFSK
+        MfskReceiver mfsk_receiver;
+#endif
+
+        // Block on device state changes instead of polling the application state
+        TaskHandle_t receiver_task = xTaskGetCurrentTaskHandle();
+        DeviceStateEventManager::GetInstance().RegisterStateChangeCallback([receiver_task](DeviceState, DeviceState) {
+            xTaskNotifyGive(receiver_task);
+        });
 
         while (true)
         {
-            // 检查Application状态，只有在WiFi配置模式下才处理音频
+            // 只有在WiFi配置模式下才处理音频，其他状态下等待状态变化通知
             if (app->GetDeviceState() != kDeviceStateWifiConfiguring) {
-                // 不在WiFi配置状态，休眠100ms后再检查
-                vTaskDelay(pdMS_TO_TICKS(100));
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
                 continue;
             }
             
+            // ReadAudioData blocks until the codec delivers a full frame, so no extra delay is needed
             if (!app->GetAudioService().ReadAudioData(audio_data, 16000, 480)) { // 16kHz, 480 samples corresponds to 30ms data
                 // 读取音频失败，短暂延迟后重试
                 ESP_LOGI(kLogTag, "Failed to read audio data, retrying.");
@@ -40,66 +76,45 @@ namespace audio_wifi_config
                 continue;
             }
 
-            if (input_channels == 2) { // 如果是双声道输入，转换为单声道
-                auto mono_data = std::vector<int16_t>(audio_data.size() / 2);
-                for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                    mono_data[i] = audio_data[j];
-                }
-                audio_data = std::move(mono_data);
-            }
-            
-            // Downsample the audio data
-            std::vector<float> downsampled_data;
+            // Downsample the audio data, taking the left channel if the input is stereo
+            const size_t stride = input_channels == 2 ? 2 : 1;
+            const size_t frame_count = audio_data.size() / stride;
+            downsampled_data.clear();
             size_t last_index = 0;
 
             if (kDownsampleStep > 1.0f) {
-                downsampled_data.reserve(audio_data.size() / static_cast<size_t>(kDownsampleStep));
-                for (size_t i = 0; i < audio_data.size(); ++i) {
+                for (size_t i = 0; i < frame_count; ++i) {
                     size_t sample_index = static_cast<size_t>(i / kDownsampleStep);
                     if ((sample_index + 1) > last_index) {
-                        downsampled_data.push_back(static_cast<float>(audio_data[i]));
+                        downsampled_data.push_back(static_cast<AfskSample>(audio_data[i * stride]));
                         last_index = sample_index + 1;
                     }
                 }
             } else {
-                downsampled_data.reserve(audio_data.size());
-                for (int16_t sample : audio_data) {
-                    downsampled_data.push_back(static_cast<float>(sample));
+                for (size_t i = 0; i < frame_count; ++i) {
+                    downsampled_data.push_back(static_cast<AfskSample>(audio_data[i * stride]));
                 }
             }
             
             // Process audio samples to get probability data
-            auto probabilities = signal_processor.ProcessAudioSamples(downsampled_data);
+            probabilities.clear();
+            signal_processor.ProcessAudioSamples(downsampled_data.data(), downsampled_data.size(), probabilities);
             
             // Feed probability data to the data buffer
-            if (data_buffer.ProcessProbabilityData(probabilities, 0.5f)) {
+            if (data_buffer.ProcessProbabilityData(probabilities, 0.5f) && data_buffer.decoded_text.has_value()) {
                 // If complete data was received, extract WiFi credentials
-                if (data_buffer.decoded_text.has_value()) {
-                    ESP_LOGI(kLogTag, "Received text data: %s", data_buffer.decoded_text->c_str());
-                    display->SetChatMessage("system", data_buffer.decoded_text->c_str());
-                    
-                    // Split SSID and password by newline character
-                    std::string wifi_ssid, wifi_password;
-                    size_t newline_position = data_buffer.decoded_text->find('\n');
-                    if (newline_position != std::string::npos) {
-                        wifi_ssid = data_buffer.decoded_text->substr(0, newline_position);
-                        wifi_password = data_buffer.decoded_text->substr(newline_position + 1);
-                        ESP_LOGI(kLogTag, "WiFi SSID: %s, Password: %s", wifi_ssid.c_str(), wifi_password.c_str());
-                    } else {
-                        ESP_LOGE(kLogTag, "Invalid data format, no newline character found");
-                        continue;
-                    }
-                    
-                    if (wifi_ap->ConnectToWifi(wifi_ssid, wifi_password)) {
-                        wifi_ap->Save(wifi_ssid, wifi_password);  // Save WiFi credentials
-                        esp_restart();                            // Restart device to apply new WiFi configuration
-                    } else {
-                        ESP_LOGE(kLogTag, "Failed to connect to WiFi with received credentials");
-                    }
-                    data_buffer.decoded_text.reset();  // Clear processed data
-                }
+                ApplyWifiCredentials(*data_buffer.decoded_text, wifi_ap, display);
+                data_buffer.decoded_text.reset();  // Clear processed data
+            }
+
+#if CONFIG_ACOUSTIC_WIFI_MFSK
+            // The MFSK receiver listens on the same samples and is selected by its own preamble
+            if (mfsk_receiver.ProcessAudioSamples(downsampled_data.data(), downsampled_data.size()) &&
+                mfsk_receiver.decoded_text.has_value()) {
+                ApplyWifiCredentials(*mfsk_receiver.decoded_text, wifi_ap, display);
+                mfsk_receiver.decoded_text.reset();
             }
-            vTaskDelay(pdMS_TO_TICKS(1));  // 1ms delay
+#endif
         }
     }
 
@@ -112,117 +127,130 @@ namespace audio_wifi_config
     const std::vector<uint8_t> kDefaultEndTransmissionPattern = {
         0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0};
 
-    // FrequencyDetector implementation
-    FrequencyDetector::FrequencyDetector(float frequency, size_t window_size)
-        : frequency_(frequency), window_size_(window_size) {
-        frequency_bin_ = std::floor(frequency_ * static_cast<float>(window_size_));
-        angular_frequency_ = 2.0f * M_PI * frequency_;
-        cos_coefficient_ = std::cos(angular_frequency_);
-        sin_coefficient_ = std::sin(angular_frequency_);
-        filter_coefficient_ = 2.0f * cos_coefficient_;
-
-        // Initialize state buffer
-        state_buffer_.push_back(0.0f);
-        state_buffer_.push_back(0.0f);
+    // GoertzelBank implementation
+    GoertzelBank::GoertzelBank(const std::vector<float> &frequencies, size_t window_size)
+        : tone_count_(std::min(frequencies.size(), kMaxTones)), window_size_(window_size) {
+        if (frequencies.size() > kMaxTones) {
+            ESP_LOGW(kLogTag, "Goertzel bank supports %zu tones, %zu requested", kMaxTones, frequencies.size());
+        }
+        for (size_t i = 0; i < tone_count_; ++i) {
+            float angular_frequency = 2.0f * M_PI * frequencies[i];
+            cos_coefficient_[i] = std::cos(angular_frequency);
+            sin_coefficient_[i] = std::sin(angular_frequency);
+#if CONFIG_ACOUSTIC_WIFI_PROVISIONING_FIXED_POINT
+            filter_coefficient_[i] = static_cast<int32_t>(std::lround(2.0f * cos_coefficient_[i] * (1 << 14)));
+#else
+            filter_coefficient_[i] = 2.0f * cos_coefficient_[i];
+#endif
+        }
+        Reset();
     }
 
-    void FrequencyDetector::Reset() {
-        state_buffer_.clear();
-        state_buffer_.push_back(0.0f);
-        state_buffer_.push_back(0.0f);
+    void GoertzelBank::Reset() {
+        s_minus_1_.fill(0);
+        s_minus_2_.fill(0);
     }
 
-    void FrequencyDetector::ProcessSample(float sample) {
-        if (state_buffer_.size() < 2) {
-            return;
+    void GoertzelBank::Feed(const AfskSample *samples, size_t count) {
+        for (size_t n = 0; n < count; ++n) {
+            const auto sample = samples[n];
+            for (size_t i = 0; i < tone_count_; ++i) {
+#if CONFIG_ACOUSTIC_WIFI_PROVISIONING_FIXED_POINT
+                // S[n] = x[n] + C * S[n-1] - S[n-2], with C in Q14
+                int32_t s_current = sample +
+                    static_cast<int32_t>((static_cast<int64_t>(filter_coefficient_[i]) * s_minus_1_[i]) >> 14) -
+                    s_minus_2_[i];
+#else
+                float s_current = sample + filter_coefficient_[i] * s_minus_1_[i] - s_minus_2_[i];
+#endif
+                s_minus_2_[i] = s_minus_1_[i];
+                s_minus_1_[i] = s_current;
+            }
         }
-
-        float s_minus_2 = state_buffer_.front();  // S[-2]
-        state_buffer_.pop_front();
-        float s_minus_1 = state_buffer_.front();  // S[-1]
-        state_buffer_.pop_front();
-
-        float s_current = sample + filter_coefficient_ * s_minus_1 - s_minus_2;
-
-        state_buffer_.push_back(s_minus_1);  // Put S[-1] back
-        state_buffer_.push_back(s_current);  // Add new S[0]
     }
 
-    float FrequencyDetector::GetAmplitude() const {
-        if (state_buffer_.size() < 2) {
-            return 0.0f;
+    void GoertzelBank::GetAmplitudes(float *amplitudes) const {
+        const float scale = static_cast<float>(window_size_) / 2.0f;
+        for (size_t i = 0; i < tone_count_; ++i) {
+            float s_minus_1 = static_cast<float>(s_minus_1_[i]);
+            float s_minus_2 = static_cast<float>(s_minus_2_[i]);
+            float real_part = cos_coefficient_[i] * s_minus_1 - s_minus_2;  // Real part
+            float imaginary_part = sin_coefficient_[i] * s_minus_1;         // Imaginary part
+            amplitudes[i] = std::sqrt(real_part * real_part + imaginary_part * imaginary_part) / scale;
         }
-
-        float s_minus_1 = state_buffer_[1];                      // S[-1]
-        float s_minus_2 = state_buffer_[0];                      // S[-2]
-        float real_part = cos_coefficient_ * s_minus_1 - s_minus_2;  // Real part
-        float imaginary_part = sin_coefficient_ * s_minus_1;         // Imaginary part
-
-        return std::sqrt(real_part * real_part + imaginary_part * imaginary_part) / 
-               (static_cast<float>(window_size_) / 2.0f);
     }
 
     // AudioSignalProcessor implementation
+    static size_t ClampWindowSize(size_t sample_rate, size_t bit_rate, size_t window_size) {
+        size_t samples_per_bit = sample_rate / bit_rate;
+        if (window_size > samples_per_bit) {
+            ESP_LOGI(kLogTag, "Window size %zu exceeds %zu samples per bit, clamping", window_size, samples_per_bit);
+            return samples_per_bit;
+        }
+        return window_size;
+    }
+
     AudioSignalProcessor::AudioSignalProcessor(size_t sample_rate, size_t mark_frequency, size_t space_frequency,
                                              size_t bit_rate, size_t window_size)
-        : input_buffer_size_(window_size), output_sample_count_(0) {
+        : window_(ClampWindowSize(sample_rate, bit_rate, window_size)),
+          window_head_(0),
+          window_fill_(0),
+          output_sample_count_(0),
+          samples_per_bit_(sample_rate / bit_rate),  // Number of samples per bit
+          detector_bank_({static_cast<float>(mark_frequency) / static_cast<float>(sample_rate),
+                          static_cast<float>(space_frequency) / static_cast<float>(sample_rate)},
+                         window_.size()) {
         if (sample_rate % bit_rate != 0) {
             // On ESP32 we can continue execution, but log the error
             ESP_LOGW(kLogTag, "Sample rate %zu is not divisible by bit rate %zu", sample_rate, bit_rate);
         }
-
-        float normalized_mark_freq = static_cast<float>(mark_frequency) / static_cast<float>(sample_rate);
-        float normalized_space_freq = static_cast<float>(space_frequency) / static_cast<float>(sample_rate);
-
-        mark_detector_ = std::make_unique<FrequencyDetector>(normalized_mark_freq, window_size);
-        space_detector_ = std::make_unique<FrequencyDetector>(normalized_space_freq, window_size);
-
-        samples_per_bit_ = sample_rate / bit_rate;  // Number of samples per bit
     }
 
-    std::vector<float> AudioSignalProcessor::ProcessAudioSamples(const std::vector<float> &samples) {
-        std::vector<float> result;
-
-        for (float sample : samples) {
-            if (input_buffer_.size() < input_buffer_size_) {
-                input_buffer_.push_back(sample);  // Just add, don't process yet
-            } else {
-                // Input buffer is full, process the data
-                input_buffer_.pop_front();   // Remove oldest sample
-                input_buffer_.push_back(sample);  // Add new sample
-                output_sample_count_++;
-
-                if (output_sample_count_ >= samples_per_bit_) {
-                    // Process all samples in the window using Goertzel algorithm
-                    for (float window_sample : input_buffer_) {
-                        mark_detector_->ProcessSample(window_sample);
-                        space_detector_->ProcessSample(window_sample);
-                    }
-
-                    float mark_amplitude = mark_detector_->GetAmplitude();   // Mark amplitude
-                    float space_amplitude = space_detector_->GetAmplitude(); // Space amplitude
+    void AudioSignalProcessor::ProcessAudioSamples(const AfskSample *samples, size_t count,
+                                                   std::vector<float> &probabilities) {
+        const size_t window_size = window_.size();
 
-                    // Avoid division by zero
-                    float mark_probability = mark_amplitude / 
-                                           (space_amplitude + mark_amplitude + std::numeric_limits<float>::epsilon());
-                    result.push_back(mark_probability);
+        for (size_t n = 0; n < count; ++n) {
+            // Overwrite the oldest sample in the circular window
+            window_[window_head_] = samples[n];
+            window_head_ = (window_head_ + 1) % window_size;
+            if (window_fill_ < window_size) {
+                window_fill_++;  // Just add, don't process yet
+                continue;
+            }
 
-                    // Reset detector windows
-                    mark_detector_->Reset();
-                    space_detector_->Reset();
-                    output_sample_count_ = 0;  // Reset output counter
-                }
+            output_sample_count_++;
+            if (output_sample_count_ < samples_per_bit_) {
+                continue;
             }
-        }
 
-        return result;
+            // Run the whole window, oldest sample first, through both detectors in one pass
+            detector_bank_.Reset();
+            detector_bank_.Feed(window_.data() + window_head_, window_size - window_head_);
+            detector_bank_.Feed(window_.data(), window_head_);
+
+            float amplitudes[GoertzelBank::kMaxTones];
+            detector_bank_.GetAmplitudes(amplitudes);
+            float mark_amplitude = amplitudes[0];   // Mark amplitude
+            float space_amplitude = amplitudes[1];  // Space amplitude
+
+            // Avoid division by zero
+            float mark_probability = mark_amplitude /
+                                   (space_amplitude + mark_amplitude + std::numeric_limits<float>::epsilon());
+            probabilities.push_back(mark_probability);
+            output_sample_count_ = 0;  // Reset output counter
+        }
     }
 
     // AudioDataBuffer implementation
     AudioDataBuffer::AudioDataBuffer()
         : current_state_(DataReceptionState::kInactive),
+          identifier_bits_(0),
+          identifier_bit_count_(0),
           start_of_transmission_(kDefaultStartTransmissionPattern),
           end_of_transmission_(kDefaultEndTransmissionPattern),
+          start_pattern_(PackPattern(kDefaultStartTransmissionPattern)),
+          end_pattern_(PackPattern(kDefaultEndTransmissionPattern)),
           enable_checksum_validation_(true) {
         identifier_buffer_size_ = std::max(start_of_transmission_.size(), end_of_transmission_.size());
         max_bit_buffer_size_ = 776;  // Preset bit buffer size, 776 bits = (32 + 1 + 63 + 1) * 8 = 776
@@ -233,8 +261,12 @@ namespace audio_wifi_config
     AudioDataBuffer::AudioDataBuffer(size_t max_byte_size, const std::vector<uint8_t> &start_identifier,
                                    const std::vector<uint8_t> &end_identifier, bool enable_checksum)
         : current_state_(DataReceptionState::kInactive),
+          identifier_bits_(0),
+          identifier_bit_count_(0),
           start_of_transmission_(start_identifier),
           end_of_transmission_(end_identifier),
+          start_pattern_(PackPattern(start_identifier)),
+          end_pattern_(PackPattern(end_identifier)),
           enable_checksum_validation_(enable_checksum) {
         identifier_buffer_size_ = std::max(start_of_transmission_.size(), end_of_transmission_.size());
         max_bit_buffer_size_ = max_byte_size * 8;  // Bit buffer size in bytes
@@ -250,8 +282,28 @@ namespace audio_wifi_config
         return checksum;
     }
 
+    uint32_t AudioDataBuffer::PackPattern(const std::vector<uint8_t> &bits) {
+        if (bits.size() > 32) {
+            ESP_LOGE(kLogTag, "Identifier of %zu bits is longer than 32 bits", bits.size());
+        }
+        uint32_t pattern = 0;
+        for (uint8_t bit : bits) {
+            pattern = (pattern << 1) | (bit & 1);
+        }
+        return pattern;
+    }
+
+    bool AudioDataBuffer::MatchesIdentifier(uint32_t pattern, size_t length) const {
+        if (identifier_bit_count_ < length) {
+            return false;
+        }
+        uint32_t mask = length >= 32 ? 0xFFFFFFFFu : ((1u << length) - 1);
+        return (identifier_bits_ & mask) == (pattern & mask);
+    }
+
     void AudioDataBuffer::ClearBuffers() {
-        identifier_buffer_.clear();
+        identifier_bits_ = 0;
+        identifier_bit_count_ = 0;
         bit_buffer_.clear();
     }
 
@@ -259,15 +311,15 @@ namespace audio_wifi_config
         for (float probability : probabilities) {
             uint8_t bit = (probability > threshold) ? 1 : 0;
 
-            if (identifier_buffer_.size() >= identifier_buffer_size_) {
-                identifier_buffer_.pop_front();  // Maintain buffer size
+            identifier_bits_ = (identifier_bits_ << 1) | bit;
+            if (identifier_bit_count_ < identifier_buffer_size_) {
+                identifier_bit_count_++;  // Maintain buffer size
             }
-            identifier_buffer_.push_back(bit);
 
             // Process received bit based on state machine
             switch (current_state_) {
             case DataReceptionState::kInactive:
-                if (identifier_buffer_.size() >= start_of_transmission_.size()) {
+                if (identifier_bit_count_ >= start_of_transmission_.size()) {
                     current_state_ = DataReceptionState::kWaiting;  // Enter waiting state
                     ESP_LOGI(kLogTag, "Entering Waiting state");
                 }
@@ -275,22 +327,17 @@ namespace audio_wifi_config
 
             case DataReceptionState::kWaiting:
                 // Waiting state, possibly waiting for transmission end
-                if (identifier_buffer_.size() >= start_of_transmission_.size()) {
-                    std::vector<uint8_t> identifier_snapshot(identifier_buffer_.begin(), identifier_buffer_.end());
-                    if (identifier_snapshot == start_of_transmission_)
-                    {
-                        ClearBuffers();                                // Clear buffers
-                        current_state_ = DataReceptionState::kReceiving;  // Enter receiving state
-                        ESP_LOGI(kLogTag, "Entering Receiving state");
-                    }
+                if (MatchesIdentifier(start_pattern_, start_of_transmission_.size())) {
+                    ClearBuffers();                                // Clear buffers
+                    current_state_ = DataReceptionState::kReceiving;  // Enter receiving state
+                    ESP_LOGI(kLogTag, "Entering Receiving state");
                 }
                 break;
 
             case DataReceptionState::kReceiving:
                 bit_buffer_.push_back(bit);
-                if (identifier_buffer_.size() >= end_of_transmission_.size()) {
-                    std::vector<uint8_t> identifier_snapshot(identifier_buffer_.begin(), identifier_buffer_.end());
-                    if (identifier_snapshot == end_of_transmission_) {
+                if (identifier_bit_count_ >= end_of_transmission_.size()) {
+                    if (MatchesIdentifier(end_pattern_, end_of_transmission_.size())) {
                         current_state_ = DataReceptionState::kInactive;  // Enter inactive state
 
                         // Convert bits to bytes
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include <deque>
+#include <array>
 #include <string>
 #include <memory>
 #include <optional>
@@ -9,59 +9,83 @@
 #include "wifi_configuration_ap.h"
 #include "application.h"
 
+#ifndef CONFIG_ACOUSTIC_WIFI_BIT_RATE
+#define CONFIG_ACOUSTIC_WIFI_BIT_RATE 100
+#endif
+
 // Audio signal processing constants for WiFi configuration via audio
 const size_t kAudioSampleRate = 6400;
 const size_t kMarkFrequency = 1800;
 const size_t kSpaceFrequency = 1500;
-const size_t kBitRate = 100;
+const size_t kBitRate = CONFIG_ACOUSTIC_WIFI_BIT_RATE;
 const size_t kWindowSize = 64;
 
+static_assert(kAudioSampleRate % kBitRate == 0, "Each bit must hold a whole number of samples");
+static_assert(kAudioSampleRate / kBitRate >= 32, "Bits too short to tell the mark and space tones apart");
+
 namespace audio_wifi_config
 {
+#if CONFIG_ACOUSTIC_WIFI_PROVISIONING_FIXED_POINT
+    using AfskSample = int16_t;
+#else
+    using AfskSample = float;
+#endif
+
     // Main function to receive WiFi credentials through audio signal
-    void ReceiveWifiCredentialsFromAudio(Application *app, WifiConfigurationAp *wifi_ap, Display *display, 
+    void ReceiveWifiCredentialsFromAudio(Application *app, WifiConfigurationAp *wifi_ap, Display *display,
                                          size_t input_channels = 1);
 
     /**
-     * Goertzel algorithm implementation for single frequency detection
-     * Used to detect specific audio frequencies in the AFSK demodulation process
+     * Bank of Goertzel filters evaluated over the same window in a single pass
+     * Every input sample updates all tones at once; the per-tone state is kept in
+     * separate arrays so the inner loop stays branch-free and vectorizable
      */
-    class FrequencyDetector
+    class GoertzelBank
     {
-    private:
-        float frequency_;              // Target frequency (normalized, i.e., f / fs)
-        size_t window_size_;           // Window size for analysis
-        float frequency_bin_;          // Frequency bin
-        float angular_frequency_;      // Angular frequency
-        float cos_coefficient_;        // cos(w)
-        float sin_coefficient_;        // sin(w)
-        float filter_coefficient_;     // 2 * cos(w)
-        std::deque<float> state_buffer_;  // Circular buffer for storing S[-1] and S[-2]
-
     public:
+        static constexpr size_t kMaxTones = 8;
+
         /**
          * Constructor
-         * @param frequency Normalized frequency (f / fs)
+         * @param frequencies Normalized frequencies (f / fs), at most kMaxTones
          * @param window_size Window size for analysis
          */
-        FrequencyDetector(float frequency, size_t window_size);
+        GoertzelBank(const std::vector<float> &frequencies, size_t window_size);
 
         /**
-         * Reset the detector state
+         * Reset the state of all filters
          */
         void Reset();
 
         /**
-         * Process one audio sample
-         * @param sample Input audio sample
+         * Run a block of samples through every filter
+         * @param samples Input samples, oldest first
+         * @param count Number of samples
          */
-        void ProcessSample(float sample);
+        void Feed(const AfskSample *samples, size_t count);
 
         /**
-         * Calculate current amplitude
-         * @return Amplitude value
+         * Calculate the amplitude of every tone for the samples fed since the last reset
+         * @param amplitudes Output array with at least tone_count() entries
          */
-        float GetAmplitude() const;
+        void GetAmplitudes(float *amplitudes) const;
+
+        size_t tone_count() const { return tone_count_; }
+
+    private:
+        size_t tone_count_;
+        size_t window_size_;
+        std::array<float, kMaxTones> cos_coefficient_{};    // cos(w)
+        std::array<float, kMaxTones> sin_coefficient_{};    // sin(w)
+#if CONFIG_ACOUSTIC_WIFI_PROVISIONING_FIXED_POINT
+        std::array<int32_t, kMaxTones> filter_coefficient_{};  // 2 * cos(w) in Q14
+        std::array<int32_t, kMaxTones> s_minus_1_{};
+        std::array<int32_t, kMaxTones> s_minus_2_{};
+#else
+        std::array<float, kMaxTones> filter_coefficient_{};    // 2 * cos(w)
+        std::array<float, kMaxTones> s_minus_1_{};
+        std::array<float, kMaxTones> s_minus_2_{};
+#endif
     };
 
     /**
@@ -71,12 +95,12 @@ namespace audio_wifi_config
     class AudioSignalProcessor
     {
     private:
-        std::deque<float> input_buffer_;             // Input sample buffer
-        size_t input_buffer_size_;                   // Input buffer size = window size
+        std::vector<AfskSample> window_;             // Circular buffer holding the latest window
+        size_t window_head_;                         // Index of the oldest sample in the window
+        size_t window_fill_;                         // Number of valid samples in the window
         size_t output_sample_count_;                 // Output sample counter
         size_t samples_per_bit_;                     // Samples per bit threshold
-        std::unique_ptr<FrequencyDetector> mark_detector_;   // Mark frequency detector
-        std::unique_ptr<FrequencyDetector> space_detector_;  // Space frequency detector
+        GoertzelBank detector_bank_;                 // Mark (index 0) and space (index 1) detectors
 
     public:
         /**
@@ -85,17 +109,18 @@ namespace audio_wifi_config
          * @param mark_frequency Mark frequency for digital '1'
          * @param space_frequency Space frequency for digital '0'
          * @param bit_rate Data transmission bit rate
-         * @param window_size Analysis window size
+         * @param window_size Analysis window size, clamped to the number of samples per bit
          */
         AudioSignalProcessor(size_t sample_rate, size_t mark_frequency, size_t space_frequency,
                            size_t bit_rate, size_t window_size);
 
         /**
          * Process input audio samples
-         * @param samples Input audio sample vector
-         * @return Vector of Mark probability values (0.0 to 1.0)
+         * @param samples Input audio samples
+         * @param count Number of samples
+         * @param probabilities Receives one Mark probability (0.0 to 1.0) per completed bit, appended
          */
-        std::vector<float> ProcessAudioSamples(const std::vector<float> &samples);
+        void ProcessAudioSamples(const AfskSample *samples, size_t count, std::vector<float> &probabilities);
     };
 
     /**
@@ -116,12 +141,15 @@ namespace audio_wifi_config
     {
     private:
         DataReceptionState current_state_;       // Current reception state
-        std::deque<uint8_t> identifier_buffer_;  // Buffer for start/end identifier detection
+        uint32_t identifier_bits_;               // Shift register of the most recent bits, newest in bit 0
+        size_t identifier_bit_count_;            // Number of valid bits in identifier_bits_
         size_t identifier_buffer_size_;          // Identifier buffer size
         std::vector<uint8_t> bit_buffer_;        // Buffer for storing bit stream
         size_t max_bit_buffer_size_;             // Maximum bit buffer size
         const std::vector<uint8_t> start_of_transmission_;  // Start-of-transmission identifier
         const std::vector<uint8_t> end_of_transmission_;    // End-of-transmission identifier
+        uint32_t start_pattern_;                 // start_of_transmission_ packed into a word
+        uint32_t end_pattern_;                   // end_of_transmission_ packed into a word
         bool enable_checksum_validation_;       // Whether to validate checksum
 
     public:
@@ -135,8 +163,8 @@ namespace audio_wifi_config
         /**
          * Constructor with custom parameters
          * @param max_byte_size Expected maximum data size in bytes
-         * @param start_identifier Start-of-transmission identifier
-         * @param end_identifier End-of-transmission identifier
+         * @param start_identifier Start-of-transmission identifier (at most 32 bits)
+         * @param end_identifier End-of-transmission identifier (at most 32 bits)
          * @param enable_checksum Whether to enable checksum validation
          */
         AudioDataBuffer(size_t max_byte_size, const std::vector<uint8_t> &start_identifier,
@@ -158,6 +186,18 @@ namespace audio_wifi_config
         static uint8_t CalculateChecksum(const std::string &text);
 
     private:
+        /**
+         * Check whether the most recent bits match a packed identifier
+         * @param pattern Identifier packed with PackPattern
+         * @param length Identifier length in bits
+         */
+        bool MatchesIdentifier(uint32_t pattern, size_t length) const;
+
+        /**
+         * Pack a bit vector (first bit is the oldest) into a word
+         */
+        static uint32_t PackPattern(const std::vector<uint8_t> &bits);
+
         /**
          * Convert bit vector to byte vector
          * @param bits Input bit vector
@@ -174,4 +214,4 @@ namespace audio_wifi_config
     // Default start and end transmission identifiers
     extern const std::vector<uint8_t> kDefaultStartTransmissionPattern;
     extern const std::vector<uint8_t> kDefaultEndTransmissionPattern;
-}
\ No newline at end of file
+}
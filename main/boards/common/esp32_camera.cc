@@ -5,6 +5,7 @@
 #include <sys/param.h>
 #include <unistd.h>
 #include "board.h"
+#include "connection_timing.h"
 #include "display.h"
 #include "esp_video_device.h"
 #include "esp_video_init.h"
@@ -620,6 +621,8 @@ std::string Esp32Camera::Explain(const std::string& question) {
     }
     http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
     http->SetHeader("Transfer-Encoding", "chunked");
+    ConnectionTiming timing("explain", explain_url_);
+    timing.ResolveHost();
     if (!http->Open("POST", explain_url_)) {
         ESP_LOGE(TAG, "Failed to connect to explain URL");
         // Clear the queue
@@ -635,6 +638,7 @@ std::string Esp32Camera::Explain(const std::string& question) {
         vQueueDelete(jpeg_queue);
         throw std::runtime_error("Failed to connect to explain URL");
     }
+    timing.MarkConnected();
 
     {
         // 第一块：question字段
@@ -683,14 +687,17 @@ std::string Esp32Camera::Explain(const std::string& question) {
     }
     // 结束块
     http->Write("", 0);
+    timing.MarkRequestSent();
 
     if (http->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "Failed to upload photo, status code: %d", http->GetStatusCode());
         throw std::runtime_error("Failed to upload photo");
     }
+    timing.MarkFirstByte();
 
     std::string result = http->ReadAll();
     http->Close();
+    timing.Finish(true);
 
     // Get remain task stack size
     size_t remain_stack_size = uxTaskGetStackHighWaterMark(nullptr);
@@ -0,0 +1,382 @@
+#include "mfsk_demod.h"
+#include <algorithm>
+#include "esp_log.h"
+
+namespace audio_wifi_config
+{
+    static const char *kLogTag = "MFSK_WIFI_CONFIG";
+
+    const std::array<uint8_t, 8> kMfskPreamble = {0, 7, 0, 7, 2, 5, 1, 6};
+
+    uint16_t CalculateCrc16(const uint8_t *data, size_t length) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; ++i) {
+            crc ^= static_cast<uint16_t>(data[i]) << 8;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    // GF(256) arithmetic, polynomials are stored highest degree first
+    namespace gf
+    {
+        struct Tables {
+            uint8_t exp[512];
+            uint8_t log[256];
+
+            Tables() {
+                int x = 1;
+                for (int i = 0; i < 255; ++i) {
+                    exp[i] = static_cast<uint8_t>(x);
+                    log[x] = static_cast<uint8_t>(i);
+                    x <<= 1;
+                    if (x & 0x100) {
+                        x ^= 0x11d;
+                    }
+                }
+                for (int i = 255; i < 512; ++i) {
+                    exp[i] = exp[i - 255];
+                }
+                log[0] = 0;
+            }
+        };
+
+        static const Tables &GetTables() {
+            static const Tables tables;
+            return tables;
+        }
+
+        static uint8_t Mul(uint8_t a, uint8_t b) {
+            if (a == 0 || b == 0) {
+                return 0;
+            }
+            const auto &t = GetTables();
+            return t.exp[t.log[a] + t.log[b]];
+        }
+
+        static uint8_t Div(uint8_t a, uint8_t b) {
+            if (a == 0) {
+                return 0;
+            }
+            const auto &t = GetTables();
+            return t.exp[(t.log[a] + 255 - t.log[b]) % 255];
+        }
+
+        static uint8_t Pow(uint8_t a, int power) {
+            const auto &t = GetTables();
+            int e = (t.log[a] * power) % 255;
+            if (e < 0) {
+                e += 255;
+            }
+            return t.exp[e];
+        }
+
+        static uint8_t Inverse(uint8_t a) {
+            const auto &t = GetTables();
+            return t.exp[255 - t.log[a]];
+        }
+
+        using Poly = std::vector<uint8_t>;
+
+        static Poly Scale(const Poly &p, uint8_t x) {
+            Poly r(p.size());
+            for (size_t i = 0; i < p.size(); ++i) {
+                r[i] = Mul(p[i], x);
+            }
+            return r;
+        }
+
+        static Poly Add(const Poly &p, const Poly &q) {
+            Poly r(std::max(p.size(), q.size()), 0);
+            for (size_t i = 0; i < p.size(); ++i) {
+                r[i + r.size() - p.size()] = p[i];
+            }
+            for (size_t i = 0; i < q.size(); ++i) {
+                r[i + r.size() - q.size()] ^= q[i];
+            }
+            return r;
+        }
+
+        static Poly Multiply(const Poly &p, const Poly &q) {
+            Poly r(p.size() + q.size() - 1, 0);
+            for (size_t j = 0; j < q.size(); ++j) {
+                for (size_t i = 0; i < p.size(); ++i) {
+                    r[i + j] ^= Mul(p[i], q[j]);
+                }
+            }
+            return r;
+        }
+
+        static uint8_t Eval(const Poly &p, uint8_t x) {
+            uint8_t y = p.empty() ? 0 : p[0];
+            for (size_t i = 1; i < p.size(); ++i) {
+                y = Mul(y, x) ^ p[i];
+            }
+            return y;
+        }
+    }
+
+    // ReedSolomon implementation
+    ReedSolomon::ReedSolomon(size_t parity_bytes)
+        : parity_bytes_(parity_bytes), generator_{1} {
+        for (size_t i = 0; i < parity_bytes_; ++i) {
+            generator_ = gf::Multiply(generator_, {1, gf::Pow(2, static_cast<int>(i))});
+        }
+    }
+
+    std::vector<uint8_t> ReedSolomon::Encode(const std::vector<uint8_t> &message) const {
+        std::vector<uint8_t> remainder(message);
+        remainder.resize(message.size() + parity_bytes_, 0);
+        for (size_t i = 0; i < message.size(); ++i) {
+            uint8_t coef = remainder[i];
+            if (coef != 0) {
+                for (size_t j = 1; j < generator_.size(); ++j) {
+                    remainder[i + j] ^= gf::Mul(generator_[j], coef);
+                }
+            }
+        }
+        return std::vector<uint8_t>(remainder.begin() + message.size(), remainder.end());
+    }
+
+    int ReedSolomon::Decode(std::vector<uint8_t> &codeword) const {
+        const size_t length = codeword.size();
+        if (length <= parity_bytes_ || length > 255) {
+            return -1;
+        }
+
+        // Syndromes, padded with a leading zero so S(x) starts at x^1
+        gf::Poly syndromes(parity_bytes_ + 1, 0);
+        bool has_errors = false;
+        for (size_t i = 0; i < parity_bytes_; ++i) {
+            syndromes[i + 1] = gf::Eval(codeword, gf::Pow(2, static_cast<int>(i)));
+            has_errors |= syndromes[i + 1] != 0;
+        }
+        if (!has_errors) {
+            return 0;
+        }
+
+        // Berlekamp-Massey: find the error locator polynomial
+        gf::Poly error_locator{1};
+        gf::Poly old_locator{1};
+        for (size_t i = 0; i < parity_bytes_; ++i) {
+            size_t k = i + 1;
+            uint8_t delta = syndromes[k];
+            for (size_t j = 1; j < error_locator.size(); ++j) {
+                delta ^= gf::Mul(error_locator[error_locator.size() - 1 - j], syndromes[k - j]);
+            }
+            old_locator.push_back(0);
+            if (delta != 0) {
+                if (old_locator.size() > error_locator.size()) {
+                    gf::Poly new_locator = gf::Scale(old_locator, delta);
+                    old_locator = gf::Scale(error_locator, gf::Inverse(delta));
+                    error_locator = new_locator;
+                }
+                error_locator = gf::Add(error_locator, gf::Scale(old_locator, delta));
+            }
+        }
+        auto first_nonzero = std::find_if(error_locator.begin(), error_locator.end(), [](uint8_t c) { return c != 0; });
+        error_locator.erase(error_locator.begin(), first_nonzero);
+        const size_t error_count = error_locator.empty() ? 0 : error_locator.size() - 1;
+        if (error_count == 0 || error_count * 2 > parity_bytes_) {
+            return -1;
+        }
+
+        // Chien search: find the error positions
+        gf::Poly reversed_locator(error_locator.rbegin(), error_locator.rend());
+        std::vector<size_t> error_positions;
+        for (size_t i = 0; i < length; ++i) {
+            if (gf::Eval(reversed_locator, gf::Pow(2, static_cast<int>(i))) == 0) {
+                error_positions.push_back(length - 1 - i);
+            }
+        }
+        if (error_positions.size() != error_count) {
+            return -1;
+        }
+
+        // Forney: compute the error magnitudes
+        std::vector<int> coefficient_positions;
+        gf::Poly errata_locator{1};
+        for (size_t position : error_positions) {
+            int coefficient_position = static_cast<int>(length - 1 - position);
+            coefficient_positions.push_back(coefficient_position);
+            errata_locator = gf::Multiply(errata_locator, gf::Add({1}, {gf::Pow(2, coefficient_position), 0}));
+        }
+
+        gf::Poly reversed_syndromes(syndromes.rbegin(), syndromes.rend());
+        gf::Poly product = gf::Multiply(reversed_syndromes, errata_locator);
+        size_t evaluator_size = std::min(product.size(), errata_locator.size());  // mod x^(errors + 1)
+        gf::Poly error_evaluator(product.end() - evaluator_size, product.end());
+
+        std::vector<uint8_t> x_values;
+        for (int position : coefficient_positions) {
+            x_values.push_back(gf::Pow(2, position));
+        }
+
+        for (size_t i = 0; i < x_values.size(); ++i) {
+            uint8_t xi_inverse = gf::Inverse(x_values[i]);
+            uint8_t locator_prime = 1;
+            for (size_t j = 0; j < x_values.size(); ++j) {
+                if (j != i) {
+                    locator_prime = gf::Mul(locator_prime, 1 ^ gf::Mul(xi_inverse, x_values[j]));
+                }
+            }
+            if (locator_prime == 0) {
+                return -1;
+            }
+            uint8_t y = gf::Mul(x_values[i], gf::Eval(error_evaluator, xi_inverse));
+            codeword[error_positions[i]] ^= gf::Div(y, locator_prime);
+        }
+
+        // Verify the corrected codeword
+        for (size_t i = 0; i < parity_bytes_; ++i) {
+            if (gf::Eval(codeword, gf::Pow(2, static_cast<int>(i))) != 0) {
+                return -1;
+            }
+        }
+        return static_cast<int>(error_count);
+    }
+
+    // MfskReceiver implementation
+    static std::vector<float> MfskToneFrequencies() {
+        std::vector<float> frequencies;
+        for (size_t i = 0; i < kMfskToneCount; ++i) {
+            frequencies.push_back(static_cast<float>(kMfskBaseFrequency + i * kMfskToneSpacing) /
+                                  static_cast<float>(kAudioSampleRate));
+        }
+        return frequencies;
+    }
+
+    MfskReceiver::MfskReceiver()
+        : window_(kAudioSampleRate / kMfskSymbolRate),
+          window_head_(0),
+          window_fill_(0),
+          hop_size_(kAudioSampleRate / kMfskSymbolRate / kMfskTimingPhases),
+          hop_count_(0),
+          phase_index_(0),
+          detector_bank_(MfskToneFrequencies(), kAudioSampleRate / kMfskSymbolRate),
+          reed_solomon_(kMfskParityBytes) {
+    }
+
+    void MfskReceiver::ResetPhases() {
+        for (auto &phase : phases_) {
+            phase = PhaseDecoder();
+        }
+    }
+
+    bool MfskReceiver::ProcessAudioSamples(const AfskSample *samples, size_t count) {
+        const size_t window_size = window_.size();
+        bool decoded = false;
+
+        for (size_t n = 0; n < count; ++n) {
+            window_[window_head_] = samples[n];
+            window_head_ = (window_head_ + 1) % window_size;
+            if (window_fill_ < window_size) {
+                window_fill_++;
+                continue;
+            }
+            if (++hop_count_ < hop_size_) {
+                continue;
+            }
+            hop_count_ = 0;
+
+            // Evaluate all tones over the latest symbol window, oldest sample first
+            detector_bank_.Reset();
+            detector_bank_.Feed(window_.data() + window_head_, window_size - window_head_);
+            detector_bank_.Feed(window_.data(), window_head_);
+
+            float amplitudes[GoertzelBank::kMaxTones];
+            detector_bank_.GetAmplitudes(amplitudes);
+            uint8_t tone = static_cast<uint8_t>(std::max_element(amplitudes, amplitudes + kMfskToneCount) - amplitudes);
+
+            auto &decoder = phases_[phase_index_];
+            phase_index_ = (phase_index_ + 1) % kMfskTimingPhases;
+            if (ProcessSymbol(decoder, tone)) {
+                decoded = true;
+                ResetPhases();
+            }
+        }
+        return decoded;
+    }
+
+    bool MfskReceiver::ProcessSymbol(PhaseDecoder &decoder, uint8_t tone) {
+        const uint32_t preamble_mask = (1u << (kMfskPreamble.size() * kMfskBitsPerSymbol)) - 1;
+
+        if (decoder.state == State::kSearching) {
+            decoder.preamble_bits = ((decoder.preamble_bits << kMfskBitsPerSymbol) | tone) & preamble_mask;
+            decoder.preamble_count = std::min(decoder.preamble_count + 1, kMfskPreamble.size());
+            if (decoder.preamble_count < kMfskPreamble.size()) {
+                return false;
+            }
+            uint32_t preamble = 0;
+            for (uint8_t symbol : kMfskPreamble) {
+                preamble = (preamble << kMfskBitsPerSymbol) | symbol;
+            }
+            if (decoder.preamble_bits == preamble) {
+                decoder.state = State::kHeader;
+                decoder.bit_accumulator = 0;
+                decoder.bit_count = 0;
+                decoder.bytes.clear();
+                decoder.expected_bytes = 3;
+            }
+            return false;
+        }
+
+        // Gray decode the tone index into symbol bits
+        uint8_t value = tone;
+        for (uint8_t shift = tone >> 1; shift != 0; shift >>= 1) {
+            value ^= shift;
+        }
+        decoder.bit_accumulator = (decoder.bit_accumulator << kMfskBitsPerSymbol) | value;
+        decoder.bit_count += kMfskBitsPerSymbol;
+        while (decoder.bit_count >= 8 && decoder.bytes.size() < decoder.expected_bytes) {
+            decoder.bit_count -= 8;
+            decoder.bytes.push_back(static_cast<uint8_t>(decoder.bit_accumulator >> decoder.bit_count));
+        }
+        if (decoder.bytes.size() < decoder.expected_bytes) {
+            return false;
+        }
+
+        if (decoder.state == State::kHeader) {
+            // Bitwise majority vote over the three length copies
+            const uint8_t a = decoder.bytes[0], b = decoder.bytes[1], c = decoder.bytes[2];
+            size_t payload_size = (a & b) | (a & c) | (b & c);
+            if (payload_size == 0 || payload_size > kMfskMaxPayloadSize) {
+                decoder = PhaseDecoder();
+                return false;
+            }
+            decoder.state = State::kBody;
+            decoder.bytes.clear();
+            decoder.bit_accumulator = 0;
+            decoder.bit_count = 0;
+            decoder.expected_bytes = payload_size + 2 + kMfskParityBytes;
+            decoder.bytes.reserve(decoder.expected_bytes);
+            return false;
+        }
+
+        bool decoded = DecodeFrame(decoder);
+        decoder = PhaseDecoder();
+        return decoded;
+    }
+
+    bool MfskReceiver::DecodeFrame(PhaseDecoder &decoder) {
+        int corrected = reed_solomon_.Decode(decoder.bytes);
+        if (corrected < 0) {
+            ESP_LOGD(kLogTag, "Uncorrectable frame");
+            return false;
+        }
+
+        size_t payload_size = decoder.bytes.size() - 2 - kMfskParityBytes;
+        uint16_t received_crc = (decoder.bytes[payload_size] << 8) | decoder.bytes[payload_size + 1];
+        uint16_t calculated_crc = CalculateCrc16(decoder.bytes.data(), payload_size);
+        if (received_crc != calculated_crc) {
+            ESP_LOGW(kLogTag, "CRC mismatch: expected %04x, got %04x", received_crc, calculated_crc);
+            return false;
+        }
+
+        ESP_LOGI(kLogTag, "Frame decoded, %zu bytes, %d corrected", payload_size, corrected);
+        decoded_text = std::string(decoder.bytes.begin(), decoder.bytes.begin() + payload_size);
+        return true;
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <optional>
+#include <cstdint>
+#include "afsk_demod.h"
+
+/*
+ * MFSK audio provisioning frame (all tones at the 6400Hz demodulation rate):
+ *
+ * |preamble 8 symbols|length x3 (8 symbols)|Reed-Solomon codeword|
+ *
+ * The codeword is payload | CRC-16/CCITT-FALSE (big endian) | parity bytes.
+ * Bytes are sent MSB first, 3 bits per symbol, Gray coded onto 8 tones.
+ */
+const size_t kMfskToneCount = 8;
+const size_t kMfskBaseFrequency = 1000;
+const size_t kMfskToneSpacing = 100;
+const size_t kMfskSymbolRate = 100;
+const size_t kMfskBitsPerSymbol = 3;
+const size_t kMfskTimingPhases = 4;
+const size_t kMfskParityBytes = 16;
+const size_t kMfskMaxPayloadSize = 96;  // 32 bytes SSID + '\n' + 63 bytes password
+
+namespace audio_wifi_config
+{
+    // Preamble tone indices that select the MFSK decoder
+    extern const std::array<uint8_t, 8> kMfskPreamble;
+
+    /**
+     * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+     * @param data Input bytes
+     * @param length Number of bytes
+     * @return CRC value
+     */
+    uint16_t CalculateCrc16(const uint8_t *data, size_t length);
+
+    /**
+     * Systematic Reed-Solomon codec over GF(256), primitive polynomial 0x11d, first root alpha^0
+     * Shortened codewords are supported, as long as message + parity <= 255 bytes
+     */
+    class ReedSolomon
+    {
+    public:
+        /**
+         * Constructor
+         * @param parity_bytes Number of parity bytes, corrects up to parity_bytes / 2 byte errors
+         */
+        explicit ReedSolomon(size_t parity_bytes);
+
+        /**
+         * Compute parity bytes for a message
+         * @param message Message bytes
+         * @return Parity bytes to append to the message
+         */
+        std::vector<uint8_t> Encode(const std::vector<uint8_t> &message) const;
+
+        /**
+         * Correct a codeword in place
+         * @param codeword Message followed by parity bytes
+         * @return Number of corrected bytes, or -1 if the codeword is not correctable
+         */
+        int Decode(std::vector<uint8_t> &codeword) const;
+
+    private:
+        size_t parity_bytes_;
+        std::vector<uint8_t> generator_;
+    };
+
+    /**
+     * MFSK receiver with CRC and Reed-Solomon FEC
+     * Symbol timing is recovered by running several decoders offset by a fraction of a symbol;
+     * the first one whose frame passes FEC and CRC wins
+     */
+    class MfskReceiver
+    {
+    public:
+        std::optional<std::string> decoded_text;  // Successfully decoded text data
+
+        MfskReceiver();
+
+        /**
+         * Process input audio samples at kAudioSampleRate
+         * @param samples Input audio samples
+         * @param count Number of samples
+         * @return true if complete data was successfully received and decoded
+         */
+        bool ProcessAudioSamples(const AfskSample *samples, size_t count);
+
+    private:
+        enum class State
+        {
+            kSearching,  // Looking for the preamble
+            kHeader,     // Receiving the repeated length byte
+            kBody        // Receiving the Reed-Solomon codeword
+        };
+
+        struct PhaseDecoder
+        {
+            State state = State::kSearching;
+            uint32_t preamble_bits = 0;        // Last 8 tone indices, 3 bits each
+            size_t preamble_count = 0;
+            uint32_t bit_accumulator = 0;
+            size_t bit_count = 0;
+            size_t expected_bytes = 0;
+            std::vector<uint8_t> bytes;
+        };
+
+        std::vector<AfskSample> window_;      // Circular buffer holding the latest symbol window
+        size_t window_head_;
+        size_t window_fill_;
+        size_t hop_size_;                     // Samples between two timing phases
+        size_t hop_count_;
+        size_t phase_index_;
+        GoertzelBank detector_bank_;
+        ReedSolomon reed_solomon_;
+        std::array<PhaseDecoder, kMfskTimingPhases> phases_;
+
+        bool ProcessSymbol(PhaseDecoder &decoder, uint8_t tone);
+        bool DecodeFrame(PhaseDecoder &decoder);
+        void ResetPhases();
+    };
+}
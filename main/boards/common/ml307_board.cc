@@ -2,6 +2,7 @@
 
 #include "application.h"
 #include "display.h"
+#include "event_bus.h"
 #include "assets/lang_config.h"
 
 #include <esp_log.h>
@@ -32,6 +33,7 @@ void Ml307Board::StartNetwork() {
     }
 
     modem_->OnNetworkStateChanged([this, &application](bool network_ready) {
+        EventBus::GetInstance().Publish(NetworkChangedEvent{network_ready});
         if (network_ready) {
             ESP_LOGI(TAG, "Network is ready");
         } else {
@@ -40,7 +42,7 @@ void Ml307Board::StartNetwork() {
             if (device_state == kDeviceStateListening || device_state == kDeviceStateSpeaking) {
                 application.Schedule([this, &application]() {
                     application.SetDeviceState(kDeviceStateIdle);
-                });
+                }, kTaskLaneUi, "OnNetworkStateChanged");
             }
         }
     });
@@ -1,5 +1,6 @@
 #include "power_save_timer.h"
 #include "application.h"
+#include "event_bus.h"
 #include "settings.h"
 
 #include <esp_log.h>
@@ -20,9 +21,17 @@ PowerSaveTimer::PowerSaveTimer(int cpu_max_freq, int seconds_to_sleep, int secon
         .skip_unhandled_events = true,
     };
     ESP_ERROR_CHECK(esp_timer_create(&timer_args, &power_save_timer_));
+
+    // Any state change is activity, even one that is over before the next check
+    device_idle_ = Application::GetInstance().GetDeviceState() == kDeviceStateIdle;
+    state_subscription_ = EventBus::GetInstance().Subscribe<DeviceStateChangedEvent>([this](const DeviceStateChangedEvent& event) {
+        device_idle_ = event.current_state == kDeviceStateIdle;
+        ticks_ = 0;
+    });
 }
 
 PowerSaveTimer::~PowerSaveTimer() {
+    EventBus::GetInstance().Unsubscribe(state_subscription_);
     esp_timer_stop(power_save_timer_);
     esp_timer_delete(power_save_timer_);
 }
@@ -60,8 +69,7 @@ void PowerSaveTimer::OnShutdownRequest(std::function<void()> callback) {
 }
 
 void PowerSaveTimer::PowerSaveCheck() {
-    auto& app = Application::GetInstance();
-    if (!in_sleep_mode_ && !app.CanEnterSleepMode()) {
+    if (!in_sleep_mode_ && !device_idle_) {
         ticks_ = 0;
         return;
     }
@@ -77,7 +85,7 @@ void PowerSaveTimer::PowerSaveCheck() {
 
             if (cpu_max_freq_ != -1) {
                 // Disable wake word detection
-                auto& audio_service = app.GetAudioService();
+                auto& audio_service = Application::GetInstance().GetAudioService();
                 is_wake_word_running_ = audio_service.IsWakeWordRunning();
                 if (is_wake_word_running_) {
                     audio_service.EnableWakeWordDetection(false);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <atomic>
 
 #include <esp_timer.h>
 #include <esp_pm.h>
@@ -23,7 +24,11 @@ private:
     bool enabled_ = false;
     bool in_sleep_mode_ = false;
     bool is_wake_word_running_ = false;
-    int ticks_ = 0;
+    // Also reset by the event bus task
+    std::atomic<int> ticks_ = 0;
+    // Kept by the event bus task, so the check does not have to ask the application
+    std::atomic<bool> device_idle_ = false;
+    int state_subscription_ = -1;
     int cpu_max_freq_;
     int seconds_to_sleep_;
     int seconds_to_shutdown_;
@@ -1,5 +1,6 @@
 #include "sleep_timer.h"
 #include "application.h"
+#include "event_bus.h"
 #include "board.h"
 #include "display.h"
 #include "settings.h"
@@ -24,9 +25,15 @@ SleepTimer::SleepTimer(int seconds_to_light_sleep, int seconds_to_deep_sleep)
         .skip_unhandled_events = true,
     };
     ESP_ERROR_CHECK(esp_timer_create(&timer_args, &sleep_timer_));
+
+    // Any state change is activity, even one that is over before the next check
+    state_subscription_ = EventBus::GetInstance().Subscribe<DeviceStateChangedEvent>([this](const DeviceStateChangedEvent& event) {
+        ticks_ = 0;
+    });
 }
 
 SleepTimer::~SleepTimer() {
+    EventBus::GetInstance().Unsubscribe(state_subscription_);
     esp_timer_stop(sleep_timer_);
     esp_timer_delete(sleep_timer_);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <atomic>
 
 #include <esp_timer.h>
 #include <esp_pm.h>
@@ -21,7 +22,9 @@ private:
 
     esp_timer_handle_t sleep_timer_ = nullptr;
     bool enabled_ = false;
-    int ticks_ = 0;
+    // Also reset by the event bus task
+    std::atomic<int> ticks_ = 0;
+    int state_subscription_ = -1;
     int seconds_to_light_sleep_;
     int seconds_to_deep_sleep_;
     bool in_light_sleep_mode_ = false;
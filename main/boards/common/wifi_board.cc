@@ -4,6 +4,7 @@
 #include "application.h"
 #include "system_info.h"
 #include "settings.h"
+#include "event_bus.h"
 #include "assets/lang_config.h"
 
 #include <freertos/FreeRTOS.h>
@@ -104,6 +105,7 @@ void WifiBoard::StartNetwork() {
         std::string notification = Lang::Strings::CONNECTED_TO;
         notification += ssid;
         display->ShowNotification(notification.c_str(), 30000);
+        EventBus::GetInstance().Publish(NetworkChangedEvent{true});
     });
     wifi_station.Start();
 
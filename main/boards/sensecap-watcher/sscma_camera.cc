@@ -6,6 +6,7 @@
 #include "system_info.h"
 #include "config.h"
 #include "settings.h"
+#include "connection_timing.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
@@ -656,10 +657,13 @@ std::string SscmaCamera::Explain(const std::string& question) {
     }
     http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
     http->SetHeader("Transfer-Encoding", "chunked");
+    ConnectionTiming timing("explain", explain_url_);
+    timing.ResolveHost();
     if (!http->Open("POST", explain_url_)) {
         ESP_LOGE(TAG, "Failed to connect to explain URL");
         return "{\"success\": false, \"message\": \"Failed to connect to explain URL\"}";
     }
+    timing.MarkConnected();
     
     // 第一块：question字段
     http->Write(question_field.c_str(), question_field.size());
@@ -675,14 +679,17 @@ std::string SscmaCamera::Explain(const std::string& question) {
     
     // 结束块
     http->Write("", 0);
+    timing.MarkRequestSent();
 
     if (http->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "Failed to upload photo, status code: %d", http->GetStatusCode());
         return "{\"success\": false, \"message\": \"Failed to upload photo\"}";
     }
+    timing.MarkFirstByte();
 
     std::string result = http->ReadAll();
     http->Close();
+    timing.Finish(true);
 
     ESP_LOGI(TAG, "Explain image size=%d, question=%s\n%s", jpeg_data_.len, question.c_str(), result.c_str());
     return result;
@@ -0,0 +1,92 @@
+#include "boot_timeline.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <mutex>
+#include <cstring>
+
+#define TAG "BootTimeline"
+
+#define MAX_BOOT_STAGES 8
+
+namespace {
+
+struct BootStage {
+    const char* name;
+    int64_t begin_us;
+    int64_t end_us;
+};
+
+std::mutex timeline_mutex;
+BootStage stages[MAX_BOOT_STAGES];
+int stage_count = 0;
+int64_t ready_us = 0;
+bool printed = false;
+
+BootStage* FindStage(const char* name) {
+    for (int i = 0; i < stage_count; i++) {
+        if (strcmp(stages[i].name, name) == 0) {
+            return &stages[i];
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void BootTimeline::Begin(const char* stage) {
+    std::lock_guard<std::mutex> lock(timeline_mutex);
+    if (stage_count >= MAX_BOOT_STAGES) {
+        ESP_LOGW(TAG, "Too many boot stages, %s is not recorded", stage);
+        return;
+    }
+    stages[stage_count++] = {stage, esp_timer_get_time(), 0};
+}
+
+void BootTimeline::End(const char* stage) {
+    std::lock_guard<std::mutex> lock(timeline_mutex);
+    auto entry = FindStage(stage);
+    if (entry == nullptr) {
+        return;
+    }
+    entry->end_us = esp_timer_get_time();
+    PrintIfComplete();
+}
+
+void BootTimeline::MarkReady() {
+    std::lock_guard<std::mutex> lock(timeline_mutex);
+    ready_us = esp_timer_get_time();
+    PrintIfComplete();
+}
+
+// Called with timeline_mutex held
+void BootTimeline::PrintIfComplete() {
+    if (printed || ready_us == 0 || stage_count == 0) {
+        return;
+    }
+    for (int i = 0; i < stage_count; i++) {
+        if (stages[i].end_us == 0) {
+            return;
+        }
+    }
+    printed = true;
+
+    int64_t first_begin_us = stages[0].begin_us;
+    int64_t sequential_us = 0;
+    ESP_LOGI(TAG, "Boot timeline (ms since power on):");
+    for (int i = 0; i < stage_count; i++) {
+        auto& stage = stages[i];
+        int64_t duration_us = stage.end_us - stage.begin_us;
+        sequential_us += duration_us;
+        if (stage.begin_us < first_begin_us) {
+            first_begin_us = stage.begin_us;
+        }
+        ESP_LOGI(TAG, "  %-10s %6lld -> %6lld  %6lld ms%s", stage.name, stage.begin_us / 1000, stage.end_us / 1000,
+            duration_us / 1000, stage.end_us > ready_us ? "  (after ready)" : "");
+    }
+    // Before the stages were pipelined, the device was ready only after all of them had run in sequence
+    int64_t saved_us = first_begin_us + sequential_us - ready_us;
+    ESP_LOGI(TAG, "Ready at %lld ms, stages add up to %lld ms, %lld ms saved by running them concurrently",
+        ready_us / 1000, sequential_us / 1000, saved_us > 0 ? saved_us / 1000 : 0);
+}
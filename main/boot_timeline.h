@@ -0,0 +1,21 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <cstdint>
+
+/*
+ * Records when each boot stage starts and ends, possibly from several tasks.
+ * Once the device is ready and every stage has ended, the timeline is printed together with
+ * how much sooner the device became ready than if the stages had run one after another.
+ */
+class BootTimeline {
+public:
+    static void Begin(const char* stage);
+    static void End(const char* stage);
+    static void MarkReady();
+
+private:
+    static void PrintIfComplete();
+};
+
+#endif // BOOT_TIMELINE_H
@@ -0,0 +1,209 @@
+#include "connection_timing.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+#include <lwip/netdb.h>
+#include <lwip/inet.h>
+
+#include <mutex>
+#include <vector>
+
+#define TAG "ConnectionTiming"
+
+#define MAX_TRACKED_HOSTS 8
+
+namespace {
+
+struct HostStats {
+    std::string host;
+    uint32_t requests = 0;
+    uint32_t failures = 0;
+    int last_dns_ms = -1;
+    int last_connect_ms = -1;
+    int min_connect_ms = -1;
+    int max_connect_ms = -1;
+    int64_t total_connect_ms = 0;
+    uint32_t connect_samples = 0;
+    int last_first_byte_ms = -1;
+};
+
+std::mutex stats_mutex;
+std::vector<HostStats> host_stats;
+
+HostStats& GetHostStats(const std::string& host) {
+    for (auto& stats : host_stats) {
+        if (stats.host == host) {
+            return stats;
+        }
+    }
+    if (host_stats.size() >= MAX_TRACKED_HOSTS) {
+        host_stats.erase(host_stats.begin());
+    }
+    host_stats.emplace_back();
+    host_stats.back().host = host;
+    return host_stats.back();
+}
+
+} // namespace
+
+ConnectionTiming::ConnectionTiming(const char* name, const std::string& url) : name_(name) {
+    // scheme://[user@]host[:port]/path
+    size_t start = url.find("://");
+    if (start != std::string::npos) {
+        auto scheme = url.substr(0, start);
+        secure_ = scheme == "https" || scheme == "wss";
+        start += 3;
+    } else {
+        start = 0;
+    }
+    size_t end = url.find_first_of("/?#", start);
+    host_ = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    auto at = host_.rfind('@');
+    if (at != std::string::npos) {
+        host_ = host_.substr(at + 1);
+    }
+    if (!host_.empty() && host_[0] == '[') {
+        auto bracket = host_.find(']');
+        host_ = host_.substr(1, bracket == std::string::npos ? std::string::npos : bracket - 1);
+    } else {
+        auto colon = host_.find(':');
+        if (colon != std::string::npos) {
+            host_ = host_.substr(0, colon);
+        }
+    }
+
+    start_time_ = esp_timer_get_time();
+    phase_time_ = start_time_;
+}
+
+ConnectionTiming::~ConnectionTiming() {
+    // Early returns on error paths count as failures
+    if (!finished_) {
+        Finish(false);
+    }
+}
+
+int ConnectionTiming::ElapsedPhaseMs() {
+    auto now = esp_timer_get_time();
+    int elapsed = (now - phase_time_) / 1000;
+    phase_time_ = now;
+    return elapsed;
+}
+
+void ConnectionTiming::ResolveHost() {
+    phase_time_ = esp_timer_get_time();
+#if CONFIG_CONNECTION_TIMING_RESOLVE_DNS
+    if (host_.empty()) {
+        return;
+    }
+
+    // Modems resolve names themselves, lwIP has no route there
+    if (Board::GetInstance().GetBoardType() != "wifi") {
+        return;
+    }
+
+    ip_addr_t literal;
+    if (ipaddr_aton(host_.c_str(), &literal)) {
+        dns_ms_ = 0;
+        return;
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    int ret = getaddrinfo(host_.c_str(), nullptr, &hints, &result);
+    dns_ms_ = ElapsedPhaseMs();
+    if (ret != 0 || result == nullptr) {
+        ESP_LOGW(TAG, "[%s] Failed to resolve %s (%d) in %d ms", name_, host_.c_str(), ret, dns_ms_);
+        return;
+    }
+    freeaddrinfo(result);
+#endif
+}
+
+void ConnectionTiming::MarkConnected() {
+    connect_ms_ = ElapsedPhaseMs();
+}
+
+void ConnectionTiming::MarkRequestSent() {
+    // Upload time is not server latency, restart the phase clock
+    phase_time_ = esp_timer_get_time();
+}
+
+void ConnectionTiming::MarkFirstByte() {
+    first_byte_ms_ = ElapsedPhaseMs();
+}
+
+void ConnectionTiming::Finish(bool success) {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+    int total_ms = (esp_timer_get_time() - start_time_) / 1000;
+
+    int avg_connect_ms = -1;
+    uint32_t requests;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        auto& stats = GetHostStats(host_);
+        stats.requests++;
+        if (!success) {
+            stats.failures++;
+        }
+        if (dns_ms_ >= 0) {
+            stats.last_dns_ms = dns_ms_;
+        }
+        if (connect_ms_ >= 0) {
+            stats.last_connect_ms = connect_ms_;
+            if (stats.min_connect_ms < 0 || connect_ms_ < stats.min_connect_ms) {
+                stats.min_connect_ms = connect_ms_;
+            }
+            if (connect_ms_ > stats.max_connect_ms) {
+                stats.max_connect_ms = connect_ms_;
+            }
+            stats.total_connect_ms += connect_ms_;
+            stats.connect_samples++;
+        }
+        // An error status answers fast, it says nothing about the server's usual latency
+        if (success && first_byte_ms_ >= 0) {
+            stats.last_first_byte_ms = first_byte_ms_;
+        }
+        if (stats.connect_samples > 0) {
+            avg_connect_ms = stats.total_connect_ms / stats.connect_samples;
+        }
+        requests = stats.requests;
+    }
+
+    // Without a separate lookup the connect phase includes DNS
+    const char* connect_phase = dns_ms_ >= 0 ? (secure_ ? "tcp+tls" : "tcp") : (secure_ ? "dns+tcp+tls" : "dns+tcp");
+    ESP_LOGI(TAG, "[%s] %s%s: dns %d ms, %s %d ms, first byte %d ms, total %d ms%s (avg connect %d ms over %lu requests)",
+        name_, host_.c_str(), secure_ ? " (tls)" : "", dns_ms_, connect_phase, connect_ms_,
+        first_byte_ms_, total_ms, success ? "" : ", failed", avg_connect_ms, requests);
+}
+
+std::string ConnectionTiming::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    cJSON* root = cJSON_CreateArray();
+    for (auto& stats : host_stats) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "host", stats.host.c_str());
+        cJSON_AddNumberToObject(item, "requests", stats.requests);
+        cJSON_AddNumberToObject(item, "failures", stats.failures);
+        cJSON_AddNumberToObject(item, "last_dns_ms", stats.last_dns_ms);
+        cJSON_AddNumberToObject(item, "last_connect_ms", stats.last_connect_ms);
+        cJSON_AddNumberToObject(item, "min_connect_ms", stats.min_connect_ms);
+        cJSON_AddNumberToObject(item, "max_connect_ms", stats.max_connect_ms);
+        cJSON_AddNumberToObject(item, "avg_connect_ms",
+            stats.connect_samples > 0 ? (double)(stats.total_connect_ms / stats.connect_samples) : -1);
+        cJSON_AddNumberToObject(item, "last_first_byte_ms", stats.last_first_byte_ms);
+        cJSON_AddItemToArray(root, item);
+    }
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,60 @@
+#ifndef CONNECTION_TIMING_H
+#define CONNECTION_TIMING_H
+
+#include <string>
+#include <cstdint>
+
+/*
+ * Measures the phases of one Http / WebSocket request and keeps running statistics per host.
+ *
+ * Usage:
+ *   ConnectionTiming timing("ota", url);
+ *   timing.ResolveHost();      // Starts the clock, and the DNS phase if enabled, before Open()/Connect()
+ *   http->Open(...);
+ *   timing.MarkConnected();    // TCP connect + TLS handshake + request sent
+ *   timing.MarkRequestSent();  // Optional, after uploading a request body
+ *   http->GetStatusCode();
+ *   timing.MarkFirstByte();    // Response headers received
+ *   timing.Finish(true);
+ *
+ * The transport resolves, connects and handshakes inside Open(), so by default the connect phase
+ * includes DNS. With CONFIG_CONNECTION_TIMING_RESOLVE_DNS, ResolveHost() resolves the host on Wi-Fi
+ * boards first and leaves the answer in the lwIP DNS cache, so DNS and TCP + TLS are reported apart.
+ * That costs an extra blocking lookup per request, it is meant for diagnosis only. Cellular modems
+ * resolve on the module, there the connect phase always includes DNS.
+ *
+ * TLS session resumption is out of scope here. The handshakes run inside esp-ml307 (esp_tls on Wi-Fi
+ * boards, the module's own TLS stack on ML307 boards), which offers no way to pass a cached session
+ * in, so a shared session-ticket cache needs a change in that component. The connect phase stats
+ * show what a full handshake costs per host until then.
+ */
+class ConnectionTiming {
+public:
+    ConnectionTiming(const char* name, const std::string& url);
+    ~ConnectionTiming();
+
+    void ResolveHost();
+    void MarkConnected();
+    void MarkRequestSent();
+    void MarkFirstByte();
+    void Finish(bool success);
+
+    const std::string& host() const { return host_; }
+
+    static std::string GetStatsJson();
+
+private:
+    const char* name_;
+    std::string host_;
+    bool secure_ = false;
+    bool finished_ = false;
+    int64_t start_time_ = 0;
+    int64_t phase_time_ = 0;
+    int dns_ms_ = -1;
+    int connect_ms_ = -1;
+    int first_byte_ms_ = -1;
+
+    int ElapsedPhaseMs();
+};
+
+#endif // CONNECTION_TIMING_H
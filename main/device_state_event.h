@@ -1,39 +1,24 @@
 #ifndef _DEVICE_STATE_EVENT_H_
 #define _DEVICE_STATE_EVENT_H_
 
-#include <esp_event.h>
 #include <functional>
-#include <vector>
-#include <mutex>
 #include "device_state.h"
+#include "event_bus.h"
 
-ESP_EVENT_DECLARE_BASE(XIAOZHI_STATE_EVENTS);
-
-enum {
-    XIAOZHI_STATE_CHANGED_EVENT,
-};
-
-struct device_state_event_data_t {
-    DeviceState previous_state;
-    DeviceState current_state;
-};
-
+// Device state changes, delivered in order on the event bus task
 class DeviceStateEventManager {
 public:
     static DeviceStateEventManager& GetInstance();
     DeviceStateEventManager(const DeviceStateEventManager&) = delete;
     DeviceStateEventManager& operator=(const DeviceStateEventManager&) = delete;
 
-    void RegisterStateChangeCallback(std::function<void(DeviceState, DeviceState)> callback);
+    // Returns the event bus subscription id
+    int RegisterStateChangeCallback(std::function<void(DeviceState, DeviceState)> callback);
     void PostStateChangeEvent(DeviceState previous_state, DeviceState current_state);
-    std::vector<std::function<void(DeviceState, DeviceState)>> GetCallbacks();
 
 private:
-    DeviceStateEventManager();
-    ~DeviceStateEventManager();
-
-    std::vector<std::function<void(DeviceState, DeviceState)>> callbacks_;
-    std::mutex mutex_;
+    DeviceStateEventManager() = default;
+    ~DeviceStateEventManager() = default;
 };
 
-#endif // _DEVICE_STATE_EVENT_H_ 
\ No newline at end of file
+#endif // _DEVICE_STATE_EVENT_H_ 
@@ -35,6 +35,11 @@ void Display::ShowNotification(const char* notification, int duration_ms) {
 void Display::UpdateStatusBar(bool update_all) {
 }
 
+void Display::RefreshStatusBar(uint32_t items) {
+    // Displays without per-item updates redraw what they have
+    UpdateStatusBar(items == STATUS_BAR_ALL_ITEMS);
+}
+
 
 void Display::SetEmotion(const char* emotion) {
     ESP_LOGW(TAG, "SetEmotion: %s", emotion);
@@ -25,6 +25,16 @@ private:
     std::string name_;
 };
 
+// Status bar items that change by themselves, refreshed by StatusBarMonitor when due or notified
+enum StatusBarItem {
+    kStatusBarMute = 1 << 0,
+    kStatusBarClock = 1 << 1,
+    kStatusBarBattery = 1 << 2,
+    kStatusBarNetwork = 1 << 3,
+};
+#define STATUS_BAR_ITEM_COUNT 4
+#define STATUS_BAR_ALL_ITEMS ((1 << STATUS_BAR_ITEM_COUNT) - 1)
+
 class Display {
 public:
     Display();
@@ -38,6 +48,8 @@ public:
     virtual void SetTheme(Theme* theme);
     virtual Theme* GetTheme() { return current_theme_; }
     virtual void UpdateStatusBar(bool update_all = false);
+    // Queries only the given StatusBarItem sources, a widget is only redrawn when its value changed
+    virtual void RefreshStatusBar(uint32_t items);
     virtual void SetPowerSaveMode(bool on);
 
     inline int width() const { return width_; }
@@ -79,6 +79,7 @@ void LvglDisplay::SetStatus(const char* status) {
     lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
 
     last_status_update_time_ = std::chrono::system_clock::now();
+    clock_shown_ = false;
 }
 
 void LvglDisplay::ShowNotification(const std::string &notification, int duration_ms) {
@@ -99,12 +100,16 @@ void LvglDisplay::ShowNotification(const char* notification, int duration_ms) {
 }
 
 void LvglDisplay::UpdateStatusBar(bool update_all) {
+    RefreshStatusBar(STATUS_BAR_ALL_ITEMS);
+}
+
+void LvglDisplay::RefreshStatusBar(uint32_t items) {
     auto& app = Application::GetInstance();
     auto& board = Board::GetInstance();
     auto codec = board.GetAudioCodec();
 
     // Update mute icon
-    {
+    if (items & kStatusBarMute) {
         DisplayLockGuard lock(this);
         if (mute_label_ == nullptr) {
             return;
@@ -121,28 +126,37 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
     }
 
     // Update time
-    if (app.GetDeviceState() == kDeviceStateIdle) {
+    if ((items & kStatusBarClock) && app.GetDeviceState() == kDeviceStateIdle) {
         if (last_status_update_time_ + std::chrono::seconds(10) < std::chrono::system_clock::now()) {
             // Set status to clock "HH:MM"
             time_t now = time(NULL);
             struct tm* tm = localtime(&now);
             // Check if the we have already set the time
             if (tm->tm_year >= 2025 - 1900) {
-                char time_str[16];
+                char time_str[sizeof(clock_text_)];
                 strftime(time_str, sizeof(time_str), "%H:%M  ", tm);
-                SetStatus(time_str);
+                // The label is only redrawn when the minute changed or it showed something else
+                if (!clock_shown_ || strcmp(time_str, clock_text_) != 0) {
+                    SetStatus(time_str);
+                    strcpy(clock_text_, time_str);
+                    clock_shown_ = true;
+                }
             } else {
                 ESP_LOGW(TAG, "System time is not set, tm_year: %d", tm->tm_year);
             }
         }
     }
 
+    if (!(items & (kStatusBarBattery | kStatusBarNetwork))) {
+        return;
+    }
+
     esp_pm_lock_acquire(pm_lock_);
     // 更新电池图标
     int battery_level;
     bool charging, discharging;
     const char* icon = nullptr;
-    if (board.GetBatteryLevel(battery_level, charging, discharging)) {
+    if ((items & kStatusBarBattery) && board.GetBatteryLevel(battery_level, charging, discharging)) {
         if (charging) {
             icon = FONT_AWESOME_BATTERY_BOLT;
         } else {
@@ -177,11 +191,9 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
         }
     }
 
-    // 每 10 秒更新一次网络图标
-    static int seconds_counter = 0;
-    if (update_all || seconds_counter++ % 10 == 0) {
+    if (items & kStatusBarNetwork) {
         // 升级固件时，不读取 4G 网络状态，避免占用 UART 资源
-        auto device_state = Application::GetInstance().GetDeviceState();
+        auto device_state = app.GetDeviceState();
         static const std::vector<DeviceState> allowed_states = {
             kDeviceStateIdle,
             kDeviceStateStarting,
@@ -0,0 +1,196 @@
+#include "event_bus.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "EventBus"
+
+static_assert((EVENT_BUS_QUEUE_SIZE & (EVENT_BUS_QUEUE_SIZE - 1)) == 0, "EVENT_BUS_QUEUE_SIZE must be a power of two");
+
+EventBus::EventBus() {
+    for (uint32_t i = 0; i < EVENT_BUS_QUEUE_SIZE; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Above the main loop, so LED and status bar changes are not held back by long main loop tasks
+    xTaskCreate([](void* arg) {
+        ((EventBus*)arg)->Run();
+        vTaskDelete(NULL);
+    }, "event_bus", EVENT_BUS_TASK_STACK_SIZE, this, 4, &task_);
+}
+
+EventBus::~EventBus() {
+    if (task_ != nullptr) {
+        vTaskDelete(task_);
+    }
+}
+
+const char* EventBus::TopicName(EventTopic topic) {
+    switch (topic) {
+    case kEventDeviceState:
+        return "device_state";
+    case kEventVadChange:
+        return "vad";
+    case kEventBattery:
+        return "battery";
+    case kEventNetwork:
+        return "network";
+    default:
+        return "unknown";
+    }
+}
+
+int EventBus::AddSubscriber(EventTopic topic, std::function<void(const void*)> handler) {
+    std::lock_guard<std::mutex> lock(subscribe_mutex_);
+    int count = subscriber_counts_[topic].load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        // A handler that unsubscribed itself may still be running, its slot waits for the next call
+        auto& subscriber = subscribers_[topic][i];
+        if (subscriber.active.load() || dispatching_.load() == &subscriber) {
+            continue;
+        }
+        // The bus task only calls the handler after it sees the slot active again
+        subscriber.handler = std::move(handler);
+        subscriber.active.store(true, std::memory_order_release);
+        return topic * EVENT_BUS_MAX_SUBSCRIBERS + i;
+    }
+    if (count >= EVENT_BUS_MAX_SUBSCRIBERS) {
+        ESP_LOGE(TAG, "Too many subscribers for %s", TopicName(topic));
+        return -1;
+    }
+    auto& subscriber = subscribers_[topic][count];
+    subscriber.handler = std::move(handler);
+    subscriber.active.store(true, std::memory_order_relaxed);
+    // The bus task only reads slots below the count, the slot is complete before it is counted
+    subscriber_counts_[topic].store(count + 1, std::memory_order_release);
+    return topic * EVENT_BUS_MAX_SUBSCRIBERS + count;
+}
+
+void EventBus::Unsubscribe(int id) {
+    if (id < 0 || id >= kEventTopicCount * EVENT_BUS_MAX_SUBSCRIBERS) {
+        return;
+    }
+    // The handler stays in place in case the bus task is about to call it, until the slot is reused
+    auto& subscriber = subscribers_[id / EVENT_BUS_MAX_SUBSCRIBERS][id % EVENT_BUS_MAX_SUBSCRIBERS];
+    subscriber.active.store(false);
+    if (xTaskGetCurrentTaskHandle() == task_) {
+        return;
+    }
+    while (dispatching_.load() == &subscriber) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+bool EventBus::Push(EventTopic topic, const void* payload, size_t size) {
+    counters_[topic].published.fetch_add(1, std::memory_order_relaxed);
+
+    Cell* cell;
+    uint32_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        cell = &cells_[pos & (EVENT_BUS_QUEUE_SIZE - 1)];
+        uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(sequence - pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full, the bus task is behind; a blocked ISR would be worse than a lost event
+            counters_[topic].dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    cell->message.topic = topic;
+    cell->message.publish_time_us = esp_timer_get_time();
+    memcpy(cell->message.payload, payload, size);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    if (task_ == nullptr) {
+        return true;
+    }
+    if (xPortInIsrContext()) {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(task_, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    } else {
+        xTaskNotifyGive(task_);
+    }
+    return true;
+}
+
+// Bus task only. An event claimed but not yet written stops the drain, its publisher notifies again
+bool EventBus::Pop(Message& message) {
+    auto& cell = cells_[dequeue_pos_ & (EVENT_BUS_QUEUE_SIZE - 1)];
+    uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if ((int32_t)(sequence - (dequeue_pos_ + 1)) < 0) {
+        return false;
+    }
+    message = cell.message;
+    cell.sequence.store(dequeue_pos_ + EVENT_BUS_QUEUE_SIZE, std::memory_order_release);
+    dequeue_pos_++;
+    return true;
+}
+
+void EventBus::Deliver(const Message& message) {
+    int64_t start_time = esp_timer_get_time();
+    int count = subscriber_counts_[message.topic].load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        auto& subscriber = subscribers_[message.topic][i];
+        if (!subscriber.active.load(std::memory_order_acquire)) {
+            continue;
+        }
+        // Sequentially consistent with Unsubscribe(), it either sees the store or we see it inactive
+        dispatching_.store(&subscriber);
+        if (subscriber.active.load()) {
+            subscriber.handler(message.payload);
+        }
+        dispatching_.store(nullptr, std::memory_order_release);
+    }
+    int64_t end_time = esp_timer_get_time();
+
+    uint32_t latency_us = start_time - message.publish_time_us;
+    uint32_t handler_us = end_time - start_time;
+    if (handler_us > EVENT_BUS_SLOW_HANDLER_MS * 1000) {
+        ESP_LOGW(TAG, "Handlers of %s took %lu ms", TopicName(message.topic), handler_us / 1000);
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    auto& stats = delivery_stats_[message.topic];
+    stats.delivered++;
+    stats.total_latency_us += latency_us;
+    if (latency_us > stats.max_latency_us) {
+        stats.max_latency_us = latency_us;
+    }
+    if (handler_us > stats.max_handler_us) {
+        stats.max_handler_us = handler_us;
+    }
+}
+
+void EventBus::Run() {
+    Message message;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (Pop(message)) {
+            Deliver(message);
+        }
+    }
+}
+
+EventBusTopicStats EventBus::GetStats(EventTopic topic) {
+    EventBusTopicStats stats;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats = delivery_stats_[topic];
+    }
+    stats.published = counters_[topic].published.load(std::memory_order_relaxed);
+    stats.dropped = counters_[topic].dropped.load(std::memory_order_relaxed);
+    int count = subscriber_counts_[topic].load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        if (subscribers_[topic][i].active.load(std::memory_order_relaxed)) {
+            stats.subscribers++;
+        }
+    }
+    return stats;
+}
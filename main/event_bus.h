@@ -0,0 +1,154 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "device_state.h"
+
+// Events waiting for the bus task, must be a power of two
+#define EVENT_BUS_QUEUE_SIZE 32
+// Subscribers per topic, the tables are static and slots are reused after Unsubscribe()
+#define EVENT_BUS_MAX_SUBSCRIBERS 8
+#define EVENT_BUS_PAYLOAD_SIZE 16
+#define EVENT_BUS_TASK_STACK_SIZE (4096)
+// Handlers share one task, a slower one delays every other topic
+#define EVENT_BUS_SLOW_HANDLER_MS 20
+
+enum EventTopic {
+    kEventDeviceState,
+    kEventVadChange,
+    kEventBattery,
+    kEventNetwork,
+    kEventTopicCount,
+};
+
+struct DeviceStateChangedEvent {
+    static constexpr EventTopic kTopic = kEventDeviceState;
+    DeviceState previous_state;
+    DeviceState current_state;
+};
+
+struct VadChangedEvent {
+    static constexpr EventTopic kTopic = kEventVadChange;
+    bool speaking;
+};
+
+struct BatteryChangedEvent {
+    static constexpr EventTopic kTopic = kEventBattery;
+    int level;
+    bool charging;
+    bool discharging;
+};
+
+struct NetworkChangedEvent {
+    static constexpr EventTopic kTopic = kEventNetwork;
+    bool connected;
+};
+
+struct EventBusTopicStats {
+    uint32_t published = 0;
+    uint32_t delivered = 0;
+    uint32_t dropped = 0;           // The queue was full
+    uint32_t subscribers = 0;
+    uint64_t total_latency_us = 0;  // From Publish() until the handlers started
+    uint32_t max_latency_us = 0;
+    uint32_t max_handler_us = 0;    // Slowest delivery to all subscribers
+};
+
+/*
+ * Typed publish / subscribe between modules, e.g. the device state, VAD, battery and network.
+ *
+ * Publish() only copies the event into a preallocated lock-free ring and notifies the bus task,
+ * so it can be called from any task or ISR. The bus task delivers the events in order to the
+ * subscribers of their topic. Subscribers live in static per-topic tables, a slot given up with
+ * Unsubscribe() is reused by a later Subscribe(); handlers must be short and never run in ISR context.
+ */
+class EventBus {
+public:
+    static EventBus& GetInstance() {
+        static EventBus instance;
+        return instance;
+    }
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    // Task context only. Returns an id for Unsubscribe(), or -1 when the topic is full.
+    // Ids are reused, unsubscribe each id once
+    template <typename T>
+    int Subscribe(std::function<void(const T&)> handler) {
+        static_assert(T::kTopic < kEventTopicCount, "Unknown event topic");
+        return AddSubscriber(T::kTopic, [handler = std::move(handler)](const void* payload) {
+            handler(*static_cast<const T*>(payload));
+        });
+    }
+    // The handler is not called after this returns, unless called from the handler itself
+    void Unsubscribe(int id);
+
+    // Any task or ISR. Returns false when the event was dropped because the queue was full
+    template <typename T>
+    bool Publish(const T& event) {
+        static_assert(std::is_trivially_copyable<T>::value, "Events are copied into the queue");
+        static_assert(sizeof(T) <= EVENT_BUS_PAYLOAD_SIZE, "Event too large for the queue");
+        return Push(T::kTopic, &event, sizeof(T));
+    }
+
+    EventBusTopicStats GetStats(EventTopic topic);
+    static const char* TopicName(EventTopic topic);
+
+private:
+    EventBus();
+    ~EventBus();
+
+    struct Message {
+        EventTopic topic;
+        int64_t publish_time_us;
+        alignas(8) uint8_t payload[EVENT_BUS_PAYLOAD_SIZE];
+    };
+
+    // Bounded MPMC ring by Dmitry Vyukov, drained by the bus task only
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        Message message;
+    };
+
+    struct Subscriber {
+        std::atomic<bool> active{false};
+        std::function<void(const void*)> handler;
+    };
+
+    struct TopicCounters {
+        std::atomic<uint32_t> published{0};
+        std::atomic<uint32_t> dropped{0};
+    };
+
+    Cell cells_[EVENT_BUS_QUEUE_SIZE];
+    std::atomic<uint32_t> enqueue_pos_{0};
+    uint32_t dequeue_pos_ = 0;
+    TaskHandle_t task_ = nullptr;
+
+    std::mutex subscribe_mutex_;
+    Subscriber subscribers_[kEventTopicCount][EVENT_BUS_MAX_SUBSCRIBERS];
+    std::atomic<int> subscriber_counts_[kEventTopicCount] = {};
+    std::atomic<Subscriber*> dispatching_{nullptr};
+
+    TopicCounters counters_[kEventTopicCount];
+    // Delivery stats are only written by the bus task
+    std::mutex stats_mutex_;
+    EventBusTopicStats delivery_stats_[kEventTopicCount];
+
+    int AddSubscriber(EventTopic topic, std::function<void(const void*)> handler);
+    bool Push(EventTopic topic, const void* payload, size_t size);
+    bool Pop(Message& message);
+    void Deliver(const Message& message);
+    void Run();
+};
+
+#endif // EVENT_BUS_H
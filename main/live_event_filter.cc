@@ -0,0 +1,135 @@
+#include "live_event_filter.h"
+
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "LiveFilter"
+
+#define LIVE_DEDUP_BLOOM_HASHES 3
+
+// Bit positions for one fingerprint: multiply by a different odd constant each, then scale the high
+// bits to the filter size. Low bits alone would make every position depend on the same few input bits.
+static void BloomBits(uint32_t fingerprint, uint32_t bits[LIVE_DEDUP_BLOOM_HASHES]) {
+    static const uint32_t kMultipliers[LIVE_DEDUP_BLOOM_HASHES] = { 0x9e3779b1u, 0x85ebca6bu, 0xc2b2ae35u };
+    for (int i = 0; i < LIVE_DEDUP_BLOOM_HASHES; i++) {
+        bits[i] = (uint32_t)(((uint64_t)(fingerprint * kMultipliers[i]) * LIVE_DEDUP_BLOOM_BITS) >> 32);
+    }
+}
+
+LiveEventFilter::LiveEventFilter() {
+    memset(bloom_, 0, sizeof(bloom_));
+    global_.tokens_ms = LIVE_GLOBAL_BUCKET_SIZE * LIVE_GLOBAL_REFILL_MS;
+}
+
+bool LiveEventFilter::IsDuplicate(uint32_t fingerprint) {
+    uint32_t bits[LIVE_DEDUP_BLOOM_HASHES];
+    BloomBits(fingerprint, bits);
+    bool maybe = false;
+    for (auto& generation : bloom_) {
+        bool all = true;
+        for (auto bit : bits) {
+            all &= (generation[bit / 8] >> (bit % 8)) & 1;
+        }
+        maybe |= all;
+    }
+    if (!maybe) {
+        return false;
+    }
+
+    for (auto& recent : recent_) {
+        if (recent.fingerprint == fingerprint) {
+            recent.last_use = ++use_counter_;
+            return true;
+        }
+    }
+    stats_.bloom_unconfirmed++;
+    return false;
+}
+
+void LiveEventFilter::Remember(uint32_t fingerprint) {
+    if (++generation_count_ > LIVE_DEDUP_GENERATION_SIZE) {
+        // The older generation goes, the current one still covers the last LIVE_DEDUP_GENERATION_SIZE
+        generation_ ^= 1;
+        memset(bloom_[generation_], 0, sizeof(bloom_[generation_]));
+        generation_count_ = 1;
+    }
+    uint32_t bits[LIVE_DEDUP_BLOOM_HASHES];
+    BloomBits(fingerprint, bits);
+    for (auto bit : bits) {
+        bloom_[generation_][bit / 8] |= 1 << (bit % 8);
+    }
+
+    Recent* oldest = &recent_[0];
+    for (auto& recent : recent_) {
+        if (recent.last_use < oldest->last_use) {
+            oldest = &recent;
+        }
+    }
+    oldest->fingerprint = fingerprint;
+    oldest->last_use = ++use_counter_;
+}
+
+bool LiveEventFilter::Take(Bucket& bucket, int size, int refill_ms, int64_t now_us) {
+    int64_t elapsed_ms = (now_us - bucket.last_time) / 1000;
+    int64_t tokens_ms = bucket.tokens_ms + elapsed_ms;
+    if (tokens_ms > (int64_t)size * refill_ms) {
+        tokens_ms = (int64_t)size * refill_ms;
+    }
+    bucket.last_time = now_us;
+    if (tokens_ms < refill_ms) {
+        bucket.tokens_ms = tokens_ms;
+        return false;
+    }
+    bucket.tokens_ms = tokens_ms - refill_ms;
+    return true;
+}
+
+bool LiveEventFilter::Admit(uint32_t fingerprint, uint32_t user, bool rate_limited, int64_t now_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fingerprint != 0) {
+        if (IsDuplicate(fingerprint)) {
+            stats_.duplicates++;
+            return false;
+        }
+        Remember(fingerprint);
+    }
+    if (!rate_limited) {
+        return true;
+    }
+
+    if (user != 0) {
+        Bucket* bucket = nullptr;
+        Bucket* oldest = &buckets_[0];
+        for (auto& candidate : buckets_) {
+            if (candidate.user == user) {
+                bucket = &candidate;
+                break;
+            }
+            if (candidate.last_time < oldest->last_time) {
+                oldest = &candidate;
+            }
+        }
+        if (bucket == nullptr) {
+            // A viewer not seen for a while starts with a full bucket
+            bucket = oldest;
+            bucket->user = user;
+            bucket->tokens_ms = LIVE_USER_BUCKET_SIZE * LIVE_USER_REFILL_MS;
+            bucket->last_time = now_us;
+        }
+        if (!Take(*bucket, LIVE_USER_BUCKET_SIZE, LIVE_USER_REFILL_MS, now_us)) {
+            stats_.user_limited++;
+            return false;
+        }
+    }
+    if (!Take(global_, LIVE_GLOBAL_BUCKET_SIZE, LIVE_GLOBAL_REFILL_MS, now_us)) {
+        stats_.global_limited++;
+        ESP_LOGD(TAG, "Global rate limit hit");
+        return false;
+    }
+    return true;
+}
+
+LiveFilterStats LiveEventFilter::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
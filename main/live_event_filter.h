@@ -0,0 +1,80 @@
+#ifndef LIVE_EVENT_FILTER_H
+#define LIVE_EVENT_FILTER_H
+
+#include <mutex>
+#include <string_view>
+#include <cstdint>
+
+// Bloom filter generations, each rotated out after LIVE_DEDUP_GENERATION_SIZE insertions
+#define LIVE_DEDUP_BLOOM_BITS 2048
+#define LIVE_DEDUP_GENERATION_SIZE 256
+// Exact fingerprints kept to confirm bloom hits, least recently seen evicted
+#define LIVE_DEDUP_RECENT_SIZE 64
+// Per viewer: a burst of 2 chat messages, then one every 15 seconds
+#define LIVE_USER_BUCKET_COUNT 32
+#define LIVE_USER_BUCKET_SIZE 2
+#define LIVE_USER_REFILL_MS 15000
+// All viewers together: a burst of 10, then 2 per second
+#define LIVE_GLOBAL_BUCKET_SIZE 10
+#define LIVE_GLOBAL_REFILL_MS 500
+
+// FNV-1a, also used for method names and coalescing keys
+inline uint32_t LiveEventHash(std::string_view data, uint32_t hash = 2166136261u) {
+    for (char c : data) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return hash;
+}
+
+struct LiveFilterStats {
+    uint32_t duplicates = 0;
+    // Bloom hits the exact set did not confirm: false positives, or resends older than the LRU. Both pass.
+    uint32_t bloom_unconfirmed = 0;
+    uint32_t user_limited = 0;
+    uint32_t global_limited = 0;
+};
+
+/*
+ * Drops resent live-stream events and throttles chatty viewers before they reach the event queue.
+ *
+ * Duplicates are found by fingerprint (the platform's message id, or user and content). A two-generation
+ * bloom filter answers "never seen" for the common case without a scan. Its hits are confirmed against
+ * a small LRU of exact fingerprints, so a false positive never drops a fresh message. Rate limits are
+ * token buckets, one per viewer in a fixed table and one shared by everyone. Thread safe.
+ */
+class LiveEventFilter {
+public:
+    LiveEventFilter();
+
+    // fingerprint 0 skips deduplication, user 0 the per-viewer limit
+    bool Admit(uint32_t fingerprint, uint32_t user, bool rate_limited, int64_t now_us);
+
+    LiveFilterStats GetStats();
+
+private:
+    struct Bucket {
+        uint32_t user = 0;
+        int32_t tokens_ms = 0;      // Tokens scaled by the refill period, so refilling is integer math
+        int64_t last_time = 0;
+    };
+    struct Recent {
+        uint32_t fingerprint = 0;
+        uint32_t last_use = 0;
+    };
+
+    std::mutex mutex_;
+    uint8_t bloom_[2][LIVE_DEDUP_BLOOM_BITS / 8];
+    int generation_ = 0;
+    int generation_count_ = 0;
+    Recent recent_[LIVE_DEDUP_RECENT_SIZE];
+    uint32_t use_counter_ = 0;
+    Bucket buckets_[LIVE_USER_BUCKET_COUNT];
+    Bucket global_;
+    LiveFilterStats stats_;
+
+    bool IsDuplicate(uint32_t fingerprint);
+    void Remember(uint32_t fingerprint);
+    bool Take(Bucket& bucket, int size, int refill_ms, int64_t now_us);
+};
+
+#endif // LIVE_EVENT_FILTER_H
@@ -0,0 +1,324 @@
+#include "live_event_parser.h"
+#include "json_reader.h"
+
+#include <esp_log.h>
+#include <cstdlib>
+
+#define TAG "LiveEvents"
+
+// Power of two, at least twice the number of methods so probes stay short
+#define LIVE_METHOD_TABLE_SIZE 16
+
+enum LiveMethod {
+    kLiveMethodNone,        // No method member, maybe a room entry
+    kLiveMethodOther,       // A webcast method nothing is shown for
+    kLiveMethodChat,
+    kLiveMethodMember,
+    kLiveMethodGift,
+    kLiveMethodRoomStats,
+    kLiveMethodRoomUserSeq,
+};
+
+struct LiveMethodSlot {
+    std::string_view name;
+    LiveMethod method = kLiveMethodNone;
+};
+
+static const LiveMethodSlot* BuildMethodTable() {
+    static const LiveMethodSlot methods[] = {
+        { "WebcastChatMessage", kLiveMethodChat },
+        { "WebcastMemberMessage", kLiveMethodMember },
+        { "WebcastGiftMessage", kLiveMethodGift },
+        { "WebcastRoomStatsMessage", kLiveMethodRoomStats },
+        { "WebcastRoomUserSeqMessage", kLiveMethodRoomUserSeq },
+    };
+    static LiveMethodSlot table[LIVE_METHOD_TABLE_SIZE];
+    for (auto& method : methods) {
+        uint32_t index = LiveEventHash(method.name) & (LIVE_METHOD_TABLE_SIZE - 1);
+        while (!table[index].name.empty()) {
+            index = (index + 1) & (LIVE_METHOD_TABLE_SIZE - 1);
+        }
+        table[index] = method;
+    }
+    return table;
+}
+
+static LiveMethod LookupMethod(std::string_view name) {
+    static const LiveMethodSlot* table = BuildMethodTable();
+    uint32_t index = LiveEventHash(name) & (LIVE_METHOD_TABLE_SIZE - 1);
+    while (!table[index].name.empty()) {
+        if (table[index].name == name) {
+            return table[index].method;
+        }
+        index = (index + 1) & (LIVE_METHOD_TABLE_SIZE - 1);
+    }
+    return kLiveMethodOther;
+}
+
+// One member of a nested object, e.g. user.name
+static JsonValue GetMember(const JsonValue& object, std::string_view name) {
+    JsonReader reader(object);
+    std::string_view key;
+    JsonValue value;
+    while (reader.Next(key, value)) {
+        if (key == name) {
+            return value;
+        }
+    }
+    return JsonValue();
+}
+
+// Name to show, and a hash of the platform's user id (or the name without one) for rate limiting
+static std::string GetUser(const JsonValue& user, uint32_t* user_hash = nullptr) {
+    JsonReader reader(user);
+    std::string_view key;
+    JsonValue value;
+    JsonValue name;
+    JsonValue id;
+    while (reader.Next(key, value)) {
+        if (key == "name") {
+            name = value;
+        } else if (key == "id") {
+            id = value;
+        }
+    }
+    if (user_hash != nullptr) {
+        *user_hash = id.present() ? LiveEventHash(id.raw) : name.present() ? LiveEventHash(name.raw) : 0;
+    }
+    return name.is_string() ? name.str() : "unknown";
+}
+
+// Keyed events replace an earlier one from the same message
+static void AddEvent(std::vector<LiveEvent>& events, LiveEvent&& event) {
+    if (!event.key.empty()) {
+        for (auto it = events.rbegin(); it != events.rend(); ++it) {
+            if (it->key == event.key) {
+                *it = std::move(event);
+                return;
+            }
+        }
+    }
+    events.push_back(std::move(event));
+}
+
+namespace {
+
+// The members of one item that any event type uses, read in a single pass
+struct LiveItem {
+    LiveMethod method = kLiveMethodNone;
+    JsonValue room_id;
+    JsonValue nickname;
+    JsonValue title;
+    JsonValue user;
+    JsonValue content;
+    JsonValue gift;
+    JsonValue combo_count;
+    JsonValue room;
+    JsonValue rank;
+    JsonValue msg_id;
+    bool jsonrpc = false;
+
+    bool Read(const JsonValue& item) {
+        JsonReader reader(item);
+        std::string_view key;
+        JsonValue value;
+        while (reader.Next(key, value)) {
+            if (key == "method") {
+                if (value.is_string() && !value.escaped) {
+                    method = LookupMethod(value.raw);
+                } else if (value.is_string()) {
+                    method = LookupMethod(value.str());
+                }
+            } else if (key == "user") {
+                user = value;
+            } else if (key == "content") {
+                content = value;
+            } else if (key == "gift") {
+                gift = value;
+            } else if (key == "comboCount") {
+                combo_count = value;
+            } else if (key == "room") {
+                room = value;
+            } else if (key == "rank") {
+                rank = value;
+            } else if (key == "roomId") {
+                room_id = value;
+            } else if (key == "nickname") {
+                nickname = value;
+            } else if (key == "title") {
+                title = value;
+            } else if (key == "msgId") {
+                msg_id = value;
+            } else if (key == "jsonrpc") {
+                jsonrpc = value.Equals("2.0");
+            }
+        }
+        return reader.valid() && !jsonrpc;
+    }
+};
+
+}  // namespace
+
+// The platform's message id when it has one, otherwise what makes a resent event identical
+static uint32_t Fingerprint(const LiveItem& item, uint32_t user, std::string_view extra) {
+    if (item.msg_id.present()) {
+        return LiveEventHash(item.msg_id.raw) | 1;
+    }
+    uint32_t hash = LiveEventHash(std::string_view((const char*)&user, sizeof(user)));
+    hash = LiveEventHash(item.content.raw, hash);
+    return LiveEventHash(extra, hash) | 1;
+}
+
+LiveEventParseResult LiveEventParser::Parse(const char* data, size_t length, int64_t now_us,
+    std::vector<LiveEvent>& events, LiveEventFilter* filter) {
+    LiveEventParseResult result;
+    JsonReader reader(data, length);
+    if (!reader.valid()) {
+        result.valid = false;
+        return result;
+    }
+
+    // Member joins of the whole message become one event
+    size_t member_count = 0;
+    std::string member_names[LIVE_EVENT_MAX_MEMBER_NAMES];
+
+    auto parse_item = [&](const JsonValue& value) {
+        result.items++;
+        LiveItem item;
+        if (value.type != kJsonValueObject || !item.Read(value)) {
+            result.unknown++;
+            return;
+        }
+
+        LiveEvent event;
+        event.time_us = now_us;
+        switch (item.method) {
+        case kLiveMethodNone:
+            // roomId + nickname/title style (simple chat entry)
+            if (!item.room_id.is_string() || !item.nickname.is_string()) {
+                result.unknown++;
+                return;
+            }
+            event.priority = kLiveEventChat;
+            event.key = "room";
+            if (item.title.is_string()) {
+                event.prompt = "进入" + item.nickname.str() + "的直播间，带货兔，跟直播间朋友欢快地打个招呼吧，不要调用任何工具。";
+            } else {
+                event.prompt = item.nickname.str();
+            }
+            event.text = event.prompt;
+            break;
+        case kLiveMethodChat: {
+            uint32_t user;
+            std::string name = GetUser(item.user, &user);
+            if (filter != nullptr && !filter->Admit(Fingerprint(item, user, "chat"), user, true, now_us)) {
+                return;
+            }
+            event.priority = kLiveEventChat;
+            event.text = name + ": " + (item.content.is_string() ? item.content.str() : "");
+            event.prompt = event.text;
+            break;
+        }
+        case kLiveMethodMember: {
+            uint32_t user;
+            std::string name = GetUser(item.user, &user);
+            // Platforms resend joins, a viewer is greeted once
+            if (filter != nullptr && !filter->Admit(Fingerprint(item, user, "member"), 0, false, now_us)) {
+                return;
+            }
+            // Newest names are listed
+            member_names[member_count % LIVE_EVENT_MAX_MEMBER_NAMES] = std::move(name);
+            member_count++;
+            return;
+        }
+        case kLiveMethodGift: {
+            uint32_t user;
+            std::string name = GetUser(item.user, &user);
+            auto gift_name = GetMember(item.gift, "name");
+            // Gifts are never rate limited, only resends are dropped
+            if (filter != nullptr && !filter->Admit(Fingerprint(item, user, std::string(gift_name.raw) + ":" + std::string(item.combo_count.raw)),
+                0, false, now_us)) {
+                return;
+            }
+            std::string gift_text = gift_name.is_string() ? gift_name.str() : "礼物";
+            int combo = item.combo_count.present() ? atoi(item.combo_count.str().c_str()) : 0;
+            if (combo > 1) {
+                gift_text += " x" + std::to_string(combo);
+            }
+            event.priority = kLiveEventGift;
+            // A combo sends one message per hit, only the latest count matters
+            event.key = "gift:" + name + ":" + (gift_name.is_string() ? gift_name.str() : "");
+            event.text = name + " 送出了 " + gift_text;
+            event.prompt = event.text;
+            break;
+        }
+        case kLiveMethodRoomStats: {
+            auto audience = GetMember(item.room, "audienceCount");
+            if (!audience.is_string()) {
+                return;
+            }
+            event.priority = kLiveEventStats;
+            event.key = "WebcastRoomStatsMessage";
+            event.text = "直播间观众人数: " + audience.str();
+            break;
+        }
+        case kLiveMethodRoomUserSeq: {
+            if (item.rank.type != kJsonValueArray) {
+                return;
+            }
+            std::string preview;
+            JsonReader rank(item.rank);
+            JsonValue entry;
+            for (int i = 0; i < 3 && rank.NextElement(entry); i++) {
+                auto nickname = GetMember(entry, "nickname");
+                if (nickname.is_string()) {
+                    if (!preview.empty()) preview += ", ";
+                    preview += nickname.str();
+                }
+            }
+            if (preview.empty()) {
+                return;
+            }
+            event.priority = kLiveEventStats;
+            event.key = "WebcastRoomUserSeqMessage";
+            event.text = "直播间前三位观众: " + preview;
+            break;
+        }
+        default:
+            // Known webcast method without anything to show
+            return;
+        }
+        AddEvent(events, std::move(event));
+    };
+
+    if (reader.is_array()) {
+        JsonValue item;
+        while (reader.NextElement(item)) {
+            parse_item(item);
+        }
+    } else {
+        JsonValue item;
+        item.type = kJsonValueObject;
+        item.raw = std::string_view(data, length);
+        parse_item(item);
+    }
+
+    if (member_count > 0) {
+        std::string names;
+        size_t listed = member_count < LIVE_EVENT_MAX_MEMBER_NAMES ? member_count : LIVE_EVENT_MAX_MEMBER_NAMES;
+        for (size_t i = 0; i < listed; i++) {
+            if (!names.empty()) names += ", ";
+            names += member_names[(member_count - 1 - i) % LIVE_EVENT_MAX_MEMBER_NAMES];
+        }
+        LiveEvent event;
+        event.priority = kLiveEventMember;
+        // Joins still waiting from an earlier message are superseded, nobody greets them anymore
+        event.key = "member";
+        event.text = std::to_string(member_count) + " 位新观众: " + names;
+        event.prompt = event.text;
+        event.time_us = now_us;
+        AddEvent(events, std::move(event));
+    }
+    ESP_LOGD(TAG, "Parsed %u items into %u events", (unsigned)result.items, (unsigned)events.size());
+    return result;
+}
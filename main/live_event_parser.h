@@ -0,0 +1,35 @@
+#ifndef LIVE_EVENT_PARSER_H
+#define LIVE_EVENT_PARSER_H
+
+#include "live_event_queue.h"
+#include "live_event_filter.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Names listed in a merged member-join event
+#define LIVE_EVENT_MAX_MEMBER_NAMES 3
+
+struct LiveEventParseResult {
+    size_t items = 0;
+    size_t unknown = 0;     // Items that are not live-stream events
+    bool valid = true;      // False if the text is not a JSON object or array
+};
+
+/*
+ * Turns one ingest message, a Douyin-style event object or an array of them, into live events.
+ *
+ * The text is read in place with JsonReader, each item in a single pass over its members, and the
+ * method name is looked up in a small hash table. Within one message member joins are merged into
+ * a single "N new viewers" event, and events with a coalescing key keep only the last one, so a batch
+ * of hundreds of items comes out as a handful of events.
+ */
+class LiveEventParser {
+public:
+    // With a filter, resent chat, joins and gifts are dropped and chat is rate limited per viewer and overall
+    static LiveEventParseResult Parse(const char* data, size_t length, int64_t now_us, std::vector<LiveEvent>& events,
+        LiveEventFilter* filter = nullptr);
+};
+
+#endif // LIVE_EVENT_PARSER_H
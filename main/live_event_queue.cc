@@ -0,0 +1,130 @@
+#include "live_event_queue.h"
+
+#include <esp_log.h>
+
+#define TAG "LiveEvents"
+
+bool LiveEventQueue::Coalesce(LiveEvent& event) {
+    if (event.key.empty()) {
+        return false;
+    }
+    for (auto& queued : queues_[event.priority]) {
+        if (queued.key == event.key) {
+            // Keep the queue position, so a stream of updates cannot jump ahead of older events
+            queued.text = std::move(event.text);
+            queued.prompt = std::move(event.prompt);
+            return true;
+        }
+    }
+    return false;
+}
+
+void LiveEventQueue::PushLocked(LiveEvent&& event) {
+    stats_.received++;
+    if (Coalesce(event)) {
+        stats_.coalesced++;
+        return;
+    }
+
+    if (size_ >= LIVE_EVENT_QUEUE_SIZE) {
+        int victim = kLiveEventPriorityCount - 1;
+        while (victim > event.priority && queues_[victim].empty()) {
+            victim--;
+        }
+        stats_.dropped++;
+        if (queues_[victim].empty()) {
+            // Less important than everything queued
+            ESP_LOGD(TAG, "Queue full, dropping new event: %s", event.text.c_str());
+            return;
+        }
+        queues_[victim].pop_front();
+        size_--;
+    }
+
+    queues_[event.priority].push_back(std::move(event));
+    size_++;
+}
+
+bool LiveEventQueue::ScheduleDrainLocked() {
+    if (drain_pending_ || size_ == 0) {
+        return false;
+    }
+    drain_pending_ = true;
+    return true;
+}
+
+bool LiveEventQueue::Push(LiveEvent&& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PushLocked(std::move(event));
+    return ScheduleDrainLocked();
+}
+
+bool LiveEventQueue::Push(std::vector<LiveEvent>&& events) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& event : events) {
+        PushLocked(std::move(event));
+    }
+    return ScheduleDrainLocked();
+}
+
+void LiveEventQueue::BeginDrain() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain_pending_ = false;
+}
+
+bool LiveEventQueue::PopDisplayOnly(LiveEvent& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& queue : queues_) {
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (it->prompt.empty()) {
+                event = std::move(*it);
+                queue.erase(it);
+                size_--;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool LiveEventQueue::PopForLlm(LiveEvent& event, int64_t now_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& queue : queues_) {
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->prompt.empty()) {
+                ++it;
+                continue;
+            }
+            if (now_us - it->time_us > LIVE_EVENT_MAX_AGE_MS * 1000LL) {
+                stats_.expired++;
+                it = queue.erase(it);
+                size_--;
+                continue;
+            }
+            event = std::move(*it);
+            queue.erase(it);
+            size_--;
+            stats_.forwarded++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LiveEventQueue::HasLlmEvents() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& queue : queues_) {
+        for (auto& event : queue) {
+            if (!event.prompt.empty()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+LiveEventStats LiveEventQueue::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.pending = size_;
+    return stats_;
+}
@@ -0,0 +1,83 @@
+#ifndef LIVE_EVENT_QUEUE_H
+#define LIVE_EVENT_QUEUE_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Events waiting for the main loop, across all priorities
+#define LIVE_EVENT_QUEUE_SIZE 32
+// Chat that waited longer than this is no longer worth answering
+#define LIVE_EVENT_MAX_AGE_MS 30000
+// Minimum time between two events handed to the LLM
+#define LIVE_EVENT_LLM_INTERVAL_MS 8000
+
+// Lower value is more important
+enum LiveEventPriority {
+    kLiveEventGift,
+    kLiveEventChat,
+    kLiveEventMember,
+    kLiveEventStats,
+    kLiveEventPriorityCount,
+};
+
+struct LiveEvent {
+    LiveEventPriority priority = kLiveEventChat;
+    // A queued event with the same key is replaced instead of queueing another one, empty to never coalesce
+    std::string key;
+    // Shown on the display
+    std::string text;
+    // Sent to the LLM, empty for display-only events such as room statistics
+    std::string prompt;
+    int64_t time_us = 0;
+};
+
+struct LiveEventStats {
+    uint32_t received = 0;
+    uint32_t coalesced = 0;
+    uint32_t dropped = 0;       // Queue full
+    uint32_t expired = 0;       // Waited longer than LIVE_EVENT_MAX_AGE_MS for the LLM
+    uint32_t forwarded = 0;     // Handed to the LLM
+    uint32_t pending = 0;
+};
+
+/*
+ * Bounded queue between the live-stream ingest task and the main loop.
+ *
+ * Events are popped by priority, oldest first within a priority. When the queue is full the oldest
+ * event of the least important non-empty priority makes room, or the new event is dropped if it is
+ * less important than everything queued. Thread safe.
+ */
+class LiveEventQueue {
+public:
+    // Returns true when the consumer has to be scheduled, i.e. no drain is pending yet
+    bool Push(LiveEvent&& event);
+    // All events of one ingest message under one lock
+    bool Push(std::vector<LiveEvent>&& events);
+
+    // Marks the start of a drain, the next Push() schedules a new one
+    void BeginDrain();
+    // Display-only events, they never wait for the LLM
+    bool PopDisplayOnly(LiveEvent& event);
+    // The most important event for the LLM, expired ones are dropped on the way
+    bool PopForLlm(LiveEvent& event, int64_t now_us);
+    bool HasLlmEvents();
+
+    LiveEventStats GetStats();
+
+private:
+    std::mutex mutex_;
+    std::deque<LiveEvent> queues_[kLiveEventPriorityCount];
+    size_t size_ = 0;
+    bool drain_pending_ = false;
+    LiveEventStats stats_;
+
+    bool Coalesce(LiveEvent& event);
+    void PushLocked(LiveEvent&& event);
+    bool ScheduleDrainLocked();
+};
+
+#endif // LIVE_EVENT_QUEUE_H
@@ -0,0 +1,312 @@
+#include "main_task_queue.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+
+#define TAG "MainTasks"
+
+static const uint32_t kLaneSizes[kTaskLaneCount] = {
+    MAIN_TASK_AUDIO_QUEUE_SIZE,
+    MAIN_TASK_UI_QUEUE_SIZE,
+    MAIN_TASK_TELEMETRY_QUEUE_SIZE,
+};
+
+MainTaskQueue::MainTaskQueue() {
+    for (int i = 0; i < kTaskLaneCount; i++) {
+        auto& lane = lanes_[i];
+        lane.slots.reset(new Slot[kLaneSizes[i]]);
+        lane.overflow.reset(new Overflowed[MAIN_TASK_OVERFLOW_SIZE]);
+        lane.overflow_capacity = MAIN_TASK_OVERFLOW_SIZE;
+        lane.mask = kLaneSizes[i] - 1;
+        for (uint32_t j = 0; j < kLaneSizes[i]; j++) {
+            lane.slots[j].sequence.store(j, std::memory_order_relaxed);
+        }
+    }
+
+    esp_timer_create_args_t watchdog_timer_args = {
+        .callback = [](void* arg) {
+            ((MainTaskQueue*)arg)->OnWatchdog();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "main_task_watchdog",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&watchdog_timer_args, &watchdog_timer_);
+}
+
+MainTaskQueue::~MainTaskQueue() {
+    if (watchdog_timer_ != nullptr) {
+        esp_timer_stop(watchdog_timer_);
+        esp_timer_delete(watchdog_timer_);
+    }
+}
+
+// Bounded MPMC ring by Dmitry Vyukov, used here with a single consumer. A slot's sequence tells
+// whose turn it is: equal to the position when free for that producer, position + 1 once filled.
+bool MainTaskQueue::TryPush(Lane& lane, MainTask& task, int64_t time_us, const char* name) {
+    uint32_t position = lane.enqueue_position.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &lane.slots[position & lane.mask];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(sequence - position);
+        if (diff == 0) {
+            if (lane.enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            position = lane.enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+    slot->task = std::move(task);
+    slot->time_us = time_us;
+    slot->name = name;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool MainTaskQueue::TryPop(Lane& lane, MainTask& task, int64_t& time_us, const char*& name) {
+    uint32_t position = lane.dequeue_position.load(std::memory_order_relaxed);
+    Slot* slot = &lane.slots[position & lane.mask];
+    uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if ((int32_t)(sequence - (position + 1)) < 0) {
+        return false;
+    }
+    task = std::move(slot->task);
+    time_us = slot->time_us;
+    name = slot->name;
+    slot->sequence.store(position + lane.mask + 1, std::memory_order_release);
+    lane.dequeue_position.store(position + 1, std::memory_order_relaxed);
+    return true;
+}
+
+bool MainTaskQueue::Push(MainTask&& task, MainTaskLane lane_index, const char* name) {
+    auto& lane = lanes_[lane_index];
+    int64_t now = esp_timer_get_time();
+    if (task.on_heap()) {
+        lane.heap_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Once spilling, keep spilling until the main loop empties the list, or tasks would overtake it
+    if (!lane.overflowed.load(std::memory_order_acquire) && TryPush(lane, task, now, name)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    if (!lane.overflowed.load(std::memory_order_relaxed)) {
+        ESP_LOGW(TAG, "Lane %d is full, spilling tasks from %s", lane_index, name);
+    }
+    lane.overflowed.store(true, std::memory_order_release);
+    if (lane.overflow_size == lane.overflow_capacity) {
+        if (lane_index != kTaskLaneAudioControl) {
+            // Logged once per spill, the count tells how many followed
+            if (!lane.dropping) {
+                ESP_LOGE(TAG, "Lane %d overflow is full, dropping tasks from %s", lane_index, name);
+                lane.dropping = true;
+            }
+            lane.drop_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // Audio control tasks finish opens and state changes that nothing else would redo, never dropped
+        GrowOverflow(lane);
+        ESP_LOGW(TAG, "Lane %d overflow grown to %lu tasks", lane_index, lane.overflow_capacity);
+    }
+    auto& entry = lane.overflow[(lane.overflow_head + lane.overflow_size) % lane.overflow_capacity];
+    entry.task = std::move(task);
+    entry.time_us = now;
+    entry.name = name;
+    lane.overflow_size++;
+    lane.overflow_count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Called with overflow_mutex_ held, keeps the entries in order
+void MainTaskQueue::GrowOverflow(Lane& lane) {
+    uint32_t capacity = lane.overflow_capacity * 2;
+    std::unique_ptr<Overflowed[]> overflow(new Overflowed[capacity]);
+    for (uint32_t i = 0; i < lane.overflow_size; i++) {
+        auto& entry = lane.overflow[(lane.overflow_head + i) % lane.overflow_capacity];
+        overflow[i].task = std::move(entry.task);
+        overflow[i].time_us = entry.time_us;
+        overflow[i].name = entry.name;
+    }
+    lane.overflow = std::move(overflow);
+    lane.overflow_head = 0;
+    lane.overflow_capacity = capacity;
+}
+
+bool MainTaskQueue::PopNext(MainTask& task, int64_t& time_us, const char*& name, Lane*& from) {
+    for (auto& lane : lanes_) {
+        if (TryPop(lane, task, time_us, name)) {
+            from = &lane;
+            return true;
+        }
+        if (lane.overflowed.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            // The ring may have been refilled since, it still goes first
+            if (TryPop(lane, task, time_us, name)) {
+                from = &lane;
+                return true;
+            }
+            if (lane.overflow_size > 0) {
+                auto& front = lane.overflow[lane.overflow_head];
+                task = std::move(front.task);
+                time_us = front.time_us;
+                name = front.name;
+                lane.overflow_head = (lane.overflow_head + 1) % lane.overflow_capacity;
+                lane.overflow_size--;
+                from = &lane;
+                if (lane.overflow_size == 0) {
+                    lane.overflowed.store(false, std::memory_order_release);
+                    lane.dropping = false;
+                }
+                return true;
+            }
+            lane.overflowed.store(false, std::memory_order_release);
+        }
+    }
+    return false;
+}
+
+size_t MainTaskQueue::RunPending() {
+    // Tasks scheduled by these tasks run on the next wake-up, like the old deque swap
+    size_t pending = 0;
+    for (auto& lane : lanes_) {
+        pending += lane.enqueue_position.load(std::memory_order_acquire) - lane.dequeue_position.load(std::memory_order_relaxed);
+        if (lane.overflowed.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            pending += lane.overflow_size;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        for (auto& lane : lanes_) {
+            uint32_t depth = lane.enqueue_position.load(std::memory_order_relaxed) - lane.dequeue_position.load(std::memory_order_relaxed);
+            if (depth > lane.stats.max_depth) {
+                lane.stats.max_depth = depth;
+            }
+        }
+    }
+
+    size_t executed = 0;
+    MainTask task;
+    int64_t time_us;
+    const char* name;
+    Lane* from;
+    while (executed < pending && PopNext(task, time_us, name, from)) {
+        int64_t start_time = BeginWork(name);
+        task();
+        task.Reset();
+        EndWork(name, from - lanes_, start_time, (uint32_t)(start_time - time_us));
+        executed++;
+    }
+    return executed;
+}
+
+int64_t MainTaskQueue::BeginWork(const char* name) {
+    int64_t now = esp_timer_get_time();
+    current_start_time_.store(now, std::memory_order_relaxed);
+    current_name_.store(name, std::memory_order_release);
+    // Fails when a check re-armed by the watchdog is still pending, that check covers this task
+    esp_timer_start_once(watchdog_timer_, MAIN_TASK_WATCHDOG_MS * 1000);
+    return now;
+}
+
+void MainTaskQueue::EndWork(const char* name, int lane_index, int64_t start_time, uint32_t wait_us) {
+    current_name_.store(nullptr, std::memory_order_release);
+    esp_timer_stop(watchdog_timer_);
+    int64_t now = esp_timer_get_time();
+    uint32_t run_us = (uint32_t)(now - start_time);
+    bool long_task = run_us >= MAIN_TASK_LONG_TASK_MS * 1000;
+    if (long_task && lane_index < 0) {
+        ESP_LOGW(TAG, "%s ran for %lu ms", name, run_us / 1000);
+    } else if (long_task) {
+        ESP_LOGW(TAG, "%s ran for %lu ms (lane %d, waited %lu ms)", name, run_us / 1000, lane_index, wait_us / 1000);
+    }
+
+    // The loop's own work, such as sending audio every frame, would flush the history, only its long runs are kept
+    if (lane_index < 0 && !long_task) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    auto& timing = history_[history_count_++ % MAIN_TASK_TIMING_HISTORY_SIZE];
+    timing.name = name;
+    timing.lane = lane_index;
+    timing.wait_us = wait_us;
+    timing.run_us = run_us;
+    timing.start_time_us = start_time;
+
+    if (lane_index < 0) {
+        long_work_count_++;
+        return;
+    }
+    auto& stats = lanes_[lane_index].stats;
+    stats.executed++;
+    stats.last_latency_us = wait_us;
+    stats.total_latency_us += wait_us;
+    if (wait_us > stats.max_latency_us) {
+        stats.max_latency_us = wait_us;
+    }
+    stats.total_run_us += run_us;
+    if (run_us > stats.max_run_us) {
+        stats.max_run_us = run_us;
+    }
+    if (long_task) {
+        stats.long_tasks++;
+    }
+}
+
+// Runs on the esp_timer task while the main loop may be blocked, so it only reads atomics
+void MainTaskQueue::OnWatchdog() {
+    const char* name = current_name_.load(std::memory_order_acquire);
+    if (name == nullptr) {
+        return;
+    }
+    int64_t elapsed = esp_timer_get_time() - current_start_time_.load(std::memory_order_relaxed);
+    int64_t period = MAIN_TASK_WATCHDOG_MS * 1000;
+    if (elapsed >= period) {
+        watchdog_count_.fetch_add(1, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "Main loop blocked in %s for %lld ms", name, elapsed / 1000);
+        esp_timer_start_once(watchdog_timer_, period);
+    } else {
+        // Armed for an earlier task, wait out the rest of this one's period
+        esp_timer_start_once(watchdog_timer_, period - elapsed);
+    }
+}
+
+MainTaskLaneStats MainTaskQueue::GetStats(MainTaskLane lane_index) {
+    auto& lane = lanes_[lane_index];
+    MainTaskLaneStats stats;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats = lane.stats;
+    }
+    stats.overflowed = lane.overflow_count.load(std::memory_order_relaxed);
+    stats.dropped = lane.drop_count.load(std::memory_order_relaxed);
+    stats.heap_tasks = lane.heap_count.load(std::memory_order_relaxed);
+    // A snapshot, the producers and the main loop keep moving; the position is read first so it never goes negative
+    uint32_t dequeue_position = lane.dequeue_position.load(std::memory_order_acquire);
+    stats.depth = lane.enqueue_position.load(std::memory_order_acquire) - dequeue_position;
+    return stats;
+}
+
+std::vector<MainTaskTiming> MainTaskQueue::GetRecentTimings() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    uint32_t count = std::min<uint32_t>(history_count_, MAIN_TASK_TIMING_HISTORY_SIZE);
+    std::vector<MainTaskTiming> timings;
+    timings.reserve(count);
+    for (uint32_t i = 1; i <= count; i++) {
+        timings.push_back(history_[(history_count_ - i) % MAIN_TASK_TIMING_HISTORY_SIZE]);
+    }
+    return timings;
+}
+
+uint32_t MainTaskQueue::long_work_count() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return long_work_count_;
+}
@@ -0,0 +1,248 @@
+#ifndef MAIN_TASK_QUEUE_H
+#define MAIN_TASK_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_timer.h>
+
+// Captures up to this size are stored inside the task, e.g. `this` plus a std::string
+#define MAIN_TASK_INLINE_SIZE (sizeof(void*) * 10)
+// Ring sizes, powers of two. A full ring spills into a locked list of fixed size per lane.
+#define MAIN_TASK_AUDIO_QUEUE_SIZE 16
+#define MAIN_TASK_UI_QUEUE_SIZE 32
+#define MAIN_TASK_TELEMETRY_QUEUE_SIZE 16
+// Tasks beyond the ring and this list are dropped, the main loop has been stuck for a while by then.
+// The audio control lane grows its list on the heap instead, its tasks are never dropped.
+#define MAIN_TASK_OVERFLOW_SIZE 32
+// Recent task timings kept for the MCP tool
+#define MAIN_TASK_TIMING_HISTORY_SIZE 32
+// A task that ran longer than this is logged when it returns, it held back audio sends meanwhile
+#define MAIN_TASK_LONG_TASK_MS 100
+// The watchdog reports a task still running after this long, and again each period until it returns
+#define MAIN_TASK_WATCHDOG_MS 1000
+
+// Lanes run in this order, audio control never waits behind a burst of UI updates
+enum MainTaskLane {
+    kTaskLaneAudioControl,
+    kTaskLaneUi,
+    // Statistics and work that can wait, such as live-stream events
+    kTaskLaneTelemetry,
+    kTaskLaneCount,
+};
+
+/*
+ * Move-only void() callable with inline storage. Small lambdas are constructed in place, larger
+ * ones fall back to the heap, which the queue counts.
+ */
+class MainTask {
+public:
+    MainTask() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, MainTask>>>
+    MainTask(F&& callable) {
+        using T = std::decay_t<F>;
+        if constexpr (sizeof(T) <= MAIN_TASK_INLINE_SIZE && alignof(T) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<T>) {
+            new (storage_) T(std::forward<F>(callable));
+            ops_ = &kInlineOps<T>;
+        } else {
+            *reinterpret_cast<T**>(storage_) = new T(std::forward<F>(callable));
+            ops_ = &kHeapOps<T>;
+        }
+    }
+
+    MainTask(MainTask&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    MainTask& operator=(MainTask&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    ~MainTask() {
+        Reset();
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+    bool on_heap() const { return ops_ != nullptr && ops_->heap; }
+
+    void operator()() {
+        ops_->invoke(storage_);
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        // Move constructs into destination and destroys the source
+        void (*relocate)(void* destination, void* source);
+        void (*destroy)(void* storage);
+        bool heap;
+    };
+
+    template <typename T>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<T*>(storage))(); },
+        [](void* destination, void* source) {
+            new (destination) T(std::move(*static_cast<T*>(source)));
+            static_cast<T*>(source)->~T();
+        },
+        [](void* storage) { static_cast<T*>(storage)->~T(); },
+        false,
+    };
+
+    template <typename T>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<T**>(storage))(); },
+        [](void* destination, void* source) { *static_cast<T**>(destination) = *static_cast<T**>(source); },
+        [](void* storage) { delete *static_cast<T**>(storage); },
+        true,
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[MAIN_TASK_INLINE_SIZE];
+    const Ops* ops_ = nullptr;
+
+    void MoveFrom(MainTask& other) {
+        if (other.ops_ != nullptr) {
+            other.ops_->relocate(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+};
+
+struct MainTaskTiming {
+    const char* name = nullptr;
+    int8_t lane = -1;               // -1 for the main loop's own work, e.g. sending audio
+    uint32_t wait_us = 0;           // From Schedule() to the task starting
+    uint32_t run_us = 0;
+    int64_t start_time_us = 0;
+};
+
+struct MainTaskLaneStats {
+    uint32_t executed = 0;
+    uint32_t overflowed = 0;        // Spilled into the locked list because the ring was full
+    uint32_t dropped = 0;           // The locked list was full as well, never on the audio control lane
+    uint32_t heap_tasks = 0;        // Captures too large for the inline storage
+    uint32_t depth = 0;
+    uint32_t max_depth = 0;
+    uint32_t last_latency_us = 0;   // From Schedule() to the task starting
+    uint32_t max_latency_us = 0;
+    uint64_t total_latency_us = 0;
+    uint32_t max_run_us = 0;
+    uint64_t total_run_us = 0;
+    uint32_t long_tasks = 0;        // Ran longer than MAIN_TASK_LONG_TASK_MS
+};
+
+/*
+ * Tasks for the main event loop, one bounded lock-free ring per lane.
+ *
+ * Any task may push, only the main loop pops (multi-producer, single-consumer). The slots are
+ * allocated once, so scheduling a small task allocates nothing. When a ring is full, tasks go to a
+ * locked overflow list until the main loop has drained it, which keeps each producer's tasks in order.
+ * The list has a fixed size too, tasks that do not fit are dropped and counted, except on the audio
+ * control lane, which grows its list rather than lose a task.
+ *
+ * Every task carries a name and is timed from Schedule() to its start and from its start to its
+ * return. Long tasks are logged, and a watchdog timer names the task while it is still blocking.
+ */
+class MainTaskQueue {
+public:
+    MainTaskQueue();
+    ~MainTaskQueue();
+
+    // `name` must outlive the task, a string literal or a function name.
+    // Returns false when the task was dropped, undo whatever waits for it to run
+    bool Push(MainTask&& task, MainTaskLane lane, const char* name);
+    // Main loop only. Runs what was queued when called, audio control first, and returns the count
+    size_t RunPending();
+    // Main loop only. Times work done outside a task the same way, e.g. handling a wake word
+    template <typename F>
+    void Measure(const char* name, F&& work) {
+        int64_t start_time = BeginWork(name);
+        work();
+        EndWork(name, -1, start_time, 0);
+    }
+
+    MainTaskLaneStats GetStats(MainTaskLane lane);
+    // Newest first
+    std::vector<MainTaskTiming> GetRecentTimings();
+    // Main loop work longer than MAIN_TASK_LONG_TASK_MS outside of tasks
+    uint32_t long_work_count();
+    uint32_t watchdog_count() const { return watchdog_count_.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        MainTask task;
+        int64_t time_us;
+        const char* name;
+    };
+
+    struct Overflowed {
+        MainTask task;
+        int64_t time_us = 0;
+        const char* name = nullptr;
+    };
+
+    struct Lane {
+        std::unique_ptr<Slot[]> slots;
+        uint32_t mask = 0;
+        std::atomic<uint32_t> enqueue_position = 0;
+        // Only written by the main loop, atomic for the depth in the statistics
+        std::atomic<uint32_t> dequeue_position = 0;
+        std::atomic<bool> overflowed = false;
+        // Circular list guarded by overflow_mutex_
+        std::unique_ptr<Overflowed[]> overflow;
+        uint32_t overflow_head = 0;
+        uint32_t overflow_size = 0;
+        uint32_t overflow_capacity = 0;
+        bool dropping = false;
+        // Written by producers, read from other tasks for statistics
+        std::atomic<uint32_t> overflow_count = 0;
+        std::atomic<uint32_t> drop_count = 0;
+        std::atomic<uint32_t> heap_count = 0;
+        MainTaskLaneStats stats;
+    };
+
+    Lane lanes_[kTaskLaneCount];
+    std::mutex overflow_mutex_;
+    std::mutex stats_mutex_;
+    MainTaskTiming history_[MAIN_TASK_TIMING_HISTORY_SIZE];
+    uint32_t history_count_ = 0;
+    uint32_t long_work_count_ = 0;
+
+    // The work in progress, read by the watchdog timer
+    std::atomic<const char*> current_name_ = nullptr;
+    std::atomic<int64_t> current_start_time_ = 0;
+    std::atomic<uint32_t> watchdog_count_ = 0;
+    esp_timer_handle_t watchdog_timer_ = nullptr;
+
+    bool TryPush(Lane& lane, MainTask& task, int64_t time_us, const char* name);
+    void GrowOverflow(Lane& lane);
+    bool TryPop(Lane& lane, MainTask& task, int64_t& time_us, const char*& name);
+    bool PopNext(MainTask& task, int64_t& time_us, const char*& name, Lane*& from);
+    int64_t BeginWork(const char* name);
+    void EndWork(const char* name, int lane, int64_t start_time, uint32_t wait_us);
+    void OnWatchdog();
+};
+
+#endif // MAIN_TASK_QUEUE_H
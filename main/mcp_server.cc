@@ -15,12 +15,42 @@
 #include "oled_display.h"
 #include "board.h"
 #include "settings.h"
+#include "connection_timing.h"
 #include "lvgl_theme.h"
 #include "lvgl_display.h"
 
 #define TAG "MCP"
 
 McpServer::McpServer() {
+    // Forwarded as notifications once the server asked for them in initialize
+    auto& event_bus = EventBus::GetInstance();
+    event_bus.Subscribe<DeviceStateChangedEvent>([this](const DeviceStateChangedEvent& event) {
+        if (!device_events_enabled_) {
+            return;
+        }
+        cJSON *params = cJSON_CreateObject();
+        cJSON_AddStringToObject(params, "previous_state", Application::GetStateName(event.previous_state));
+        cJSON_AddStringToObject(params, "state", Application::GetStateName(event.current_state));
+        SendDeviceEvent(kEventDeviceState, params);
+    });
+    event_bus.Subscribe<BatteryChangedEvent>([this](const BatteryChangedEvent& event) {
+        if (!device_events_enabled_) {
+            return;
+        }
+        cJSON *params = cJSON_CreateObject();
+        cJSON_AddNumberToObject(params, "level", event.level);
+        cJSON_AddBoolToObject(params, "charging", event.charging);
+        cJSON_AddBoolToObject(params, "discharging", event.discharging);
+        SendDeviceEvent(kEventBattery, params);
+    });
+    event_bus.Subscribe<NetworkChangedEvent>([this](const NetworkChangedEvent& event) {
+        if (!device_events_enabled_) {
+            return;
+        }
+        cJSON *params = cJSON_CreateObject();
+        cJSON_AddBoolToObject(params, "connected", event.connected);
+        SendDeviceEvent(kEventNetwork, params);
+    });
 }
 
 McpServer::~McpServer() {
@@ -144,10 +174,181 @@ void McpServer::AddUserOnlyTools() {
                 vTaskDelay(pdMS_TO_TICKS(1000));
 
                 app.Reboot();
-            });
+            }, kTaskLaneUi, "self.reboot");
             return true;
         });
 
+    AddUserOnlyTool("self.audio.set_processing_profile",
+        "Select the audio processing profile without rebooting: `low_power`, `balanced` or `high_quality`.\n"
+        "Lower profiles use cheaper echo cancellation and noise suppression to save CPU, and a voice detection "
+        "that needs longer speech before triggering, ignoring short noises, but takes longer to notice the end of speech.",
+        PropertyList({
+            Property("profile", kPropertyTypeString)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto profile = properties["profile"].value<std::string>();
+            auto& audio_service = Application::GetInstance().GetAudioService();
+            if (!audio_service.SetAudioProcessorProfile(profile)) {
+                throw std::runtime_error("Unsupported audio processing profile: " + profile);
+            }
+            return true;
+        });
+
+    AddUserOnlyTool("self.audio.get_uplink_stats",
+        "Get the current uplink Opus bitrate, the measured network throughput and how many packets were dropped "
+        "because the send queue was full",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto stats = Application::GetInstance().GetAudioService().GetUplinkStats();
+            cJSON *json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(json, "bitrate", stats.bitrate);
+            cJSON_AddNumberToObject(json, "throughput_bps", stats.throughput_bps);
+            cJSON_AddNumberToObject(json, "bitrate_changes", stats.bitrate_changes);
+            cJSON_AddNumberToObject(json, "dropped_oldest", stats.dropped_oldest);
+            cJSON_AddNumberToObject(json, "dropped_newest", stats.dropped_newest);
+            return json;
+        });
+
+    AddUserOnlyTool("self.audio.get_barge_in_stats",
+        "Get how long it took from interrupting the assistant until its audio went silent, in milliseconds",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto stats = Application::GetInstance().GetAudioService().GetBargeInStats();
+            cJSON *json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(json, "count", stats.count);
+            cJSON_AddNumberToObject(json, "last_latency_ms", stats.last_latency_ms);
+            cJSON_AddNumberToObject(json, "max_latency_ms", stats.max_latency_ms);
+            cJSON_AddNumberToObject(json, "average_latency_ms", stats.count > 0 ? stats.total_latency_ms / stats.count : 0);
+            return json;
+        });
+
+    AddUserOnlyTool("self.live.get_event_stats",
+        "Get how many live-stream events (gifts, chat, member joins, room statistics) were received, merged "
+        "into a newer update, dropped because the queue was full, expired, or handed to the assistant, and how "
+        "many were filtered out as resends or by the per-viewer and overall rate limits",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& app = Application::GetInstance();
+            auto stats = app.GetLiveEventStats();
+            auto filter = app.GetLiveFilterStats();
+            cJSON *json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(json, "received", stats.received);
+            cJSON_AddNumberToObject(json, "coalesced", stats.coalesced);
+            cJSON_AddNumberToObject(json, "dropped", stats.dropped);
+            cJSON_AddNumberToObject(json, "expired", stats.expired);
+            cJSON_AddNumberToObject(json, "forwarded", stats.forwarded);
+            cJSON_AddNumberToObject(json, "pending", stats.pending);
+            cJSON_AddNumberToObject(json, "duplicates", filter.duplicates);
+            cJSON_AddNumberToObject(json, "bloom_unconfirmed", filter.bloom_unconfirmed);
+            cJSON_AddNumberToObject(json, "user_limited", filter.user_limited);
+            cJSON_AddNumberToObject(json, "global_limited", filter.global_limited);
+            return json;
+        });
+
+    AddUserOnlyTool("self.system.get_main_loop_timings",
+        "Get how long main loop tasks (tool calls, UI updates, state changes) waited in the queue and ran, per lane, "
+        "how many ran too long or were caught blocking by the watchdog, and the timings of the most recent tasks",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            static const char* const lane_names[kTaskLaneCount] = { "audio_control", "ui", "telemetry" };
+            auto& app = Application::GetInstance();
+            cJSON *json = cJSON_CreateObject();
+            cJSON *lanes = cJSON_CreateObject();
+            for (int i = 0; i < kTaskLaneCount; i++) {
+                auto stats = app.GetMainTaskStats((MainTaskLane)i);
+                cJSON *lane = cJSON_CreateObject();
+                cJSON_AddNumberToObject(lane, "executed", stats.executed);
+                cJSON_AddNumberToObject(lane, "max_depth", stats.max_depth);
+                cJSON_AddNumberToObject(lane, "avg_wait_us", stats.executed > 0 ? stats.total_latency_us / stats.executed : 0);
+                cJSON_AddNumberToObject(lane, "max_wait_us", stats.max_latency_us);
+                cJSON_AddNumberToObject(lane, "avg_run_us", stats.executed > 0 ? stats.total_run_us / stats.executed : 0);
+                cJSON_AddNumberToObject(lane, "max_run_us", stats.max_run_us);
+                cJSON_AddNumberToObject(lane, "long_tasks", stats.long_tasks);
+                cJSON_AddNumberToObject(lane, "overflowed", stats.overflowed);
+                cJSON_AddNumberToObject(lane, "dropped", stats.dropped);
+                cJSON_AddItemToObject(lanes, lane_names[i], lane);
+            }
+            cJSON_AddItemToObject(json, "lanes", lanes);
+            cJSON_AddNumberToObject(json, "long_loop_work", app.GetMainLoopLongWork());
+            cJSON_AddNumberToObject(json, "watchdog_warnings", app.GetMainLoopWatchdogCount());
+
+            int64_t now = esp_timer_get_time();
+            cJSON *recent = cJSON_CreateArray();
+            for (auto& timing : app.GetMainTaskTimings()) {
+                cJSON *item = cJSON_CreateObject();
+                cJSON_AddStringToObject(item, "name", timing.name);
+                cJSON_AddStringToObject(item, "lane", timing.lane < 0 ? "loop" : lane_names[timing.lane]);
+                cJSON_AddNumberToObject(item, "wait_us", timing.wait_us);
+                cJSON_AddNumberToObject(item, "run_us", timing.run_us);
+                cJSON_AddNumberToObject(item, "ago_ms", (now - timing.start_time_us) / 1000);
+                cJSON_AddItemToArray(recent, item);
+            }
+            cJSON_AddItemToObject(json, "recent", recent);
+            return json;
+        });
+
+    AddUserOnlyTool("self.system.get_event_bus_stats",
+        "Get per topic (device state, VAD, battery, network) event bus counters: published, delivered and dropped "
+        "events, subscribers, and the delivery latency from publish until the subscribers ran",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& event_bus = EventBus::GetInstance();
+            cJSON *json = cJSON_CreateObject();
+            for (int i = 0; i < kEventTopicCount; i++) {
+                auto stats = event_bus.GetStats((EventTopic)i);
+                cJSON *topic = cJSON_CreateObject();
+                cJSON_AddNumberToObject(topic, "published", stats.published);
+                cJSON_AddNumberToObject(topic, "delivered", stats.delivered);
+                cJSON_AddNumberToObject(topic, "dropped", stats.dropped);
+                cJSON_AddNumberToObject(topic, "subscribers", stats.subscribers);
+                cJSON_AddNumberToObject(topic, "avg_latency_us", stats.delivered > 0 ? stats.total_latency_us / stats.delivered : 0);
+                cJSON_AddNumberToObject(topic, "max_latency_us", stats.max_latency_us);
+                cJSON_AddNumberToObject(topic, "max_handler_us", stats.max_handler_us);
+                cJSON_AddItemToObject(json, EventBus::TopicName((EventTopic)i), topic);
+            }
+            return json;
+        });
+
+    AddUserOnlyTool("self.system.get_status_bar_stats",
+        "Get how often the status bar woke the device up (in total and in the last minute), how often it was "
+        "refreshed, and how often each item (mute, clock, battery, network) was refreshed or reported a change",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            static const char* const item_names[STATUS_BAR_ITEM_COUNT] = { "mute", "clock", "battery", "network" };
+            auto stats = StatusBarMonitor::GetInstance().GetStats();
+            cJSON *json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(json, "wakeups", stats.wakeups);
+            cJSON_AddNumberToObject(json, "wakeups_last_minute", stats.wakeups_last_minute);
+            cJSON_AddNumberToObject(json, "refreshes", stats.refreshes);
+            cJSON *items = cJSON_CreateObject();
+            for (int i = 0; i < STATUS_BAR_ITEM_COUNT; i++) {
+                cJSON *item = cJSON_CreateObject();
+                cJSON_AddNumberToObject(item, "refreshed", stats.items_refreshed[i]);
+                cJSON_AddNumberToObject(item, "notified", stats.items_notified[i]);
+                cJSON_AddItemToObject(items, item_names[i], item);
+            }
+            cJSON_AddItemToObject(json, "items", items);
+            return json;
+        });
+
+    AddUserOnlyTool("self.network.get_connection_stats",
+        "Get DNS, connect (TCP + TLS) and first byte times of recent HTTP / WebSocket requests, per host",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return ConnectionTiming::GetStatsJson();
+        });
+
+    AddUserOnlyTool("self.network.get_audio_channel_stats",
+        "Get packet loss, reordering, duplicate, late and recovery counters of the current or last audio channel",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto protocol = Application::GetInstance().GetProtocol();
+            if (protocol == nullptr) {
+                return std::string("{}");
+            }
+            return protocol->GetStatsJson();
+        });
+
     // Firmware upgrade
     AddUserOnlyTool("self.upgrade_firmware", "Upgrade firmware from a specific URL. This will download and install the firmware, then reboot the device.",
         PropertyList({
@@ -165,7 +366,7 @@ void McpServer::AddUserOnlyTools() {
                 if (!success) {
                     ESP_LOGE(TAG, "Firmware upgrade failed");
                 }
-            });
+            }, kTaskLaneUi, "self.upgrade_firmware");
             
             return true;
         });
@@ -210,9 +411,12 @@ void McpServer::AddUserOnlyTools() {
                 
                 auto http = Board::GetInstance().GetNetwork()->CreateHttp(3);
                 http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
+                ConnectionTiming timing("snapshot", url);
+                timing.ResolveHost();
                 if (!http->Open("POST", url)) {
                     throw std::runtime_error("Failed to open URL: " + url);
                 }
+                timing.MarkConnected();
                 {
                     // 文件字段头部
                     std::string file_header;
@@ -233,12 +437,15 @@ void McpServer::AddUserOnlyTools() {
                     http->Write(multipart_footer.c_str(), multipart_footer.size());
                 }
                 http->Write("", 0);
+                timing.MarkRequestSent();
 
                 if (http->GetStatusCode() != 200) {
                     throw std::runtime_error("Unexpected status code: " + std::to_string(http->GetStatusCode()));
                 }
+                timing.MarkFirstByte();
                 std::string result = http->ReadAll();
                 http->Close();
+                timing.Finish(true);
                 ESP_LOGI(TAG, "Snapshot screen result: %s", result.c_str());
                 return true;
             });
@@ -251,13 +458,18 @@ void McpServer::AddUserOnlyTools() {
                 auto url = properties["url"].value<std::string>();
                 auto http = Board::GetInstance().GetNetwork()->CreateHttp(3);
 
+                ConnectionTiming timing("preview", url);
+                timing.ResolveHost();
                 if (!http->Open("GET", url)) {
                     throw std::runtime_error("Failed to open URL: " + url);
                 }
+                timing.MarkConnected();
                 int status_code = http->GetStatusCode();
                 if (status_code != 200) {
                     throw std::runtime_error("Unexpected status code: " + std::to_string(status_code));
                 }
+                timing.MarkFirstByte();
+                timing.Finish(true);
 
                 size_t content_length = http->GetBodyLength();
                 char* data = (char*)heap_caps_malloc(content_length, MALLOC_CAP_8BIT);
@@ -334,6 +546,9 @@ void McpServer::ParseMessage(const std::string& message) {
 }
 
 void McpServer::ParseCapabilities(const cJSON* capabilities) {
+    auto device_events = cJSON_GetObjectItem(capabilities, "deviceEvents");
+    device_events_enabled_ = cJSON_IsTrue(device_events) || cJSON_IsObject(device_events);
+
     auto vision = cJSON_GetObjectItem(capabilities, "vision");
     if (cJSON_IsObject(vision)) {
         auto url = cJSON_GetObjectItem(vision, "url");
@@ -437,6 +652,20 @@ void McpServer::ParseMessage(const cJSON* json) {
     }
 }
 
+// Takes ownership of `params`
+void McpServer::SendDeviceEvent(EventTopic topic, cJSON* params) {
+    cJSON_AddStringToObject(params, "topic", EventBus::TopicName(topic));
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "jsonrpc", "2.0");
+    cJSON_AddStringToObject(json, "method", "notifications/device_event");
+    cJSON_AddItemToObject(json, "params", params);
+    auto json_str = cJSON_PrintUnformatted(json);
+    std::string payload(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(json);
+    Application::GetInstance().SendMcpMessage(payload);
+}
+
 void McpServer::ReplyResult(int id, const std::string& result) {
     std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
     payload += std::to_string(id) + ",\"result\":";
@@ -561,5 +790,5 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
             ESP_LOGE(TAG, "tools/call: %s", e.what());
             ReplyError(id, e.what());
         }
-    });
+    }, kTaskLaneUi, (*tool_iter)->name().c_str());
 }
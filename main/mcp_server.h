@@ -9,10 +9,13 @@
 #include <optional>
 #include <stdexcept>
 #include <thread>
+#include <atomic>
 #include <mbedtls/base64.h>
 
 #include <cJSON.h>
 
+#include "event_bus.h"
+
 class ImageContent {
 private:
     std::string encoded_data_;
@@ -331,6 +334,7 @@ private:
     ~McpServer();
 
     void ParseCapabilities(const cJSON* capabilities);
+    void SendDeviceEvent(EventTopic topic, cJSON* params);
 
     void ReplyResult(int id, const std::string& result);
     void ReplyError(int id, const std::string& message);
@@ -339,6 +343,7 @@ private:
     void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments);
 
     std::vector<McpTool*> tools_;
+    std::atomic<bool> device_events_enabled_ = false;
 };
 
 #endif // MCP_SERVER_H
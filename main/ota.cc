@@ -1,6 +1,7 @@
 #include "ota.h"
 #include "system_info.h"
 #include "settings.h"
+#include "connection_timing.h"
 #include "assets/lang_config.h"
 
 #include <cJSON.h>
@@ -21,6 +22,20 @@
 
 #define TAG "Ota"
 
+// Lists of strings (websocket "urls", mqtt "endpoints") are stored in NVS newline separated
+static std::string JoinStringArray(const cJSON* array) {
+    std::string list;
+    const cJSON* item = NULL;
+    cJSON_ArrayForEach(item, array) {
+        if (cJSON_IsString(item)) {
+            if (!list.empty()) {
+                list += '\n';
+            }
+            list += item->valuestring;
+        }
+    }
+    return list;
+}
 
 Ota::Ota() {
 #ifdef ESP_EFUSE_BLOCK_USR_DATA
@@ -49,6 +64,11 @@ std::string Ota::GetCheckVersionUrl() {
     return url;
 }
 
+std::string Ota::GetLastProtocol() {
+    Settings settings("ota", false);
+    return settings.GetString("protocol");
+}
+
 std::unique_ptr<Http> Ota::SetupHttp() {
     auto& board = Board::GetInstance();
     auto network = board.GetNetwork();
@@ -91,19 +111,24 @@ bool Ota::CheckVersion() {
     std::string method = data.length() > 0 ? "POST" : "GET";
     http->SetContent(std::move(data));
 
+    ConnectionTiming timing("ota", url);
+    timing.ResolveHost();
     if (!http->Open(method, url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
     }
+    timing.MarkConnected();
 
     auto status_code = http->GetStatusCode();
     if (status_code != 200) {
         ESP_LOGE(TAG, "Failed to check version, status code: %d", status_code);
         return false;
     }
+    timing.MarkFirstByte();
 
     data = http->ReadAll();
     http->Close();
+    timing.Finish(true);
 
     // Response: { "firmware": { "version": "1.0.0", "url": "http://" } }
     // Parse the JSON response and check if the version is newer
@@ -139,6 +164,7 @@ bool Ota::CheckVersion() {
         }
     }
 
+    protocol_config_changed_ = false;
     has_mqtt_config_ = false;
     cJSON *mqtt = cJSON_GetObjectItem(root, "mqtt");
     if (cJSON_IsObject(mqtt)) {
@@ -148,13 +174,26 @@ bool Ota::CheckVersion() {
             if (cJSON_IsString(item)) {
                 if (settings.GetString(item->string) != item->valuestring) {
                     settings.SetString(item->string, item->valuestring);
+                    protocol_config_changed_ = true;
                 }
             } else if (cJSON_IsNumber(item)) {
                 if (settings.GetInt(item->string) != item->valueint) {
                     settings.SetInt(item->string, item->valueint);
+                    protocol_config_changed_ = true;
+                }
+            } else if (cJSON_IsArray(item)) {
+                auto list = JoinStringArray(item);
+                if (settings.GetString(item->string) != list) {
+                    settings.SetString(item->string, list);
+                    protocol_config_changed_ = true;
                 }
             }
         }
+        // Drop a list the server no longer sends, or the client keeps failing over to stale servers
+        if (!cJSON_IsArray(cJSON_GetObjectItem(mqtt, "endpoints")) && !settings.GetString("endpoints").empty()) {
+            settings.SetString("endpoints", "");
+            protocol_config_changed_ = true;
+        }
         has_mqtt_config_ = true;
     } else {
         ESP_LOGI(TAG, "No mqtt section found !");
@@ -169,18 +208,41 @@ bool Ota::CheckVersion() {
             if (cJSON_IsString(item)) {
                 if (settings.GetString(item->string) != item->valuestring) {
                     settings.SetString(item->string, item->valuestring);
+                    protocol_config_changed_ = true;
                 }
             } else if (cJSON_IsNumber(item)) {
                 if (settings.GetInt(item->string) != item->valueint) {
                     settings.SetInt(item->string, item->valueint);
+                    protocol_config_changed_ = true;
+                }
+            } else if (cJSON_IsArray(item)) {
+                auto list = JoinStringArray(item);
+                if (settings.GetString(item->string) != list) {
+                    settings.SetString(item->string, list);
+                    protocol_config_changed_ = true;
                 }
             }
         }
+        // Drop a list the server no longer sends, or the client keeps failing over to stale servers
+        if (!cJSON_IsArray(cJSON_GetObjectItem(websocket, "urls")) && !settings.GetString("urls").empty()) {
+            settings.SetString("urls", "");
+            protocol_config_changed_ = true;
+        }
         has_websocket_config_ = true;
     } else {
         ESP_LOGI(TAG, "No websocket section found!");
     }
 
+    {
+        // Remember the assigned protocol, the next boot starts it without waiting for this check
+        Settings settings("ota", true);
+        std::string protocol = has_mqtt_config_ ? "mqtt" : (has_websocket_config_ ? "websocket" : "");
+        if (settings.GetString("protocol") != protocol) {
+            settings.SetString("protocol", protocol);
+            protocol_config_changed_ = true;
+        }
+    }
+
     has_server_time_ = false;
     cJSON *server_time = cJSON_GetObjectItem(root, "server_time");
     if (cJSON_IsObject(server_time)) {
@@ -275,15 +337,21 @@ bool Ota::Upgrade(const std::string& firmware_url) {
 
     auto network = Board::GetInstance().GetNetwork();
     auto http = network->CreateHttp(0);
+    ConnectionTiming timing("firmware", firmware_url);
+    timing.ResolveHost();
     if (!http->Open("GET", firmware_url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
     }
+    timing.MarkConnected();
 
     if (http->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
         return false;
     }
+    timing.MarkFirstByte();
+    // Only the connection phases are of interest, the download speed is logged below
+    timing.Finish(true);
 
     size_t content_length = http->GetBodyLength();
     if (content_length == 0) {
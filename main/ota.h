@@ -20,6 +20,8 @@ public:
     bool HasWebsocketConfig() { return has_websocket_config_; }
     bool HasActivationCode() { return has_activation_code_; }
     bool HasServerTime() { return has_server_time_; }
+    // The last check rewrote the stored protocol type, endpoints or credentials
+    bool HasProtocolConfigChanged() { return protocol_config_changed_; }
     bool StartUpgrade(std::function<void(int progress, size_t speed)> callback);
     bool StartUpgradeFromUrl(const std::string& url, std::function<void(int progress, size_t speed)> callback);
     void MarkCurrentVersionValid();
@@ -30,6 +32,8 @@ public:
     const std::string& GetActivationMessage() const { return activation_message_; }
     const std::string& GetActivationCode() const { return activation_code_; }
     std::string GetCheckVersionUrl();
+    // "mqtt" or "websocket" as assigned by the last successful check, empty before the first one
+    static std::string GetLastProtocol();
 
 private:
     std::string activation_message_;
@@ -38,6 +42,7 @@ private:
     bool has_mqtt_config_ = false;
     bool has_websocket_config_ = false;
     bool has_server_time_ = false;
+    bool protocol_config_changed_ = false;
     bool has_activation_code_ = false;
     bool has_serial_number_ = false;
     bool has_activation_challenge_ = false;
@@ -0,0 +1,80 @@
+#include "control_codec.h"
+
+static const char* const TYPE_STRINGS[] = {
+    "unknown",
+    "goodbye",
+    "listen",
+    "abort",
+    "mcp",
+    "tts",
+    "stt",
+    "llm",
+    "system",
+    "alert",
+};
+
+const char* ControlTypeToString(ControlMessageType type) {
+    if (type >= sizeof(TYPE_STRINGS) / sizeof(TYPE_STRINGS[0])) {
+        return TYPE_STRINGS[kControlTypeUnknown];
+    }
+    return TYPE_STRINGS[type];
+}
+
+ControlEncoder::ControlEncoder(ControlMessageType type, size_t reserve) {
+    buffer_.reserve(reserve);
+    buffer_.push_back((char)CONTROL_CODEC_MAGIC);
+    buffer_.push_back((char)type);
+}
+
+ControlEncoder& ControlEncoder::Add(ControlTag tag, const char* value, size_t length) {
+    buffer_.push_back((char)tag);
+    size_t remaining = length;
+    do {
+        uint8_t byte = remaining & 0x7F;
+        remaining >>= 7;
+        if (remaining != 0) {
+            byte |= 0x80;
+        }
+        buffer_.push_back((char)byte);
+    } while (remaining != 0);
+    buffer_.append(value, length);
+    return *this;
+}
+
+ControlDecoder::ControlDecoder(const uint8_t* data, size_t length) : data_(data), length_(length) {
+    if (IsControlMessage(data, length)) {
+        valid_ = true;
+        type_ = (ControlMessageType)data[1];
+    }
+}
+
+bool ControlDecoder::Next(uint8_t& tag, const char*& value, size_t& length) {
+    if (!valid_ || offset_ >= length_) {
+        return false;
+    }
+
+    tag = data_[offset_++];
+    size_t field_length = 0;
+    int shift = 0;
+    while (true) {
+        if (offset_ >= length_ || shift > 28) {
+            valid_ = false;
+            return false;
+        }
+        uint8_t byte = data_[offset_++];
+        field_length |= (size_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+        shift += 7;
+    }
+    if (field_length > length_ - offset_) {
+        valid_ = false;
+        return false;
+    }
+
+    value = (const char*)data_ + offset_;
+    length = field_length;
+    offset_ += field_length;
+    return true;
+}
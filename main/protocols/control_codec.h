@@ -0,0 +1,91 @@
+#ifndef _CONTROL_CODEC_H_
+#define _CONTROL_CODEC_H_
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * Compact binary encoding of the control messages, negotiated in the hello (features.control = "tlv").
+ *
+ *   magic u8 (0xC7) | message type u8 | field*
+ *   field: tag u8 | length varint (LEB128) | value
+ *
+ * Values are UTF-8 strings except kControlTagPayload, which carries the MCP JSON text untouched.
+ * Unknown tags are skipped, so either side can add fields without breaking the other.
+ * See docs/websocket.md for the field table.
+ */
+#define CONTROL_CODEC_MAGIC 0xC7
+
+enum ControlMessageType : uint8_t {
+    kControlTypeUnknown = 0,
+    kControlTypeGoodbye = 1,
+    kControlTypeListen = 2,
+    kControlTypeAbort = 3,
+    kControlTypeMcp = 4,
+    kControlTypeTts = 5,
+    kControlTypeStt = 6,
+    kControlTypeLlm = 7,
+    kControlTypeSystem = 8,
+    kControlTypeAlert = 9,
+};
+
+enum ControlTag : uint8_t {
+    kControlTagSessionId = 1,
+    kControlTagState = 2,
+    kControlTagMode = 3,
+    kControlTagText = 4,
+    kControlTagReason = 5,
+    kControlTagPayload = 6,
+    kControlTagEmotion = 7,
+    kControlTagCommand = 8,
+    kControlTagStatus = 9,
+    kControlTagMessage = 10,
+};
+
+// Appends fields straight into the output buffer, nothing is built in between
+class ControlEncoder {
+public:
+    explicit ControlEncoder(ControlMessageType type, size_t reserve = 64);
+
+    ControlEncoder& Add(ControlTag tag, const char* value, size_t length);
+    ControlEncoder& Add(ControlTag tag, const std::string& value) {
+        return Add(tag, value.data(), value.size());
+    }
+    ControlEncoder& Add(ControlTag tag, const char* value) {
+        return Add(tag, value, strlen(value));
+    }
+
+    const std::string& data() const { return buffer_; }
+
+private:
+    std::string buffer_;
+};
+
+// Walks the fields of one message in place, values point into the input buffer
+class ControlDecoder {
+public:
+    ControlDecoder(const uint8_t* data, size_t length);
+
+    bool valid() const { return valid_; }
+    ControlMessageType type() const { return type_; }
+
+    // Returns false at the end of the message or on a truncated field
+    bool Next(uint8_t& tag, const char*& value, size_t& length);
+
+    static bool IsControlMessage(const uint8_t* data, size_t length) {
+        return length >= 2 && data[0] == CONTROL_CODEC_MAGIC;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t length_;
+    size_t offset_ = 2;
+    bool valid_ = false;
+    ControlMessageType type_ = kControlTypeUnknown;
+};
+
+const char* ControlTypeToString(ControlMessageType type);
+
+#endif // _CONTROL_CODEC_H_
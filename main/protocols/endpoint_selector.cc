@@ -0,0 +1,302 @@
+#include "endpoint_selector.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#define TAG "EndpointSelector"
+
+EndpointSelector::EndpointSelector(const char* name, int default_port) : name_(name), default_port_(default_port) {
+}
+
+std::vector<std::string> EndpointSelector::Split(const std::string& list) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find('\n', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        if (end > start) {
+            result.push_back(list.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+bool EndpointSelector::ParseAddress(const std::string& address, int default_port, std::string& host, int& port) {
+    // [scheme://][user@]host[:port][/path]
+    port = default_port;
+    size_t start = address.find("://");
+    if (start != std::string::npos) {
+        auto scheme = address.substr(0, start);
+        if (scheme == "wss" || scheme == "https" || scheme == "mqtts") {
+            port = scheme == "mqtts" ? 8883 : 443;
+        } else if (scheme == "ws" || scheme == "http") {
+            port = 80;
+        } else if (scheme == "mqtt") {
+            port = 1883;
+        }
+        start += 3;
+    } else {
+        start = 0;
+    }
+    size_t end = address.find_first_of("/?#", start);
+    auto authority = address.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    auto at = authority.rfind('@');
+    if (at != std::string::npos) {
+        authority = authority.substr(at + 1);
+    }
+
+    size_t port_pos;
+    if (!authority.empty() && authority[0] == '[') {
+        auto bracket = authority.find(']');
+        if (bracket == std::string::npos) {
+            return false;
+        }
+        host = authority.substr(1, bracket - 1);
+        port_pos = authority.find(':', bracket);
+    } else {
+        port_pos = authority.find(':');
+        host = authority.substr(0, port_pos);
+    }
+    if (port_pos != std::string::npos) {
+        port = atoi(authority.c_str() + port_pos + 1);
+    }
+    return !host.empty() && port > 0 && port < 65536;
+}
+
+void EndpointSelector::SetEndpoints(const std::vector<std::string>& addresses) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool changed = addresses.size() != endpoints_.size();
+    for (size_t i = 0; !changed && i < addresses.size(); i++) {
+        // Compare as sets, the stored order is the probed order
+        changed = std::none_of(endpoints_.begin(), endpoints_.end(), [&](const Endpoint& endpoint) {
+            return endpoint.address == addresses[i];
+        });
+    }
+    if (!changed) {
+        return;
+    }
+
+    endpoints_.clear();
+    for (auto& address : addresses) {
+        endpoints_.push_back(Endpoint{ .address = address });
+    }
+    last_probe_time_ = 0;
+    list_version_++;
+}
+
+size_t EndpointSelector::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return endpoints_.size();
+}
+
+std::vector<std::string> EndpointSelector::GetOrder() {
+    std::vector<Endpoint> probed;
+    uint32_t version = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = esp_timer_get_time();
+        if (endpoints_.size() > 1 && !probing_ &&
+            (last_probe_time_ == 0 || now - last_probe_time_ > ENDPOINT_PROBE_INTERVAL_SECONDS * 1000000LL)) {
+            // Another caller arriving meanwhile takes the current order instead of waiting
+            probing_ = true;
+            probed = endpoints_;
+            version = list_version_;
+        }
+    }
+
+    if (!probed.empty()) {
+        Probe(probed);
+        std::lock_guard<std::mutex> lock(mutex_);
+        probing_ = false;
+        // A list replaced during the probe is probed on the next call
+        if (version == list_version_) {
+            for (auto& endpoint : endpoints_) {
+                auto it = std::find_if(probed.begin(), probed.end(), [&](const Endpoint& result) {
+                    return result.address == endpoint.address;
+                });
+                if (it == probed.end()) {
+                    continue;
+                }
+                endpoint.rtt_ms = it->rtt_ms;
+                endpoint.resolved = std::move(it->resolved);
+                if (endpoint.rtt_ms >= 0) {
+                    // Reachable again, give it another chance
+                    endpoint.failed = false;
+                }
+            }
+            Sort();
+            last_probe_time_ = esp_timer_get_time();
+            for (auto& endpoint : endpoints_) {
+                ESP_LOGI(TAG, "[%s] %s: %s", name_, endpoint.address.c_str(),
+                    endpoint.rtt_ms >= 0 ? (std::to_string(endpoint.rtt_ms) + " ms").c_str() : "unreachable");
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> order;
+    for (auto& endpoint : endpoints_) {
+        order.push_back(endpoint.address);
+    }
+    return order;
+}
+
+void EndpointSelector::MarkFailed(const std::string& address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool all_failed = true;
+    for (auto& endpoint : endpoints_) {
+        if (endpoint.address == address) {
+            endpoint.failed = true;
+        }
+        all_failed = all_failed && endpoint.failed;
+    }
+    Sort();
+    if (all_failed) {
+        // Nothing left to fall back to, measure again on the next attempt
+        last_probe_time_ = 0;
+    }
+}
+
+void EndpointSelector::MarkSucceeded(const std::string& address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& endpoint : endpoints_) {
+        if (endpoint.address == address) {
+            endpoint.failed = false;
+        }
+    }
+}
+
+void EndpointSelector::Sort() {
+    // Reachable endpoints by handshake time, then the unreachable ones, failed ones last.
+    // Stable, so the server's order breaks ties
+    std::stable_sort(endpoints_.begin(), endpoints_.end(), [](const Endpoint& a, const Endpoint& b) {
+        if (a.failed != b.failed) {
+            return b.failed;
+        }
+        if ((a.rtt_ms < 0) != (b.rtt_ms < 0)) {
+            return b.rtt_ms < 0;
+        }
+        return a.rtt_ms < b.rtt_ms;
+    });
+}
+
+bool EndpointSelector::Resolve(Endpoint& endpoint) {
+    std::string host;
+    int port;
+    if (!ParseAddress(endpoint.address, default_port_, host, port)) {
+        ESP_LOGW(TAG, "[%s] Invalid endpoint: %s", name_, endpoint.address.c_str());
+        return false;
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    auto port_str = std::to_string(port);
+    if (getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result) != 0 || result == nullptr) {
+        ESP_LOGW(TAG, "[%s] Failed to resolve %s", name_, host.c_str());
+        return false;
+    }
+    auto addr = (const uint8_t*)result->ai_addr;
+    endpoint.resolved.assign(addr, addr + result->ai_addrlen);
+    freeaddrinfo(result);
+    return true;
+}
+
+// Works on a copy of the list, called without mutex_ held
+void EndpointSelector::Probe(std::vector<Endpoint>& endpoints) {
+    for (auto& endpoint : endpoints) {
+        endpoint.rtt_ms = -1;
+    }
+    // Modems resolve and connect on the module, lwIP has no route there
+    if (Board::GetInstance().GetBoardType() != "wifi") {
+        return;
+    }
+
+    struct PendingProbe {
+        int fd;
+        Endpoint* endpoint;
+        int64_t start_time;
+    };
+    std::vector<PendingProbe> pending;
+
+    // Start each handshake right after its lookup, before waiting for any of them
+    for (auto& endpoint : endpoints) {
+        if (endpoint.resolved.empty() && !Resolve(endpoint)) {
+            continue;
+        }
+        auto addr = (const struct sockaddr*)endpoint.resolved.data();
+        int fd = socket(addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+        if (fd < 0) {
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        auto start_time = esp_timer_get_time();
+        int ret = connect(fd, addr, endpoint.resolved.size());
+        if (ret == 0) {
+            endpoint.rtt_ms = (esp_timer_get_time() - start_time) / 1000;
+            close(fd);
+        } else if (errno == EINPROGRESS) {
+            pending.push_back(PendingProbe{ fd, &endpoint, start_time });
+        } else {
+            close(fd);
+        }
+    }
+
+    auto deadline = esp_timer_get_time() + ENDPOINT_PROBE_TIMEOUT_MS * 1000LL;
+    while (!pending.empty()) {
+        auto now = esp_timer_get_time();
+        if (now >= deadline) {
+            break;
+        }
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        int max_fd = -1;
+        for (auto& probe : pending) {
+            FD_SET(probe.fd, &write_fds);
+            max_fd = std::max(max_fd, probe.fd);
+        }
+        struct timeval timeout = {
+            .tv_sec = (time_t)((deadline - now) / 1000000),
+            .tv_usec = (suseconds_t)((deadline - now) % 1000000),
+        };
+        if (select(max_fd + 1, nullptr, &write_fds, nullptr, &timeout) <= 0) {
+            break;
+        }
+
+        now = esp_timer_get_time();
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (!FD_ISSET(it->fd, &write_fds)) {
+                ++it;
+                continue;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(it->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error == 0) {
+                it->endpoint->rtt_ms = (now - it->start_time) / 1000;
+            }
+            close(it->fd);
+            it = pending.erase(it);
+        }
+    }
+    for (auto& probe : pending) {
+        close(probe.fd);
+    }
+
+    for (auto& endpoint : endpoints) {
+        if (endpoint.rtt_ms < 0) {
+            // The server may have moved, look it up again next time
+            endpoint.resolved.clear();
+        }
+    }
+}
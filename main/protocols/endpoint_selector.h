@@ -0,0 +1,64 @@
+#ifndef _ENDPOINT_SELECTOR_H_
+#define _ENDPOINT_SELECTOR_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#define ENDPOINT_PROBE_TIMEOUT_MS 1500
+#define ENDPOINT_PROBE_INTERVAL_SECONDS 600
+
+/*
+ * Orders the server endpoints handed out by the OTA server (websocket "urls", mqtt "endpoints").
+ *
+ * Before the first connection, and again every ENDPOINT_PROBE_INTERVAL_SECONDS, all endpoints are
+ * probed at once with a non-blocking TCP connect and sorted by handshake time. The caller connects
+ * to the first one and walks down the list on failure. A failed endpoint is moved to the end until
+ * the next probe reaches it again.
+ *
+ * The probe runs without the lock, so MarkFailed() is never held up by it. Each connect starts as soon
+ * as its host is resolved, and the lookup is kept until the endpoint turns out unreachable.
+ *
+ * Probing needs lwIP sockets, so it only runs on Wi-Fi boards. On cellular boards the configured
+ * order is kept and failures still rotate the list.
+ */
+class EndpointSelector {
+public:
+    // default_port is used for addresses without a scheme or port, e.g. the MQTT "host[:port]" form
+    EndpointSelector(const char* name, int default_port);
+
+    // Keeps the probe results if the list did not change
+    void SetEndpoints(const std::vector<std::string>& addresses);
+    // Endpoints in the order to try, probes first when the results are stale
+    std::vector<std::string> GetOrder();
+    void MarkFailed(const std::string& address);
+    void MarkSucceeded(const std::string& address);
+    size_t size();
+
+    // The OTA response stores lists in NVS as one newline separated string
+    static std::vector<std::string> Split(const std::string& list);
+    static bool ParseAddress(const std::string& address, int default_port, std::string& host, int& port);
+
+private:
+    struct Endpoint {
+        std::string address;
+        int rtt_ms = -1;
+        bool failed = false;
+        std::vector<uint8_t> resolved;  // sockaddr of the last lookup, empty until resolved
+    };
+
+    const char* name_;
+    int default_port_;
+    std::mutex mutex_;
+    std::vector<Endpoint> endpoints_;
+    int64_t last_probe_time_ = 0;
+    bool probing_ = false;
+    uint32_t list_version_ = 0;
+
+    bool Resolve(Endpoint& endpoint);
+    void Probe(std::vector<Endpoint>& endpoints);
+    void Sort();
+};
+
+#endif // _ENDPOINT_SELECTOR_H_
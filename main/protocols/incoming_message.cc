@@ -0,0 +1,71 @@
+#include "incoming_message.h"
+#include "control_codec.h"
+
+bool IncomingMessage::FromJson(const char* data, size_t length, IncomingMessage& message) {
+    message = IncomingMessage();
+    message.raw = std::string_view(data, length);
+
+    JsonReader reader(data, length);
+    std::string_view key;
+    JsonValue value;
+    while (reader.Next(key, value)) {
+        if (key == "type") {
+            message.type = value;
+        } else if (key == "session_id") {
+            message.session_id = value;
+        } else if (key == "state") {
+            message.state = value;
+        } else if (key == "text") {
+            message.text = value;
+        } else if (key == "emotion") {
+            message.emotion = value;
+        } else if (key == "command") {
+            message.command = value;
+        } else if (key == "status") {
+            message.status = value;
+        } else if (key == "message") {
+            message.message = value;
+        } else if (key == "payload") {
+            message.payload = value;
+        }
+    }
+    return reader.valid();
+}
+
+bool IncomingMessage::FromControl(const uint8_t* data, size_t length, IncomingMessage& message) {
+    message = IncomingMessage();
+    message.raw = std::string_view((const char*)data, length);
+
+    ControlDecoder decoder(data, length);
+    if (!decoder.valid()) {
+        return false;
+    }
+    message.type.type = kJsonValueString;
+    message.type.raw = ControlTypeToString(decoder.type());
+
+    uint8_t tag;
+    const char* data_ptr;
+    size_t data_length;
+    while (decoder.Next(tag, data_ptr, data_length)) {
+        JsonValue value;
+        value.type = kJsonValueString;
+        value.raw = std::string_view(data_ptr, data_length);
+        switch (tag) {
+            case kControlTagSessionId: message.session_id = value; break;
+            case kControlTagState: message.state = value; break;
+            case kControlTagText: message.text = value; break;
+            case kControlTagEmotion: message.emotion = value; break;
+            case kControlTagCommand: message.command = value; break;
+            case kControlTagStatus: message.status = value; break;
+            case kControlTagMessage: message.message = value; break;
+            case kControlTagPayload:
+                // Carried as JSON text
+                value.type = data_length > 0 && data_ptr[0] == '{' ? kJsonValueObject : kJsonValueString;
+                message.payload = value;
+                break;
+            default:
+                break;
+        }
+    }
+    return decoder.valid();
+}
@@ -0,0 +1,30 @@
+#ifndef _INCOMING_MESSAGE_H_
+#define _INCOMING_MESSAGE_H_
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+#include "json_reader.h"
+
+/*
+ * Routing fields of one incoming control message, read in place from the received JSON text or
+ * TLV record without building a cJSON tree. Only valid during the OnIncomingMessage callback.
+ */
+struct IncomingMessage {
+    JsonValue type;
+    JsonValue session_id;
+    JsonValue state;
+    JsonValue text;
+    JsonValue emotion;
+    JsonValue command;
+    JsonValue status;
+    JsonValue message;
+    JsonValue payload;      // Raw JSON text, e.g. the MCP request
+    std::string_view raw;   // The whole message as received
+
+    static bool FromJson(const char* data, size_t length, IncomingMessage& message);
+    static bool FromControl(const uint8_t* data, size_t length, IncomingMessage& message);
+};
+
+#endif // _INCOMING_MESSAGE_H_
@@ -0,0 +1,268 @@
+#include "json_reader.h"
+
+#include <cstdint>
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool ReadHex4(std::string_view text, size_t offset, uint32_t& value) {
+    if (offset + 4 > text.size()) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        int digit = HexValue(text[offset + i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back((char)code_point);
+    } else if (code_point < 0x800) {
+        out.push_back((char)(0xC0 | (code_point >> 6)));
+        out.push_back((char)(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.push_back((char)(0xE0 | (code_point >> 12)));
+        out.push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code_point & 0x3F)));
+    } else {
+        out.push_back((char)(0xF0 | (code_point >> 18)));
+        out.push_back((char)(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code_point & 0x3F)));
+    }
+}
+
+bool JsonValue::Equals(std::string_view value) const {
+    if (type != kJsonValueString) {
+        return false;
+    }
+    if (!escaped) {
+        return raw == value;
+    }
+    return str() == value;
+}
+
+std::string JsonValue::str() const {
+    if (type != kJsonValueString || !escaped) {
+        return std::string(raw);
+    }
+
+    std::string out;
+    out.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        char c = raw[i];
+        if (c != '\\' || i + 1 >= raw.size()) {
+            out.push_back(c);
+            continue;
+        }
+        c = raw[++i];
+        switch (c) {
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t code_point;
+                if (!ReadHex4(raw, i + 1, code_point)) {
+                    break;
+                }
+                i += 4;
+                // Characters outside the BMP come as a surrogate pair
+                if (code_point >= 0xD800 && code_point <= 0xDBFF && i + 2 < raw.size() &&
+                    raw[i + 1] == '\\' && raw[i + 2] == 'u') {
+                    uint32_t low;
+                    if (ReadHex4(raw, i + 3, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+                AppendUtf8(out, code_point);
+                break;
+            }
+            default:
+                // \" \\ \/
+                out.push_back(c);
+                break;
+        }
+    }
+    return out;
+}
+
+JsonReader::JsonReader(const char* data, size_t length) : data_(data), length_(length) {
+    SkipWhitespace();
+    if (offset_ < length_ && (data_[offset_] == '{' || data_[offset_] == '[')) {
+        array_ = data_[offset_] == '[';
+        offset_++;
+        valid_ = true;
+    }
+}
+
+void JsonReader::SkipWhitespace() {
+    while (offset_ < length_) {
+        char c = data_[offset_];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        offset_++;
+    }
+}
+
+// Expects offset_ at the opening quote, leaves it after the closing quote
+bool JsonReader::ReadString(std::string_view& out, bool& escaped) {
+    size_t start = ++offset_;
+    escaped = false;
+    while (offset_ < length_) {
+        char c = data_[offset_];
+        if (c == '"') {
+            out = std::string_view(data_ + start, offset_ - start);
+            offset_++;
+            return true;
+        }
+        if (c == '\\') {
+            escaped = true;
+            offset_++;
+        }
+        offset_++;
+    }
+    return false;
+}
+
+// Expects offset_ at '{' or '[', leaves it after the matching bracket
+bool JsonReader::SkipContainer() {
+    int depth = 0;
+    while (offset_ < length_) {
+        char c = data_[offset_];
+        if (c == '"') {
+            std::string_view ignored;
+            bool escaped;
+            if (!ReadString(ignored, escaped)) {
+                return false;
+            }
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                offset_++;
+                return true;
+            }
+        }
+        offset_++;
+    }
+    return false;
+}
+
+bool JsonReader::ReadValue(JsonValue& value) {
+    if (offset_ >= length_) {
+        return false;
+    }
+    size_t start = offset_;
+    char c = data_[offset_];
+    value.escaped = false;
+    if (c == '"') {
+        value.type = kJsonValueString;
+        return ReadString(value.raw, value.escaped);
+    }
+    if (c == '{' || c == '[') {
+        value.type = c == '{' ? kJsonValueObject : kJsonValueArray;
+        if (!SkipContainer()) {
+            return false;
+        }
+        value.raw = std::string_view(data_ + start, offset_ - start);
+        return true;
+    }
+
+    // Number, true, false or null
+    while (offset_ < length_) {
+        c = data_[offset_];
+        if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            break;
+        }
+        offset_++;
+    }
+    value.raw = std::string_view(data_ + start, offset_ - start);
+    if (value.raw.empty()) {
+        return false;
+    }
+    c = value.raw[0];
+    if (c == 't' || c == 'f') {
+        value.type = kJsonValueBool;
+    } else if (c == 'n') {
+        value.type = kJsonValueNull;
+    } else {
+        value.type = kJsonValueNumber;
+    }
+    return true;
+}
+
+// After a value: a comma, or the closing bracket which the next call reports as the end
+bool JsonReader::SkipSeparator(char close) {
+    SkipWhitespace();
+    if (offset_ < length_ && data_[offset_] == ',') {
+        offset_++;
+        return true;
+    }
+    return offset_ < length_ && data_[offset_] == close;
+}
+
+bool JsonReader::Next(std::string_view& key, JsonValue& value) {
+    if (!valid_ || done_ || array_) {
+        return false;
+    }
+
+    SkipWhitespace();
+    if (offset_ < length_ && data_[offset_] == '}') {
+        done_ = true;
+        return false;
+    }
+    bool key_escaped;
+    if (offset_ >= length_ || data_[offset_] != '"' || !ReadString(key, key_escaped)) {
+        valid_ = false;
+        return false;
+    }
+    SkipWhitespace();
+    if (offset_ >= length_ || data_[offset_] != ':') {
+        valid_ = false;
+        return false;
+    }
+    offset_++;
+    SkipWhitespace();
+    if (!ReadValue(value) || !SkipSeparator('}')) {
+        valid_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool JsonReader::NextElement(JsonValue& value) {
+    if (!valid_ || done_ || !array_) {
+        return false;
+    }
+
+    SkipWhitespace();
+    if (offset_ < length_ && data_[offset_] == ']') {
+        done_ = true;
+        return false;
+    }
+    if (!ReadValue(value) || !SkipSeparator(']')) {
+        valid_ = false;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef _JSON_READER_H_
+#define _JSON_READER_H_
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+enum JsonValueType {
+    kJsonValueNone,     // Member not present
+    kJsonValueString,
+    kJsonValueNumber,
+    kJsonValueBool,
+    kJsonValueNull,
+    kJsonValueObject,
+    kJsonValueArray,
+};
+
+/*
+ * A value inside a JSON text, not copied and not decoded.
+ * For strings raw holds the characters between the quotes with escapes left in place,
+ * for objects and arrays it holds the whole text including the brackets.
+ */
+struct JsonValue {
+    JsonValueType type = kJsonValueNone;
+    std::string_view raw;
+    bool escaped = false;
+
+    bool is_string() const { return type == kJsonValueString; }
+    bool is_object() const { return type == kJsonValueObject; }
+    bool present() const { return type != kJsonValueNone; }
+
+    // Compares a string value, only unescapes when the value has escapes
+    bool Equals(std::string_view value) const;
+    // Decoded string value (escapes and \u sequences resolved), raw text for other types
+    std::string str() const;
+};
+
+/*
+ * Pull reader over the members of one JSON object, or the elements of one JSON array. Nested
+ * objects and arrays are skipped without being parsed, nothing is allocated. The input must stay
+ * valid while values are used.
+ */
+class JsonReader {
+public:
+    JsonReader(const char* data, size_t length);
+    explicit JsonReader(const JsonValue& value) : JsonReader(value.raw.data(), value.raw.size()) {}
+
+    bool valid() const { return valid_; }
+    bool is_array() const { return array_; }
+    // Returns false after the last member or on malformed input, check valid() to tell them apart
+    bool Next(std::string_view& key, JsonValue& value);
+    // Same for the elements of an array
+    bool NextElement(JsonValue& value);
+
+private:
+    const char* data_;
+    size_t length_;
+    size_t offset_ = 0;
+    bool valid_ = false;
+    bool array_ = false;
+    bool done_ = false;
+
+    void SkipWhitespace();
+    bool ReadString(std::string_view& out, bool& escaped);
+    bool SkipContainer();
+    bool ReadValue(JsonValue& value);
+    bool SkipSeparator(char close);
+};
+
+#endif // _JSON_READER_H_
@@ -2,15 +2,21 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "control_codec.h"
 
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
 #define TAG "MQTT"
 
-MqttProtocol::MqttProtocol() {
+#ifndef CONFIG_MQTT_UDP_RECOVERY_BUDGET_MS
+#define CONFIG_MQTT_UDP_RECOVERY_BUDGET_MS 0
+#endif
+
+MqttProtocol::MqttProtocol() : endpoints_("mqtt", 8883) {
     event_group_handle_ = xEventGroupCreate();
 
     // Initialize reconnect timer
@@ -21,21 +27,40 @@ MqttProtocol::MqttProtocol() {
             if (app.GetDeviceState() == kDeviceStateIdle) {
                 ESP_LOGI(TAG, "Reconnecting to MQTT server");
                 app.Schedule([protocol]() {
-                    protocol->StartMqttClient(false);
-                });
+                    // Connects on the channel task, the main loop keeps running
+                    protocol->PreconnectAsync();
+                }, kTaskLaneUi, "mqtt_reconnect");
             }
         },
         .arg = this,
     };
     esp_timer_create(&reconnect_timer_args, &reconnect_timer_);
+
+    // Releases held packets when a gap runs out of budget and no packet arrives to do it
+    esp_timer_create_args_t recovery_timer_args = {
+        .callback = [](void* arg) {
+            auto protocol = (MqttProtocol*)arg;
+            protocol->DeliverRecoveredAudio();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "udp_recovery",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&recovery_timer_args, &recovery_timer_);
 }
 
 MqttProtocol::~MqttProtocol() {
     ESP_LOGI(TAG, "MqttProtocol deinit");
+    StopLivenessCheck();
     if (reconnect_timer_ != nullptr) {
         esp_timer_stop(reconnect_timer_);
         esp_timer_delete(reconnect_timer_);
     }
+    if (recovery_timer_ != nullptr) {
+        esp_timer_stop(recovery_timer_);
+        esp_timer_delete(recovery_timer_);
+    }
 
     udp_.reset();
     mqtt_.reset();
@@ -56,14 +81,18 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     }
 
     Settings settings("mqtt", false);
+    auto endpoints = EndpointSelector::Split(settings.GetString("endpoints"));
     auto endpoint = settings.GetString("endpoint");
+    if (endpoints.empty() && !endpoint.empty()) {
+        endpoints.push_back(endpoint);
+    }
     auto client_id = settings.GetString("client_id");
     auto username = settings.GetString("username");
     auto password = settings.GetString("password");
     int keepalive_interval = settings.GetInt("keepalive", 240);
     publish_topic_ = settings.GetString("publish_topic");
 
-    if (endpoint.empty()) {
+    if (endpoints.empty()) {
         ESP_LOGW(TAG, "MQTT endpoint is not specified");
         if (report_error) {
             SetError(Lang::Strings::SERVER_NOT_FOUND);
@@ -71,6 +100,25 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         return false;
     }
 
+    endpoints_.SetEndpoints(endpoints);
+    for (auto& address : endpoints_.GetOrder()) {
+        if (ConnectTo(address, client_id, username, password, keepalive_interval)) {
+            endpoints_.MarkSucceeded(address);
+            ESP_LOGI(TAG, "Connected to endpoint");
+            return true;
+        }
+        // Fail over to the next broker right away
+        endpoints_.MarkFailed(address);
+        mqtt_.reset();
+    }
+
+    ESP_LOGE(TAG, "Failed to connect to endpoint");
+    SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+    return false;
+}
+
+bool MqttProtocol::ConnectTo(const std::string& endpoint, const std::string& client_id,
+    const std::string& username, const std::string& password, int keepalive_interval) {
     auto network = Board::GetInstance().GetNetwork();
     mqtt_ = network->CreateMqtt(0);
     mqtt_->SetKeepAlive(keepalive_interval);
@@ -91,52 +139,63 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
-        cJSON* root = cJSON_Parse(payload.c_str());
-        if (root == nullptr) {
-            ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
+        IncomingMessage message;
+        auto data = (const uint8_t*)payload.data();
+        bool parsed = ControlDecoder::IsControlMessage(data, payload.size())
+            ? IncomingMessage::FromControl(data, payload.size(), message)
+            : IncomingMessage::FromJson(payload.data(), payload.size(), message);
+        if (!parsed) {
+            ESP_LOGE(TAG, "Failed to parse message %.*s", (int)payload.size(), payload.c_str());
             return;
         }
-        cJSON* type = cJSON_GetObjectItem(root, "type");
-        if (!cJSON_IsString(type)) {
+        if (!message.type.is_string()) {
             ESP_LOGE(TAG, "Message type is invalid");
-            cJSON_Delete(root);
             return;
         }
 
-        if (strcmp(type->valuestring, "hello") == 0) {
+        if (message.type.Equals("hello")) {
+            // The hello is the one message that needs a full parse
+            auto root = cJSON_ParseWithLength(payload.data(), payload.size());
             ParseServerHello(root);
-        } else if (strcmp(type->valuestring, "goodbye") == 0) {
-            auto session_id = cJSON_GetObjectItem(root, "session_id");
-            ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id ? session_id->valuestring : "null");
-            if (session_id == nullptr || session_id_ == session_id->valuestring) {
+            cJSON_Delete(root);
+        } else if (message.type.Equals("goodbye")) {
+            auto session_id = message.session_id.str();
+            ESP_LOGI(TAG, "Received goodbye message, session_id: %s", message.session_id.present() ? session_id.c_str() : "null");
+            if (!message.session_id.present() || session_id_ == session_id) {
                 Application::GetInstance().Schedule([this]() {
                     CloseAudioChannel();
-                });
+                }, kTaskLaneUi, "mqtt_goodbye");
             }
-        } else if (on_incoming_json_ != nullptr) {
-            on_incoming_json_(root);
+        } else if (on_incoming_message_ != nullptr) {
+            on_incoming_message_(message);
         }
-        cJSON_Delete(root);
-        last_incoming_time_ = std::chrono::steady_clock::now();
+        MarkIncoming();
     });
 
     ESP_LOGI(TAG, "Connecting to endpoint %s", endpoint.c_str());
     std::string broker_address;
     int broker_port = 8883;
-    size_t pos = endpoint.find(':');
-    if (pos != std::string::npos) {
-        broker_address = endpoint.substr(0, pos);
-        broker_port = std::stoi(endpoint.substr(pos + 1));
-    } else {
-        broker_address = endpoint;
+    if (!EndpointSelector::ParseAddress(endpoint, 8883, broker_address, broker_port)) {
+        ESP_LOGE(TAG, "Invalid endpoint %s", endpoint.c_str());
+        return false;
     }
     if (!mqtt_->Connect(broker_address, broker_port, client_id, username, password)) {
-        ESP_LOGE(TAG, "Failed to connect to endpoint");
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        ESP_LOGW(TAG, "Failed to connect to endpoint %s", endpoint.c_str());
         return false;
     }
+    return true;
+}
 
-    ESP_LOGI(TAG, "Connected to endpoint");
+bool MqttProtocol::SendBinaryControl(const std::string& data) {
+    if (publish_topic_.empty()) {
+        return false;
+    }
+    // MQTT payloads are binary safe, the magic byte tells control messages apart from JSON
+    if (!mqtt_->Publish(publish_topic_, data)) {
+        ESP_LOGE(TAG, "Failed to publish control message");
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
     return true;
 }
 
@@ -158,37 +217,71 @@ bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         return false;
     }
 
+    // With redundancy the plaintext is |primary size 2u|primary|previous frame|
+    std::vector<uint8_t> redundant_payload;
+    if (udp_redundancy_) {
+        redundant_payload.resize(2 + packet->payload.size() + last_uplink_payload_.size());
+        *(uint16_t*)&redundant_payload[0] = htons(packet->payload.size());
+        memcpy(&redundant_payload[2], packet->payload.data(), packet->payload.size());
+        if (!last_uplink_payload_.empty()) {
+            memcpy(&redundant_payload[2 + packet->payload.size()], last_uplink_payload_.data(), last_uplink_payload_.size());
+        }
+        last_uplink_payload_ = std::move(packet->payload);
+    }
+    auto& payload = udp_redundancy_ ? redundant_payload : packet->payload;
+
     std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
+    nonce[0] = UDP_PACKET_TYPE_AUDIO;
+    nonce[1] = udp_redundancy_ ? UDP_FLAG_REDUNDANT : 0;
+    *(uint16_t*)&nonce[2] = htons(payload.size());
     *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
     *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
 
     std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
+    encrypted.resize(aes_nonce_.size() + payload.size());
     memcpy(encrypted.data(), nonce.data(), nonce.size());
 
     size_t nc_off = 0;
     uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
+        (uint8_t*)payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    bool sent = udp_->Send(encrypted) > 0;
+    if (udp_nack_) {
+        std::lock_guard<std::mutex> history_lock(history_mutex_);
+        if (uplink_history_.size() >= UDP_RETRANSMIT_HISTORY) {
+            uplink_history_.pop_front();
+        }
+        uplink_history_.emplace_back(local_sequence_, std::move(encrypted));
+    }
+    return sent;
 }
 
 void MqttProtocol::CloseAudioChannel() {
+    StopLivenessCheck();
     {
         std::lock_guard<std::mutex> lock(channel_mutex_);
         udp_.reset();
+        last_uplink_payload_.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+        uplink_history_.clear();
+    }
+    esp_timer_stop(recovery_timer_);
+    {
+        std::lock_guard<std::mutex> lock(recovery_mutex_);
+        auto& stats = recovery_.stats();
+        ESP_LOGI(TAG, "UDP downlink: %lu received, %lu delivered, %lu lost, %lu late, %lu reordered, %lu duplicates, "
+            "recovered %lu by redundancy and %lu by %lu NACKs, %lu uplink retransmits",
+            stats.received, stats.delivered, stats.lost, stats.late, stats.reordered, stats.duplicates,
+            stats.recovered_fec, stats.recovered_nack, stats.nacks_sent, stats.retransmitted);
     }
 
-    std::string message = "{";
-    message += "\"session_id\":\"" + session_id_ + "\",";
-    message += "\"type\":\"goodbye\"";
-    message += "}";
-    SendText(message);
+    SendGoodbye();
 
     if (on_audio_channel_closed_ != nullptr) {
         on_audio_channel_closed_();
@@ -223,58 +316,271 @@ bool MqttProtocol::OpenAudioChannel() {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     auto network = Board::GetInstance().GetNetwork();
     udp_ = network->CreateUdp(2);
-    udp_->OnMessage([this](const std::string& data) {
+    udp_->OnMessage([this, udp = udp_.get()](const std::string& data) {
         /*
          * UDP Encrypted OPUS Packet Format:
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < aes_nonce_.size()) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
-        if (data[0] != 0x01) {
+        if (data[0] == UDP_PACKET_TYPE_AUDIO) {
+            OnUdpAudio(udp, data);
+        } else if (data[0] == UDP_PACKET_TYPE_NACK) {
+            OnUdpNack(udp, data);
+        } else if (data[0] == UDP_PACKET_TYPE_PONG) {
+            MarkIncoming();
+            OnHeartbeatReply(ntohl(*(uint32_t*)&data[12]));
+        } else {
             ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
-            return;
         }
-        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
-        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
+    });
+
+    udp_->Connect(udp_server_, udp_port_);
+    MarkIncoming();
+    StartLivenessCheck();
+
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+// Runs on the UDP task, which keeps udp alive; udp_ itself may be reset by CloseAudioChannel meanwhile
+void MqttProtocol::OnUdpAudio(Udp* udp, const std::string& data) {
+    uint8_t flags = data[1];
+    uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
+    uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
+
+    size_t decrypted_size = data.size() - aes_nonce_.size();
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    auto nonce = (uint8_t*)data.data();
+    auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
+    std::vector<uint8_t> decrypted(decrypted_size);
+    int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, decrypted.data());
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+        return;
+    }
+    MarkIncoming();
+
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->sample_rate = server_sample_rate_;
+    packet->frame_duration = server_frame_duration_;
+    packet->timestamp = timestamp;
+    std::unique_ptr<AudioStreamPacket> redundant;
+    if ((flags & UDP_FLAG_REDUNDANT) && decrypted_size >= 2) {
+        // |primary size 2u|primary|previous frame|
+        size_t primary_size = ntohs(*(uint16_t*)decrypted.data());
+        if (primary_size > decrypted_size - 2) {
+            ESP_LOGE(TAG, "Invalid redundant audio packet, primary size %u > %u", primary_size, decrypted_size - 2);
             return;
         }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        packet->payload.assign(decrypted.begin() + 2, decrypted.begin() + 2 + primary_size);
+        if (decrypted_size > 2 + primary_size) {
+            redundant = std::make_unique<AudioStreamPacket>();
+            redundant->sample_rate = server_sample_rate_;
+            redundant->frame_duration = server_frame_duration_;
+            redundant->timestamp = timestamp - server_frame_duration_;
+            redundant->payload.assign(decrypted.begin() + 2 + primary_size, decrypted.end());
         }
+    } else {
+        packet->payload = std::move(decrypted);
+    }
 
-        size_t decrypted_size = data.size() - aes_nonce_.size();
-        size_t nc_off = 0;
-        uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        auto packet = std::make_unique<AudioStreamPacket>();
-        packet->sample_rate = server_sample_rate_;
-        packet->frame_duration = server_frame_duration_;
-        packet->timestamp = timestamp;
-        packet->payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
-        if (ret != 0) {
-            ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
-            return;
+    std::vector<uint32_t> missing;
+    {
+        std::lock_guard<std::mutex> lock(recovery_mutex_);
+        auto now = esp_timer_get_time();
+        recovery_.Push(sequence, std::move(packet), now);
+        if (redundant != nullptr && recovery_.IsMissing(sequence - 1)) {
+            recovery_.Push(sequence - 1, std::move(redundant), now, true);
+        }
+        missing = recovery_.TakeMissing();
+    }
+    if (!missing.empty()) {
+        SendNack(udp, missing);
+    }
+    DeliverRecoveredAudio();
+}
+
+// Called from the UDP task and the recovery timer. The decoder callback runs without recovery_mutex_,
+// so the UDP task can keep pushing while it runs; one caller at a time delivers to keep the order.
+void MqttProtocol::DeliverRecoveredAudio() {
+    std::unique_lock<std::mutex> lock(recovery_mutex_);
+    if (delivering_) {
+        // The caller delivering now comes back for what this call would have released
+        redeliver_ = true;
+        return;
+    }
+    delivering_ = true;
+    do {
+        redeliver_ = false;
+        std::vector<std::unique_ptr<AudioStreamPacket>> packets;
+        auto now = esp_timer_get_time();
+        while (auto packet = recovery_.Pop(now)) {
+            packets.push_back(std::move(packet));
+        }
+
+        // Come back when the gap at the head runs out of budget
+        auto deadline = recovery_.NextDeadline();
+        esp_timer_stop(recovery_timer_);
+        if (deadline != 0) {
+            esp_timer_start_once(recovery_timer_, std::max<int64_t>(deadline - now, 1000));
         }
+
+        lock.unlock();
         if (on_incoming_audio_ != nullptr) {
-            on_incoming_audio_(std::move(packet));
+            for (auto& packet : packets) {
+                on_incoming_audio_(std::move(packet));
+            }
         }
-        remote_sequence_ = sequence;
-        last_incoming_time_ = std::chrono::steady_clock::now();
-    });
+        lock.lock();
+    } while (redeliver_);
+    delivering_ = false;
+}
 
-    udp_->Connect(udp_server_, udp_port_);
+void MqttProtocol::SendNack(Udp* udp, const std::vector<uint32_t>& sequences) {
+    /*
+     * NACK, the sequence list is encrypted like an audio payload with the header as nonce:
+     * |type 1u (0x02)|flags 1u|count 2u|ssrc 4u|nack_id 4u|reserved 4u|sequence 4u * count|
+     * nack_id grows with every NACK so no nonce repeats, and a replayed NACK is ignored
+     */
+    std::string nonce(aes_nonce_);
+    nonce[0] = UDP_PACKET_TYPE_NACK;
+    nonce[1] = 0;
+    *(uint16_t*)&nonce[2] = htons(sequences.size());
+    *(uint32_t*)&nonce[8] = htonl(++local_nack_id_);
+    memset(&nonce[12], 0, 4);
+
+    std::vector<uint8_t> plain(sequences.size() * 4);
+    for (size_t i = 0; i < sequences.size(); i++) {
+        uint32_t sequence = htonl(sequences[i]);
+        memcpy(&plain[i * 4], &sequence, 4);
+    }
+    std::string nack(nonce.size() + plain.size(), '\0');
+    memcpy(nack.data(), nonce.data(), nonce.size());
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, plain.size(), &nc_off, (uint8_t*)nonce.data(), stream_block,
+        plain.data(), (uint8_t*)&nack[nonce.size()]) != 0) {
+        ESP_LOGE(TAG, "Failed to encrypt NACK");
+        return;
+    }
+    udp->Send(nack);
+}
 
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
+void MqttProtocol::OnUdpNack(Udp* udp, const std::string& data) {
+    if (!udp_nack_) {
+        return;
     }
-    return true;
+    size_t count = ntohs(*(uint16_t*)&data[2]);
+    if (data.size() < 16 + count * 4) {
+        ESP_LOGE(TAG, "Invalid NACK packet size: %u", data.size());
+        return;
+    }
+    uint32_t nack_id = ntohl(*(uint32_t*)&data[8]);
+    if ((int32_t)(nack_id - remote_nack_id_) <= 0) {
+        ESP_LOGW(TAG, "Replayed NACK %lu ignored", nack_id);
+        return;
+    }
+
+    std::vector<uint8_t> plain(count * 4);
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    uint8_t nonce[16];
+    memcpy(nonce, data.data(), sizeof(nonce));
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, plain.size(), &nc_off, nonce, stream_block,
+        (const uint8_t*)data.data() + 16, plain.data()) != 0) {
+        ESP_LOGE(TAG, "Failed to decrypt NACK");
+        return;
+    }
+    remote_nack_id_ = nack_id;
+
+    std::vector<std::string> resend;
+    {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t sequence;
+            memcpy(&sequence, &plain[i * 4], 4);
+            sequence = ntohl(sequence);
+            for (auto& [sent_sequence, packet] : uplink_history_) {
+                if (sent_sequence == sequence) {
+                    resend.push_back(packet);
+                    break;
+                }
+            }
+        }
+    }
+    for (auto& packet : resend) {
+        udp->Send(packet);
+    }
+    std::lock_guard<std::mutex> lock(recovery_mutex_);
+    recovery_.stats().retransmitted += resend.size();
+}
+
+void MqttProtocol::SendHeartbeat(uint32_t id) {
+    /*
+     * Heartbeats go over UDP, a dead UDP path is what the MQTT keepalive cannot see.
+     * Not encrypted, the server echoes the packet with type 0x04:
+     * |type 1u (0x03)|flags 1u|payload_len 2u (0)|ssrc 4u|reserved 4u|id 4u|
+     */
+    std::string ping(16, '\0');
+    ping[0] = UDP_PACKET_TYPE_PING;
+    memcpy(&ping[4], &aes_nonce_[4], 4);
+    *(uint32_t*)&ping[12] = htonl(id);
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (udp_ != nullptr) {
+        MarkHeartbeatSent(id);
+        udp_->Send(ping);
+    }
+}
+
+void MqttProtocol::OnChannelDead() {
+    ESP_LOGW(TAG, "UDP audio channel stopped answering");
+    SetError(Lang::Strings::SERVER_TIMEOUT);
+    Application::GetInstance().Schedule([this]() {
+        if (udp_ != nullptr) {
+            CloseAudioChannel();
+        }
+        // The broker may be gone too, do not wait for the MQTT keepalive to notice
+        PreconnectAsync();
+    });
+}
+
+// Runs on the channel task
+void MqttProtocol::Preconnect() {
+    if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
+        StartMqttClient(false);
+    }
+}
+
+std::string MqttProtocol::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(recovery_mutex_);
+    auto& stats = recovery_.stats();
+    cJSON* root = cJSON_CreateObject();
+    AddLivenessStats(root);
+    cJSON_AddStringToObject(root, "transport", "udp");
+    cJSON_AddBoolToObject(root, "redundancy", udp_redundancy_);
+    cJSON_AddBoolToObject(root, "nack", udp_nack_);
+    cJSON_AddNumberToObject(root, "received", stats.received);
+    cJSON_AddNumberToObject(root, "delivered", stats.delivered);
+    cJSON_AddNumberToObject(root, "lost", stats.lost);
+    cJSON_AddNumberToObject(root, "late", stats.late);
+    cJSON_AddNumberToObject(root, "reordered", stats.reordered);
+    cJSON_AddNumberToObject(root, "duplicates", stats.duplicates);
+    cJSON_AddNumberToObject(root, "recovered_redundancy", stats.recovered_fec);
+    cJSON_AddNumberToObject(root, "recovered_nack", stats.recovered_nack);
+    cJSON_AddNumberToObject(root, "nacks_sent", stats.nacks_sent);
+    cJSON_AddNumberToObject(root, "uplink_retransmitted", stats.retransmitted);
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
 }
 
 std::string MqttProtocol::GetHelloMessage() {
@@ -284,10 +590,13 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddNumberToObject(root, "version", 3);
     cJSON_AddStringToObject(root, "transport", "udp");
     cJSON* features = cJSON_CreateObject();
-#if CONFIG_USE_SERVER_AEC
-    cJSON_AddBoolToObject(features, "aec", true);
+    AddHelloFeatures(features, true);
+#if CONFIG_MQTT_UDP_REDUNDANCY
+    cJSON_AddBoolToObject(features, "udp_redundancy", true);
+#endif
+#if CONFIG_MQTT_UDP_NACK
+    cJSON_AddBoolToObject(features, "udp_nack", true);
 #endif
-    cJSON_AddBoolToObject(features, "mcp", true);
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
@@ -315,6 +624,17 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
+    ParseHelloFeatures(root);
+    auto features = cJSON_GetObjectItem(root, "features");
+    udp_redundancy_ = false;
+    udp_nack_ = false;
+#if CONFIG_MQTT_UDP_REDUNDANCY
+    udp_redundancy_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "udp_redundancy"));
+#endif
+#if CONFIG_MQTT_UDP_NACK
+    udp_nack_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "udp_nack"));
+#endif
+
     // Get sample rate from hello message
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
@@ -344,7 +664,18 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     mbedtls_aes_init(&aes_ctx_);
     mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
     local_sequence_ = 0;
-    remote_sequence_ = 0;
+    local_nack_id_ = 0;
+    remote_nack_id_ = 0;
+    {
+        // Packets behind a gap are only worth holding when something can fill it
+        std::lock_guard<std::mutex> lock(recovery_mutex_);
+        bool recovery = udp_redundancy_ || udp_nack_;
+        recovery_.Reset(recovery ? CONFIG_MQTT_UDP_RECOVERY_BUDGET_MS : 0, udp_nack_);
+    }
+    if (udp_redundancy_ || udp_nack_) {
+        ESP_LOGI(TAG, "UDP loss recovery: redundancy %s, nack %s, budget %d ms", udp_redundancy_ ? "on" : "off",
+            udp_nack_ ? "on" : "off", CONFIG_MQTT_UDP_RECOVERY_BUDGET_MS);
+    }
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
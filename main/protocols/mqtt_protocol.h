@@ -3,6 +3,8 @@
 
 
 #include "protocol.h"
+#include "endpoint_selector.h"
+#include "udp_recovery.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
@@ -15,12 +17,21 @@
 #include <string>
 #include <map>
 #include <mutex>
+#include <deque>
 
 #define MQTT_PING_INTERVAL_SECONDS 90
 #define MQTT_RECONNECT_INTERVAL_MS 60000
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
+#define UDP_PACKET_TYPE_AUDIO 0x01
+#define UDP_PACKET_TYPE_NACK 0x02
+#define UDP_PACKET_TYPE_PING 0x03
+#define UDP_PACKET_TYPE_PONG 0x04
+#define UDP_FLAG_REDUNDANT 0x01
+// Uplink packets kept for retransmission, about 2 seconds at 60 ms frames
+#define UDP_RETRANSMIT_HISTORY 32
+
 class MqttProtocol : public Protocol {
 public:
     MqttProtocol();
@@ -29,8 +40,11 @@ public:
     bool Start() override;
     bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
     bool OpenAudioChannel() override;
+    // Reconnects to the broker if needed, the UDP channel is only opened with the audio channel
+    void Preconnect() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    std::string GetStatsJson() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
@@ -45,15 +59,41 @@ private:
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
-    uint32_t remote_sequence_;
     esp_timer_handle_t reconnect_timer_;
 
+    // Loss recovery, negotiated in the hello (see CONFIG_MQTT_UDP_REDUNDANCY / CONFIG_MQTT_UDP_NACK)
+    bool udp_redundancy_ = false;
+    bool udp_nack_ = false;
+    std::vector<uint8_t> last_uplink_payload_;
+    // Separate from channel_mutex_, the UDP task must not wait on a lock held while udp_ is destroyed
+    std::mutex history_mutex_;
+    std::deque<std::pair<uint32_t, std::string>> uplink_history_;
+    // UDP task only, reset by the hello before the channel opens
+    uint32_t local_nack_id_ = 0;
+    uint32_t remote_nack_id_ = 0;
+    std::mutex recovery_mutex_;
+    UdpRecoveryBuffer recovery_;
+    bool delivering_ = false;       // Guarded by recovery_mutex_, see DeliverRecoveredAudio()
+    bool redeliver_ = false;
+    esp_timer_handle_t recovery_timer_ = nullptr;
+    // Filled from the "endpoints" list of the OTA response, or the single "endpoint"
+    EndpointSelector endpoints_;
+
     bool StartMqttClient(bool report_error=false);
+    bool ConnectTo(const std::string& endpoint, const std::string& client_id,
+        const std::string& username, const std::string& password, int keepalive_interval);
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
+    void OnUdpAudio(Udp* udp, const std::string& data);
+    void OnUdpNack(Udp* udp, const std::string& data);
+    void SendNack(Udp* udp, const std::vector<uint32_t>& sequences);
+    void DeliverRecoveredAudio();
 
     bool SendText(const std::string& text) override;
+    bool SendBinaryControl(const std::string& data) override;
     std::string GetHelloMessage();
+    void SendHeartbeat(uint32_t id) override;
+    void OnChannelDead() override;
 };
 
 
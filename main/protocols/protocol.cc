@@ -1,11 +1,41 @@
 #include "protocol.h"
+#include "control_codec.h"
+#include "application.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <esp_log.h>
+#include <cstring>
+#include <cstdlib>
+#include "assets/lang_config.h"
 
 #define TAG "Protocol"
 
-void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
-    on_incoming_json_ = callback;
+#ifndef CONFIG_PROTOCOL_HEARTBEAT_INTERVAL_MS
+#define CONFIG_PROTOCOL_HEARTBEAT_INTERVAL_MS 0
+#endif
+
+Protocol::Protocol() {
+    esp_timer_create_args_t liveness_timer_args = {
+        .callback = [](void* arg) {
+            auto protocol = (Protocol*)arg;
+            protocol->CheckLiveness();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "liveness",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&liveness_timer_args, &liveness_timer_);
+}
+
+Protocol::~Protocol() {
+    esp_timer_stop(liveness_timer_);
+    esp_timer_delete(liveness_timer_);
+}
+
+void Protocol::OnIncomingMessage(std::function<void(const IncomingMessage& message)> callback) {
+    on_incoming_message_ = callback;
 }
 
 void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
@@ -32,6 +62,122 @@ void Protocol::OnDisconnected(std::function<void()> callback) {
     on_disconnected_ = callback;
 }
 
+void Protocol::Preconnect() {
+    // Protocols without a reusable connection open everything in OpenAudioChannel
+}
+
+void Protocol::OpenAudioChannelAsync(OpenCallback callback) {
+    open_callbacks_.push_back(std::move(callback));
+    if (open_in_flight_) {
+        // Cancelled but still running, its result is wanted again
+        open_cancelled_ = false;
+        return;
+    }
+    open_in_flight_ = true;
+    open_start_time_ = esp_timer_get_time();
+    PostChannelJob(kChannelJobOpen);
+}
+
+void Protocol::PreconnectAsync() {
+    if (!open_in_flight_) {
+        PostChannelJob(kChannelJobPreconnect);
+    }
+}
+
+void Protocol::CancelOpenAudioChannel() {
+    if (!open_in_flight_ || open_cancelled_) {
+        return;
+    }
+    ESP_LOGI(TAG, "Opening audio channel cancelled");
+    open_cancelled_ = true;
+    auto callbacks = std::move(open_callbacks_);
+    open_callbacks_.clear();
+    for (auto& callback : callbacks) {
+        callback(false);
+    }
+}
+
+void Protocol::PostChannelJob(ChannelJob job) {
+    std::lock_guard<std::mutex> lock(channel_job_mutex_);
+    // An open connects as well, a preconnect never replaces it
+    if (job > pending_channel_job_) {
+        pending_channel_job_ = job;
+    }
+    if (channel_busy_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    channel_busy_.store(true, std::memory_order_release);
+    auto ret = xTaskCreate([](void* arg) {
+        ((Protocol*)arg)->RunChannelJobs();
+        vTaskDelete(NULL);
+    }, "audio_channel", PROTOCOL_CHANNEL_TASK_STACK_SIZE, this, 3, nullptr);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create audio channel task");
+        pending_channel_job_ = kChannelJobNone;
+        channel_busy_.store(false, std::memory_order_release);
+        if (job == kChannelJobOpen) {
+            Application::GetInstance().Schedule([this]() {
+                FinishOpen(false);
+            }, kTaskLaneAudioControl, "FinishOpenAudioChannel");
+        }
+    }
+}
+
+// Runs on the worker task, jobs posted meanwhile are picked up before it exits
+void Protocol::RunChannelJobs() {
+    while (true) {
+        ChannelJob job;
+        {
+            std::lock_guard<std::mutex> lock(channel_job_mutex_);
+            job = pending_channel_job_;
+            pending_channel_job_ = kChannelJobNone;
+            if (job == kChannelJobNone) {
+                channel_busy_.store(false, std::memory_order_release);
+                return;
+            }
+        }
+        if (job == kChannelJobOpen) {
+            bool opened = OpenAudioChannel();
+            Application::GetInstance().Schedule([this, opened]() {
+                FinishOpen(opened);
+            }, kTaskLaneAudioControl, "FinishOpenAudioChannel");
+        } else {
+            Preconnect();
+        }
+    }
+}
+
+void Protocol::FinishOpen(bool opened) {
+    int open_ms = (esp_timer_get_time() - open_start_time_) / 1000;
+    bool cancelled = open_cancelled_;
+    auto callbacks = std::move(open_callbacks_);
+    open_callbacks_.clear();
+    open_in_flight_ = false;
+    open_cancelled_ = false;
+
+    if (cancelled && opened) {
+        ESP_LOGI(TAG, "Audio channel opened after it was cancelled, closing it");
+        CloseAudioChannel();
+    }
+    {
+        std::lock_guard<std::mutex> lock(liveness_mutex_);
+        if (cancelled) {
+            channel_opens_cancelled_++;
+        } else if (opened) {
+            channel_opens_++;
+            last_open_ms_ = open_ms;
+            if (open_ms > max_open_ms_) {
+                max_open_ms_ = open_ms;
+            }
+        } else {
+            channel_open_failures_++;
+        }
+    }
+    for (auto& callback : callbacks) {
+        callback(opened && !cancelled);
+    }
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -39,7 +185,65 @@ void Protocol::SetError(const std::string& message) {
     }
 }
 
+bool Protocol::SendBinaryControl(const std::string& data) {
+    ESP_LOGE(TAG, "Binary control messages are not supported by this transport");
+    return false;
+}
+
+size_t Protocol::MaxBinaryControlSize() const {
+    return SIZE_MAX;
+}
+
+void Protocol::AddHelloFeatures(cJSON* features, bool binary_control_supported) {
+#if CONFIG_USE_SERVER_AEC
+    cJSON_AddBoolToObject(features, "aec", true);
+#endif
+    cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_PROTOCOL_HEARTBEAT_INTERVAL_MS > 0
+    cJSON_AddBoolToObject(features, "heartbeat", true);
+#endif
+#if CONFIG_PROTOCOL_BINARY_CONTROL
+    if (binary_control_supported) {
+        cJSON_AddStringToObject(features, "control", "tlv");
+    }
+#endif
+}
+
+void Protocol::ParseHelloFeatures(const cJSON* root) {
+    binary_control_ = false;
+    heartbeat_ = false;
+#if CONFIG_PROTOCOL_HEARTBEAT_INTERVAL_MS > 0
+    heartbeat_ = cJSON_IsTrue(cJSON_GetObjectItem(cJSON_GetObjectItem(root, "features"), "heartbeat"));
+    ESP_LOGI(TAG, "Heartbeat: %s", heartbeat_ ? "on" : "off");
+#endif
+#if CONFIG_PROTOCOL_BINARY_CONTROL
+    auto features = cJSON_GetObjectItem(root, "features");
+    auto control = cJSON_GetObjectItem(features, "control");
+    binary_control_ = cJSON_IsString(control) && strcmp(control->valuestring, "tlv") == 0;
+    ESP_LOGI(TAG, "Control messages: %s", binary_control_ ? "tlv" : "json");
+#endif
+}
+
+void Protocol::SendGoodbye() {
+    if (binary_control_) {
+        SendBinaryControl(ControlEncoder(kControlTypeGoodbye)
+            .Add(kControlTagSessionId, session_id_)
+            .data());
+        return;
+    }
+    SendText("{\"session_id\":\"" + session_id_ + "\",\"type\":\"goodbye\"}");
+}
+
 void Protocol::SendAbortSpeaking(AbortReason reason) {
+    if (binary_control_) {
+        ControlEncoder encoder(kControlTypeAbort);
+        encoder.Add(kControlTagSessionId, session_id_);
+        if (reason == kAbortReasonWakeWordDetected) {
+            encoder.Add(kControlTagReason, "wake_word_detected");
+        }
+        SendBinaryControl(encoder.data());
+        return;
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
         message += ",\"reason\":\"wake_word_detected\"";
@@ -49,42 +253,199 @@ void Protocol::SendAbortSpeaking(AbortReason reason) {
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
+    if (binary_control_) {
+        SendBinaryControl(ControlEncoder(kControlTypeListen)
+            .Add(kControlTagSessionId, session_id_)
+            .Add(kControlTagState, "detect")
+            .Add(kControlTagText, wake_word)
+            .data());
+        return;
+    }
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
     SendText(json);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\"";
-    message += ",\"type\":\"listen\",\"state\":\"start\"";
+    const char* mode_string;
     if (mode == kListeningModeRealtime) {
-        message += ",\"mode\":\"realtime\"";
+        mode_string = "realtime";
     } else if (mode == kListeningModeAutoStop) {
-        message += ",\"mode\":\"auto\"";
+        mode_string = "auto";
     } else {
-        message += ",\"mode\":\"manual\"";
+        mode_string = "manual";
     }
-    message += "}";
+
+    if (binary_control_) {
+        SendBinaryControl(ControlEncoder(kControlTypeListen)
+            .Add(kControlTagSessionId, session_id_)
+            .Add(kControlTagState, "start")
+            .Add(kControlTagMode, mode_string)
+            .data());
+        return;
+    }
+    std::string message = "{\"session_id\":\"" + session_id_ + "\"";
+    message += ",\"type\":\"listen\",\"state\":\"start\"";
+    message += ",\"mode\":\"";
+    message += mode_string;
+    message += "\"}";
     SendText(message);
 }
 
 void Protocol::SendStopListening() {
+    if (binary_control_) {
+        SendBinaryControl(ControlEncoder(kControlTypeListen)
+            .Add(kControlTagSessionId, session_id_)
+            .Add(kControlTagState, "stop")
+            .data());
+        return;
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
     SendText(message);
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
+    if (binary_control_) {
+        // The MCP payload is copied once as is, no JSON envelope around it
+        ControlEncoder encoder(kControlTypeMcp, payload.size() + session_id_.size() + 16);
+        encoder.Add(kControlTagSessionId, session_id_).Add(kControlTagPayload, payload);
+        if (encoder.data().size() <= MaxBinaryControlSize()) {
+            SendBinaryControl(encoder.data());
+            return;
+        }
+        ESP_LOGW(TAG, "MCP message of %u bytes too large for a binary frame, sending JSON", payload.size());
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
     SendText(message);
 }
 
+std::string Protocol::GetStatsJson() {
+    cJSON* root = cJSON_CreateObject();
+    AddLivenessStats(root);
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
 bool Protocol::IsTimeout() const {
-    const int kTimeoutSeconds = 120;
-    auto now = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_incoming_time_);
-    bool timeout = duration.count() > kTimeoutSeconds;
+    auto seconds = (esp_timer_get_time() - last_incoming_time_) / 1000000;
+    bool timeout = seconds > PROTOCOL_CHANNEL_TIMEOUT_SECONDS;
     if (timeout) {
-        ESP_LOGE(TAG, "Channel timeout %ld seconds", (long)duration.count());
+        ESP_LOGE(TAG, "Channel timeout %ld seconds", (long)seconds);
     }
     return timeout;
 }
+
+void Protocol::MarkIncoming() {
+    last_incoming_time_ = esp_timer_get_time();
+}
+
+void Protocol::StartLivenessCheck() {
+    {
+        std::lock_guard<std::mutex> lock(liveness_mutex_);
+        pending_heartbeat_ = 0;
+        missed_heartbeats_ = 0;
+    }
+    int interval_ms = heartbeat_ ? CONFIG_PROTOCOL_HEARTBEAT_INTERVAL_MS : PROTOCOL_LIVENESS_CHECK_INTERVAL_MS;
+    esp_timer_stop(liveness_timer_);
+    esp_timer_start_periodic(liveness_timer_, interval_ms * 1000LL);
+}
+
+void Protocol::StopLivenessCheck() {
+    esp_timer_stop(liveness_timer_);
+}
+
+void Protocol::CheckLiveness() {
+    if (!heartbeat_) {
+        if (IsTimeout()) {
+            StopLivenessCheck();
+            OnChannelDead();
+        }
+        return;
+    }
+
+    uint32_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(liveness_mutex_);
+        if (pending_heartbeat_ != 0) {
+            if (heartbeat_sent_time_ == 0) {
+                // Still queued behind the main loop, a busy main loop is not a dead channel
+                return;
+            }
+            heartbeats_lost_++;
+            missed_heartbeats_++;
+        }
+        if (missed_heartbeats_ < PROTOCOL_HEARTBEAT_MAX_MISSED) {
+            id = ++heartbeat_id_;
+            if (id == 0) {
+                id = ++heartbeat_id_;
+            }
+            pending_heartbeat_ = id;
+            // Stamped by MarkHeartbeatSent() when the transport actually sends it
+            heartbeat_sent_time_ = 0;
+            heartbeats_sent_++;
+        }
+    }
+    if (id == 0) {
+        ESP_LOGE(TAG, "No reply to %d heartbeats, the channel is dead", PROTOCOL_HEARTBEAT_MAX_MISSED);
+        StopLivenessCheck();
+        OnChannelDead();
+        return;
+    }
+    SendHeartbeat(id);
+}
+
+void Protocol::MarkHeartbeatSent(uint32_t id) {
+    std::lock_guard<std::mutex> lock(liveness_mutex_);
+    if (id == pending_heartbeat_) {
+        heartbeat_sent_time_ = esp_timer_get_time();
+    }
+}
+
+void Protocol::OnHeartbeatReply(uint32_t id) {
+    std::lock_guard<std::mutex> lock(liveness_mutex_);
+    if (id == 0 || id != pending_heartbeat_ || heartbeat_sent_time_ == 0) {
+        // Late reply to a heartbeat already counted as lost
+        return;
+    }
+    int rtt = (esp_timer_get_time() - heartbeat_sent_time_) / 1000;
+    pending_heartbeat_ = 0;
+    missed_heartbeats_ = 0;
+    last_rtt_ms_ = rtt;
+
+    // Same smoothing as the TCP retransmission timer (RFC 6298)
+    if (srtt_ms_ == 0) {
+        srtt_ms_ = rtt;
+        rttvar_ms_ = rtt / 2;
+    } else {
+        rttvar_ms_ = (3 * rttvar_ms_ + std::abs(srtt_ms_ - rtt)) / 4;
+        srtt_ms_ = (7 * srtt_ms_ + rtt) / 8;
+    }
+    ESP_LOGD(TAG, "Heartbeat rtt %d ms, smoothed %d ms, var %d ms", rtt, srtt_ms_.load(), rttvar_ms_.load());
+}
+
+void Protocol::AddLivenessStats(cJSON* root) {
+    std::lock_guard<std::mutex> lock(liveness_mutex_);
+    cJSON_AddBoolToObject(root, "heartbeat", heartbeat_);
+    cJSON_AddNumberToObject(root, "rtt_ms", last_rtt_ms_);
+    cJSON_AddNumberToObject(root, "srtt_ms", srtt_ms_);
+    cJSON_AddNumberToObject(root, "rtt_var_ms", rttvar_ms_);
+    cJSON_AddNumberToObject(root, "heartbeats_sent", heartbeats_sent_);
+    cJSON_AddNumberToObject(root, "heartbeats_lost", heartbeats_lost_);
+    cJSON_AddNumberToObject(root, "idle_ms", (esp_timer_get_time() - last_incoming_time_) / 1000);
+    cJSON_AddNumberToObject(root, "channel_opens", channel_opens_);
+    cJSON_AddNumberToObject(root, "channel_open_failures", channel_open_failures_);
+    cJSON_AddNumberToObject(root, "channel_opens_cancelled", channel_opens_cancelled_);
+    cJSON_AddNumberToObject(root, "last_open_ms", last_open_ms_);
+    cJSON_AddNumberToObject(root, "max_open_ms", max_open_ms_);
+}
+
+void Protocol::SendHeartbeat(uint32_t id) {
+    // Transports without heartbeats never negotiate them
+}
+
+void Protocol::OnChannelDead() {
+    SetError(Lang::Strings::SERVER_TIMEOUT);
+}
@@ -6,6 +6,13 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include <esp_timer.h>
+
+#include "incoming_message.h"
 
 struct AudioStreamPacket {
     int sample_rate = 0;
@@ -16,7 +23,7 @@ struct AudioStreamPacket {
 
 struct BinaryProtocol2 {
     uint16_t version;
-    uint16_t type;          // Message type (0: OPUS, 1: JSON)
+    uint16_t type;          // Message type (0: OPUS, 1: JSON, 2: TLV control)
     uint32_t reserved;      // Reserved for future use
     uint32_t timestamp;     // Timestamp in milliseconds (used for server-side AEC)
     uint32_t payload_size;  // Payload size in bytes
@@ -24,12 +31,23 @@ struct BinaryProtocol2 {
 } __attribute__((packed));
 
 struct BinaryProtocol3 {
-    uint8_t type;
+    uint8_t type;           // Same values as BinaryProtocol2::type
     uint8_t reserved;
     uint16_t payload_size;
     uint8_t payload[];
 } __attribute__((packed));
 
+#define BINARY_PROTOCOL_TYPE_OPUS 0
+#define BINARY_PROTOCOL_TYPE_CONTROL 2
+
+// Without heartbeats only a silent channel tells it is dead, checked this often
+#define PROTOCOL_LIVENESS_CHECK_INTERVAL_MS 5000
+#define PROTOCOL_CHANNEL_TIMEOUT_SECONDS 120
+// Heartbeats left unanswered in a row before the channel is given up
+#define PROTOCOL_HEARTBEAT_MAX_MISSED 3
+// Opening the audio channel connects and runs TLS on this task instead of the main loop
+#define PROTOCOL_CHANNEL_TASK_STACK_SIZE (4096 * 2)
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -43,7 +61,8 @@ enum ListeningMode {
 
 class Protocol {
 public:
-    virtual ~Protocol() = default;
+    Protocol();
+    virtual ~Protocol();
 
     inline int server_sample_rate() const {
         return server_sample_rate_;
@@ -56,7 +75,7 @@ public:
     }
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
-    void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    void OnIncomingMessage(std::function<void(const IncomingMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -64,7 +83,22 @@ public:
     void OnDisconnected(std::function<void()> callback);
 
     virtual bool Start() = 0;
+    // Blocks until the server answers the hello, up to 10 s. The main loop uses OpenAudioChannelAsync().
     virtual bool OpenAudioChannel() = 0;
+    virtual void Preconnect();
+
+    // Runs in the main loop once an asynchronous open is done, false if it failed or was cancelled
+    using OpenCallback = std::function<void(bool opened)>;
+    // Main loop only. Opens the audio channel on a worker task and keeps the main loop running.
+    // A request made while an open is in flight waits for that open instead of starting another.
+    void OpenAudioChannelAsync(OpenCallback callback);
+    // Main loop only. Runs Preconnect() on the worker task, unless an open is in flight
+    void PreconnectAsync();
+    // Main loop only. Pending callbacks get false right away, a channel that opens anyway is closed again
+    void CancelOpenAudioChannel();
+    bool IsOpeningAudioChannel() const { return open_in_flight_ && !open_cancelled_; }
+    // The worker task is using the connection, the main loop must leave it alone until it is done
+    bool IsChannelBusy() const { return channel_busy_.load(std::memory_order_acquire); }
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
     virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
@@ -73,9 +107,16 @@ public:
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
+    // Transport statistics of the current or last audio channel, as a JSON object
+    virtual std::string GetStatsJson();
+
+    // Smoothed heartbeat round trip time and its mean deviation, 0 until the first reply.
+    // Lets bitrate and jitter buffer decisions follow the network instead of guessing.
+    int rtt_ms() const { return srtt_ms_; }
+    int rtt_var_ms() const { return rttvar_ms_; }
 
 protected:
-    std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(const IncomingMessage& message)> on_incoming_message_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
@@ -86,12 +127,74 @@ protected:
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
     bool error_occurred_ = false;
+    // Negotiated in the hello, see control_codec.h
+    bool binary_control_ = false;
+    // Heartbeats, negotiated in the hello (see CONFIG_PROTOCOL_HEARTBEAT_INTERVAL_MS)
+    bool heartbeat_ = false;
     std::string session_id_;
-    std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    std::atomic<int64_t> last_incoming_time_ = 0;
 
     virtual bool SendText(const std::string& text) = 0;
+    virtual bool SendBinaryControl(const std::string& data);
+    // Largest control message the transport can frame, larger ones go out as JSON
+    virtual size_t MaxBinaryControlSize() const;
+    void SendGoodbye();
+    void AddHelloFeatures(cJSON* features, bool binary_control_supported);
+    void ParseHelloFeatures(const cJSON* root);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+
+    void MarkIncoming();
+    // Watch the audio channel while it is open, from a timer instead of waiting for someone to ask
+    void StartLivenessCheck();
+    void StopLivenessCheck();
+    // Called by the transport right before the heartbeat goes out, so the rtt has no queueing in it
+    void MarkHeartbeatSent(uint32_t id);
+    void OnHeartbeatReply(uint32_t id);
+    void AddLivenessStats(cJSON* root);
+    // Runs on the timer task, must not block
+    virtual void SendHeartbeat(uint32_t id);
+    // The channel stopped answering, runs on the timer task
+    virtual void OnChannelDead();
+
+private:
+    enum ChannelJob {
+        kChannelJobNone,
+        kChannelJobPreconnect,
+        kChannelJobOpen,
+    };
+
+    // Hands jobs to the worker task, which exits once there are none left
+    std::mutex channel_job_mutex_;
+    ChannelJob pending_channel_job_ = kChannelJobNone;
+    std::atomic<bool> channel_busy_ = false;
+    // State of the asynchronous open, main loop only
+    bool open_in_flight_ = false;
+    bool open_cancelled_ = false;
+    std::vector<OpenCallback> open_callbacks_;
+    int64_t open_start_time_ = 0;
+    uint32_t channel_opens_ = 0;
+    uint32_t channel_open_failures_ = 0;
+    uint32_t channel_opens_cancelled_ = 0;
+    int last_open_ms_ = 0;
+    int max_open_ms_ = 0;
+
+    esp_timer_handle_t liveness_timer_ = nullptr;
+    std::mutex liveness_mutex_;
+    uint32_t heartbeat_id_ = 0;
+    uint32_t pending_heartbeat_ = 0;
+    int64_t heartbeat_sent_time_ = 0;
+    int missed_heartbeats_ = 0;
+    uint32_t heartbeats_sent_ = 0;
+    uint32_t heartbeats_lost_ = 0;
+    std::atomic<int> srtt_ms_ = 0;
+    std::atomic<int> rttvar_ms_ = 0;
+    int last_rtt_ms_ = 0;
+
+    void CheckLiveness();
+    void PostChannelJob(ChannelJob job);
+    void RunChannelJobs();
+    void FinishOpen(bool opened);
 };
 
 #endif // PROTOCOL_H
@@ -0,0 +1,130 @@
+#include "udp_recovery.h"
+
+void UdpRecoveryBuffer::Reset(int budget_ms, bool nack) {
+    budget_us_ = budget_ms * 1000LL;
+    nack_ = nack;
+    started_ = false;
+    next_sequence_ = 0;
+    highest_sequence_ = 0;
+    released_mask_ = 0;
+    pending_.clear();
+    gaps_.clear();
+    new_missing_.clear();
+    stats_ = UdpChannelStats();
+}
+
+void UdpRecoveryBuffer::Push(uint32_t sequence, std::unique_ptr<AudioStreamPacket> packet, int64_t now_us, bool from_redundancy) {
+    if (!from_redundancy) {
+        stats_.received++;
+    }
+    if (!started_) {
+        started_ = true;
+        next_sequence_ = sequence;
+        highest_sequence_ = sequence - 1;
+    }
+
+    if ((int32_t)(sequence - next_sequence_) < 0) {
+        // Its slot has already been played or skipped
+        if (!from_redundancy) {
+            uint32_t age = next_sequence_ - 1 - sequence;
+            if (age < 64 && ((released_mask_ >> age) & 1)) {
+                stats_.duplicates++;
+            } else {
+                stats_.late++;
+            }
+        }
+        return;
+    }
+    if (pending_.find(sequence) != pending_.end()) {
+        if (!from_redundancy) {
+            stats_.duplicates++;
+        }
+        return;
+    }
+
+    int32_t ahead = sequence - highest_sequence_;
+    if (ahead > 1) {
+        uint32_t gap = ahead - 1;
+        if (gap <= UDP_RECOVERY_MAX_NACK_GAP) {
+            for (uint32_t missing = highest_sequence_ + 1; missing != sequence; missing++) {
+                gaps_[missing] = Gap{ now_us, false };
+                if (nack_) {
+                    new_missing_.push_back(missing);
+                }
+            }
+        }
+        // Larger gaps get no entry and are skipped without waiting
+    } else if (ahead <= 0) {
+        auto gap = gaps_.find(sequence);
+        if (from_redundancy) {
+            stats_.recovered_fec++;
+        } else if (gap != gaps_.end() && gap->second.nacked) {
+            stats_.recovered_nack++;
+        } else {
+            stats_.reordered++;
+        }
+    }
+    if (ahead > 0) {
+        highest_sequence_ = sequence;
+    }
+    gaps_.erase(sequence);
+    pending_[sequence] = std::move(packet);
+}
+
+std::unique_ptr<AudioStreamPacket> UdpRecoveryBuffer::Pop(int64_t now_us) {
+    if (pending_.empty()) {
+        return nullptr;
+    }
+    auto it = pending_.find(next_sequence_);
+    if (it == pending_.end()) {
+        auto gap = gaps_.find(next_sequence_);
+        if (gap != gaps_.end() && now_us - gap->second.since < budget_us_) {
+            return nullptr;
+        }
+        // Out of budget, play on from the first packet we have
+        uint32_t first = pending_.begin()->first;
+        uint32_t skipped = first - next_sequence_;
+        stats_.lost += skipped;
+        gaps_.erase(gaps_.begin(), gaps_.lower_bound(first));
+        released_mask_ = skipped >= 64 ? 0 : released_mask_ << skipped;
+        next_sequence_ = first;
+        it = pending_.begin();
+    }
+
+    auto packet = std::move(it->second);
+    pending_.erase(it);
+    released_mask_ = (released_mask_ << 1) | 1;
+    next_sequence_++;
+    stats_.delivered++;
+    return packet;
+}
+
+std::vector<uint32_t> UdpRecoveryBuffer::TakeMissing() {
+    std::vector<uint32_t> missing;
+    for (auto sequence : new_missing_) {
+        auto gap = gaps_.find(sequence);
+        if (gap != gaps_.end() && !gap->second.nacked) {
+            gap->second.nacked = true;
+            missing.push_back(sequence);
+        }
+    }
+    new_missing_.clear();
+    stats_.nacks_sent += missing.size();
+    return missing;
+}
+
+int64_t UdpRecoveryBuffer::NextDeadline() const {
+    if (pending_.empty() || pending_.find(next_sequence_) != pending_.end()) {
+        return 0;
+    }
+    auto gap = gaps_.find(next_sequence_);
+    if (gap == gaps_.end()) {
+        return 1;
+    }
+    return gap->second.since + budget_us_;
+}
+
+bool UdpRecoveryBuffer::IsMissing(uint32_t sequence) const {
+    return started_ && (int32_t)(sequence - next_sequence_) >= 0 && pending_.find(sequence) == pending_.end() &&
+        (int32_t)(sequence - highest_sequence_) < 0;
+}
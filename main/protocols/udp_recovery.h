@@ -0,0 +1,74 @@
+#ifndef _UDP_RECOVERY_H_
+#define _UDP_RECOVERY_H_
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "protocol.h"
+
+// Gaps larger than this are a restart of the stream, not loss worth asking for
+#define UDP_RECOVERY_MAX_NACK_GAP 16
+
+struct UdpChannelStats {
+    uint32_t received = 0;          // Packets that passed decryption, duplicates included
+    uint32_t delivered = 0;         // Packets handed to the decoder, recovered ones included
+    uint32_t lost = 0;              // Sequences skipped at playout
+    uint32_t reordered = 0;         // Arrived behind a later packet, still in time
+    uint32_t duplicates = 0;
+    uint32_t late = 0;              // Arrived after their slot was skipped
+    uint32_t recovered_fec = 0;     // Rebuilt from the redundant copy in the next packet
+    uint32_t recovered_nack = 0;    // Retransmitted after a NACK, in time
+    uint32_t nacks_sent = 0;        // Sequences asked for
+    uint32_t retransmitted = 0;     // Uplink packets sent again on a server NACK
+};
+
+/*
+ * Puts the downlink audio packets of the UDP channel back in sequence order.
+ *
+ * With a latency budget of 0 packets are released as they come and a gap is skipped at once,
+ * which is how the channel always behaved. With a budget, packets behind a gap are held until
+ * the gap is filled by a retransmission, a redundant copy or a reordered packet, or until the
+ * budget runs out and the gap is counted as lost.
+ *
+ * Not thread safe, the owner serializes Push / Pop.
+ */
+class UdpRecoveryBuffer {
+public:
+    // nack: remember new gaps for TakeMissing()
+    void Reset(int budget_ms, bool nack);
+
+    // from_redundancy: the payload is the previous frame carried inside packet sequence + 1
+    void Push(uint32_t sequence, std::unique_ptr<AudioStreamPacket> packet, int64_t now_us, bool from_redundancy = false);
+    // Next packet in order, or nullptr when the next one is still missing and within the budget
+    std::unique_ptr<AudioStreamPacket> Pop(int64_t now_us);
+    // Sequences that went missing since the last call, to be NACKed. Each one is returned once
+    std::vector<uint32_t> TakeMissing();
+    // esp_timer time when the gap at the head runs out of budget, 0 if nothing is waiting
+    int64_t NextDeadline() const;
+    bool IsMissing(uint32_t sequence) const;
+
+    const UdpChannelStats& stats() const { return stats_; }
+    UdpChannelStats& stats() { return stats_; }
+
+private:
+    struct Gap {
+        int64_t since;
+        bool nacked;
+    };
+
+    int64_t budget_us_ = 0;
+    bool nack_ = false;
+    bool started_ = false;
+    uint32_t next_sequence_ = 0;        // Next sequence to release
+    uint32_t highest_sequence_ = 0;
+    uint64_t released_mask_ = 0;        // Bit n: next_sequence_ - 1 - n was delivered, not skipped
+    std::map<uint32_t, std::unique_ptr<AudioStreamPacket>> pending_;
+    std::map<uint32_t, Gap> gaps_;
+    std::vector<uint32_t> new_missing_;
+    UdpChannelStats stats_;
+};
+
+#endif // _UDP_RECOVERY_H_
@@ -3,8 +3,11 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "connection_timing.h"
+#include "control_codec.h"
 
 #include <cstring>
+#include <cstdlib>
 #include <cJSON.h>
 #include <esp_log.h>
 #include <arpa/inet.h>
@@ -12,11 +15,36 @@
 
 #define TAG "WS"
 
-WebsocketProtocol::WebsocketProtocol() {
+#ifndef CONFIG_WEBSOCKET_KEEP_WARM_SECONDS
+#define CONFIG_WEBSOCKET_KEEP_WARM_SECONDS 0
+#endif
+
+WebsocketProtocol::WebsocketProtocol() : endpoints_("websocket", 443) {
     event_group_handle_ = xEventGroupCreate();
+
+    esp_timer_create_args_t keep_warm_timer_args = {
+        .callback = [](void* arg) {
+            auto protocol = (WebsocketProtocol*)arg;
+            // Close the idle connection from the main loop, which owns websocket_
+            Application::GetInstance().Schedule([protocol]() {
+                if (!protocol->IsChannelBusy() && !protocol->channel_opened_ && protocol->websocket_ != nullptr) {
+                    ESP_LOGI(TAG, "Closing idle websocket connection");
+                    protocol->websocket_.reset();
+                }
+            }, kTaskLaneUi, "ws_keep_warm");
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_keep_warm",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&keep_warm_timer_args, &keep_warm_timer_);
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    StopLivenessCheck();
+    esp_timer_stop(keep_warm_timer_);
+    esp_timer_delete(keep_warm_timer_);
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -71,17 +99,241 @@ bool WebsocketProtocol::SendText(const std::string& text) {
     return true;
 }
 
+bool WebsocketProtocol::SendBinaryControl(const std::string& data) {
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+
+    std::string serialized;
+    if (version_ == 2) {
+        serialized.resize(sizeof(BinaryProtocol2) + data.size());
+        auto bp2 = (BinaryProtocol2*)serialized.data();
+        bp2->version = htons(version_);
+        bp2->type = htons(BINARY_PROTOCOL_TYPE_CONTROL);
+        bp2->reserved = 0;
+        bp2->timestamp = 0;
+        bp2->payload_size = htonl(data.size());
+        memcpy(bp2->payload, data.data(), data.size());
+    } else if (version_ == 3) {
+        if (data.size() > MaxBinaryControlSize()) {
+            ESP_LOGE(TAG, "Control message of %u bytes does not fit a version 3 frame", data.size());
+            return false;
+        }
+        serialized.resize(sizeof(BinaryProtocol3) + data.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = BINARY_PROTOCOL_TYPE_CONTROL;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(data.size());
+        memcpy(bp3->payload, data.data(), data.size());
+    } else {
+        ESP_LOGE(TAG, "Binary control messages need protocol version 2 or 3");
+        return false;
+    }
+
+    if (!websocket_->Send(serialized.data(), serialized.size(), true)) {
+        ESP_LOGE(TAG, "Failed to send control message");
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    return true;
+}
+
+size_t WebsocketProtocol::MaxBinaryControlSize() const {
+    // Version 3 frames carry a 16-bit payload size
+    return version_ == 3 ? UINT16_MAX : SIZE_MAX;
+}
+
+bool WebsocketProtocol::IsBinaryControl(const char* data, size_t len) const {
+    if (version_ == 2) {
+        auto bp2 = (const BinaryProtocol2*)data;
+        return len >= sizeof(BinaryProtocol2) && ntohs(bp2->type) == BINARY_PROTOCOL_TYPE_CONTROL;
+    } else if (version_ == 3) {
+        auto bp3 = (const BinaryProtocol3*)data;
+        return len >= sizeof(BinaryProtocol3) && bp3->type == BINARY_PROTOCOL_TYPE_CONTROL;
+    }
+    return false;
+}
+
+void WebsocketProtocol::OnBinaryControl(const char* data, size_t len) {
+    const uint8_t* payload;
+    size_t payload_size;
+    if (version_ == 2) {
+        auto bp2 = (const BinaryProtocol2*)data;
+        payload = bp2->payload;
+        payload_size = ntohl(bp2->payload_size);
+        len -= sizeof(BinaryProtocol2);
+    } else {
+        auto bp3 = (const BinaryProtocol3*)data;
+        payload = bp3->payload;
+        payload_size = ntohs(bp3->payload_size);
+        len -= sizeof(BinaryProtocol3);
+    }
+    if (payload_size > len) {
+        ESP_LOGE(TAG, "Invalid control frame, payload size %u > %u", (unsigned)payload_size, (unsigned)len);
+        return;
+    }
+
+    IncomingMessage message;
+    if (!IncomingMessage::FromControl(payload, payload_size, message)) {
+        ESP_LOGE(TAG, "Failed to decode control message");
+        return;
+    }
+    if (on_incoming_message_ != nullptr) {
+        on_incoming_message_(message);
+    }
+}
+
+// {"type":"pong","id":N}, the id is not one of the routing fields
+static uint32_t ReadHeartbeatId(const char* data, size_t len) {
+    JsonReader reader(data, len);
+    std::string_view key;
+    JsonValue value;
+    while (reader.Next(key, value)) {
+        if (key == "id" && value.type == kJsonValueNumber) {
+            return strtoul(std::string(value.raw).c_str(), nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+void WebsocketProtocol::SendHeartbeat(uint32_t id) {
+    // Sent from the main loop like every other text frame, the clock starts when it leaves
+    Application::GetInstance().Schedule([this, id]() {
+        if (channel_opened_) {
+            MarkHeartbeatSent(id);
+            SendText("{\"session_id\":\"" + session_id_ + "\",\"type\":\"ping\",\"id\":" + std::to_string(id) + "}");
+        }
+    });
+}
+
+void WebsocketProtocol::OnChannelDead() {
+    ESP_LOGW(TAG, "Websocket %s stopped answering", current_url_.c_str());
+    SetError(Lang::Strings::SERVER_TIMEOUT);
+    Application::GetInstance().Schedule([this]() {
+        // An open or preconnect on the audio_channel task still uses websocket_, it reports its own failure
+        if (IsChannelBusy()) {
+            return;
+        }
+        // The socket may still look connected, do not reuse it for the next conversation
+        bool was_opened = channel_opened_.exchange(false);
+        websocket_.reset();
+        if (was_opened && on_audio_channel_closed_ != nullptr) {
+            on_audio_channel_closed_();
+        }
+        PreconnectAsync();
+    });
+}
+
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    return channel_opened_ && websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
-    websocket_.reset();
+    StopLivenessCheck();
+    if (!keep_warm_ || error_occurred_ || websocket_ == nullptr || !websocket_->IsConnected()) {
+        websocket_.reset();
+        channel_opened_ = false;
+        return;
+    }
+
+    // End the session but keep the connection for the next conversation
+    SendGoodbye();
+    channel_opened_ = false;
+    esp_timer_stop(keep_warm_timer_);
+    esp_timer_start_once(keep_warm_timer_, CONFIG_WEBSOCKET_KEEP_WARM_SECONDS * 1000000LL);
+    if (on_audio_channel_closed_ != nullptr) {
+        on_audio_channel_closed_();
+    }
+}
+
+void WebsocketProtocol::Preconnect() {
+    // Servers that did not accept keep-warm expect one session per connection, opened when needed
+    if (!keep_warm_ || (websocket_ != nullptr && websocket_->IsConnected())) {
+        return;
+    }
+    int64_t start_time = esp_timer_get_time();
+    if (Connect()) {
+        ESP_LOGI(TAG, "Preconnected in %lld ms", (esp_timer_get_time() - start_time) / 1000);
+        esp_timer_stop(keep_warm_timer_);
+        esp_timer_start_once(keep_warm_timer_, CONFIG_WEBSOCKET_KEEP_WARM_SECONDS * 1000000LL);
+    } else {
+        websocket_.reset();
+    }
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    int64_t start_time = esp_timer_get_time();
+    error_occurred_ = false;
+    esp_timer_stop(keep_warm_timer_);
+
+    bool reused = websocket_ != nullptr && websocket_->IsConnected();
+    if (!reused && !Connect()) {
+        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        return false;
+    }
+    int64_t connected_time = esp_timer_get_time();
+
+    bool hello_received = ExchangeHello();
+    if (!hello_received && !error_occurred_ && endpoints_.size() > 1) {
+        // The server took the connection but never answered, the others may still be fine
+        ESP_LOGW(TAG, "No server hello from %s, failing over", current_url_.c_str());
+        endpoints_.MarkFailed(current_url_);
+        websocket_.reset();
+        reused = false;
+        if (Connect()) {
+            connected_time = esp_timer_get_time();
+            hello_received = ExchangeHello();
+        }
+    }
+    if (!hello_received) {
+        if (!error_occurred_) {
+            SetError(Lang::Strings::SERVER_TIMEOUT);
+        }
+        return false;
+    }
+
+    int64_t hello_time = esp_timer_get_time();
+    ESP_LOGI(TAG, "Audio channel opened in %lld ms (%s connect: %lld ms, hello: %lld ms)",
+        (hello_time - start_time) / 1000, reused ? "warm" : "cold",
+        (connected_time - start_time) / 1000, (hello_time - connected_time) / 1000);
+
+    StartLivenessCheck();
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+
+    return true;
+}
+
+bool WebsocketProtocol::ExchangeHello() {
+    // Incoming messages are only delivered while the channel is open
+    channel_opened_ = true;
+    MarkIncoming();
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+
+    // Send hello message to describe the client
+    auto message = GetHelloMessage();
+    if (!SendText(message)) {
+        channel_opened_ = false;
+        return false;
+    }
+
+    // Wait for server hello
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
+        ESP_LOGE(TAG, "Failed to receive server hello");
+        channel_opened_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool WebsocketProtocol::Connect() {
     Settings settings("websocket", false);
-    std::string url = settings.GetString("url");
+    auto urls = EndpointSelector::Split(settings.GetString("urls"));
+    if (urls.empty()) {
+        urls.push_back(settings.GetString("url"));
+    }
     std::string token = settings.GetString("token");
     int version = settings.GetInt("version");
     if (version != 0) {
@@ -90,6 +342,21 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     error_occurred_ = false;
 
+    endpoints_.SetEndpoints(urls);
+    for (auto& url : endpoints_.GetOrder()) {
+        if (ConnectTo(url, token)) {
+            current_url_ = url;
+            endpoints_.MarkSucceeded(url);
+            return true;
+        }
+        // Try the next one right away, the user is waiting
+        endpoints_.MarkFailed(url);
+        websocket_.reset();
+    }
+    return false;
+}
+
+bool WebsocketProtocol::ConnectTo(const std::string& url, const std::string& token) {
     auto network = Board::GetInstance().GetNetwork();
     websocket_ = network->CreateWebSocket(1);
     if (websocket_ == nullptr) {
@@ -100,17 +367,23 @@ bool WebsocketProtocol::OpenAudioChannel() {
     if (!token.empty()) {
         // If token not has a space, add "Bearer " prefix
         if (token.find(" ") == std::string::npos) {
-            token = "Bearer " + token;
+            websocket_->SetHeader("Authorization", ("Bearer " + token).c_str());
+        } else {
+            websocket_->SetHeader("Authorization", token.c_str());
         }
-        websocket_->SetHeader("Authorization", token.c_str());
     }
     websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
     websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
     websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
+        if (binary && !channel_opened_) {
+            return;
+        }
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
+            if (IsBinaryControl(data, len)) {
+                OnBinaryControl(data, len);
+            } else if (on_incoming_audio_ != nullptr) {
                 if (version_ == 2) {
                     BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
                     bp2->version = ntohs(bp2->version);
@@ -145,57 +418,48 @@ bool WebsocketProtocol::OpenAudioChannel() {
                 }
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
-                    ParseServerHello(root);
-                } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
+            // Only the routing fields are read, the hello is the one message that needs a full parse
+            IncomingMessage message;
+            if (!IncomingMessage::FromJson(data, len, message) || !message.type.is_string()) {
+                ESP_LOGE(TAG, "Missing message type, data: %.*s", (int)len, data);
+            } else if (message.type.Equals("hello")) {
+                auto root = cJSON_ParseWithLength(data, len);
+                ParseServerHello(root);
+                cJSON_Delete(root);
+            } else if (message.type.Equals("pong")) {
+                OnHeartbeatReply(ReadHeartbeatId(data, len));
+            } else if (channel_opened_) {
+                if (on_incoming_message_ != nullptr) {
+                    on_incoming_message_(message);
                 }
-            } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
             }
-            cJSON_Delete(root);
         }
-        last_incoming_time_ = std::chrono::steady_clock::now();
+        MarkIncoming();
     });
 
     websocket_->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
+        if (!channel_opened_) {
+            // A warm connection went away, the next OpenAudioChannel reconnects
+            return;
+        }
+        StopLivenessCheck();
+        channel_opened_ = false;
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
 
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
+    ConnectionTiming timing("websocket", url);
+    timing.ResolveHost();
     if (!websocket_->Connect(url.c_str())) {
-        ESP_LOGE(TAG, "Failed to connect to websocket server");
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        ESP_LOGE(TAG, "Failed to connect to websocket server %s", url.c_str());
         return false;
     }
-
-    // Send hello message to describe the client
-    auto message = GetHelloMessage();
-    if (!SendText(message)) {
-        return false;
-    }
-
-    // Wait for server hello
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
-    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
-        ESP_LOGE(TAG, "Failed to receive server hello");
-        SetError(Lang::Strings::SERVER_TIMEOUT);
-        return false;
-    }
-
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
-    }
-
+    // Connect() returns after the upgrade response, so connect time covers TCP, TLS and the HTTP upgrade
+    timing.MarkConnected();
+    timing.Finish(true);
     return true;
 }
 
@@ -205,12 +469,18 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(root, "type", "hello");
     cJSON_AddNumberToObject(root, "version", version_);
     cJSON* features = cJSON_CreateObject();
-#if CONFIG_USE_SERVER_AEC
-    cJSON_AddBoolToObject(features, "aec", true);
+    // Binary control frames need the type field of protocol version 2 and 3
+    AddHelloFeatures(features, version_ == 2 || version_ == 3);
+#if CONFIG_WEBSOCKET_KEEP_WARM_SECONDS > 0
+    // Several sessions per connection, goodbye and resume_session_id, only used once the server agrees
+    cJSON_AddBoolToObject(features, "keep_warm", true);
 #endif
-    cJSON_AddBoolToObject(features, "mcp", true);
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
+    if (keep_warm_ && !session_id_.empty()) {
+        // Lets the server pick up the previous session's context if it still has it
+        cJSON_AddStringToObject(root, "resume_session_id", session_id_.c_str());
+    }
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
@@ -248,6 +518,11 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
             server_frame_duration_ = frame_duration->valueint;
         }
     }
+    ParseHelloFeatures(root);
+#if CONFIG_WEBSOCKET_KEEP_WARM_SECONDS > 0
+    keep_warm_ = cJSON_IsTrue(cJSON_GetObjectItem(cJSON_GetObjectItem(root, "features"), "keep_warm"));
+    ESP_LOGI(TAG, "Keep warm: %s", keep_warm_ ? "on" : "off");
+#endif
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
@@ -3,10 +3,12 @@
 
 
 #include "protocol.h"
+#include "endpoint_selector.h"
 
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
@@ -18,6 +20,7 @@ public:
     bool Start() override;
     bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
     bool OpenAudioChannel() override;
+    void Preconnect() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
 
@@ -25,10 +28,28 @@ private:
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
-
+    // Written by the channel task, the websocket task and the main loop
+    std::atomic<bool> channel_opened_ = false;
+    // The WebSocket may stay connected after the audio channel is closed once the server accepted it in
+    // the hello, see CONFIG_WEBSOCKET_KEEP_WARM_SECONDS
+    std::atomic<bool> keep_warm_ = false;
+    esp_timer_handle_t keep_warm_timer_ = nullptr;
+    // Filled from the "urls" list of the OTA response, or the single "url"
+    EndpointSelector endpoints_;
+    std::string current_url_;
+
+    bool Connect();
+    bool ConnectTo(const std::string& url, const std::string& token);
+    bool ExchangeHello();
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
+    bool SendBinaryControl(const std::string& data) override;
+    size_t MaxBinaryControlSize() const override;
+    bool IsBinaryControl(const char* data, size_t len) const;
+    void OnBinaryControl(const char* data, size_t len);
     std::string GetHelloMessage();
+    void SendHeartbeat(uint32_t id) override;
+    void OnChannelDead() override;
 };
 
 #endif
@@ -0,0 +1,164 @@
+#include "ws_frame_parser.h"
+
+#include <cstring>
+
+WsFrameParser::WsFrameParser(size_t max_frame_size) : max_frame_size_(max_frame_size) {
+}
+
+char* WsFrameParser::PrepareWrite(size_t& available) {
+    if (begin_ == end_) {
+        begin_ = end_ = 0;
+        // One large batch should not pin a big arena for the rest of the connection
+        if (buffer_.size() > WS_ARENA_KEEP_SIZE) {
+            std::vector<char>(WS_ARENA_KEEP_SIZE).swap(buffer_);
+        }
+    } else if (begin_ > 0) {
+        // Only the tail of a partial frame is left, move it to the front
+        memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    size_t wanted = end_ + WS_RECEIVE_CHUNK_SIZE;
+    if (needed_ > wanted) {
+        wanted = needed_;
+    }
+    if (buffer_.size() < wanted) {
+        buffer_.resize(wanted);
+    }
+    available = buffer_.size() - end_;
+    return buffer_.data() + end_;
+}
+
+void WsFrameParser::Commit(size_t length) {
+    end_ += length;
+}
+
+void WsFrameParser::Feed(const char* data, size_t length) {
+    while (length > 0) {
+        size_t available;
+        char* dest = PrepareWrite(available);
+        size_t n = length < available ? length : available;
+        memcpy(dest, data, n);
+        Commit(n);
+        data += n;
+        length -= n;
+    }
+}
+
+void WsFrameParser::Unmask(char* data, size_t length, const uint8_t mask[4]) {
+    size_t i = 0;
+    // Byte by byte up to a word boundary, Xtensa does not do unaligned loads
+    for (; i < length && ((uintptr_t)(data + i) & 3) != 0; i++) {
+        data[i] ^= mask[i & 3];
+    }
+    if (i + 4 <= length) {
+        // The mask as it lines up with the aligned words, in memory byte order
+        uint8_t rotated[4] = { mask[i & 3], mask[(i + 1) & 3], mask[(i + 2) & 3], mask[(i + 3) & 3] };
+        uint32_t word_mask;
+        memcpy(&word_mask, rotated, 4);
+        for (; i + 4 <= length; i += 4) {
+            // memcpy keeps it free of aliasing, the alignment hint still gets single word loads and stores
+            auto word_ptr = (char*)__builtin_assume_aligned(data + i, 4);
+            uint32_t word;
+            memcpy(&word, word_ptr, 4);
+            word ^= word_mask;
+            memcpy(word_ptr, &word, 4);
+        }
+    }
+    for (; i < length; i++) {
+        data[i] ^= mask[i & 3];
+    }
+}
+
+bool WsFrameParser::Next(WsFrame& frame) {
+    if (error_ != nullptr) {
+        return false;
+    }
+
+    auto data = (uint8_t*)buffer_.data() + begin_;
+    size_t available = end_ - begin_;
+    if (available < 2) {
+        return false;
+    }
+
+    bool fin = data[0] & 0x80;
+    uint8_t opcode = data[0] & 0x0f;
+    bool masked = data[1] & 0x80;
+    uint64_t payload_length = data[1] & 0x7f;
+    size_t header_length = 2;
+    if (payload_length == 126) {
+        header_length += 2;
+    } else if (payload_length == 127) {
+        header_length += 8;
+    }
+    if (masked) {
+        header_length += 4;
+    }
+    if (available < header_length) {
+        return false;
+    }
+
+    if (!masked) {
+        error_ = "client frame is not masked";
+        return false;
+    }
+    if (data[0] & 0x70) {
+        error_ = "reserved bits set";
+        return false;
+    }
+    if (payload_length == 126) {
+        payload_length = (data[2] << 8) | data[3];
+    } else if (payload_length == 127) {
+        // The most significant bit must be 0, anything near 2^63 is refused below anyway
+        payload_length = 0;
+        for (int i = 0; i < 8; i++) {
+            payload_length = (payload_length << 8) | data[2 + i];
+        }
+    }
+    if (opcode & 0x08) {
+        if (!fin || payload_length > WS_MAX_CONTROL_FRAME_SIZE) {
+            error_ = "invalid control frame";
+            return false;
+        }
+    }
+    if (payload_length > max_frame_size_) {
+        error_ = "frame too large";
+        return false;
+    }
+    if (available < header_length + payload_length) {
+        needed_ = header_length + payload_length;
+        return false;
+    }
+
+    char* payload = (char*)data + header_length;
+    Unmask(payload, payload_length, data + header_length - 4);
+    frame.fin = fin;
+    frame.opcode = opcode;
+    frame.payload = payload;
+    frame.length = payload_length;
+
+    begin_ += header_length + payload_length;
+    needed_ = 0;
+    return true;
+}
+
+std::string WsFrameParser::Encode(uint8_t opcode, const char* data, size_t length) {
+    std::string frame;
+    frame.reserve(length + 10);
+    frame.push_back((char)(0x80 | opcode));
+    if (length < 126) {
+        frame.push_back((char)length);
+    } else if (length <= 0xffff) {
+        frame.push_back((char)126);
+        frame.push_back((char)(length >> 8));
+        frame.push_back((char)length);
+    } else {
+        frame.push_back((char)127);
+        for (int i = 7; i >= 0; i--) {
+            frame.push_back((char)((uint64_t)length >> (i * 8)));
+        }
+    }
+    frame.append(data, length);
+    return frame;
+}
@@ -0,0 +1,73 @@
+#ifndef _WS_FRAME_PARSER_H_
+#define _WS_FRAME_PARSER_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Frames and reassembled messages above this are refused before their payload is buffered
+#define WS_MAX_FRAME_SIZE 65536
+// RFC 6455 5.5: control frames carry at most 125 bytes and are never fragmented
+#define WS_MAX_CONTROL_FRAME_SIZE 125
+// Bytes asked from recv() at a time, and the arena size kept while the connection is quiet
+#define WS_RECEIVE_CHUNK_SIZE 1024
+#define WS_ARENA_KEEP_SIZE 4096
+
+enum WsOpcode {
+    kWsOpcodeContinuation = 0x0,
+    kWsOpcodeText = 0x1,
+    kWsOpcodeBinary = 0x2,
+    kWsOpcodeClose = 0x8,
+    kWsOpcodePing = 0x9,
+    kWsOpcodePong = 0xA,
+};
+
+// Points into the parser's arena, valid until the next PrepareWrite() or Feed()
+struct WsFrame {
+    uint8_t opcode = 0;
+    bool fin = false;
+    const char* payload = nullptr;  // Unmasked
+    size_t length = 0;
+};
+
+/*
+ * Incremental parser for client-to-server WebSocket frames (RFC 6455).
+ *
+ * The parser owns the receive buffer: the socket reads straight into PrepareWrite() and frames are
+ * unmasked in place, so a frame costs no allocation or copy. Bytes may be split anywhere. The arena
+ * grows to the largest frame seen and goes back to WS_ARENA_KEEP_SIZE once it is drained.
+ * Plain C++ without ESP-IDF dependencies, so it also builds on the host.
+ */
+class WsFrameParser {
+public:
+    explicit WsFrameParser(size_t max_frame_size = WS_MAX_FRAME_SIZE);
+
+    // Room for at least WS_RECEIVE_CHUNK_SIZE bytes, or the rest of a large frame being received
+    char* PrepareWrite(size_t& available);
+    void Commit(size_t length);
+    // Copies into the arena, for bytes that did not come from the socket
+    void Feed(const char* data, size_t length);
+    // Returns false when no complete frame is buffered, check error() to tell malformed input apart
+    bool Next(WsFrame& frame);
+
+    bool error() const { return error_ != nullptr; }
+    const char* error_message() const { return error_; }
+    size_t buffered() const { return end_ - begin_; }
+
+    // XORs with the 4-byte mask, a word at a time once the pointer is aligned
+    static void Unmask(char* data, size_t length, const uint8_t mask[4]);
+    // Server-to-client frame, not masked
+    static std::string Encode(uint8_t opcode, const char* data, size_t length);
+
+private:
+    std::vector<char> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    // Size of the frame at begin_ once its header is known, so PrepareWrite() can make room at once
+    size_t needed_ = 0;
+    size_t max_frame_size_;
+    const char* error_ = nullptr;
+};
+
+#endif // _WS_FRAME_PARSER_H_
@@ -0,0 +1,436 @@
+#include "ws_ingest_server.h"
+
+#include <esp_log.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <strings.h>
+#include <cstring>
+#include <mbedtls/sha1.h>
+#include <mbedtls/base64.h>
+
+#define TAG "WsIngest"
+
+// Reads per connection and select() round, so one busy client cannot starve the others
+#define WS_INGEST_MAX_READS_PER_ROUND 4
+
+WsIngestServer::WsIngestServer(int port, int max_clients) : port_(port), max_clients_(max_clients) {
+}
+
+WsIngestServer::~WsIngestServer() {
+    for (auto& connection : connections_) {
+        close(connection.fd);
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+    }
+}
+
+void WsIngestServer::OnTextMessage(std::function<void(const char* data, size_t length)> callback) {
+    on_text_message_ = callback;
+}
+
+static bool SetNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool WsIngestServer::Start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_fd_ < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: %d", errno);
+        return false;
+    }
+
+    int opt = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port_);
+    if (bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, max_clients_) < 0
+        || !SetNonBlocking(listen_fd_)) {
+        ESP_LOGE(TAG, "Failed to listen on port %d: %d", port_, errno);
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(listen_fd_, (struct sockaddr*)&addr, &addr_len) == 0) {
+        port_ = ntohs(addr.sin_port);
+    }
+    running_ = true;
+    ESP_LOGI(TAG, "WebSocket ingest server listening on port %d, up to %d clients", port_, max_clients_);
+    return true;
+}
+
+void WsIngestServer::Stop() {
+    running_ = false;
+}
+
+void WsIngestServer::Run() {
+    while (running_) {
+        fd_set read_fds;
+        fd_set write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(listen_fd_, &read_fds);
+        int max_fd = listen_fd_;
+        for (auto& connection : connections_) {
+            FD_SET(connection.fd, &read_fds);
+            if (!connection.output.empty()) {
+                FD_SET(connection.fd, &write_fds);
+            }
+            if (connection.fd > max_fd) {
+                max_fd = connection.fd;
+            }
+        }
+
+        struct timeval timeout = {
+            .tv_sec = WS_INGEST_POLL_INTERVAL_MS / 1000,
+            .tv_usec = (WS_INGEST_POLL_INTERVAL_MS % 1000) * 1000,
+        };
+        int ready = select(max_fd + 1, &read_fds, &write_fds, nullptr, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "select failed: %d", errno);
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            auto& connection = *it;
+            bool keep = true;
+            if (FD_ISSET(connection.fd, &read_fds)) {
+                keep = Receive(connection);
+            }
+            if (keep && connection.output_overflow) {
+                ESP_LOGW(TAG, "Client %d does not read its replies, closing", connection.fd);
+                keep = false;
+            }
+            if (keep && !connection.output.empty()) {
+                keep = Flush(connection);
+            }
+            if (keep && connection.closing && connection.output.empty()) {
+                keep = false;
+            }
+            if (keep && !connection.upgraded && now - connection.accepted_time >
+                std::chrono::milliseconds(WS_INGEST_HANDSHAKE_TIMEOUT_MS)) {
+                ESP_LOGW(TAG, "Client %d did not finish the handshake in time", connection.fd);
+                keep = false;
+            }
+            if (keep && connection.upgraded && !connection.closing) {
+                keep = CheckIdle(connection, now);
+            }
+            if (keep) {
+                ++it;
+            } else {
+                close(connection.fd);
+                it = connections_.erase(it);
+            }
+        }
+
+        // After the loop above, new sockets are not in this round's fd sets
+        if (FD_ISSET(listen_fd_, &read_fds)) {
+            Accept();
+        }
+    }
+
+    for (auto& connection : connections_) {
+        close(connection.fd);
+    }
+    connections_.clear();
+    close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+// A quiet client gets a ping, one that does not answer it is gone (e.g. the phone lost Wi-Fi)
+bool WsIngestServer::CheckIdle(Connection& connection, std::chrono::steady_clock::time_point now) {
+    auto idle = now - connection.last_receive_time;
+    if (idle > std::chrono::milliseconds(WS_INGEST_IDLE_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "Client %d did not answer the ping, closing", connection.fd);
+        return false;
+    }
+    if (!connection.ping_sent && idle > std::chrono::milliseconds(WS_INGEST_IDLE_PING_MS)) {
+        Send(connection, WsFrameParser::Encode(kWsOpcodePing, nullptr, 0));
+        connection.ping_sent = true;
+    }
+    return true;
+}
+
+void WsIngestServer::Accept() {
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int fd = accept(listen_fd_, (struct sockaddr*)&client_addr, &client_len);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGW(TAG, "accept failed: %d", errno);
+            }
+            return;
+        }
+        if ((int)connections_.size() >= max_clients_ || !SetNonBlocking(fd)) {
+            ESP_LOGW(TAG, "Too many clients, rejecting %s", inet_ntoa(client_addr.sin_addr));
+            close(fd);
+            continue;
+        }
+
+        connections_.emplace_back();
+        auto& connection = connections_.back();
+        connection.fd = fd;
+        connection.accepted_time = std::chrono::steady_clock::now();
+        connection.last_receive_time = connection.accepted_time;
+        ESP_LOGI(TAG, "Client %d connected from %s, %u clients", fd, inet_ntoa(client_addr.sin_addr),
+            (unsigned)connections_.size());
+    }
+}
+
+bool WsIngestServer::Receive(Connection& connection) {
+    for (int i = 0; i < WS_INGEST_MAX_READS_PER_ROUND; i++) {
+        // After the upgrade, the socket reads straight into the parser's arena
+        char buffer[256];
+        char* dest = buffer;
+        size_t available = sizeof(buffer);
+        if (connection.upgraded && !connection.closing) {
+            dest = connection.parser.PrepareWrite(available);
+        }
+        int received = recv(connection.fd, dest, available, 0);
+        if (received == 0) {
+            ESP_LOGI(TAG, "Client %d disconnected", connection.fd);
+            return false;
+        }
+        if (received < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        connection.last_receive_time = std::chrono::steady_clock::now();
+        connection.ping_sent = false;
+        if (connection.closing) {
+            continue;
+        }
+
+        if (!connection.upgraded) {
+            connection.request.append(buffer, received);
+            auto end = connection.request.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                if (connection.request.size() > WS_INGEST_MAX_REQUEST_SIZE) {
+                    ESP_LOGW(TAG, "Client %d sent an oversized request", connection.fd);
+                    return false;
+                }
+                continue;
+            }
+            // Frames may follow the request in the same read
+            std::string rest = connection.request.substr(end + 4);
+            connection.request.resize(end + 4);
+            HandleRequest(connection);
+            if (connection.closing) {
+                continue;
+            }
+            connection.parser.Feed(rest.data(), rest.size());
+        } else {
+            connection.parser.Commit(received);
+        }
+
+        WsFrame frame;
+        while (connection.parser.Next(frame)) {
+            if (!HandleFrame(connection, frame)) {
+                return false;
+            }
+            if (connection.output_overflow) {
+                // Run() drops it, nothing more is read or answered
+                return true;
+            }
+        }
+        if (connection.parser.error()) {
+            ESP_LOGW(TAG, "Client %d: %s", connection.fd, connection.parser.error_message());
+            // 1002: protocol error, 1009: message too big
+            bool too_big = strcmp(connection.parser.error_message(), "frame too large") == 0;
+            Send(connection, WsFrameParser::Encode(kWsOpcodeClose, too_big ? "\x03\xf1" : "\x03\xea", 2));
+            connection.closing = true;
+        }
+    }
+    return true;
+}
+
+// Case-insensitive header lookup in the upgrade request
+static std::string FindHeader(const std::string& request, const char* name) {
+    size_t name_length = strlen(name);
+    size_t line = request.find("\r\n");
+    while (line != std::string::npos && line + 2 < request.size()) {
+        size_t start = line + 2;
+        size_t end = request.find("\r\n", start);
+        if (end == std::string::npos) {
+            break;
+        }
+        if (end - start > name_length && request[start + name_length] == ':' &&
+            strncasecmp(request.c_str() + start, name, name_length) == 0) {
+            size_t value = request.find_first_not_of(' ', start + name_length + 1);
+            return value < end ? request.substr(value, end - value) : "";
+        }
+        line = end;
+    }
+    return "";
+}
+
+// Whether a comma separated header value lists the token, e.g. "Upgrade: websocket"
+static bool HasToken(const std::string& value, const char* token) {
+    size_t token_length = strlen(token);
+    size_t start = 0;
+    while (start < value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        size_t first = value.find_first_not_of(" \t", start);
+        size_t last = value.find_last_not_of(" \t", end - 1);
+        if (first < end && last - first + 1 == token_length &&
+            strncasecmp(value.c_str() + first, token, token_length) == 0) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+void WsIngestServer::HandleRequest(Connection& connection) {
+    // RFC 6455 4.2.1: a GET with Upgrade: websocket, a key and version 13
+    const char* problem = nullptr;
+    auto key = FindHeader(connection.request, "Sec-WebSocket-Key");
+    if (connection.request.compare(0, 4, "GET ") != 0) {
+        problem = "not a GET request";
+    } else if (!HasToken(FindHeader(connection.request, "Upgrade"), "websocket")) {
+        problem = "no Upgrade: websocket";
+    } else if (FindHeader(connection.request, "Sec-WebSocket-Version") != "13") {
+        problem = "unsupported Sec-WebSocket-Version";
+    } else if (key.empty()) {
+        problem = "no Sec-WebSocket-Key";
+    }
+    connection.request.clear();
+    connection.request.shrink_to_fit();
+    if (problem != nullptr) {
+        ESP_LOGW(TAG, "Client %d: %s, closing", connection.fd, problem);
+        Send(connection, "HTTP/1.1 400 Bad Request\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "Content-Length: 0\r\n"
+            "Connection: close\r\n\r\n");
+        connection.closing = true;
+        return;
+    }
+
+    // Accept key: base64(sha1(key + GUID))
+    std::string to_hash = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char sha1_result[20];
+    mbedtls_sha1((const unsigned char*)to_hash.data(), to_hash.size(), sha1_result);
+    size_t olen = 0;
+    unsigned char b64[32];
+    mbedtls_base64_encode(b64, sizeof(b64), &olen, sha1_result, sizeof(sha1_result));
+
+    Send(connection, "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: " + std::string((char*)b64, olen) + "\r\n\r\n");
+    connection.upgraded = true;
+}
+
+void WsIngestServer::DeliverMessage(uint8_t opcode, const char* data, size_t length) {
+    if (opcode == kWsOpcodeText && on_text_message_) {
+        on_text_message_(data, length);
+    }
+}
+
+bool WsIngestServer::HandleFrame(Connection& connection, const WsFrame& frame) {
+    if (connection.closing) {
+        return true;
+    }
+
+    switch (frame.opcode) {
+    case kWsOpcodeText:
+    case kWsOpcodeBinary:
+        if (connection.message_opcode != 0) {
+            ESP_LOGW(TAG, "Client %d started a new message inside a fragmented one", connection.fd);
+            return false;
+        }
+        if (frame.fin) {
+            // The common case, handed over straight from the arena
+            DeliverMessage(frame.opcode, frame.payload, frame.length);
+        } else {
+            connection.message_opcode = frame.opcode;
+            connection.message.assign(frame.payload, frame.length);
+        }
+        return true;
+    case kWsOpcodeContinuation:
+        if (connection.message_opcode == 0) {
+            ESP_LOGW(TAG, "Client %d sent a continuation without a message", connection.fd);
+            return false;
+        }
+        if (connection.message.size() + frame.length > WS_MAX_FRAME_SIZE) {
+            ESP_LOGW(TAG, "Client %d: fragmented message too large", connection.fd);
+            // 1009: message too big
+            Send(connection, WsFrameParser::Encode(kWsOpcodeClose, "\x03\xf1", 2));
+            connection.closing = true;
+            return true;
+        }
+        connection.message.append(frame.payload, frame.length);
+        if (frame.fin) {
+            DeliverMessage(connection.message_opcode, connection.message.data(), connection.message.size());
+            connection.message_opcode = 0;
+            // Keep the buffer for the next fragmented message unless it was a large one
+            if (connection.message.capacity() > WS_ARENA_KEEP_SIZE) {
+                std::string().swap(connection.message);
+            } else {
+                connection.message.clear();
+            }
+        }
+        return true;
+    case kWsOpcodeClose:
+        // Echo the status code and close once it is sent
+        Send(connection, WsFrameParser::Encode(kWsOpcodeClose, frame.payload, frame.length >= 2 ? 2 : 0));
+        connection.closing = true;
+        return true;
+    case kWsOpcodePing:
+        Send(connection, WsFrameParser::Encode(kWsOpcodePong, frame.payload, frame.length));
+        return true;
+    case kWsOpcodePong:
+        // Answer to our keepalive ping, receiving it already refreshed last_receive_time
+        return true;
+    default:
+        ESP_LOGW(TAG, "Client %d sent unknown opcode %d", connection.fd, frame.opcode);
+        Send(connection, WsFrameParser::Encode(kWsOpcodeClose, "\x03\xea", 2));
+        connection.closing = true;
+        return true;
+    }
+}
+
+void WsIngestServer::Send(Connection& connection, const std::string& data) {
+    if (connection.output.size() + data.size() > WS_INGEST_MAX_OUTPUT_SIZE) {
+        // Replies pile up within one round of reads, hand them to the socket before giving up on the client
+        Flush(connection);
+        if (connection.output.size() + data.size() > WS_INGEST_MAX_OUTPUT_SIZE) {
+            connection.output_overflow = true;
+            return;
+        }
+    }
+    connection.output.append(data);
+}
+
+bool WsIngestServer::Flush(Connection& connection) {
+    while (!connection.output.empty()) {
+        int sent = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return true;
+            }
+            ESP_LOGW(TAG, "Client %d: send failed: %d", connection.fd, errno);
+            return false;
+        }
+        connection.output.erase(0, sent);
+    }
+    return true;
+}
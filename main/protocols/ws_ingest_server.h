@@ -0,0 +1,84 @@
+#ifndef _WS_INGEST_SERVER_H_
+#define _WS_INGEST_SERVER_H_
+
+#include "ws_frame_parser.h"
+
+#include <string>
+#include <list>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+// lwIP has few sockets (CONFIG_LWIP_MAX_SOCKETS), extra clients are closed right after accept
+#define WS_INGEST_MAX_CLIENTS 4
+#define WS_INGEST_MAX_REQUEST_SIZE 8192
+// Replies waiting for a client that does not read, e.g. pongs to a ping flood; beyond this it is dropped
+#define WS_INGEST_MAX_OUTPUT_SIZE 4096
+// A client that does not finish the upgrade request in time is dropped, it would hold a slot forever
+#define WS_INGEST_HANDSHAKE_TIMEOUT_MS 5000
+#define WS_INGEST_POLL_INTERVAL_MS 1000
+// A client silent this long is pinged, and dropped if it is still silent at the timeout
+#define WS_INGEST_IDLE_PING_MS 30000
+#define WS_INGEST_IDLE_TIMEOUT_MS 40000
+
+/*
+ * Local WebSocket server that receives live-stream events (e.g. Douyin comments and likes).
+ *
+ * One task serves every client with select() on non-blocking sockets. Each connection has its own
+ * request and frame buffers, so a slow or stalled client only delays itself. Unfragmented messages
+ * are handed to the callback straight from the receive arena, without a copy. Uses plain BSD sockets
+ * and mbedtls, so it builds and runs on the host as well (see scripts/ws_ingest_test).
+ */
+class WsIngestServer {
+public:
+    explicit WsIngestServer(int port, int max_clients = WS_INGEST_MAX_CLIENTS);
+    ~WsIngestServer();
+
+    // Called on the server task for every complete text message, the data is only valid during the call
+    void OnTextMessage(std::function<void(const char* data, size_t length)> callback);
+
+    bool Start();
+    // Serves clients until Stop() is called
+    void Run();
+    void Stop();
+
+    // The bound port, useful after Start() with port 0
+    int port() const { return port_; }
+    size_t client_count() const { return connections_.size(); }
+
+private:
+    struct Connection {
+        int fd = -1;
+        bool upgraded = false;
+        bool closing = false;
+        std::string request;
+        std::string output;
+        bool output_overflow = false;
+        WsFrameParser parser;
+        // Fragmented message being assembled
+        std::string message;
+        uint8_t message_opcode = 0;
+        std::chrono::steady_clock::time_point accepted_time;
+        std::chrono::steady_clock::time_point last_receive_time;
+        bool ping_sent = false;
+    };
+
+    int port_;
+    int max_clients_;
+    int listen_fd_ = -1;
+    std::atomic<bool> running_ = false;
+    std::list<Connection> connections_;
+    std::function<void(const char* data, size_t length)> on_text_message_;
+
+    void Accept();
+    bool Receive(Connection& connection);
+    bool Flush(Connection& connection);
+    // Answers the upgrade, or answers 400 and marks the connection closing
+    void HandleRequest(Connection& connection);
+    bool HandleFrame(Connection& connection, const WsFrame& frame);
+    bool CheckIdle(Connection& connection, std::chrono::steady_clock::time_point now);
+    void DeliverMessage(uint8_t opcode, const char* data, size_t length);
+    void Send(Connection& connection, const std::string& data);
+};
+
+#endif // _WS_INGEST_SERVER_H_
@@ -0,0 +1,243 @@
+#include "status_bar_monitor.h"
+#include "application.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <sys/time.h>
+#include <climits>
+#include <algorithm>
+
+#define TAG "StatusBar"
+
+static const int64_t kNever = INT64_MAX;
+
+StatusBarMonitor::StatusBarMonitor() {
+    for (auto& deadline : deadlines_) {
+        deadline = kNever;
+    }
+    timer_deadline_ = kNever;
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            ((StatusBarMonitor*)arg)->OnTimer();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "status_bar",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&timer_args, &timer_);
+
+    auto& event_bus = EventBus::GetInstance();
+    event_bus.Subscribe<DeviceStateChangedEvent>([this](const DeviceStateChangedEvent& event) {
+        if (event.current_state == kDeviceStateIdle) {
+            // The network icon is not queried while speaking, catch up on it
+            Notify(kStatusBarNetwork);
+            Notify(kStatusBarClock, STATUS_BAR_CLOCK_DELAY_MS);
+        }
+    });
+    event_bus.Subscribe<NetworkChangedEvent>([this](const NetworkChangedEvent& event) {
+        Notify(kStatusBarNetwork);
+    });
+    event_bus.Subscribe<BatteryChangedEvent>([this](const BatteryChangedEvent& event) {
+        Notify(kStatusBarBattery);
+    });
+}
+
+StatusBarMonitor::~StatusBarMonitor() {
+    if (timer_ != nullptr) {
+        esp_timer_stop(timer_);
+        esp_timer_delete(timer_);
+    }
+}
+
+void StatusBarMonitor::Start(std::function<void()> on_refresh) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    on_refresh_ = std::move(on_refresh);
+    started_ = true;
+    for (auto& deadline : deadlines_) {
+        deadline = 0;
+    }
+    ScheduleRefresh();
+}
+
+void StatusBarMonitor::Notify(uint32_t items, int delay_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = esp_timer_get_time();
+    int64_t deadline = now + delay_ms * 1000LL;
+    for (int i = 0; i < STATUS_BAR_ITEM_COUNT; i++) {
+        if ((items & (1 << i)) == 0) {
+            continue;
+        }
+        stats_.items_notified[i]++;
+        if (i == __builtin_ctz(kStatusBarBattery)) {
+            battery_notified_ = true;
+        }
+        if (deadline < deadlines_[i]) {
+            deadlines_[i] = deadline;
+        }
+    }
+    if (!started_) {
+        return;
+    }
+    if (delay_ms <= 0) {
+        ScheduleRefresh();
+    } else {
+        ArmTimer(now);
+    }
+}
+
+// Runs on the esp_timer task, the display is only touched from the main loop
+void StatusBarMonitor::OnTimer() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timer_deadline_ = kNever;
+    wakeup_times_[stats_.wakeups % STATUS_BAR_WAKEUP_HISTORY] = esp_timer_get_time();
+    stats_.wakeups++;
+    ScheduleRefresh();
+}
+
+// Called with mutex_ held, at most one refresh waits in the main loop
+void StatusBarMonitor::ScheduleRefresh() {
+    if (refresh_scheduled_) {
+        return;
+    }
+    refresh_scheduled_ = true;
+    if (Application::GetInstance().Schedule([this]() {
+        Refresh();
+    }, kTaskLaneUi, "RefreshStatusBar")) {
+        return;
+    }
+    // The UI lane is full, the deadlines are still due, try again once the main loop caught up
+    refresh_scheduled_ = false;
+    int64_t retry = esp_timer_get_time() + STATUS_BAR_RETRY_MS * 1000LL;
+    if (retry < timer_deadline_) {
+        esp_timer_stop(timer_);
+        timer_deadline_ = retry;
+        esp_timer_start_once(timer_, STATUS_BAR_RETRY_MS * 1000LL);
+    }
+}
+
+void StatusBarMonitor::Refresh() {
+    uint32_t due = 0;
+    bool notified_battery;
+    std::function<void()> on_refresh;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        refresh_scheduled_ = false;
+        notified_battery = battery_notified_;
+        battery_notified_ = false;
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < STATUS_BAR_ITEM_COUNT; i++) {
+            if (deadlines_[i] <= now) {
+                due |= 1 << i;
+            }
+        }
+        if (due != 0) {
+            // Already awake, polling these a little early saves them a wake-up of their own
+            for (int item : { kStatusBarBattery, kStatusBarNetwork }) {
+                int i = __builtin_ctz(item);
+                if (deadlines_[i] <= now + STATUS_BAR_COALESCE_MS * 1000LL) {
+                    due |= item;
+                }
+            }
+            stats_.refreshes++;
+        }
+
+        for (int i = 0; i < STATUS_BAR_ITEM_COUNT; i++) {
+            if ((due & (1 << i)) == 0) {
+                continue;
+            }
+            stats_.items_refreshed[i]++;
+            switch (1 << i) {
+            case kStatusBarClock:
+                deadlines_[i] = NextClockDeadline(now);
+                break;
+            case kStatusBarBattery:
+                deadlines_[i] = now + STATUS_BAR_BATTERY_INTERVAL_MS * 1000LL;
+                break;
+            case kStatusBarNetwork:
+                deadlines_[i] = now + STATUS_BAR_NETWORK_INTERVAL_MS * 1000LL;
+                break;
+            default:
+                // Only refreshed when notified
+                deadlines_[i] = kNever;
+                break;
+            }
+        }
+        ArmTimer(now);
+        on_refresh = on_refresh_;
+    }
+
+    // A battery change comes back through the event bus, the icon is only redrawn then
+    if ((due & kStatusBarBattery) && !notified_battery) {
+        PollBattery();
+        due &= ~kStatusBarBattery;
+    }
+    if (due != 0) {
+        auto display = Board::GetInstance().GetDisplay();
+        display->RefreshStatusBar(due);
+    }
+    if (on_refresh) {
+        on_refresh();
+    }
+}
+
+// Main loop only. Boards have no common battery change event, so it is polled here and published on changes
+void StatusBarMonitor::PollBattery() {
+    BatteryChangedEvent event = {};
+    if (!Board::GetInstance().GetBatteryLevel(event.level, event.charging, event.discharging)) {
+        return;
+    }
+    if (battery_known_ && event.level == last_battery_.level && event.charging == last_battery_.charging &&
+        event.discharging == last_battery_.discharging) {
+        return;
+    }
+    battery_known_ = true;
+    last_battery_ = event;
+    EventBus::GetInstance().Publish(event);
+}
+
+// Called with mutex_ held
+void StatusBarMonitor::ArmTimer(int64_t now) {
+    int64_t next = kNever;
+    for (auto deadline : deadlines_) {
+        if (deadline < next) {
+            next = deadline;
+        }
+    }
+    if (next == timer_deadline_) {
+        return;
+    }
+    esp_timer_stop(timer_);
+    timer_deadline_ = next;
+    if (next == kNever) {
+        return;
+    }
+    esp_timer_start_once(timer_, next > now ? next - now : 1);
+}
+
+// The clock shows minutes, it only changes at the minute boundary and is only shown while idle
+int64_t StatusBarMonitor::NextClockDeadline(int64_t now) const {
+    if (Application::GetInstance().GetDeviceState() != kDeviceStateIdle) {
+        return kNever;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    int64_t into_minute = (tv.tv_sec % 60) * 1000000LL + tv.tv_usec;
+    // A little past the boundary, so the new minute is already there when the timer fires
+    return now + 60 * 1000000LL - into_minute + 50000;
+}
+
+StatusBarStats StatusBarMonitor::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StatusBarStats stats = stats_;
+    int64_t since = esp_timer_get_time() - 60 * 1000000LL;
+    uint32_t count = std::min<uint32_t>(stats_.wakeups, STATUS_BAR_WAKEUP_HISTORY);
+    stats.wakeups_last_minute = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (wakeup_times_[i] >= since) {
+            stats.wakeups_last_minute++;
+        }
+    }
+    return stats;
+}
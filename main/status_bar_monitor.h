@@ -0,0 +1,83 @@
+#ifndef STATUS_BAR_MONITOR_H
+#define STATUS_BAR_MONITOR_H
+
+#include <esp_timer.h>
+
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+#include "display.h"
+#include "event_bus.h"
+
+// Sources without a change event are polled this often
+#define STATUS_BAR_BATTERY_INTERVAL_MS 30000
+#define STATUS_BAR_NETWORK_INTERVAL_MS 30000
+// The clock replaces the state text this long after the device went idle
+#define STATUS_BAR_CLOCK_DELAY_MS 10000
+// Polled items due this soon are refreshed with an earlier wake-up instead of their own
+#define STATUS_BAR_COALESCE_MS 10000
+// Timer wake-ups remembered for the per-minute count
+#define STATUS_BAR_WAKEUP_HISTORY 32
+// A refresh the main loop could not take is retried after this long
+#define STATUS_BAR_RETRY_MS 1000
+
+struct StatusBarStats {
+    uint32_t wakeups = 0;               // Timer wake-ups, each one ends a light sleep
+    uint32_t wakeups_last_minute = 0;
+    uint32_t refreshes = 0;             // Refreshes run in the main loop, including notified ones
+    uint32_t items_refreshed[STATUS_BAR_ITEM_COUNT] = {};
+    uint32_t items_notified[STATUS_BAR_ITEM_COUNT] = {};
+};
+
+/*
+ * Decides when the status bar is refreshed, instead of redrawing it every second.
+ *
+ * Each StatusBarItem has its own deadline: the clock at the next minute boundary while idle, battery
+ * and network at their polling interval, and any item right away when its source reports a change
+ * through Notify() or the event bus. One one-shot timer is armed for the earliest deadline, so between real changes
+ * the CPU has nothing to wake up for and can stay in light sleep.
+ */
+class StatusBarMonitor {
+public:
+    static StatusBarMonitor& GetInstance() {
+        static StatusBarMonitor instance;
+        return instance;
+    }
+    StatusBarMonitor(const StatusBarMonitor&) = delete;
+    StatusBarMonitor& operator=(const StatusBarMonitor&) = delete;
+
+    // Refreshes every item once and starts the deadlines. `on_refresh` runs in the main loop after
+    // each refresh, for periodic work that can share the wake-up.
+    void Start(std::function<void()> on_refresh = nullptr);
+    // Any task. Refreshes the items after `delay_ms`, or sooner if they are already due
+    void Notify(uint32_t items, int delay_ms = 0);
+    StatusBarStats GetStats();
+
+private:
+    StatusBarMonitor();
+    ~StatusBarMonitor();
+
+    std::mutex mutex_;
+    esp_timer_handle_t timer_ = nullptr;
+    bool started_ = false;
+    bool refresh_scheduled_ = false;
+    int64_t deadlines_[STATUS_BAR_ITEM_COUNT];
+    int64_t timer_deadline_;
+    std::function<void()> on_refresh_;
+    StatusBarStats stats_;
+    int64_t wakeup_times_[STATUS_BAR_WAKEUP_HISTORY] = {};
+    bool battery_notified_ = false;
+    // Main loop only
+    bool battery_known_ = false;
+    BatteryChangedEvent last_battery_ = {};
+
+    void OnTimer();
+    void Refresh();
+    void ScheduleRefresh();
+    void ArmTimer(int64_t now);
+    void PollBattery();
+    int64_t NextClockDeadline(int64_t now) const;
+};
+
+#endif // STATUS_BAR_MONITOR_H
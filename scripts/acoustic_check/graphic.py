@@ -37,6 +37,11 @@ class UDPServerProtocol(asyncio.DatagramProtocol):
         
         # 只处理来自已记录客户端的数据
         if addr == self.client_address:
+            # 新固件每个包带流头(见 audio_debug_server.py), 只取原始输入流的PCM
+            if len(data) >= 16 and data[0] == 0xAD:
+                if data[1] != 0 or data[2] != 0:
+                    return
+                data = data[16:]
             # 将接收到的音频数据添加到队列
             self.data_queue.extend(data)
         else:
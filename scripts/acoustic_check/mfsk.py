@@ -0,0 +1,321 @@
+"""
+MFSK + FEC 声波配网编解码 - 与固件 main/boards/common/mfsk_demod.cc 保持一致
+
+帧格式: |前导 8 符号|长度字节 x3|Reed-Solomon 码字(数据 | CRC-16 大端 | 16 字节校验)|
+每个符号 3 比特, 格雷码映射到 8 个音调, 字节按 MSB 优先发送
+"""
+
+import numpy as np
+
+TONE_COUNT = 8
+BASE_FREQ = 1000
+TONE_SPACING = 100
+SYMBOL_RATE = 100
+BITS_PER_SYMBOL = 3
+TIMING_PHASES = 4
+PARITY_BYTES = 16
+MAX_PAYLOAD_SIZE = 96
+PREAMBLE = [0, 7, 0, 7, 2, 5, 1, 6]
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)"""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+# GF(256), 本原多项式 0x11d, 多项式按最高次在前存储
+_GF_EXP = [0] * 512
+_GF_LOG = [0] * 256
+_x = 1
+for _i in range(255):
+    _GF_EXP[_i] = _x
+    _GF_LOG[_x] = _i
+    _x <<= 1
+    if _x & 0x100:
+        _x ^= 0x11d
+for _i in range(255, 512):
+    _GF_EXP[_i] = _GF_EXP[_i - 255]
+
+
+def _mul(a, b):
+    return 0 if a == 0 or b == 0 else _GF_EXP[_GF_LOG[a] + _GF_LOG[b]]
+
+
+def _div(a, b):
+    return 0 if a == 0 else _GF_EXP[(_GF_LOG[a] + 255 - _GF_LOG[b]) % 255]
+
+
+def _pow(a, n):
+    return _GF_EXP[(_GF_LOG[a] * n) % 255]
+
+
+def _inv(a):
+    return _GF_EXP[255 - _GF_LOG[a]]
+
+
+def _poly_scale(p, x):
+    return [_mul(c, x) for c in p]
+
+
+def _poly_add(p, q):
+    r = [0] * max(len(p), len(q))
+    for i, c in enumerate(p):
+        r[i + len(r) - len(p)] = c
+    for i, c in enumerate(q):
+        r[i + len(r) - len(q)] ^= c
+    return r
+
+
+def _poly_mul(p, q):
+    r = [0] * (len(p) + len(q) - 1)
+    for j, qc in enumerate(q):
+        for i, pc in enumerate(p):
+            r[i + j] ^= _mul(pc, qc)
+    return r
+
+
+def _poly_eval(p, x):
+    y = p[0] if p else 0
+    for c in p[1:]:
+        y = _mul(y, x) ^ c
+    return y
+
+
+class ReedSolomon:
+    """GF(256) 系统 Reed-Solomon 编解码, 最多纠正 parity_bytes // 2 个字节错误"""
+
+    def __init__(self, parity_bytes: int = PARITY_BYTES):
+        self.parity_bytes = parity_bytes
+        self.generator = [1]
+        for i in range(parity_bytes):
+            self.generator = _poly_mul(self.generator, [1, _pow(2, i)])
+
+    def encode(self, message: bytes) -> bytes:
+        """返回需要附加在消息后的校验字节"""
+        remainder = list(message) + [0] * self.parity_bytes
+        for i in range(len(message)):
+            coef = remainder[i]
+            if coef:
+                for j in range(1, len(self.generator)):
+                    remainder[i + j] ^= _mul(self.generator[j], coef)
+        return bytes(remainder[len(message):])
+
+    def decode(self, codeword: bytearray) -> int:
+        """原地纠错, 返回纠正的字节数, 无法纠正时返回 -1"""
+        n = len(codeword)
+        if n <= self.parity_bytes or n > 255:
+            return -1
+        synd = [0] + [_poly_eval(codeword, _pow(2, i)) for i in range(self.parity_bytes)]
+        if not any(synd):
+            return 0
+
+        # Berlekamp-Massey
+        err_loc, old_loc = [1], [1]
+        for i in range(self.parity_bytes):
+            k = i + 1
+            delta = synd[k]
+            for j in range(1, len(err_loc)):
+                delta ^= _mul(err_loc[-(j + 1)], synd[k - j])
+            old_loc = old_loc + [0]
+            if delta:
+                if len(old_loc) > len(err_loc):
+                    new_loc = _poly_scale(old_loc, delta)
+                    old_loc = _poly_scale(err_loc, _inv(delta))
+                    err_loc = new_loc
+                err_loc = _poly_add(err_loc, _poly_scale(old_loc, delta))
+        while err_loc and err_loc[0] == 0:
+            err_loc.pop(0)
+        errors = len(err_loc) - 1
+        if errors <= 0 or errors * 2 > self.parity_bytes:
+            return -1
+
+        # Chien 搜索
+        reversed_loc = err_loc[::-1]
+        positions = [n - 1 - i for i in range(n) if _poly_eval(reversed_loc, _pow(2, i)) == 0]
+        if len(positions) != errors:
+            return -1
+
+        # Forney
+        coef_pos = [n - 1 - p for p in positions]
+        errata_loc = [1]
+        for cp in coef_pos:
+            errata_loc = _poly_mul(errata_loc, _poly_add([1], [_pow(2, cp), 0]))
+        product = _poly_mul(synd[::-1], errata_loc)
+        evaluator = product[-min(len(product), len(errata_loc)):]
+        xs = [_pow(2, cp) for cp in coef_pos]
+        for i, xi in enumerate(xs):
+            xi_inv = _inv(xi)
+            loc_prime = 1
+            for j, xj in enumerate(xs):
+                if j != i:
+                    loc_prime = _mul(loc_prime, 1 ^ _mul(xi_inv, xj))
+            if loc_prime == 0:
+                return -1
+            y = _mul(xi, _poly_eval(evaluator, xi_inv))
+            codeword[positions[i]] ^= _div(y, loc_prime)
+
+        if any(_poly_eval(codeword, _pow(2, i)) for i in range(self.parity_bytes)):
+            return -1
+        return errors
+
+
+def _gray_encode(value: int) -> int:
+    return value ^ (value >> 1)
+
+
+def _gray_decode(tone: int) -> int:
+    value, shift = tone, tone >> 1
+    while shift:
+        value ^= shift
+        shift >>= 1
+    return value
+
+
+def _bytes_to_tones(data: bytes) -> list:
+    tones, acc, count = [], 0, 0
+    for b in data:
+        acc = (acc << 8) | b
+        count += 8
+        while count >= BITS_PER_SYMBOL:
+            count -= BITS_PER_SYMBOL
+            tones.append(_gray_encode((acc >> count) & 0x7))
+    if count:
+        tones.append(_gray_encode((acc << (BITS_PER_SYMBOL - count)) & 0x7))
+    return tones
+
+
+def encode_tones(text: str) -> list:
+    """将文本编码为音调序列"""
+    payload = text.encode("utf-8")
+    assert 0 < len(payload) <= MAX_PAYLOAD_SIZE, "数据长度超出范围"
+    body = payload + crc16(payload).to_bytes(2, "big")
+    body += ReedSolomon().encode(body)
+    header = bytes([len(payload)] * 3)
+    return PREAMBLE + _bytes_to_tones(header) + _bytes_to_tones(body)
+
+
+def modulate(text: str, f_sample: int = 44100, amplitude: float = 0.8) -> np.ndarray:
+    """生成相位连续的 MFSK 波形, 符号边界按累计时间取整, 支持非整数倍采样率"""
+    tones = encode_tones(text)
+    out = np.zeros(int(round(len(tones) * f_sample / SYMBOL_RATE)), dtype=np.float32)
+    phase = 0.0
+    for i, tone in enumerate(tones):
+        begin = int(round(i * f_sample / SYMBOL_RATE))
+        end = int(round((i + 1) * f_sample / SYMBOL_RATE))
+        step = 2.0 * np.pi * (BASE_FREQ + tone * TONE_SPACING) / f_sample
+        out[begin:end] = amplitude * np.sin(phase + step * np.arange(end - begin))
+        phase = (phase + step * (end - begin)) % (2.0 * np.pi)
+    return out
+
+
+class RealTimeMFSKDecoder:
+    """实时MFSK解码器 - 多个定时相位并行, 首个通过FEC与CRC的帧胜出"""
+
+    def __init__(self, f_sample: int = 16000):
+        assert f_sample % (SYMBOL_RATE * TIMING_PHASES) == 0, "采样频率必须是符号率*相位数的整数倍"
+        self.f_sample = f_sample
+        self.window_size = f_sample // SYMBOL_RATE
+        self.hop_size = self.window_size // TIMING_PHASES
+        n = np.arange(self.window_size)
+        freqs = (BASE_FREQ + TONE_SPACING * np.arange(TONE_COUNT)) / f_sample
+        # 与 Goertzel 滤波器组等价的 DFT 投影
+        self.basis = np.exp(-2j * np.pi * np.outer(freqs, n))
+        self.window = np.zeros(self.window_size, dtype=np.float32)
+        self.fill = 0
+        self.hop_count = 0
+        self.phase_index = 0
+        self.rs = ReedSolomon()
+        self.decoded_messages = []
+        self.corrected_bytes = 0
+        self.failed_frames = 0
+        self._reset_phases()
+
+    def _reset_phases(self):
+        self.phases = [self._new_phase() for _ in range(TIMING_PHASES)]
+
+    @staticmethod
+    def _new_phase() -> dict:
+        return {"state": "searching", "recent": [], "acc": 0, "bits": 0, "expected": 0, "bytes": bytearray()}
+
+    def process_audio(self, samples: np.ndarray) -> str:
+        """处理音频采样, 返回新解码的文本"""
+        new_text = ""
+        for sample in samples:
+            self.window = np.roll(self.window, -1)
+            self.window[-1] = sample
+            if self.fill < self.window_size:
+                self.fill += 1
+                continue
+            self.hop_count += 1
+            if self.hop_count < self.hop_size:
+                continue
+            self.hop_count = 0
+            tone = int(np.argmax(np.abs(self.basis @ self.window)))
+            phase = self.phases[self.phase_index]
+            self.phase_index = (self.phase_index + 1) % TIMING_PHASES
+            text = self._process_symbol(phase, tone)
+            if text is not None:
+                new_text += text
+                self.decoded_messages.append(text)
+                self._reset_phases()
+        return new_text
+
+    def _process_symbol(self, d: dict, tone: int):
+        if d["state"] == "searching":
+            d["recent"] = (d["recent"] + [tone])[-len(PREAMBLE):]
+            if d["recent"] == PREAMBLE:
+                d.update(state="header", acc=0, bits=0, expected=3, bytes=bytearray())
+            return None
+
+        d["acc"] = (d["acc"] << BITS_PER_SYMBOL) | _gray_decode(tone)
+        d["bits"] += BITS_PER_SYMBOL
+        while d["bits"] >= 8 and len(d["bytes"]) < d["expected"]:
+            d["bits"] -= 8
+            d["bytes"].append((d["acc"] >> d["bits"]) & 0xFF)
+        d["acc"] &= (1 << d["bits"]) - 1
+        if len(d["bytes"]) < d["expected"]:
+            return None
+
+        if d["state"] == "header":
+            a, b, c = d["bytes"]
+            size = (a & b) | (a & c) | (b & c)
+            if size == 0 or size > MAX_PAYLOAD_SIZE:
+                d.clear()
+                d.update(self._new_phase())
+                return None
+            d.update(state="body", acc=0, bits=0, expected=size + 2 + PARITY_BYTES, bytes=bytearray())
+            return None
+
+        codeword = d["bytes"]
+        d.clear()
+        d.update(self._new_phase())
+        corrected = self.rs.decode(codeword)
+        size = len(codeword) - 2 - PARITY_BYTES
+        if corrected < 0 or int.from_bytes(codeword[size:size + 2], "big") != crc16(bytes(codeword[:size])):
+            self.failed_frames += 1
+            return None
+        self.corrected_bytes += corrected
+        return bytes(codeword[:size]).decode("utf-8", errors="replace")
+
+    def clear(self):
+        """清空解码状态"""
+        self._reset_phases()
+        self.decoded_messages = []
+        self.corrected_bytes = 0
+        self.failed_frames = 0
+
+    def get_stats(self) -> dict:
+        """获取解码统计信息"""
+        return {
+            "states": [p["state"] for p in self.phases],
+            "decoded_frames": len(self.decoded_messages),
+            "corrected_bytes": self.corrected_bytes,
+            "failed_frames": self.failed_frames,
+            "symbol_rate": SYMBOL_RATE,
+        }
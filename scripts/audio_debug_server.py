@@ -1,54 +1,178 @@
 import socket
+import struct
+import time
 import wave
 import argparse
 
 
 '''
   Create a UDP socket and bind it to the server's IP:8000.
-  Listen for incoming messages and print them to the console.
-  Save the audio to a WAV file.
+  Reassemble the audio streams sent by the device and save every stream to its own WAV file.
+
+  Packet layout (little endian), see main/audio/processors/audio_debugger.h:
+    magic u8 (0xAD) | stream u8 | codec u8 | channels u8 | sequence u32 | frame_offset u32 | sample_rate u32 | payload
+  A gap in sequence is a packet lost on the network, a gap in frame_offset without a sequence gap
+  means the device ring buffer overflowed. Missing frames are filled with silence to keep streams aligned.
 '''
+
+HEADER = struct.Struct('<BBBBIII')
+MAGIC = 0xAD
+CODEC_PCM16 = 0
+CODEC_IMA_ADPCM = 1
+STREAM_NAMES = {0: 'input', 1: 'processed', 2: 'playback'}
+REPORT_INTERVAL = 5.0
+
+ADPCM_INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+ADPCM_STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+]
+
+
+def decode_adpcm(payload, channels):
+    '''Decode one IMA ADPCM packet, returns interleaved 16-bit PCM bytes'''
+    states = []
+    for ch in range(channels):
+        predictor, index, _ = struct.unpack_from('<hBB', payload, ch * 4)
+        states.append([predictor, index])
+    data = payload[channels * 4:]
+    samples = []
+    for i in range(len(data) * 2):
+        nibble = (data[i // 2] >> (4 * (i % 2))) & 0x0F
+        state = states[i % channels]
+        step = ADPCM_STEP_TABLE[state[1]]
+        delta = step >> 3
+        if nibble & 4:
+            delta += step
+        if nibble & 2:
+            delta += step >> 1
+        if nibble & 1:
+            delta += step >> 2
+        state[0] = max(-32768, min(32767, state[0] - delta if nibble & 8 else state[0] + delta))
+        state[1] = max(0, min(88, state[1] + ADPCM_INDEX_TABLE[nibble]))
+        samples.append(state[0])
+    # The last byte may carry a padding nibble
+    samples = samples[:len(samples) - len(samples) % channels]
+    return struct.pack(f'<{len(samples)}h', *samples)
+
+
+class StreamWriter:
+    def __init__(self, stream, channels, sample_rate):
+        self.name = STREAM_NAMES.get(stream, f'stream{stream}')
+        self.channels = channels
+        self.sample_rate = sample_rate
+        self.filename = f"{self.name}_{sample_rate}_{channels}.wav"
+        self.wav_file = wave.open(self.filename, "wb")
+        self.wav_file.setnchannels(channels)
+        self.wav_file.setsampwidth(2)
+        self.wav_file.setframerate(sample_rate)
+        self.next_sequence = None
+        self.next_frame = None
+        self.packets = 0
+        self.lost_packets = 0
+        self.late_packets = 0
+        self.overflow_frames = 0
+        self.frames = 0
+        print(f"Saving stream '{self.name}' ({sample_rate}Hz, {channels}ch) to {self.filename}")
+
+    def write(self, sequence, frame_offset, pcm):
+        frames = len(pcm) // (2 * self.channels)
+        if self.next_sequence is not None:
+            # Sequence numbers wrap at 2^32
+            sequence_gap = (sequence - self.next_sequence) & 0xFFFFFFFF
+            if sequence_gap >= 0x80000000:
+                self.late_packets += 1
+                return
+            frame_gap = (frame_offset - self.next_frame) & 0xFFFFFFFF
+            self.lost_packets += sequence_gap
+            if sequence_gap == 0:
+                self.overflow_frames += frame_gap
+            if frame_gap > 0:
+                self.wav_file.writeframes(b'\x00' * (frame_gap * 2 * self.channels))
+        self.next_sequence = (sequence + 1) & 0xFFFFFFFF
+        self.next_frame = (frame_offset + frames) & 0xFFFFFFFF
+        self.packets += 1
+        self.frames += frames
+        self.wav_file.writeframes(pcm)
+
+    def report(self):
+        total = self.packets + self.lost_packets
+        loss = self.lost_packets * 100.0 / total if total else 0.0
+        print(f"[{self.name}] packets: {self.packets}, lost: {self.lost_packets} ({loss:.2f}%), "
+              f"late: {self.late_packets}, device overflow: {self.overflow_frames} frames, "
+              f"audio: {self.frames / self.sample_rate:.1f}s")
+
+    def close(self):
+        self.wav_file.close()
+        print(f"WAV file '{self.filename}' saved successfully")
+
+
 def main(samplerate, channels):
     # Create a UDP socket
     server_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     server_socket.bind(('0.0.0.0', 8000))
+    server_socket.settimeout(1.0)
 
-    # Create WAV file with parameters
-    filename = f"{samplerate}_{channels}.wav"
-    wav_file = wave.open(filename, "wb")
-    wav_file.setnchannels(channels)     # channels parameter
-    wav_file.setsampwidth(2)            # 2 bytes per sample (16-bit)
-    wav_file.setframerate(samplerate)   # samplerate parameter
-
-    print(f"Start saving audio from 0.0.0.0:8000 to {filename}...")
+    writers = {}
+    legacy_wav = None
+    last_report = time.time()
+    print("Start saving audio from 0.0.0.0:8000 ...")
 
     try:
         while True:
-            # Receive a message from the client
-            message, address = server_socket.recvfrom(8000)
-            
-            # Write PCM data to WAV file
-            wav_file.writeframes(message)
-
-            # Print length of the message
-            print(f"Received {len(message)} bytes from {address}")
-    
+            try:
+                message, address = server_socket.recvfrom(8192)
+            except socket.timeout:
+                message = None
+
+            if message is not None:
+                header = HEADER.unpack_from(message) if len(message) >= HEADER.size else None
+                if header is None or header[0] != MAGIC:
+                    # Firmware without stream headers sends raw PCM
+                    if legacy_wav is None:
+                        legacy_wav = StreamWriter(0, channels, samplerate)
+                        legacy_wav.name = 'legacy'
+                    legacy_wav.wav_file.writeframes(message)
+                else:
+                    _, stream, codec, stream_channels, sequence, frame_offset, sample_rate = header
+                    payload = message[HEADER.size:]
+                    if codec == CODEC_IMA_ADPCM:
+                        pcm = decode_adpcm(payload, stream_channels)
+                    else:
+                        pcm = payload
+                    writer = writers.get(stream)
+                    if writer is None:
+                        writer = writers[stream] = StreamWriter(stream, stream_channels, sample_rate)
+                    writer.write(sequence, frame_offset, pcm)
+
+            if time.time() - last_report >= REPORT_INTERVAL:
+                for writer in writers.values():
+                    writer.report()
+                last_report = time.time()
+
     except KeyboardInterrupt:
         print("\nStopping recording...")
-    
+
     finally:
         # Close files and socket
-        wav_file.close()
+        for writer in writers.values():
+            writer.report()
+            writer.close()
+        if legacy_wav is not None:
+            legacy_wav.close()
         server_socket.close()
-        print(f"WAV file '{filename}' saved successfully")
 
 
 if __name__ == "__main__":
-    parser = argparse.ArgumentParser(description='UDP音频数据接收器，保存为WAV文件')
-    parser.add_argument('--samplerate', '-s', type=int, default=16000, 
-                        help='采样率 (默认: 16000)')
-    parser.add_argument('--channels', '-c', type=int, default=2, 
-                        help='声道数 (默认: 2)')
-    
+    parser = argparse.ArgumentParser(description='UDP音频数据接收器，按音频流保存为WAV文件并统计丢包')
+    parser.add_argument('--samplerate', '-s', type=int, default=16000,
+                        help='旧固件原始PCM的采样率 (默认: 16000)')
+    parser.add_argument('--channels', '-c', type=int, default=2,
+                        help='旧固件原始PCM的声道数 (默认: 2)')
+
     args = parser.parse_args()
     main(args.samplerate, args.channels)
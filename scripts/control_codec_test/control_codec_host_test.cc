@@ -0,0 +1,179 @@
+/*
+ * 在主机上验证控制消息的 TLV 编解码，建议用 AddressSanitizer 编译：
+ *   roundtrip:  各种类型和长度的字段编码后解码结果一致，未知标签可以跳过
+ *   leb128:     长度 127 / 128 / 16383 / 16384 的 LEB128 编码字节正确
+ *   overflow:   超过 5 字节（shift > 28）的长度被拒绝
+ *   truncated:  任意截断的消息都不会越界读取，截在字段中间时报错，截在字段边界时少解出字段
+ *
+ * 用法: control_codec_host_test
+ */
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "control_codec.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+    printf("%s %s\n", condition ? "PASS" : "FAIL", what);
+    if (!condition) {
+        failures++;
+    }
+}
+
+struct Field {
+    uint8_t tag;
+    std::string value;
+};
+
+// 复制到刚好大小的堆内存里解码，越界读取会被 AddressSanitizer 发现
+bool Decode(const std::string& data, ControlMessageType& type, std::vector<Field>& fields) {
+    auto buffer = std::make_unique<uint8_t[]>(data.size());
+    memcpy(buffer.get(), data.data(), data.size());
+    ControlDecoder decoder(buffer.get(), data.size());
+    fields.clear();
+    type = decoder.type();
+    uint8_t tag;
+    const char* value;
+    size_t length;
+    while (decoder.Next(tag, value, length)) {
+        fields.push_back(Field{ tag, std::string(value, length) });
+    }
+    return decoder.valid();
+}
+
+void TestRoundTrip() {
+    std::string payload = "{\"jsonrpc\":\"2.0\",\"method\":\"tools/list\",\"id\":1}";
+    std::string binary("\x00\x01\xff\x80", 4);
+    ControlEncoder encoder(kControlTypeMcp);
+    encoder.Add(kControlTagSessionId, "abc").Add(kControlTagPayload, payload).Add(kControlTagText, binary)
+        .Add(kControlTagState, "");
+
+    ControlMessageType type;
+    std::vector<Field> fields;
+    bool valid = Decode(encoder.data(), type, fields);
+    Check(valid && type == kControlTypeMcp && fields.size() == 4, "roundtrip: type and field count");
+    Check(fields.size() == 4 && fields[0].tag == kControlTagSessionId && fields[0].value == "abc" &&
+        fields[1].tag == kControlTagPayload && fields[1].value == payload &&
+        fields[2].value == binary && fields[3].tag == kControlTagState && fields[3].value.empty(),
+        "roundtrip: values kept byte for byte");
+
+    // 未知标签的字段按长度跳过
+    std::string data = encoder.data();
+    data += std::string("\xF0\x03xyz", 5);
+    data += std::string("\x04\x02hi", 4);
+    valid = Decode(data, type, fields);
+    Check(valid && fields.size() == 6 && fields[4].tag == 0xF0 && fields[5].value == "hi", "roundtrip: unknown tag skipped");
+
+    Check(!ControlDecoder::IsControlMessage((const uint8_t*)"\xC7", 1), "roundtrip: one byte is not a message");
+    Check(!ControlDecoder::IsControlMessage((const uint8_t*)"{\"", 2), "roundtrip: JSON is not a message");
+    Check(strcmp(ControlTypeToString((ControlMessageType)200), "unknown") == 0 &&
+        strcmp(ControlTypeToString(kControlTypeAlert), "alert") == 0, "roundtrip: type names");
+}
+
+void TestLeb128() {
+    struct {
+        size_t length;
+        std::string encoded;
+    } cases[] = {
+        { 0, std::string("\x00", 1) },
+        { 127, "\x7F" },
+        { 128, "\x80\x01" },
+        { 16383, "\xFF\x7F" },
+        { 16384, "\x80\x80\x01" },
+        { 2097152, "\x80\x80\x80\x01" },
+    };
+    for (auto& c : cases) {
+        std::string value(c.length, 'v');
+        ControlEncoder encoder(kControlTypeTts);
+        encoder.Add(kControlTagText, value);
+        auto& data = encoder.data();
+        bool encoded = data.size() == 3 + c.encoded.size() + c.length && data.compare(3, c.encoded.size(), c.encoded) == 0;
+
+        ControlMessageType type;
+        std::vector<Field> fields;
+        bool decoded = Decode(data, type, fields) && fields.size() == 1 && fields[0].value == value;
+
+        char what[64];
+        snprintf(what, sizeof(what), "leb128: length %zu", c.length);
+        Check(encoded && decoded, what);
+    }
+
+    // 非最短编码也能解出
+    ControlMessageType type;
+    std::vector<Field> fields;
+    std::string padded = std::string("\xC7\x05\x04\x82\x80\x00", 6) + "ab";
+    Check(Decode(padded, type, fields) && fields.size() == 1 && fields[0].value == "ab", "leb128: padded length accepted");
+}
+
+void TestOverflow() {
+    ControlMessageType type;
+    std::vector<Field> fields;
+    // 5 字节（shift 到 28）是允许的最长编码
+    std::string five = std::string("\xC7\x05\x04\x80\x80\x80\x80\x00", 8);
+    Check(Decode(five, type, fields) && fields.size() == 1 && fields[0].value.empty(), "overflow: five byte length accepted");
+
+    std::string six = std::string("\xC7\x05\x04\x80\x80\x80\x80\x80\x00", 9);
+    Check(!Decode(six, type, fields) && fields.empty(), "overflow: shift past 28 rejected");
+
+    std::string endless = std::string("\xC7\x05\x04", 3) + std::string(64, '\xFF');
+    Check(!Decode(endless, type, fields) && fields.empty(), "overflow: endless continuation rejected");
+
+    // 长度超过剩余数据
+    std::string huge = std::string("\xC7\x05\x04\xFF\xFF\xFF\xFF\x0F", 8) + "abc";
+    Check(!Decode(huge, type, fields) && fields.empty(), "overflow: length beyond the message rejected");
+}
+
+void TestTruncated() {
+    ControlEncoder encoder(kControlTypeStt);
+    encoder.Add(kControlTagSessionId, "session").Add(kControlTagText, std::string(200, 't')).Add(kControlTagEmotion, "happy");
+    const std::string& data = encoder.data();
+    // 每个字段结束的位置
+    std::vector<size_t> boundaries = { 2, 2 + 2 + 7, 2 + 2 + 7 + 3 + 200, data.size() };
+
+    bool all_bounded = true;
+    bool boundary_ok = true;
+    bool inside_rejected = true;
+    for (size_t cut = 0; cut <= data.size(); cut++) {
+        ControlMessageType type;
+        std::vector<Field> fields;
+        bool valid = Decode(data.substr(0, cut), type, fields);
+        size_t complete = 0;
+        while (complete + 1 < boundaries.size() && boundaries[complete + 1] <= cut) {
+            complete++;
+        }
+        if (cut < 2) {
+            all_bounded &= !valid && fields.empty();
+            continue;
+        }
+        all_bounded &= fields.size() <= complete;
+        bool at_boundary = false;
+        for (auto boundary : boundaries) {
+            at_boundary |= boundary == cut;
+        }
+        if (at_boundary) {
+            boundary_ok &= valid && fields.size() == complete;
+        } else {
+            inside_rejected &= !valid && fields.size() == complete;
+        }
+    }
+    Check(all_bounded, "truncated: never more fields than the prefix holds");
+    Check(boundary_ok, "truncated: cut at a field boundary decodes the complete fields");
+    Check(inside_rejected, "truncated: cut inside a field rejected");
+}
+
+}  // namespace
+
+int main() {
+    TestRoundTrip();
+    TestLeb128();
+    TestOverflow();
+    TestTruncated();
+    printf("%s\n", failures == 0 ? "ALL PASSED" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+import asyncio
+import argparse
+import base64
+import hashlib
+import json
+import struct
+import time
+import uuid
+
+
+'''
+  Local stand-in servers for testing endpoint probing and failover.
+
+  Serves an OTA response whose websocket section lists several endpoints, each one broken in a
+  different way, and the healthy one last:
+    refused   nobody listens on the port, the probe and the connect fail at once
+    silent    accepts TCP but never answers the WebSocket upgrade, the connect times out
+    no_hello  completes the upgrade but never sends the server hello
+    healthy   answers the upgrade and the hello, ignores everything else
+
+  Point the device at it (ota_url in the "wifi" settings namespace, or CONFIG_OTA_URL):
+    http://<this host>:<ota port>/xiaozhi/ota/
+  The probe should put the healthy endpoint first. Use --order to list it first instead and
+  --kill-healthy to stop it, then watch the device fail over to the next one.
+
+  Handshake times are all the same on a LAN. To exercise the RTT ordering, slow one port down with
+  netem, e.g. tc qdisc add dev <if> root netem delay 80ms, or mix in a remote --extra-url.
+'''
+
+WS_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+
+def log(name, message):
+    print(f'{time.strftime("%H:%M:%S")} [{name}] {message}', flush=True)
+
+
+async def read_http_request(reader):
+    data = await reader.readuntil(b'\r\n\r\n')
+    lines = data.decode('latin-1').split('\r\n')
+    method, path, _ = lines[0].split(' ', 2)
+    headers = {}
+    for line in lines[1:]:
+        if ':' in line:
+            key, value = line.split(':', 1)
+            headers[key.strip().lower()] = value.strip()
+    return method, path, headers
+
+
+async def read_ws_frame(reader):
+    '''Returns (opcode, payload) of one client frame, client frames are always masked'''
+    b0, b1 = await reader.readexactly(2)
+    opcode = b0 & 0x0F
+    length = b1 & 0x7F
+    if length == 126:
+        length, = struct.unpack('>H', await reader.readexactly(2))
+    elif length == 127:
+        length, = struct.unpack('>Q', await reader.readexactly(8))
+    mask = await reader.readexactly(4) if b1 & 0x80 else b'\0\0\0\0'
+    payload = bytearray(await reader.readexactly(length))
+    for i in range(length):
+        payload[i] ^= mask[i % 4]
+    return opcode, bytes(payload)
+
+
+def ws_frame(opcode, payload):
+    header = bytes([0x80 | opcode])
+    if len(payload) < 126:
+        header += bytes([len(payload)])
+    elif len(payload) < 65536:
+        header += bytes([126]) + struct.pack('>H', len(payload))
+    else:
+        header += bytes([127]) + struct.pack('>Q', len(payload))
+    return header + payload
+
+
+def make_ws_handler(name, mode):
+    async def handle(reader, writer):
+        peer = writer.get_extra_info('peername')
+        log(name, f'connection from {peer[0]}:{peer[1]}')
+        try:
+            if mode == 'silent':
+                await reader.read()
+                return
+
+            _, path, headers = await read_http_request(reader)
+            accept = base64.b64encode(hashlib.sha1((headers.get('sec-websocket-key', '') + WS_GUID).encode()).digest())
+            writer.write(b'HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n'
+                         b'Sec-WebSocket-Accept: ' + accept + b'\r\n\r\n')
+            await writer.drain()
+            log(name, f'upgraded {path}, protocol version {headers.get("protocol-version")}')
+
+            while True:
+                opcode, payload = await read_ws_frame(reader)
+                if opcode == 0x8:
+                    writer.write(ws_frame(0x8, payload[:2]))
+                    break
+                if opcode == 0x9:
+                    writer.write(ws_frame(0xA, payload))
+                elif opcode == 0x1:
+                    message = json.loads(payload)
+                    log(name, f'<< {message.get("type")}')
+                    if message.get('type') == 'hello' and mode == 'healthy':
+                        hello = {
+                            'type': 'hello',
+                            'transport': 'websocket',
+                            'session_id': str(uuid.uuid4()),
+                            'audio_params': {'format': 'opus', 'sample_rate': 24000, 'channels': 1, 'frame_duration': 60},
+                        }
+                        writer.write(ws_frame(0x1, json.dumps(hello).encode()))
+                await writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            log(name, 'closed')
+            writer.close()
+    return handle
+
+
+def make_ota_handler(urls):
+    async def handle(reader, writer):
+        try:
+            method, path, headers = await read_http_request(reader)
+            length = int(headers.get('content-length', 0))
+            if length:
+                await reader.readexactly(length)
+            body = json.dumps({
+                'server_time': {'timestamp': int(time.time() * 1000), 'timezone_offset': 0},
+                'firmware': {'version': '0.0.0', 'url': ''},
+                'websocket': {'url': urls[0], 'urls': urls, 'token': 'test-token', 'version': 1},
+            }).encode()
+            writer.write(b'HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: '
+                         + str(len(body)).encode() + b'\r\nConnection: close\r\n\r\n' + body)
+            await writer.drain()
+            log('ota', f'{method} {path} from {headers.get("device-id")}, sent {len(urls)} endpoints')
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            writer.close()
+    return handle
+
+
+async def main():
+    parser = argparse.ArgumentParser(description='Stand-in OTA and WebSocket servers for endpoint failover tests')
+    parser.add_argument('--host', required=True, help='address of this machine as seen by the device')
+    parser.add_argument('--ota-port', type=int, default=8002)
+    parser.add_argument('--base-port', type=int, default=8100, help='endpoints use base-port .. base-port+3')
+    parser.add_argument('--order', choices=['healthy-last', 'healthy-first'], default='healthy-last')
+    parser.add_argument('--kill-healthy', type=float, default=0, help='stop the healthy endpoint after N seconds')
+    parser.add_argument('--extra-url', action='append', default=[], help='add another endpoint, e.g. a remote server')
+    args = parser.parse_args()
+
+    endpoints = {
+        'refused': args.base_port,
+        'silent': args.base_port + 1,
+        'no_hello': args.base_port + 2,
+        'healthy': args.base_port + 3,
+    }
+    servers = {}
+    for mode, port in endpoints.items():
+        if mode == 'refused':
+            continue
+        servers[mode] = await asyncio.start_server(make_ws_handler(f'{mode}:{port}', mode), '0.0.0.0', port)
+
+    urls = [f'ws://{args.host}:{port}/xiaozhi/v1/' for port in endpoints.values()]
+    if args.order == 'healthy-first':
+        urls.insert(0, urls.pop())
+    urls += args.extra_url
+    ota = await asyncio.start_server(make_ota_handler(urls), '0.0.0.0', args.ota_port)
+
+    log('ota', f'http://{args.host}:{args.ota_port}/xiaozhi/ota/')
+    for url in urls:
+        log('ota', f'  {url}')
+
+    if args.kill_healthy > 0:
+        await asyncio.sleep(args.kill_healthy)
+        servers['healthy'].close()
+        log('healthy', 'stopped, new connections are refused')
+
+    await ota.serve_forever()
+
+
+if __name__ == '__main__':
+    asyncio.run(main())
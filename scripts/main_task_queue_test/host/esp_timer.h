@@ -0,0 +1,91 @@
+// 主机编译用的 esp_timer.h 替身，每个定时器一个线程，只支持 main_task_queue 用到的单次定时
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_INVALID_STATE 0x103
+
+inline int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+enum { ESP_TIMER_TASK };
+
+struct esp_timer_create_args_t {
+    void (*callback)(void* arg);
+    void* arg;
+    int dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+};
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    std::mutex mutex;
+    std::condition_variable cv;
+    int64_t deadline = -1;
+    bool quit = false;
+    std::thread thread;
+};
+typedef esp_timer* esp_timer_handle_t;
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    auto timer = new esp_timer;
+    timer->args = *args;
+    timer->thread = std::thread([timer]() {
+        std::unique_lock<std::mutex> lock(timer->mutex);
+        while (!timer->quit) {
+            if (timer->deadline < 0) {
+                timer->cv.wait(lock);
+                continue;
+            }
+            int64_t now = esp_timer_get_time();
+            if (now >= timer->deadline) {
+                timer->deadline = -1;
+                lock.unlock();
+                timer->args.callback(timer->args.arg);
+                lock.lock();
+            } else {
+                timer->cv.wait_for(lock, std::chrono::microseconds(timer->deadline - now));
+            }
+        }
+    });
+    *handle = timer;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->deadline >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline = esp_timer_get_time() + timeout_us;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->deadline < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline = -1;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->quit = true;
+        timer->cv.notify_all();
+    }
+    timer->thread.join();
+    delete timer;
+    return ESP_OK;
+}
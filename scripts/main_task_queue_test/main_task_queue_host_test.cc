@@ -0,0 +1,173 @@
+/*
+ * 在主机上驱动 MainTaskQueue，建议用 ThreadSanitizer 编译：
+ *   concurrent:  多个生产者同时往三个通道投递，每个生产者在每个通道内的顺序不变，任务不重复执行，
+ *                执行数加丢弃数等于投递数
+ *   overflow:    非音频通道在环和溢出列表都满后丢弃任务，Push() 返回 false 并计数
+ *   audio:       音频控制通道从不丢弃，溢出列表按需扩容，顺序不变
+ *   timing:      长任务和主循环自身的长时间工作被记录，看门狗在任务阻塞时反复报告
+ *
+ * 用法: main_task_queue_host_test
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "main_task_queue.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+    printf("%s %s\n", condition ? "PASS" : "FAIL", what);
+    if (!condition) {
+        failures++;
+    }
+}
+
+void TestConcurrent() {
+    MainTaskQueue queue;
+    const int kProducers = 6;
+    const int kTasks = 20000;
+    // 只在主循环（本线程）里读写
+    std::vector<int> last(kProducers * kTaskLaneCount, -1);
+    int in_order = 0;
+    int out_of_order = 0;
+    std::atomic<int> pushed{0};
+    std::atomic<int> running{kProducers};
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; p++) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < kTasks; i++) {
+                auto lane = (MainTaskLane)(i % kTaskLaneCount);
+                int key = p * kTaskLaneCount + lane;
+                auto run = [&, key, i]() {
+                    if (last[key] < i) {
+                        last[key] = i;
+                        in_order++;
+                    } else {
+                        out_of_order++;
+                    }
+                };
+                bool queued;
+                if (i % 97 == 0) {
+                    // 超出内联存储，走堆分配
+                    char padding[200] = {0};
+                    queued = queue.Push(MainTask([run, padding]() mutable { (void)padding; run(); }), lane, "big");
+                } else {
+                    queued = queue.Push(MainTask(run), lane, "small");
+                }
+                if (queued) {
+                    pushed++;
+                }
+            }
+            running--;
+        });
+    }
+    size_t executed = 0;
+    while (true) {
+        bool done = running == 0;
+        size_t count = queue.RunPending();
+        executed += count;
+        if (done && count == 0) {
+            break;
+        }
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    executed += queue.RunPending();
+
+    uint32_t dropped = 0;
+    uint32_t heap_tasks = 0;
+    for (int lane = 0; lane < kTaskLaneCount; lane++) {
+        auto stats = queue.GetStats((MainTaskLane)lane);
+        dropped += stats.dropped;
+        heap_tasks += stats.heap_tasks;
+    }
+    Check(out_of_order == 0, "concurrent: each producer's tasks run in order");
+    Check((int)executed == pushed && in_order == pushed, "concurrent: every queued task runs once");
+    Check(pushed + (int)dropped == kProducers * kTasks, "concurrent: queued plus dropped equals pushed");
+    Check(queue.GetStats(kTaskLaneAudioControl).dropped == 0, "concurrent: no audio control task dropped");
+    Check(heap_tasks >= (uint32_t)(kProducers * ((kTasks + 96) / 97)), "concurrent: large captures counted on the heap");
+}
+
+void TestOverflow() {
+    MainTaskQueue queue;
+    int ran = 0;
+    int refused = 0;
+    const int kTasks = MAIN_TASK_TELEMETRY_QUEUE_SIZE + MAIN_TASK_OVERFLOW_SIZE + 20;
+    for (int i = 0; i < kTasks; i++) {
+        if (!queue.Push(MainTask([&ran]() { ran++; }), kTaskLaneTelemetry, "telemetry")) {
+            refused++;
+        }
+    }
+    auto stats = queue.GetStats(kTaskLaneTelemetry);
+    Check(refused == 20 && stats.dropped == 20, "overflow: tasks beyond the list are refused and counted");
+    Check(stats.overflowed == MAIN_TASK_OVERFLOW_SIZE, "overflow: the list takes its fixed size");
+    Check(stats.depth == MAIN_TASK_TELEMETRY_QUEUE_SIZE, "overflow: depth reads the ring");
+    while (queue.RunPending() > 0) {
+    }
+    Check(ran == kTasks - 20, "overflow: every accepted task runs");
+    Check(queue.Push(MainTask([&ran]() { ran++; }), kTaskLaneTelemetry, "telemetry"), "overflow: accepts again once drained");
+    queue.RunPending();
+}
+
+void TestAudioControl() {
+    MainTaskQueue queue;
+    const int kTasks = 500;
+    std::vector<int> order;
+    bool all_queued = true;
+    for (int i = 0; i < kTasks; i++) {
+        all_queued &= queue.Push(MainTask([&order, i]() { order.push_back(i); }), kTaskLaneAudioControl, "audio");
+    }
+    while (queue.RunPending() > 0) {
+    }
+    bool in_order = (int)order.size() == kTasks;
+    for (int i = 0; in_order && i < kTasks; i++) {
+        in_order = order[i] == i;
+    }
+    Check(all_queued && queue.GetStats(kTaskLaneAudioControl).dropped == 0, "audio: never dropped");
+    Check(in_order, "audio: grown overflow keeps the order");
+}
+
+void TestTiming() {
+    MainTaskQueue queue;
+    queue.Push(MainTask([]() { std::this_thread::sleep_for(std::chrono::milliseconds(MAIN_TASK_WATCHDOG_MS * 2 + 500)); }),
+        kTaskLaneUi, "slow_task");
+    queue.Push(MainTask([]() { std::this_thread::sleep_for(std::chrono::milliseconds(MAIN_TASK_LONG_TASK_MS + 50)); }),
+        kTaskLaneAudioControl, "medium_task");
+    for (int i = 0; i < 5; i++) {
+        queue.Push(MainTask([]() {}), kTaskLaneTelemetry, "fast_task");
+    }
+    queue.RunPending();
+    queue.Measure("loop_fast", []() {});
+    queue.Measure("loop_slow", []() { std::this_thread::sleep_for(std::chrono::milliseconds(MAIN_TASK_LONG_TASK_MS + 20)); });
+
+    auto timings = queue.GetRecentTimings();
+    Check(timings.size() == 8 && strcmp(timings[0].name, "loop_slow") == 0 && timings[0].lane == -1,
+        "timing: newest first, only long loop work kept");
+    // 音频控制通道先执行
+    Check(strcmp(timings[7].name, "medium_task") == 0 && strcmp(timings[6].name, "slow_task") == 0,
+        "timing: audio control runs first");
+    Check(queue.watchdog_count() >= 2, "timing: watchdog repeats while a task blocks");
+    Check(queue.long_work_count() == 1, "timing: long loop work counted");
+    Check(queue.GetStats(kTaskLaneUi).long_tasks == 1 && queue.GetStats(kTaskLaneAudioControl).long_tasks == 1,
+        "timing: long tasks counted per lane");
+}
+
+}  // namespace
+
+int main() {
+    TestConcurrent();
+    TestOverflow();
+    TestAudioControl();
+    TestTiming();
+    printf("%s\n", failures == 0 ? "ALL PASSED" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
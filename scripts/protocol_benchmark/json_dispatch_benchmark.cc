@@ -0,0 +1,226 @@
+/*
+ * 对比服务器下行消息的两种分发方式：
+ *   cjson:  整条消息 cJSON_Parse 成树，再按字段查找（旧的 OnIncomingJson 路径）
+ *   reader: IncomingMessage::FromJson 原地读取路由字段，只有 MCP 的 payload 才交给 cJSON 解析
+ * 两条路径都复制了 Application 里实际会复制的字符串，结果可以直接比较。
+ *
+ * 用法: json_dispatch_benchmark [trace.jsonl] [iterations]
+ */
+#include <cJSON.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "incoming_message.h"
+
+namespace {
+
+struct HeapCounter {
+    size_t current = 0;
+    size_t peak = 0;
+    size_t allocations = 0;
+
+    void Reset() {
+        current = 0;
+        peak = 0;
+        allocations = 0;
+    }
+};
+
+HeapCounter heap;
+bool counting = false;
+
+// 在每块内存前记录大小，释放时才能减掉
+void* CountedMalloc(size_t size) {
+    auto block = (size_t*)std::malloc(size + sizeof(size_t) * 2);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    block[0] = size;
+    if (counting) {
+        heap.allocations++;
+        heap.current += size;
+        if (heap.current > heap.peak) {
+            heap.peak = heap.current;
+        }
+    }
+    return block + 2;
+}
+
+void CountedFree(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto block = (size_t*)ptr - 2;
+    if (counting && heap.current >= block[0]) {
+        heap.current -= block[0];
+    }
+    std::free(block);
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    void* ptr = CountedMalloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+
+namespace {
+
+// 模拟 Application 的处理：取出会被 Schedule 带走的字段
+size_t DispatchWithCjson(const std::string& frame) {
+    size_t copied = 0;
+    cJSON* root = cJSON_ParseWithLength(frame.data(), frame.size());
+    if (root == nullptr) {
+        return 0;
+    }
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type)) {
+        auto state = cJSON_GetObjectItem(root, "state");
+        auto text = cJSON_GetObjectItem(root, "text");
+        auto emotion = cJSON_GetObjectItem(root, "emotion");
+        if (strcmp(type->valuestring, "tts") == 0 && cJSON_IsString(state) &&
+            strcmp(state->valuestring, "sentence_start") == 0 && cJSON_IsString(text)) {
+            std::string message(text->valuestring);
+            copied += message.size();
+        } else if (strcmp(type->valuestring, "stt") == 0 && cJSON_IsString(text)) {
+            std::string message(text->valuestring);
+            copied += message.size();
+        } else if (strcmp(type->valuestring, "llm") == 0 && cJSON_IsString(emotion)) {
+            std::string message(emotion->valuestring);
+            copied += message.size();
+        } else if (strcmp(type->valuestring, "mcp") == 0) {
+            // McpServer::ParseMessage(const cJSON*) 直接使用这棵树
+            auto payload = cJSON_GetObjectItem(root, "payload");
+            auto method = cJSON_GetObjectItem(payload, "method");
+            if (cJSON_IsString(method)) {
+                copied += strlen(method->valuestring);
+            }
+        }
+    }
+    cJSON_Delete(root);
+    return copied;
+}
+
+size_t DispatchWithReader(const std::string& frame) {
+    size_t copied = 0;
+    IncomingMessage message;
+    if (!IncomingMessage::FromJson(frame.data(), frame.size(), message)) {
+        return 0;
+    }
+    auto& type = message.type;
+    if (type.Equals("tts") && message.state.Equals("sentence_start") && message.text.is_string()) {
+        copied += message.text.str().size();
+    } else if (type.Equals("stt") && message.text.is_string()) {
+        copied += message.text.str().size();
+    } else if (type.Equals("llm") && message.emotion.is_string()) {
+        copied += message.emotion.str().size();
+    } else if (type.Equals("mcp") && message.payload.is_object()) {
+        // McpServer::ParseMessage(const std::string&) 只解析 payload
+        std::string payload(message.payload.raw);
+        cJSON* root = cJSON_ParseWithLength(payload.data(), payload.size());
+        auto method = cJSON_GetObjectItem(root, "method");
+        if (cJSON_IsString(method)) {
+            copied += strlen(method->valuestring);
+        }
+        cJSON_Delete(root);
+    }
+    return copied;
+}
+
+struct Result {
+    double ns_per_message;
+    double allocations_per_message;
+    size_t peak_heap;
+    size_t checksum;
+};
+
+template <typename Dispatch>
+Result Run(const std::vector<std::string>& frames, int iterations, Dispatch dispatch) {
+    Result result = {};
+
+    // 单独跑一遍统计内存，避免计数开销混进耗时
+    heap.Reset();
+    counting = true;
+    for (auto& frame : frames) {
+        size_t before = heap.current;
+        heap.peak = before;
+        result.checksum += dispatch(frame);
+        if (heap.peak - before > result.peak_heap) {
+            result.peak_heap = heap.peak - before;
+        }
+    }
+    counting = false;
+    result.allocations_per_message = (double)heap.allocations / frames.size();
+
+    auto start = std::chrono::steady_clock::now();
+    size_t sink = 0;
+    for (int i = 0; i < iterations; i++) {
+        for (auto& frame : frames) {
+            sink += dispatch(frame);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    result.ns_per_message = std::chrono::duration<double, std::nano>(elapsed).count() / (iterations * frames.size());
+    if (sink != result.checksum * iterations) {
+        fprintf(stderr, "Checksum mismatch\n");
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* trace_path = argc > 1 ? argv[1] : "server_messages.jsonl";
+    int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+
+    std::ifstream trace(trace_path);
+    if (!trace) {
+        fprintf(stderr, "Cannot open %s\n", trace_path);
+        return 1;
+    }
+    std::vector<std::string> frames;
+    std::string line;
+    while (std::getline(trace, line)) {
+        if (!line.empty()) {
+            frames.push_back(line);
+        }
+    }
+    if (frames.empty() || iterations <= 0) {
+        fprintf(stderr, "Nothing to run\n");
+        return 1;
+    }
+
+    cJSON_Hooks hooks = { CountedMalloc, CountedFree };
+    cJSON_InitHooks(&hooks);
+
+    auto cjson = Run(frames, iterations, DispatchWithCjson);
+    auto reader = Run(frames, iterations, DispatchWithReader);
+    if (cjson.checksum != reader.checksum) {
+        fprintf(stderr, "The two paths disagree: %zu vs %zu\n", cjson.checksum, reader.checksum);
+        return 1;
+    }
+
+    printf("%zu messages x %d iterations from %s\n", frames.size(), iterations, trace_path);
+    printf("%-8s %12s %14s %14s\n", "path", "ns/msg", "allocs/msg", "peak heap (B)");
+    printf("%-8s %12.0f %14.2f %14zu\n", "cjson", cjson.ns_per_message, cjson.allocations_per_message, cjson.peak_heap);
+    printf("%-8s %12.0f %14.2f %14zu\n", "reader", reader.ns_per_message, reader.allocations_per_message, reader.peak_heap);
+    return 0;
+}
@@ -0,0 +1,319 @@
+/*
+ * 对比直播间事件消息的两种处理方式，输入是直播间消息序列（每行一条 WebSocket 文本消息，单个事件或事件数组）：
+ *   per-item: 整条消息 cJSON 建树，逐个元素用 cJSON_GetObjectItem 查字段，每个识别出的事件单独 Schedule 一个任务
+ *             （原来 HandleDouyinLikeMessage 的做法）
+ *   batch:    LiveEventParser 原地读取整条消息，方法名查哈希表，合并进场消息后一次性放进 LiveEventQueue，
+ *             每条消息最多 Schedule 一个任务
+ *   filtered: 同 batch，再加上 LiveEventFilter 的去重和限速
+ * 两条路径都会把排队的任务在“主循环”里执行掉，耗时包括这部分。
+ *
+ * 用法: live_event_benchmark [trace.jsonl] [iterations]
+ */
+#include <cJSON.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "live_event_parser.h"
+
+namespace {
+
+struct HeapCounter {
+    size_t current = 0;
+    size_t peak = 0;
+    size_t allocations = 0;
+
+    void Reset() {
+        current = 0;
+        peak = 0;
+        allocations = 0;
+    }
+};
+
+HeapCounter heap;
+bool counting = false;
+
+// 在每块内存前记录大小，释放时才能减掉
+void* CountedMalloc(size_t size) {
+    auto block = (size_t*)std::malloc(size + sizeof(size_t) * 2);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    block[0] = size;
+    if (counting) {
+        heap.allocations++;
+        heap.current += size;
+        if (heap.current > heap.peak) {
+            heap.peak = heap.current;
+        }
+    }
+    return block + 2;
+}
+
+void CountedFree(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto block = (size_t*)ptr - 2;
+    if (counting && heap.current >= block[0]) {
+        heap.current -= block[0];
+    }
+    std::free(block);
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    void* ptr = CountedMalloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+
+namespace {
+
+// Application::Schedule 的替身：加锁放进 deque，之后由 RunMainLoop 执行
+std::mutex mutex;
+std::deque<std::function<void()>> main_tasks;
+size_t scheduled = 0;
+size_t shown = 0;
+
+void Schedule(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    main_tasks.push_back(std::move(callback));
+    scheduled++;
+}
+
+void RunMainLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (main_tasks.empty()) {
+                return;
+            }
+            task = std::move(main_tasks.front());
+            main_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+// WakeWordInvoke / SetChatMessage 的替身
+void Show(const std::string& text) {
+    shown += text.size();
+}
+
+std::string UserName(cJSON* obj) {
+    auto user = cJSON_GetObjectItem(obj, "user");
+    if (cJSON_IsObject(user)) {
+        auto uname = cJSON_GetObjectItem(user, "name");
+        if (uname && cJSON_IsString(uname)) return uname->valuestring;
+    }
+    return "unknown";
+}
+
+// 原来的逐条处理
+void HandleItem(cJSON* obj) {
+    auto roomId_item = cJSON_GetObjectItem(obj, "roomId");
+    auto nickname_item = cJSON_GetObjectItem(obj, "nickname");
+    auto title_item = cJSON_GetObjectItem(obj, "title");
+    if (cJSON_IsString(roomId_item) && cJSON_IsString(nickname_item)) {
+        std::string nickname = nickname_item->valuestring;
+        std::string msg = cJSON_IsString(title_item) ? "进入" + nickname + "的直播间" : nickname;
+        Schedule([msg = std::move(msg)]() { Show(msg); });
+        return;
+    }
+
+    auto method = cJSON_GetObjectItem(obj, "method");
+    auto jsonrpc = cJSON_GetObjectItem(obj, "jsonrpc");
+    if (!cJSON_IsString(method) || (cJSON_IsString(jsonrpc) && strcmp(jsonrpc->valuestring, "2.0") == 0)) {
+        return;
+    }
+    const char* m = method->valuestring;
+    if (strcmp(m, "WebcastMemberMessage") == 0 || strcmp(m, "WebcastChatMessage") == 0) {
+        auto content = cJSON_GetObjectItem(obj, "content");
+        std::string name = UserName(obj);
+        std::string text = cJSON_IsString(content) ? content->valuestring : std::string();
+        Schedule([name = std::move(name), text = std::move(text)]() { Show(name + ": " + text); });
+    } else if (strcmp(m, "WebcastGiftMessage") == 0) {
+        auto gift = cJSON_GetObjectItem(obj, "gift");
+        auto gift_name = cJSON_IsObject(gift) ? cJSON_GetObjectItem(gift, "name") : nullptr;
+        std::string text = UserName(obj) + " 送出了 " + (cJSON_IsString(gift_name) ? gift_name->valuestring : "礼物");
+        Schedule([text = std::move(text)]() { Show(text); });
+    } else if (strcmp(m, "WebcastRoomStatsMessage") == 0) {
+        auto room = cJSON_GetObjectItem(obj, "room");
+        auto ac = cJSON_IsObject(room) ? cJSON_GetObjectItem(room, "audienceCount") : nullptr;
+        if (cJSON_IsString(ac)) {
+            Schedule([acs = std::string(ac->valuestring)]() { Show("直播间观众人数: " + acs); });
+        }
+    } else if (strcmp(m, "WebcastRoomUserSeqMessage") == 0) {
+        auto rank = cJSON_GetObjectItem(obj, "rank");
+        std::string preview;
+        cJSON* r = nullptr;
+        int i = 0;
+        cJSON_ArrayForEach(r, rank) {
+            if (i++ >= 3) break;
+            auto nick = cJSON_GetObjectItem(r, "nickname");
+            if (cJSON_IsString(nick)) {
+                if (!preview.empty()) preview += ", ";
+                preview += nick->valuestring;
+            }
+        }
+        if (!preview.empty()) {
+            Schedule([preview]() { Show("直播间前三位观众: " + preview); });
+        }
+    }
+}
+
+void ProcessPerItem(const std::string& frame) {
+    cJSON* root = cJSON_ParseWithLength(frame.data(), frame.size());
+    if (root == nullptr) {
+        return;
+    }
+    if (cJSON_IsArray(root)) {
+        cJSON* item = nullptr;
+        cJSON_ArrayForEach(item, root) {
+            HandleItem(item);
+        }
+    } else {
+        HandleItem(root);
+    }
+    cJSON_Delete(root);
+    RunMainLoop();
+}
+
+LiveEventQueue live_events;
+
+// Application::HandleLiveEvents 的替身，这里每次都把 LLM 事件取完，不按间隔等待
+void HandleLiveEvents() {
+    live_events.BeginDrain();
+    LiveEvent event;
+    std::string display_text;
+    while (live_events.PopDisplayOnly(event)) {
+        display_text = std::move(event.text);
+    }
+    while (live_events.PopForLlm(event, 0)) {
+        Show(event.prompt);
+        display_text = std::move(event.text);
+    }
+    Show(display_text);
+}
+
+void ProcessBatch(const std::string& frame, LiveEventFilter* filter) {
+    std::vector<LiveEvent> events;
+    // 重复跑同一份消息时过滤器会把它们都当成重发，时间每条推进 1 秒让限速桶回满一部分
+    static int64_t now_us = 0;
+    now_us += 1000000;
+    LiveEventParser::Parse(frame.data(), frame.size(), now_us, events, filter);
+    if (!events.empty() && live_events.Push(std::move(events))) {
+        Schedule([]() { HandleLiveEvents(); });
+    }
+    RunMainLoop();
+}
+
+struct Result {
+    double ns_per_message;
+    double allocations_per_message;
+    double tasks_per_message;
+    size_t peak_heap;
+};
+
+template <typename Process>
+Result Run(const std::vector<std::string>& frames, int iterations, Process process) {
+    Result result = {};
+
+    // 单独跑一遍统计内存和任务数，避免计数开销混进耗时
+    heap.Reset();
+    scheduled = 0;
+    counting = true;
+    for (auto& frame : frames) {
+        size_t before = heap.current;
+        heap.peak = before;
+        process(frame);
+        if (heap.peak - before > result.peak_heap) {
+            result.peak_heap = heap.peak - before;
+        }
+    }
+    counting = false;
+    result.allocations_per_message = (double)heap.allocations / frames.size();
+    result.tasks_per_message = (double)scheduled / frames.size();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        for (auto& frame : frames) {
+            process(frame);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    result.ns_per_message = std::chrono::duration<double, std::nano>(elapsed).count() / (iterations * frames.size());
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* trace_path = argc > 1 ? argv[1] : "live_room_trace.jsonl";
+    int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+    std::ifstream trace(trace_path);
+    if (!trace) {
+        fprintf(stderr, "Cannot open %s\n", trace_path);
+        return 1;
+    }
+    std::vector<std::string> frames;
+    std::string line;
+    size_t items = 0;
+    while (std::getline(trace, line)) {
+        if (!line.empty()) {
+            frames.push_back(line);
+            std::vector<LiveEvent> events;
+            items += LiveEventParser::Parse(line.data(), line.size(), 0, events).items;
+        }
+    }
+    if (frames.empty() || iterations <= 0) {
+        fprintf(stderr, "Nothing to run\n");
+        return 1;
+    }
+
+    cJSON_Hooks hooks = { CountedMalloc, CountedFree };
+    cJSON_InitHooks(&hooks);
+
+    auto per_item = Run(frames, iterations, ProcessPerItem);
+    auto batch = Run(frames, iterations, [](const std::string& frame) { ProcessBatch(frame, nullptr); });
+    LiveEventFilter filter;
+    auto filtered = Run(frames, iterations, [&filter](const std::string& frame) { ProcessBatch(frame, &filter); });
+    auto stats = live_events.GetStats();
+    auto filter_stats = filter.GetStats();
+
+    printf("%zu messages (%zu items) x %d iterations from %s\n", frames.size(), items, iterations, trace_path);
+    printf("%-9s %12s %14s %14s %14s\n", "path", "ns/msg", "allocs/msg", "tasks/msg", "peak heap (B)");
+    printf("%-9s %12.0f %14.2f %14.2f %14zu\n", "per-item", per_item.ns_per_message, per_item.allocations_per_message,
+        per_item.tasks_per_message, per_item.peak_heap);
+    printf("%-9s %12.0f %14.2f %14.2f %14zu\n", "batch", batch.ns_per_message, batch.allocations_per_message,
+        batch.tasks_per_message, batch.peak_heap);
+    printf("%-9s %12.0f %14.2f %14.2f %14zu\n", "filtered", filtered.ns_per_message, filtered.allocations_per_message,
+        filtered.tasks_per_message, filtered.peak_heap);
+    printf("batch queue: received %u, coalesced %u, dropped %u\n", stats.received, stats.coalesced, stats.dropped);
+    printf("filter: duplicates %u, bloom unconfirmed %u, user limited %u, global limited %u\n",
+        filter_stats.duplicates, filter_stats.bloom_unconfirmed, filter_stats.user_limited, filter_stats.global_limited);
+    return 0;
+}
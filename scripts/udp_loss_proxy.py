@@ -0,0 +1,199 @@
+import asyncio
+import argparse
+import random
+import struct
+import time
+
+
+'''
+  Lossy stand-in for the UDP audio server of the MQTT+UDP protocol (docs/mqtt-udp.md).
+
+  Sits between the device and the real UDP server and damages the audio in both directions:
+  random and burst loss, reordering, duplication and delay jitter. Make the server advertise this
+  proxy in the hello (udp.server / udp.port) and pass the real server with --server.
+
+  Packets stay encrypted, only the plain header is read:
+    |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|payload|
+  With --nack the proxy also plays the server side of NACK retransmission (type 0x02):
+    - NACKs from the device are answered from the last downlink packets, not forwarded
+    - uplink packets the proxy drops are NACKed to the device, the retransmissions are forwarded
+  NACK sequence lists are encrypted with the session key, so --nack needs --key (udp.key of the
+  server hello) and the cryptography package.
+  Redundancy (flags 0x01) needs the real server, the proxy only passes those packets through.
+
+  Compare the proxy's counters with the device's self.network.get_audio_channel_stats tool.
+'''
+
+TYPE_AUDIO = 0x01
+TYPE_NACK = 0x02
+HEADER = struct.Struct('>BBHIII')
+HISTORY = 256
+REPORT_INTERVAL = 5.0
+
+
+class Impairment:
+    def __init__(self, name, loss, burst, reorder, dup, delay, jitter):
+        self.name = name
+        self.loss = loss
+        self.burst = burst
+        self.reorder = reorder
+        self.dup = dup
+        self.delay = delay
+        self.jitter = jitter
+        self.burst_left = 0
+        self.counters = dict(forwarded=0, dropped=0, reordered=0, duplicated=0)
+
+    def plan(self):
+        '''Returns the delays (seconds) to send one packet with, empty to drop it'''
+        if self.burst_left > 0:
+            self.burst_left -= 1
+            self.counters['dropped'] += 1
+            return []
+        if random.random() < self.loss:
+            self.burst_left = max(0, self.burst - 1)
+            self.counters['dropped'] += 1
+            return []
+        delay = self.delay + random.uniform(0, self.jitter)
+        if random.random() < self.reorder:
+            # Hold it back long enough for the next frame to overtake it
+            delay += 0.08
+            self.counters['reordered'] += 1
+        delays = [delay]
+        if random.random() < self.dup:
+            delays.append(delay + 0.01)
+            self.counters['duplicated'] += 1
+        self.counters['forwarded'] += 1
+        return delays
+
+    def report(self):
+        return f'{self.name}: ' + ', '.join(f'{k} {v}' for k, v in self.counters.items())
+
+
+class LossyProxy:
+    def __init__(self, args):
+        self.args = args
+        self.server = (args.server_host, args.server_port)
+        self.device = None
+        self.device_transport = None
+        self.server_transport = None
+        self.down = Impairment('downlink', args.loss, args.burst, args.reorder, args.dup, args.delay / 1000, args.jitter / 1000)
+        self.up = Impairment('uplink', args.up_loss, args.burst, args.reorder, args.dup, args.delay / 1000, args.jitter / 1000)
+        self.down_history = {}
+        self.up_ssrc = 0
+        self.key = bytes.fromhex(args.key) if args.key else None
+        self.nack_id = 0
+        self.nack_counters = dict(nacks_from_device=0, retransmitted=0, missing=0, nacks_to_device=0)
+
+    def send_later(self, transport, data, addr, delays):
+        loop = asyncio.get_running_loop()
+        for delay in delays:
+            loop.call_later(delay, transport.sendto, data, addr)
+
+    def crypt(self, header, data):
+        '''AES-CTR with the 16 byte header as nonce, the same call encrypts and decrypts'''
+        from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+        cipher = Cipher(algorithms.AES(self.key), modes.CTR(header))
+        return cipher.encryptor().update(data)
+
+    def from_device(self, data, addr):
+        if self.device != addr:
+            print(f'device at {addr[0]}:{addr[1]}', flush=True)
+            self.device = addr
+        if len(data) < HEADER.size:
+            return
+        packet_type, _, count, ssrc, _, sequence = HEADER.unpack_from(data)
+
+        if packet_type == TYPE_NACK and self.args.nack:
+            self.nack_counters['nacks_from_device'] += 1
+            sequences = self.crypt(data[:HEADER.size], data[HEADER.size:HEADER.size + count * 4])
+            for i in range(count):
+                wanted, = struct.unpack_from('>I', sequences, i * 4)
+                packet = self.down_history.get(wanted)
+                if packet is None:
+                    self.nack_counters['missing'] += 1
+                    continue
+                self.nack_counters['retransmitted'] += 1
+                self.send_later(self.device_transport, packet, self.device, [self.args.delay / 1000])
+            return
+
+        delays = self.up.plan() if packet_type == TYPE_AUDIO else [0]
+        if not delays and packet_type == TYPE_AUDIO and self.args.nack:
+            # Ask the device for the packet we just threw away, the retransmission passes untouched
+            self.up_ssrc = ssrc
+            self.nack_id += 1
+            header = HEADER.pack(TYPE_NACK, 0, 1, ssrc, self.nack_id, 0)
+            nack = header + self.crypt(header, struct.pack('>I', sequence))
+            self.nack_counters['nacks_to_device'] += 1
+            asyncio.get_running_loop().call_later(0.02, self.device_transport.sendto, nack, self.device)
+            return
+        self.send_later(self.server_transport, data, self.server, delays)
+
+    def from_server(self, data):
+        if self.device is None or len(data) < HEADER.size:
+            return
+        packet_type, _, _, _, _, sequence = HEADER.unpack_from(data)
+        if packet_type == TYPE_AUDIO:
+            self.down_history[sequence] = data
+            if len(self.down_history) > HISTORY:
+                del self.down_history[min(self.down_history)]
+            delays = self.down.plan()
+        else:
+            delays = [0]
+        self.send_later(self.device_transport, data, self.device, delays)
+
+    async def report(self):
+        while True:
+            await asyncio.sleep(REPORT_INTERVAL)
+            print(time.strftime('%H:%M:%S'), self.down.report(), '|', self.up.report(), flush=True)
+            if self.args.nack:
+                print('  nack:', ', '.join(f'{k} {v}' for k, v in self.nack_counters.items()), flush=True)
+
+
+class DeviceSide(asyncio.DatagramProtocol):
+    def __init__(self, proxy):
+        self.proxy = proxy
+
+    def datagram_received(self, data, addr):
+        self.proxy.from_device(data, addr)
+
+
+class ServerSide(asyncio.DatagramProtocol):
+    def __init__(self, proxy):
+        self.proxy = proxy
+
+    def datagram_received(self, data, addr):
+        self.proxy.from_server(data)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description='Lossy UDP proxy for the MQTT+UDP audio channel')
+    parser.add_argument('--listen-port', type=int, default=8884)
+    parser.add_argument('--server-host', required=True)
+    parser.add_argument('--server-port', type=int, required=True)
+    parser.add_argument('--loss', type=float, default=0.05, help='downlink loss probability')
+    parser.add_argument('--up-loss', type=float, default=0.05, help='uplink loss probability')
+    parser.add_argument('--burst', type=int, default=1, help='packets lost in a row once a loss starts')
+    parser.add_argument('--reorder', type=float, default=0.02)
+    parser.add_argument('--dup', type=float, default=0.01)
+    parser.add_argument('--delay', type=float, default=0, help='base delay in ms')
+    parser.add_argument('--jitter', type=float, default=0, help='random extra delay up to this many ms')
+    parser.add_argument('--nack', action='store_true', help='answer and send NACKs like a server with udp_nack')
+    parser.add_argument('--key', help='udp.key of the server hello in hex, needed with --nack')
+    parser.add_argument('--seed', type=int, default=None)
+    args = parser.parse_args()
+    if args.nack and not args.key:
+        parser.error('--nack needs --key')
+    random.seed(args.seed)
+
+    loop = asyncio.get_running_loop()
+    proxy = LossyProxy(args)
+    proxy.device_transport, _ = await loop.create_datagram_endpoint(lambda: DeviceSide(proxy), local_addr=('0.0.0.0', args.listen_port))
+    proxy.server_transport, _ = await loop.create_datagram_endpoint(lambda: ServerSide(proxy), remote_addr=proxy.server)
+    # remote_addr connects the socket, sendto must not name the address again
+    proxy.server = None
+    print(f'listening on udp {args.listen_port}, forwarding to {args.server_host}:{args.server_port}', flush=True)
+    await proxy.report()
+
+
+if __name__ == '__main__':
+    asyncio.run(main())
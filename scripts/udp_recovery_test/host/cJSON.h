@@ -0,0 +1,4 @@
+// 主机编译用的 cJSON.h 替身，protocol.h 只用到指针声明
+#pragma once
+
+typedef struct cJSON cJSON;
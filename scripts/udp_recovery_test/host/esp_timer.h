@@ -0,0 +1,5 @@
+// 主机编译用的 esp_timer.h 替身，UdpRecoveryBuffer 的时间由测试传入，这里只需要类型声明
+#pragma once
+#include <cstdint>
+
+typedef struct esp_timer* esp_timer_handle_t;
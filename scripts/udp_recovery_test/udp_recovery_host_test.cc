@@ -0,0 +1,149 @@
+/*
+ * 在主机上驱动 UdpRecoveryBuffer，时间由测试给出：
+ *   passthrough: 预算为 0 时按到达顺序放出，缺口立即跳过
+ *   reorder:     缺口之后的包被暂存，乱序包补上缺口后按序放出
+ *   gap:         缺口超过预算后跳过并计为丢包，之后到达的包计为迟到
+ *   nack:        新缺口只报告一次，重传补上的计为 NACK 恢复，过大的缺口不请求重传
+ *   redundancy:  下一个包里的冗余帧补上缺口
+ *   wrap:        序列号回绕时顺序不变
+ *
+ * 用法: udp_recovery_host_test
+ */
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "udp_recovery.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+    printf("%s %s\n", condition ? "PASS" : "FAIL", what);
+    if (!condition) {
+        failures++;
+    }
+}
+
+const int64_t kBudgetUs = 120 * 1000;
+
+std::unique_ptr<AudioStreamPacket> MakePacket(uint32_t sequence) {
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->timestamp = sequence;
+    return packet;
+}
+
+// 放出当前能放出的包，返回它们的序列号
+std::vector<uint32_t> Drain(UdpRecoveryBuffer& buffer, int64_t now_us) {
+    std::vector<uint32_t> sequences;
+    while (auto packet = buffer.Pop(now_us)) {
+        sequences.push_back(packet->timestamp);
+    }
+    return sequences;
+}
+
+void TestPassthrough() {
+    UdpRecoveryBuffer buffer;
+    buffer.Reset(0, false);
+    buffer.Push(1, MakePacket(1), 0);
+    buffer.Push(2, MakePacket(2), 0);
+    buffer.Push(4, MakePacket(4), 0);
+    Check(Drain(buffer, 0) == std::vector<uint32_t>{1, 2, 4}, "passthrough: released at once, gap skipped");
+    Check(buffer.stats().lost == 1 && buffer.stats().delivered == 3, "passthrough: skipped slot counted lost");
+    buffer.Push(3, MakePacket(3), 0);
+    Check(Drain(buffer, 0).empty() && buffer.stats().late == 1, "passthrough: packet behind the skip is late");
+    Check(buffer.TakeMissing().empty(), "passthrough: no NACK without negotiation");
+}
+
+void TestReorder() {
+    UdpRecoveryBuffer buffer;
+    buffer.Reset(kBudgetUs / 1000, false);
+    buffer.Push(10, MakePacket(10), 0);
+    buffer.Push(12, MakePacket(12), 1000);
+    buffer.Push(13, MakePacket(13), 2000);
+    Check(Drain(buffer, 3000) == std::vector<uint32_t>{10}, "reorder: held behind the gap");
+    Check(buffer.IsMissing(11) && !buffer.IsMissing(12), "reorder: gap reported missing");
+    Check(buffer.NextDeadline() == 1000 + kBudgetUs, "reorder: deadline from when the gap opened");
+    buffer.Push(11, MakePacket(11), 4000);
+    Check(Drain(buffer, 5000) == std::vector<uint32_t>{11, 12, 13}, "reorder: released in order once filled");
+    Check(buffer.stats().reordered == 1 && buffer.stats().lost == 0, "reorder: counted as reordered, nothing lost");
+    Check(buffer.NextDeadline() == 0, "reorder: nothing waiting");
+
+    buffer.Push(13, MakePacket(13), 6000);
+    Check(buffer.stats().duplicates == 1 && Drain(buffer, 6000).empty(), "reorder: played packet again is a duplicate");
+}
+
+void TestGap() {
+    UdpRecoveryBuffer buffer;
+    buffer.Reset(kBudgetUs / 1000, false);
+    buffer.Push(1, MakePacket(1), 0);
+    buffer.Push(4, MakePacket(4), 0);
+    Check(Drain(buffer, kBudgetUs - 1) == std::vector<uint32_t>{1}, "gap: waits within the budget");
+    Check(Drain(buffer, kBudgetUs) == std::vector<uint32_t>{4}, "gap: skipped once the budget runs out");
+    Check(buffer.stats().lost == 2, "gap: every skipped slot counted lost");
+    buffer.Push(2, MakePacket(2), kBudgetUs + 1000);
+    Check(buffer.stats().late == 1 && Drain(buffer, kBudgetUs + 1000).empty(), "gap: packet after the skip is late");
+}
+
+void TestNack() {
+    UdpRecoveryBuffer buffer;
+    buffer.Reset(kBudgetUs / 1000, true);
+    buffer.Push(1, MakePacket(1), 0);
+    buffer.Push(4, MakePacket(4), 0);
+    Check(buffer.TakeMissing() == std::vector<uint32_t>{2, 3}, "nack: new gap reported");
+    Check(buffer.TakeMissing().empty(), "nack: each sequence reported once");
+    buffer.Push(2, MakePacket(2), 1000);
+    buffer.Push(3, MakePacket(3), 2000);
+    Check(Drain(buffer, 3000) == std::vector<uint32_t>{1, 2, 3, 4}, "nack: retransmissions fill the gap in order");
+    Check(buffer.stats().recovered_nack == 2 && buffer.stats().nacks_sent == 2, "nack: recovered and sent counted");
+
+    // 序列号跳得太远是流重新开始，不请求重传，也不等待
+    buffer.Push(5 + UDP_RECOVERY_MAX_NACK_GAP + 1, MakePacket(5 + UDP_RECOVERY_MAX_NACK_GAP + 1), 4000);
+    Check(buffer.TakeMissing().empty(), "nack: large gap not asked for");
+    Check(buffer.NextDeadline() == 1 && Drain(buffer, 4000).size() == 1, "nack: large gap skipped at once");
+
+    // 预算内没补上，跳过后不再报告
+    buffer.Push(24, MakePacket(24), 5000);
+    Check(buffer.TakeMissing() == std::vector<uint32_t>{23}, "nack: gap after a restart reported");
+    Check(Drain(buffer, 5000 + kBudgetUs) == std::vector<uint32_t>{24}, "nack: unanswered gap skipped");
+    Check(buffer.stats().recovered_nack == 2, "nack: skipped gap not counted recovered");
+}
+
+void TestRedundancy() {
+    UdpRecoveryBuffer buffer;
+    buffer.Reset(kBudgetUs / 1000, false);
+    buffer.Push(1, MakePacket(1), 0);
+    buffer.Push(3, MakePacket(3), 1000);
+    Check(buffer.IsMissing(2), "redundancy: previous frame missing");
+    buffer.Push(2, MakePacket(2), 1000, true);
+    Check(Drain(buffer, 1000) == std::vector<uint32_t>{1, 2, 3}, "redundancy: copy fills the gap");
+    Check(buffer.stats().recovered_fec == 1 && buffer.stats().received == 2, "redundancy: counted, not as received");
+    buffer.Push(3, MakePacket(3), 2000, true);
+    Check(buffer.stats().duplicates == 0 && buffer.stats().late == 0, "redundancy: stale copy not counted");
+}
+
+void TestWrap() {
+    UdpRecoveryBuffer buffer;
+    buffer.Reset(kBudgetUs / 1000, true);
+    buffer.Push(0xFFFFFFFE, MakePacket(0xFFFFFFFE), 0);
+    buffer.Push(0, MakePacket(0), 0);
+    Check(buffer.TakeMissing() == std::vector<uint32_t>{0xFFFFFFFF}, "wrap: gap across the wrap reported");
+    buffer.Push(0xFFFFFFFF, MakePacket(0xFFFFFFFF), 1000);
+    buffer.Push(1, MakePacket(1), 1000);
+    Check(Drain(buffer, 1000) == std::vector<uint32_t>{0xFFFFFFFE, 0xFFFFFFFF, 0, 1}, "wrap: order kept");
+    Check(buffer.stats().lost == 0, "wrap: nothing lost");
+}
+
+}  // namespace
+
+int main() {
+    TestPassthrough();
+    TestReorder();
+    TestGap();
+    TestNack();
+    TestRedundancy();
+    TestWrap();
+    printf("%s\n", failures == 0 ? "ALL PASSED" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+// 主机编译用的声明，链接系统的 libmbedcrypto（部分发行版只装了运行库，没有头文件）
+#pragma once
+#include <cstddef>
+
+extern "C" int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen,
+    const unsigned char* src, size_t slen);
@@ -0,0 +1,5 @@
+// 主机编译用的声明，链接系统的 libmbedcrypto（部分发行版只装了运行库，没有头文件）
+#pragma once
+#include <cstddef>
+
+extern "C" int mbedtls_sha1(const unsigned char* input, size_t ilen, unsigned char output[20]);
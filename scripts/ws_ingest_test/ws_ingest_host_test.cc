@@ -0,0 +1,439 @@
+/*
+ * 在主机上用普通 socket 驱动 WsIngestServer 和 WsFrameParser：
+ *   parser:      同一串帧按各种切分方式喂给解析器，结果必须一致；按字解掩码与按字节一致；
+ *                64 位长度、超长控制帧被拒绝；接收缓冲区在大帧之后收缩
+ *   concurrent:  多个客户端同时发消息，全部送达
+ *   slow client: 一个客户端逐字节发送握手和帧，其它客户端的消息不被它拖慢
+ *   fragmented:  分片消息重组，包括 40 KB 的大数组
+ *   ping:        ping 收到带相同负载的 pong
+ *   limits:      超出连接数的客户端被拒绝，握手超时的客户端被断开，未加掩码的帧收到 1002 关闭，
+ *                超长的分片消息收到 1009 关闭
+ *
+ * 用法: ws_ingest_host_test
+ */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ws_frame_parser.h"
+#include "ws_ingest_server.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+    printf("%s %s\n", condition ? "PASS" : "FAIL", what);
+    if (!condition) {
+        failures++;
+    }
+}
+
+// 客户端发出的帧必须加掩码
+std::string ClientFrame(uint8_t opcode, const std::string& payload, bool fin = true) {
+    std::string frame;
+    frame.push_back((char)((fin ? 0x80 : 0) | opcode));
+    size_t length = payload.size();
+    if (length < 126) {
+        frame.push_back((char)(0x80 | length));
+    } else {
+        frame.push_back((char)(0x80 | 126));
+        frame.push_back((char)(length >> 8));
+        frame.push_back((char)length);
+    }
+    const char mask[4] = {0x12, 0x34, 0x56, 0x78};
+    frame.append(mask, 4);
+    for (size_t i = 0; i < length; i++) {
+        frame.push_back(payload[i] ^ mask[i & 3]);
+    }
+    return frame;
+}
+
+const char* kRequest =
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "sec-websocket-key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n\r\n";
+
+int Connect(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    struct timeval timeout = {.tv_sec = 3, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+// 读到响应头结束，返回响应头
+std::string ReadResponse(int fd) {
+    std::string response;
+    char c;
+    while (response.find("\r\n\r\n") == std::string::npos && recv(fd, &c, 1, 0) == 1) {
+        response.push_back(c);
+    }
+    return response;
+}
+
+int Handshake(int port) {
+    int fd = Connect(port);
+    if (fd < 0) {
+        return -1;
+    }
+    send(fd, kRequest, strlen(kRequest), 0);
+    auto response = ReadResponse(fd);
+    // RFC 6455 示例 key 对应的 accept 值
+    if (response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == std::string::npos) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool IsClosed(int fd) {
+    char buffer[16];
+    return recv(fd, buffer, sizeof(buffer), 0) <= 0;
+}
+
+struct Received {
+    std::mutex mutex;
+    std::vector<std::pair<std::string, std::chrono::steady_clock::time_point>> messages;
+
+    size_t Count(const std::string& prefix) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = 0;
+        for (auto& message : messages) {
+            count += message.first.compare(0, prefix.size(), prefix) == 0;
+        }
+        return count;
+    }
+
+    bool WaitFor(const std::string& prefix, size_t count, int timeout_ms = 3000) {
+        for (int i = 0; i < timeout_ms / 10; i++) {
+            if (Count(prefix) >= count) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+};
+
+std::string Payload(const WsFrame& frame) {
+    return std::string(frame.payload, frame.length);
+}
+
+void TestParser() {
+    std::string stream;
+    stream += ClientFrame(kWsOpcodeText, "{\"type\":\"like\"}");
+    stream += ClientFrame(kWsOpcodeText, std::string(300, 'x'));
+    stream += ClientFrame(kWsOpcodeClose, "\x03\xe8");
+
+    bool all_same = true;
+    for (size_t chunk = 1; chunk <= stream.size(); chunk++) {
+        WsFrameParser parser;
+        std::vector<std::pair<uint8_t, std::string>> frames;
+        for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+            parser.Feed(stream.data() + offset, std::min(chunk, stream.size() - offset));
+            WsFrame frame;
+            while (parser.Next(frame)) {
+                frames.emplace_back(frame.opcode, Payload(frame));
+            }
+        }
+        all_same &= !parser.error() && frames.size() == 3 && parser.buffered() == 0 &&
+            frames[0].second == "{\"type\":\"like\"}" && frames[1].second == std::string(300, 'x') &&
+            frames[2].first == kWsOpcodeClose;
+    }
+    Check(all_same, "parser: every split of the stream gives the same frames");
+
+    // Word-at-a-time unmasking against the byte-wise definition, for every alignment and tail length
+    bool unmask_ok = true;
+    const uint8_t mask[4] = {0xa1, 0x5b, 0x3c, 0xf0};
+    alignas(4) char data[80];
+    for (size_t start = 0; start < 4; start++) {
+        for (size_t length = 0; length < 70; length++) {
+            for (size_t i = 0; i < length; i++) {
+                data[start + i] = (char)(i * 7);
+            }
+            WsFrameParser::Unmask(data + start, length, mask);
+            for (size_t i = 0; i < length; i++) {
+                unmask_ok &= data[start + i] == (char)((i * 7) ^ mask[i & 3]);
+            }
+        }
+    }
+    Check(unmask_ok, "parser: word-wise unmask matches byte-wise for all alignments");
+
+    WsFrameParser unmasked;
+    unmasked.Feed("\x81\x02hi", 4);
+    WsFrame frame;
+    Check(!unmasked.Next(frame) && unmasked.error(), "parser: unmasked client frame is an error");
+
+    WsFrameParser limited(100);
+    auto big = ClientFrame(kWsOpcodeText, std::string(200, 'y'));
+    limited.Feed(big.data(), 8);
+    Check(!limited.Next(frame) && limited.error(), "parser: oversized frame refused from its header");
+
+    // 64-bit length with the top bit set must not wrap around the size check
+    WsFrameParser huge;
+    huge.Feed("\x81\xff\x80\x00\x00\x00\x00\x00\x00\x10\x01\x02\x03\x04", 14);
+    Check(!huge.Next(frame) && huge.error(), "parser: 64-bit length refused");
+
+    WsFrameParser control;
+    auto long_ping = ClientFrame(kWsOpcodePing, std::string(126, 'p'));
+    control.Feed(long_ping.data(), long_ping.size());
+    Check(!control.Next(frame) && control.error(), "parser: control frame over 125 bytes refused");
+
+    // A large frame grows the arena once, and it shrinks back after being drained
+    WsFrameParser arena;
+    auto large = ClientFrame(kWsOpcodeText, std::string(30000, 'z'));
+    size_t offset = 0;
+    bool large_ok = false;
+    while (offset < large.size()) {
+        size_t available;
+        char* dest = arena.PrepareWrite(available);
+        size_t n = std::min(available, large.size() - offset);
+        memcpy(dest, large.data() + offset, n);
+        arena.Commit(n);
+        offset += n;
+        large_ok |= arena.Next(frame) && frame.length == 30000 && frame.payload[29999] == 'z';
+    }
+    size_t available;
+    arena.PrepareWrite(available);
+    Check(large_ok && available <= WS_ARENA_KEEP_SIZE, "parser: arena holds a large frame, then shrinks");
+}
+
+}  // namespace
+
+int main() {
+    TestParser();
+
+    Received received;
+    WsIngestServer server(0, 4);
+    server.OnTextMessage([&received](const char* data, size_t length) {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        received.messages.emplace_back(std::string(data, length), std::chrono::steady_clock::now());
+    });
+    if (!server.Start()) {
+        printf("FAIL server start\n");
+        return 1;
+    }
+    int port = server.port();
+    std::thread server_thread([&server]() { server.Run(); });
+
+    // 慢客户端：握手和一帧都逐字节发送，每字节间隔 20ms
+    std::atomic<bool> slow_done = false;
+    std::thread slow_client([port, &slow_done]() {
+        int fd = Connect(port);
+        std::string data = std::string(kRequest) + ClientFrame(kWsOpcodeText, "slow:1");
+        for (char c : data) {
+            send(fd, &c, 1, 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        slow_done = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        close(fd);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 慢客户端还在发送时，另外三个客户端并发发消息
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < 3; c++) {
+        clients.emplace_back([port, c]() {
+            int fd = Handshake(port);
+            if (fd < 0) {
+                return;
+            }
+            std::string batch;
+            for (int i = 0; i < 50; i++) {
+                batch += ClientFrame(kWsOpcodeText, "fast:" + std::to_string(c) + ":" + std::to_string(i));
+            }
+            send(fd, batch.data(), batch.size(), 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            close(fd);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    bool fast_all = received.WaitFor("fast:", 150);
+    auto fast_elapsed = std::chrono::steady_clock::now() - start;
+    Check(fast_all, "concurrent: 150 messages from 3 clients delivered");
+    Check(!slow_done && fast_elapsed < std::chrono::seconds(2),
+        "slow client: others are served while it is still sending");
+    slow_client.join();
+    Check(received.WaitFor("slow:", 1), "slow client: byte by byte message delivered");
+
+    // 分片消息
+    {
+        int fd = Handshake(port);
+        std::string data = ClientFrame(kWsOpcodeText, "frag:", false) +
+            ClientFrame(kWsOpcodeContinuation, "part1,", false) +
+            ClientFrame(kWsOpcodeContinuation, "part2", true);
+        send(fd, data.data(), data.size(), 0);
+        bool ok = received.WaitFor("frag:", 1);
+        std::lock_guard<std::mutex> lock(received.mutex);
+        ok &= received.messages.back().first == "frag:part1,part2";
+        Check(ok, "fragmented: message reassembled");
+        close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // ping 收到带相同负载的 pong，之后的消息照常送达
+    {
+        int fd = Handshake(port);
+        auto ping = ClientFrame(kWsOpcodePing, "abc");
+        send(fd, ping.data(), ping.size(), 0);
+        unsigned char pong[5] = {0};
+        bool ok = recv(fd, pong, 5, MSG_WAITALL) == 5 && pong[0] == 0x8a && pong[1] == 3 &&
+            memcmp(pong + 2, "abc", 3) == 0;
+        auto text = ClientFrame(kWsOpcodeText, "after-ping");
+        send(fd, text.data(), text.size(), 0);
+        Check(ok && received.WaitFor("after-ping", 1), "ping: answered with pong");
+        close(fd);
+    }
+
+    // 分片拼成的大数组消息，超过上限的分片消息收到 1009 关闭
+    {
+        int fd = Handshake(port);
+        std::string array = "big:[";
+        while (array.size() < 40000) {
+            array += "{\"method\":\"WebcastChatMessage\",\"content\":\"hello\"},";
+        }
+        array.back() = ']';
+        std::string data;
+        for (size_t offset = 0; offset < array.size(); offset += 8000) {
+            bool last = offset + 8000 >= array.size();
+            data += ClientFrame(offset == 0 ? kWsOpcodeText : kWsOpcodeContinuation, array.substr(offset, 8000), last);
+        }
+        send(fd, data.data(), data.size(), 0);
+        bool ok = received.WaitFor("big:", 1);
+        {
+            std::lock_guard<std::mutex> lock(received.mutex);
+            ok &= received.messages.back().first == array;
+        }
+        Check(ok, "fragmented: 40 KB array reassembled");
+
+        data.clear();
+        for (int i = 0; i < 10; i++) {
+            data += ClientFrame(i == 0 ? kWsOpcodeText : kWsOpcodeContinuation, std::string(8000, 'q'), false);
+        }
+        send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        unsigned char close_frame[4] = {0};
+        ok = recv(fd, close_frame, 4, MSG_WAITALL) == 4 && close_frame[0] == 0x88 &&
+            close_frame[2] == 0x03 && close_frame[3] == 0xf1;
+        Check(ok, "limits: oversized fragmented message closed with 1009");
+        close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 连接数上限
+    {
+        std::vector<int> fds;
+        for (int i = 0; i < 4; i++) {
+            fds.push_back(Handshake(port));
+        }
+        int extra = Connect(port);
+        Check(extra >= 0 && IsClosed(extra), "limits: fifth client rejected");
+        close(extra);
+        for (int fd : fds) {
+            close(fd);
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 未加掩码的帧
+    {
+        int fd = Handshake(port);
+        send(fd, "\x81\x02hi", 4, 0);
+        unsigned char close_frame[4] = {0};
+        bool ok = recv(fd, close_frame, 4, MSG_WAITALL) == 4 && close_frame[0] == 0x88 &&
+            close_frame[2] == 0x03 && close_frame[3] == 0xea;
+        Check(ok && IsClosed(fd), "limits: unmasked frame closed with 1002");
+        close(fd);
+    }
+
+    // 不读回复的客户端：不停发 ping，pong 堆满发送缓冲区后被断开
+    {
+        int fd = Handshake(port);
+        int small = 4096;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        auto ping = ClientFrame(kWsOpcodePing, std::string(125, 'p'));
+        std::string batch;
+        for (int i = 0; i < 64; i++) {
+            batch += ping;
+        }
+        bool dropped = false;
+        for (int i = 0; i < 20000 && !dropped; i++) {
+            dropped = send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) < 0;
+        }
+        Check(dropped, "limits: client that does not read its replies dropped");
+        close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 不符合 RFC 6455 4.2.1 的升级请求收到 400 后被断开
+    {
+        const char* bad_requests[] = {
+            "POST / HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Version: 13\r\n\r\n",
+            "GET / HTTP/1.1\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n",
+            "GET / HTTP/1.1\r\nUpgrade: h2c\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Version: 13\r\n\r\n",
+            "GET / HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Version: 8\r\n\r\n",
+            "GET / HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\n\r\n",
+        };
+        bool all_rejected = true;
+        for (auto request : bad_requests) {
+            int fd = Connect(port);
+            send(fd, request, strlen(request), 0);
+            auto response = ReadResponse(fd);
+            all_rejected &= response.compare(0, 12, "HTTP/1.1 400") == 0 && IsClosed(fd);
+            close(fd);
+        }
+        Check(all_rejected, "handshake: request without GET, Upgrade, version 13 or key gets 400");
+
+        // 头部名和 token 不区分大小写，Upgrade 可以列出多个协议
+        int fd = Connect(port);
+        const char* request = "GET /live HTTP/1.1\r\nHost: localhost\r\nupgrade: h2c, WebSocket\r\n"
+            "Connection: keep-alive, Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "sec-websocket-version: 13\r\n\r\n";
+        send(fd, request, strlen(request), 0);
+        Check(ReadResponse(fd).compare(0, 12, "HTTP/1.1 101") == 0, "handshake: token list and case accepted");
+        close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 握手超时
+    {
+        int fd = Connect(port);
+        send(fd, "GET / HTTP/1.1\r\n", 16, 0);
+        struct timeval timeout = {.tv_sec = WS_INGEST_HANDSHAKE_TIMEOUT_MS / 1000 + 3, .tv_usec = 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        Check(IsClosed(fd), "limits: unfinished handshake dropped");
+        close(fd);
+    }
+
+    server.Stop();
+    server_thread.join();
+    printf("%s\n", failures == 0 ? "ALL PASSED" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}